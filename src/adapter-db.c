@@ -0,0 +1,294 @@
+//
+//  adapter-db.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#include "adapter-db.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "json.h"
+#include "state-db.h"
+
+struct adapter_db {
+    char *path;
+    
+    struct adapter_profile *profiles;
+    int num_profiles;
+    int capacity;
+};
+
+
+/**
+ *  Callback for members of a profile read from the database file.
+ */
+static int adapter_db_member (const char *key, enum json_type type,
+                              const char *value, void *context)
+{
+    struct adapter_profile *profile = context;
+    
+    if (strcmp(key, "adapter") == 0) {
+        snprintf(profile->adapter, sizeof(profile->adapter), "%s", value);
+    } else if (type != JSON_NUMBER) {
+        return 0;
+    } else if (strcmp(key, "baud") == 0) {
+        profile->baudrate = (int)strtol(value, NULL, 10);
+    } else if (strcmp(key, "latency_us") == 0) {
+        profile->latency = (uint32_t)strtoul(value, NULL, 10);
+    } else if (strcmp(key, "throughput") == 0) {
+        profile->throughput = (uint32_t)strtoul(value, NULL, 10);
+    } else if (strcmp(key, "time") == 0) {
+        profile->time = (time_t)strtol(value, NULL, 10);
+    }
+    return 0;
+}
+
+/**
+ *  Get a new profile at the end of the database.
+ *
+ *  @return The profile, or NULL if memory could not be allocated
+ */
+static struct adapter_profile *adapter_db_append (struct adapter_db *db)
+{
+    if (db->num_profiles == db->capacity) {
+        int capacity = (db->capacity == 0) ? 8 : (db->capacity * 2);
+        struct adapter_profile *profiles = realloc(db->profiles,
+                                    (size_t)capacity * sizeof(*profiles));
+        if (profiles == NULL) {
+            fprintf(stderr, "Could not allocate memory for adapter "
+                    "database.\n");
+            return NULL;
+        }
+        db->profiles = profiles;
+        db->capacity = capacity;
+    }
+    
+    struct adapter_profile *profile = &db->profiles[db->num_profiles++];
+    memset(profile, 0, sizeof(*profile));
+    return profile;
+}
+
+/**
+ *  Load profiles from the database file.
+ *
+ *  @return 0 if successfull
+ */
+static int adapter_db_load (struct adapter_db *db)
+{
+    FILE *file = fopen(db->path, "r");
+    if (file == NULL) {
+        if (errno == ENOENT) {
+            // Nothing has been calibrated yet
+            return 0;
+        }
+        fprintf(stderr, "Could not open %s: %s\n", db->path, strerror(errno));
+        return -1;
+    }
+    
+    char *line = NULL;
+    size_t line_capacity = 0;
+    int line_num = 0;
+    int ret = 0;
+    
+    while (getline(&line, &line_capacity, file) != -1) {
+        line_num++;
+        
+        if (line[strspn(line, " \t\r\n")] == '\0') {
+            continue;
+        }
+        
+        struct adapter_profile *profile = adapter_db_append(db);
+        if (profile == NULL) {
+            ret = -1;
+            break;
+        }
+        
+        if ((json_parse_object(line, adapter_db_member, profile) != 0) ||
+                (profile->adapter[0] == '\0') || (profile->baudrate == 0)) {
+            // Without the profile the default baudrate is used
+            fprintf(stderr, "%s:%d: Ignoring invalid profile\n", db->path,
+                    line_num);
+            db->num_profiles--;
+        }
+    }
+    
+    free(line);
+    fclose(file);
+    return ret;
+}
+
+/**
+ *  Create the directory which holds the database file, and any of its parents
+ *  which do not exist.
+ */
+static void adapter_db_make_dir (const char *path)
+{
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", path);
+    
+    char *slash = strrchr(dir, '/');
+    if ((slash == NULL) || (slash == dir)) {
+        return;
+    }
+    *slash = '\0';
+    
+    for (char *p = dir + 1; *p != '\0'; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            mkdir(dir, 0755);
+            *p = '/';
+        }
+    }
+    mkdir(dir, 0755);
+}
+
+/**
+ *  Write the database to its file. The file is replaced atomically so that it
+ *  is never left half written.
+ *
+ *  @return 0 if successfull
+ */
+static int adapter_db_save (struct adapter_db *db)
+{
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", db->path);
+    
+    adapter_db_make_dir(db->path);
+    
+    FILE *file = fopen(tmp_path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open %s: %s\n", tmp_path, strerror(errno));
+        return -1;
+    }
+    
+    for (int i = 0; i < db->num_profiles; i++) {
+        struct adapter_profile *profile = &db->profiles[i];
+        
+        fprintf(file, "{\"adapter\":");
+        json_write_string(file, profile->adapter);
+        fprintf(file, ",\"baud\":%d,\"latency_us\":%" PRIu32 ","
+                "\"throughput\":%" PRIu32 ",\"time\":%ld}\n",
+                profile->baudrate, profile->latency, profile->throughput,
+                (long)profile->time);
+    }
+    
+    if ((fclose(file) != 0) || (rename(tmp_path, db->path) != 0)) {
+        fprintf(stderr, "Could not write %s: %s\n", db->path, strerror(errno));
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ *  Find the index of the profile for an adapter.
+ *
+ *  @return The index of the profile, or -1 if there is none
+ */
+static int adapter_db_find (struct adapter_db *db, const char *adapter)
+{
+    for (int i = 0; i < db->num_profiles; i++) {
+        if (strcmp(db->profiles[i].adapter, adapter) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+int adapter_db_default_path (char *path, size_t length)
+{
+    const char *config = getenv("XDG_CONFIG_HOME");
+    if ((config != NULL) && (config[0] != '\0')) {
+        snprintf(path, length, "%s/rn2483-loader/adapters.jsonl", config);
+        return 0;
+    }
+    
+    const char *home = getenv("HOME");
+    if ((home == NULL) || (home[0] == '\0')) {
+        return -1;
+    }
+    snprintf(path, length, "%s/.config/rn2483-loader/adapters.jsonl", home);
+    return 0;
+}
+
+int adapter_db_open (const char *path, struct adapter_db **db)
+{
+    *db = calloc(1, sizeof(struct adapter_db));
+    if (*db == NULL) {
+        fprintf(stderr, "Could not allocate adapter database.\n");
+        return -1;
+    }
+    
+    (*db)->path = strdup(path);
+    if ((*db)->path == NULL) {
+        fprintf(stderr, "Could not allocate adapter database.\n");
+        free(*db);
+        return -1;
+    }
+    
+    if (adapter_db_load(*db) != 0) {
+        adapter_db_free(*db);
+        return -1;
+    }
+    return 0;
+}
+
+void adapter_db_free (struct adapter_db *db)
+{
+    free(db->profiles);
+    free(db->path);
+    free(db);
+}
+
+void adapter_db_identify (const char *path, char *adapter, size_t length)
+{
+    if (state_db_usb_serial(path, adapter, length) != 0) {
+        snprintf(adapter, length, "%s", path);
+    }
+}
+
+const struct adapter_profile *adapter_db_lookup (struct adapter_db *db,
+                                                 const char *path)
+{
+    char adapter[ADAPTER_DB_ID_LENGTH];
+    adapter_db_identify(path, adapter, sizeof(adapter));
+    
+    int i = adapter_db_find(db, adapter);
+    return (i == -1) ? NULL : &db->profiles[i];
+}
+
+int adapter_db_baudrate (struct adapter_db *db, const char *path)
+{
+    if (db == NULL) {
+        return 0;
+    }
+    
+    const struct adapter_profile *profile = adapter_db_lookup(db, path);
+    return (profile == NULL) ? 0 : profile->baudrate;
+}
+
+int adapter_db_update (struct adapter_db *db,
+                       const struct adapter_profile *profile)
+{
+    int i = adapter_db_find(db, profile->adapter);
+    struct adapter_profile *stored;
+    
+    if (i != -1) {
+        stored = &db->profiles[i];
+    } else if ((stored = adapter_db_append(db)) == NULL) {
+        return -1;
+    }
+    
+    *stored = *profile;
+    return adapter_db_save(db);
+}
@@ -0,0 +1,111 @@
+//
+//  adapter-db.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef adapter_db_h
+#define adapter_db_h
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <time.h>
+
+/** Maximum length of an adapter identity string */
+#define ADAPTER_DB_ID_LENGTH    64
+
+/**
+ *  Link settings found by calibrating a USB serial adapter.
+ */
+struct adapter_profile {
+    /** Serial number of the USB adapter, or the path of its port if the serial
+        number is not known */
+    char adapter[ADAPTER_DB_ID_LENGTH];
+    /** Fastest baudrate at which the bootloader answered without errors */
+    int baudrate;
+    /** Median time between the end of a command and the start of its
+        response, in microseconds */
+    uint32_t latency;
+    /** Bytes per second sent and received during calibration */
+    uint32_t throughput;
+    /** Time at which the adapter was calibrated */
+    time_t time;
+};
+
+struct adapter_db;
+
+/**
+ *  Get the path of the adapter database used when none is given, in the
+ *  user's configuration directory.
+ *
+ *  @param path Buffer where the path should be stored
+ *  @param length Size of the buffer
+ *
+ *  @return 0 if successfull, -1 if there is no home directory
+ */
+extern int adapter_db_default_path (char *path, size_t length);
+
+/**
+ *  Open an adapter database, loading any profiles from the file if it exists.
+ *
+ *  @param path Path to the file in which profiles are stored
+ *  @param db Pointer to where pointer to new database should be stored
+ *
+ *  @return 0 if successfull
+ */
+extern int adapter_db_open (const char *path, struct adapter_db **db);
+
+/**
+ *  Free an adapter database.
+ *
+ *  @param db The database to be freed
+ */
+extern void adapter_db_free (struct adapter_db *db);
+
+/**
+ *  Find the identity of the adapter that a port belongs to.
+ *
+ *  @param path Path to the serial port
+ *  @param adapter Buffer where the identity should be stored
+ *  @param length Size of the buffer
+ */
+extern void adapter_db_identify (const char *path, char *adapter,
+                                 size_t length);
+
+/**
+ *  Find the profile for the adapter that a port belongs to.
+ *
+ *  @param db The database
+ *  @param path Path to the serial port
+ *
+ *  @return The profile, or NULL if the adapter has not been calibrated
+ */
+extern const struct adapter_profile *adapter_db_lookup (struct adapter_db *db,
+                                                        const char *path);
+
+/**
+ *  Get the baudrate at which the bootloader should be used through the
+ *  adapter that a port belongs to.
+ *
+ *  @param db The database, or NULL
+ *  @param path Path to the serial port
+ *
+ *  @return The calibrated baudrate, or 0 if there is none
+ */
+extern int adapter_db_baudrate (struct adapter_db *db, const char *path);
+
+/**
+ *  Store the profile for an adapter, replacing any earlier one, and save the
+ *  database. The directory which holds the file is created if needed.
+ *
+ *  @param db The database
+ *  @param profile The profile
+ *
+ *  @return 0 if successfull
+ */
+extern int adapter_db_update (struct adapter_db *db,
+                              const struct adapter_profile *profile);
+
+#endif /* adapter_db_h */
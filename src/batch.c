@@ -0,0 +1,379 @@
+//
+//  batch.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#include "batch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "flash-job.h"
+#include "latency-stats.h"
+#include "json.h"
+
+enum batch_job_state {
+    BATCH_JOB_PENDING,
+    BATCH_JOB_RUNNING,
+    BATCH_JOB_FINISHED,
+    BATCH_JOB_SKIPPED
+};
+
+struct batch;
+
+struct batch_job {
+    struct manifest_job *job;
+    struct batch *batch;
+    struct intel_hex_file *hex;
+    /** Provisioning script named by the job, or NULL */
+    struct provision_script *provision;
+    
+    struct flash_job flash;
+    
+    enum batch_job_state state;
+    /** Number of attempts that have been started */
+    int attempts;
+    /** The next attempt should expect the module to be in the bootloader */
+    int recover;
+    
+    /** Outcome of the most recent attempt */
+    enum flash_phase result;
+    /** The module already held the image */
+    int skipped;
+    enum flash_phase failed_phase;
+    char error[128];
+    
+    char old_version[FLASH_VERSION_LENGTH];
+    char new_version[FLASH_VERSION_LENGTH];
+    
+    uint64_t start_time;
+    uint64_t end_time;
+};
+
+struct batch {
+    struct batch_job *jobs;
+    int num_jobs;
+    
+    struct io_loop *loop;
+    struct batch_options options;
+    FILE *log;
+    
+    /** Index of the next job to be started */
+    int next;
+    /** Number of jobs with an attempt in progress */
+    int running;
+    /** Set once no more jobs should be started */
+    int stopping;
+    /** Set when there is nothing left to do */
+    int done;
+};
+
+
+static void batch_job_done (struct batch *batch, struct batch_job *bj);
+
+/**
+ *  Callback for events from a job.
+ */
+static void batch_job_event (struct flash_job *flash, enum flash_event event,
+                             void *context)
+{
+    struct batch_job *bj = (struct batch_job *)context;
+    
+    if (event == FLASH_EVENT_PHASE) {
+        printf("%s: %s\n", bj->job->port,
+               flash_phase_name(flash_session_get_phase(flash->session)));
+    } else if (event == FLASH_EVENT_DONE) {
+        batch_job_done(bj->batch, bj);
+    }
+}
+
+/**
+ *  Start an attempt at a job.
+ *
+ *  @param batch The batch
+ *  @param bj The job to be attempted
+ */
+static void batch_start_job (struct batch *batch, struct batch_job *bj)
+{
+    bj->state = BATCH_JOB_RUNNING;
+    bj->attempts++;
+    bj->error[0] = '\0';
+    batch->running++;
+    
+    if (bj->start_time == 0) {
+        bj->start_time = latency_stats_now();
+    }
+    
+    struct flash_options options;
+    flash_options_init(&options);
+    options.confirm = 0;
+    options.recover = (bj->recover ||
+                       (bj->job->policy == MANIFEST_POLICY_RECOVER));
+    options.state = batch->options.state;
+    options.force = batch->options.force;
+    options.bootloader_baudrate = adapter_db_baudrate(batch->options.adapters,
+                                                      bj->job->port);
+    options.provision = (bj->provision != NULL) ? bj->provision :
+                                                  batch->options.provision;
+    
+    flash_job_start(&bj->flash, bj->job->port, bj->job->baudrate, bj->hex,
+                    &options);
+}
+
+/**
+ *  Write the result of a job to the log.
+ *
+ *  @param batch The batch
+ *  @param bj The job which has finished or been skipped
+ */
+static void batch_log_job (struct batch *batch, struct batch_job *bj)
+{
+    FILE *log = batch->log;
+    
+    if (log == NULL) {
+        return;
+    }
+    
+    const char *result = "skipped";
+    if ((bj->state == BATCH_JOB_FINISHED) && bj->skipped) {
+        result = "current";
+    } else if (bj->state == BATCH_JOB_FINISHED) {
+        result = flash_phase_name(bj->result);
+    }
+    
+    fprintf(log, "{\"line\":%d,\"port\":", bj->job->line);
+    json_write_string(log, bj->job->port);
+    fprintf(log, ",\"image\":");
+    json_write_string(log, bj->job->image);
+    fprintf(log, ",\"baud\":%d,\"policy\":\"%s\",\"result\":\"%s\","
+            "\"attempts\":%d,\"elapsed\":%.3f,\"old_version\":",
+            bj->job->baudrate, manifest_policy_name(bj->job->policy), result,
+            bj->attempts, (double)(bj->end_time - bj->start_time) / 1000000);
+    json_write_string(log, bj->old_version);
+    fprintf(log, ",\"new_version\":");
+    json_write_string(log, bj->new_version);
+    
+    if ((bj->state == BATCH_JOB_FINISHED) &&
+        (bj->result == FLASH_PHASE_FAILED)) {
+        fprintf(log, ",\"failed_phase\":\"%s\",\"error\":",
+                flash_phase_name(bj->failed_phase));
+        json_write_string(log, bj->error);
+    }
+    
+    fprintf(log, "}\n");
+    fflush(log);
+}
+
+/**
+ *  Start as many pending jobs as the parallelism limit allows and check
+ *  whether the batch is done.
+ *
+ *  @param batch The batch
+ */
+static void batch_fill (struct batch *batch)
+{
+    while (!batch->stopping && (batch->next < batch->num_jobs) &&
+           ((batch->options.parallel == 0) ||
+            (batch->running < batch->options.parallel))) {
+        batch_start_job(batch, &batch->jobs[batch->next++]);
+    }
+    
+    if (batch->stopping) {
+        for (; batch->next < batch->num_jobs; batch->next++) {
+            struct batch_job *bj = &batch->jobs[batch->next];
+            bj->state = BATCH_JOB_SKIPPED;
+            batch_log_job(batch, bj);
+        }
+    }
+    
+    batch->done = ((batch->running == 0) &&
+                   (batch->next == batch->num_jobs));
+}
+
+/**
+ *  Clean up an attempt which has finished and decide whether to retry it.
+ *
+ *  @param batch The batch
+ *  @param bj The job whose attempt has finished
+ */
+static void batch_job_done (struct batch *batch, struct batch_job *bj)
+{
+    batch->running--;
+    
+    /* Collect results from session */
+    struct flash_session *session = bj->flash.session;
+    if (session != NULL) {
+        bj->result = flash_session_get_phase(session);
+        bj->failed_phase = flash_session_get_failed_phase(session);
+        bj->skipped = flash_session_get_skipped(session);
+        snprintf(bj->error, sizeof(bj->error), "%s",
+                 flash_session_get_error(session));
+        if (flash_session_get_old_version(session)[0] != '\0') {
+            snprintf(bj->old_version, sizeof(bj->old_version), "%s",
+                     flash_session_get_old_version(session));
+        }
+        snprintf(bj->new_version, sizeof(bj->new_version), "%s",
+                 flash_session_get_new_version(session));
+    } else {
+        bj->result = FLASH_PHASE_FAILED;
+        bj->failed_phase = FLASH_PHASE_CHECK_VERSION;
+        snprintf(bj->error, sizeof(bj->error), "%s", bj->flash.error);
+    }
+    flash_job_release(&bj->flash);
+    
+    /* Retry failed jobs */
+    if ((bj->result == FLASH_PHASE_FAILED) && !batch->stopping &&
+        (bj->attempts <= batch->options.retries)) {
+        // If the module was left in the bootloader go straight back to it
+        bj->recover = ((bj->failed_phase >= FLASH_PHASE_WAIT_BOOTLOADER) &&
+                       (bj->failed_phase <= FLASH_PHASE_RESET));
+        printf("%s: failed while %s: %s Retrying (attempt %d of %d).\n",
+               bj->job->port, flash_phase_name(bj->failed_phase),
+               bj->error, bj->attempts + 1, batch->options.retries + 1);
+        batch_start_job(batch, bj);
+        return;
+    }
+    
+    bj->state = BATCH_JOB_FINISHED;
+    bj->end_time = latency_stats_now();
+    batch_log_job(batch, bj);
+    
+    if ((bj->result == FLASH_PHASE_DONE) && bj->skipped) {
+        printf("%s: already updated, firmware version is: %s\n",
+               bj->job->port, bj->new_version);
+    } else if (bj->result == FLASH_PHASE_DONE) {
+        printf("%s: done, firmware version is now: %s\n", bj->job->port,
+               bj->new_version);
+    } else {
+        printf("%s: failed while %s: %s\n", bj->job->port,
+               flash_phase_name(bj->failed_phase), bj->error);
+        
+        if ((batch->options.on_failure == BATCH_FAILURE_STOP) &&
+            !batch->stopping) {
+            printf("Not starting any more jobs because %s failed.\n",
+                   bj->job->port);
+            batch->stopping = 1;
+        }
+    }
+    
+    batch_fill(batch);
+}
+
+/**
+ *  Print a table with the result of each job.
+ *
+ *  @param batch The batch
+ *
+ *  @return The number of jobs which succeeded
+ */
+static int batch_print_results (struct batch *batch)
+{
+    int succeeded = 0;
+    
+    printf("\n%-24s %-10s %8s  %s\n", "Port", "Result", "Time",
+           "Firmware version");
+    
+    for (int i = 0; i < batch->num_jobs; i++) {
+        struct batch_job *bj = &batch->jobs[i];
+        
+        const char *result = "skipped";
+        const char *detail = "";
+        if (bj->state == BATCH_JOB_FINISHED) {
+            result = bj->skipped ? "current" : flash_phase_name(bj->result);
+            detail = bj->new_version;
+            if (bj->result == FLASH_PHASE_DONE) {
+                succeeded++;
+            } else {
+                detail = bj->error;
+            }
+        }
+        
+        printf("%-24s %-10s %7.1fs  %s\n", bj->job->port, result,
+               (double)(bj->end_time - bj->start_time) / 1000000, detail);
+    }
+    
+    printf("\n%d of %d jobs completed successfully.\n", succeeded,
+           batch->num_jobs);
+    
+    return succeeded;
+}
+
+
+void batch_options_init (struct batch_options *options)
+{
+    memset(options, 0, sizeof(*options));
+    options->on_failure = BATCH_FAILURE_CONTINUE;
+}
+
+int batch_run (struct io_loop *loop, struct manifest *manifest,
+               struct image_cache *cache, const struct batch_options *options,
+               FILE *log)
+{
+    struct batch batch = {
+        .num_jobs = manifest->num_jobs,
+        .loop = loop,
+        .options = *options,
+        .log = log
+    };
+    
+    batch.jobs = calloc((size_t)manifest->num_jobs, sizeof(struct batch_job));
+    if (batch.jobs == NULL) {
+        fprintf(stderr, "Could not allocate batch jobs.\n");
+        return -1;
+    }
+    
+    int ret = -1;
+    
+    /* Load all images up front */
+    for (int i = 0; i < batch.num_jobs; i++) {
+        batch.jobs[i].job = &manifest->jobs[i];
+        batch.jobs[i].batch = &batch;
+        
+        if (flash_job_init(loop, &batch.jobs[i].flash, batch_job_event,
+                           &batch.jobs[i]) != 0) {
+            goto free_jobs;
+        }
+        
+        if (image_cache_get(cache, manifest->jobs[i].image,
+                            &batch.jobs[i].hex) != 0) {
+            fprintf(stderr, "Could not load image for line %d.\n",
+                    manifest->jobs[i].line);
+            goto free_jobs;
+        }
+        
+        if ((manifest->jobs[i].script != NULL) &&
+                (provision_script_load(manifest->jobs[i].script,
+                                       &batch.jobs[i].provision) != 0)) {
+            fprintf(stderr, "Could not load provisioning script for line "
+                    "%d.\n", manifest->jobs[i].line);
+            goto free_jobs;
+        }
+    }
+    
+    /* Run jobs */
+    batch_fill(&batch);
+    
+    if (!batch.done && (io_loop_run(loop, &batch.done) != 0)) {
+        goto free_jobs;
+    }
+    
+    if (batch_print_results(&batch) == batch.num_jobs) {
+        ret = 0;
+    }
+    
+free_jobs:
+    for (int i = 0; i < batch.num_jobs; i++) {
+        flash_job_free(&batch.jobs[i].flash);
+        if (batch.jobs[i].hex != NULL) {
+            image_cache_release(cache, batch.jobs[i].hex);
+        }
+        if (batch.jobs[i].provision != NULL) {
+            provision_script_free(batch.jobs[i].provision);
+        }
+    }
+    free(batch.jobs);
+    return ret;
+}
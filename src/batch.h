@@ -0,0 +1,72 @@
+//
+//  batch.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef batch_h
+#define batch_h
+
+#include <stdio.h>
+
+#include "io-loop.h"
+#include "manifest.h"
+#include "image-cache.h"
+#include "state-db.h"
+#include "adapter-db.h"
+#include "provision.h"
+
+enum batch_failure_policy {
+    /** Keep starting jobs after a job fails */
+    BATCH_FAILURE_CONTINUE,
+    /** Do not start any more jobs after a job fails, running jobs finish */
+    BATCH_FAILURE_STOP
+};
+
+struct batch_options {
+    /** Maximum number of jobs to run at once, 0 for no limit */
+    int parallel;
+    /** What to do when a job fails */
+    enum batch_failure_policy on_failure;
+    /** Number of times to retry a failed job */
+    int retries;
+    /** Database of what was last written to each module, or NULL */
+    struct state_db *state;
+    /** Calibrated settings for USB serial adapters, or NULL */
+    struct adapter_db *adapters;
+    /** Update modules even if they already have the image */
+    int force;
+    /** Commands to be run on each module after it is updated, for jobs which
+        do not name their own script, or NULL */
+    const struct provision_script *provision;
+};
+
+/**
+ *  Fill a batch options structure with the default options.
+ *
+ *  @param options The structure to be filled
+ */
+extern void batch_options_init (struct batch_options *options);
+
+/**
+ *  Run all of the jobs in a manifest without asking for confirmation. Every
+ *  image and provisioning script is loaded before any jobs are started so that
+ *  a bad manifest does not leave modules half updated. Each image is only parsed once no matter how
+ *  many jobs use it.
+ *
+ *  @param loop The event loop on which to run the jobs
+ *  @param manifest The jobs to run
+ *  @param cache Cache from which images should be loaded
+ *  @param options Options for the batch
+ *  @param log File to which a JSON result line is written as each job
+ *             finishes, or NULL
+ *
+ *  @return 0 if all of the jobs succeeded
+ */
+extern int batch_run (struct io_loop *loop, struct manifest *manifest,
+                      struct image_cache *cache,
+                      const struct batch_options *options, FILE *log);
+
+#endif /* batch_h */
@@ -0,0 +1,261 @@
+//
+//  calibrate.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#include "calibrate.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "io-loop.h"
+#include "serial-port.h"
+#include "uart-bootloader.h"
+#include "latency-stats.h"
+#include "json.h"
+
+/** Baudrates tried, the bootloader detects the baudrate of each command so
+    any of them can be used without telling the module */
+static const int calibrate_baudrates[] = { 57600, 115200, 230400 };
+
+#define CALIBRATE_NUM_BAUDRATES (sizeof(calibrate_baudrates) / \
+                                 sizeof(calibrate_baudrates[0]))
+
+/**
+ *  Measurements made at one baudrate.
+ */
+struct calibrate_result {
+    int baudrate;
+    int exchanges;
+    int errors;
+    /** Median turnaround time in microseconds */
+    uint32_t latency;
+    /** Bytes per second sent and received */
+    uint32_t throughput;
+};
+
+
+/**
+ *  Make one exchange with the bootloader and record how long the module took
+ *  to respond.
+ *
+ *  @param port The port
+ *  @param checksum Ask for a checksum rather than the bootloader version
+ *  @param reference The checksum expected
+ *  @param turnaround Statistics to which the turnaround time is added
+ *
+ *  @return 0 if successfull
+ */
+static int calibrate_exchange (struct serial_port *port, int checksum,
+                               uint16_t reference,
+                               struct latency_stats *turnaround)
+{
+    struct serial_port_stats *stats = serial_port_get_stats(port);
+    uint64_t bytes = stats->bytes_tx + stats->bytes_rx;
+    uint64_t start = latency_stats_now();
+    int ret;
+    
+    if (checksum) {
+        uint16_t value;
+        ret = rn_bootloader_checksum(port, CALIBRATE_CHECKSUM_ADDRESS,
+                                     CALIBRATE_CHECKSUM_LENGTH, &value);
+        if ((ret == 0) && (value != reference)) {
+            // Data was corrupted on the way
+            ret = -1;
+        }
+    } else {
+        struct rn_bootloader_rsp_version *version = NULL;
+        ret = rn_bootloader_get_version_info(port, &version);
+        free(version);
+    }
+    
+    if (ret != 0) {
+        return -1;
+    }
+    
+    // Time spent sending the command and response, at 10 bits per byte, is
+    // not part of the module's turnaround time
+    uint64_t elapsed = latency_stats_now() - start;
+    uint64_t wire = ((stats->bytes_tx + stats->bytes_rx - bytes) *
+                     UINT64_C(10000000)) /
+                    (uint64_t)serial_port_get_baud(port);
+    latency_stats_add(turnaround, (elapsed > wire) ? (elapsed - wire) : 0);
+    return 0;
+}
+
+/**
+ *  Measure the link at one baudrate.
+ *
+ *  @param port The port
+ *  @param baudrate The baudrate to be measured
+ *  @param reference The checksum read at the baudrate known to work
+ *  @param result Structure where the results should be stored
+ */
+static void calibrate_measure (struct serial_port *port, int baudrate,
+                               uint16_t reference,
+                               struct calibrate_result *result)
+{
+    struct serial_port_stats *stats = serial_port_get_stats(port);
+    struct latency_stats turnaround;
+    latency_stats_reset(&turnaround);
+    
+    memset(result, 0, sizeof(*result));
+    result->baudrate = baudrate;
+    
+    if (serial_port_set_baud(port, baudrate) != 0) {
+        result->errors = CALIBRATE_MAX_ERRORS;
+        return;
+    }
+    serial_port_discard_input(port);
+    
+    uint64_t bytes = stats->bytes_tx + stats->bytes_rx;
+    uint64_t start = latency_stats_now();
+    
+    for (int i = 0; (i < (2 * CALIBRATE_EXCHANGES)) &&
+                    (result->errors < CALIBRATE_MAX_ERRORS); i++) {
+        result->exchanges++;
+        if (calibrate_exchange(port, i & 1, reference, &turnaround) != 0) {
+            result->errors++;
+            // Drop whatever is left of a garbled response
+            serial_port_discard_input(port);
+        }
+    }
+    
+    uint64_t elapsed = latency_stats_now() - start;
+    if (turnaround.count != 0) {
+        result->latency = (uint32_t)latency_stats_percentile(&turnaround, 50);
+    }
+    if (elapsed != 0) {
+        result->throughput = (uint32_t)(((stats->bytes_tx + stats->bytes_rx -
+                                          bytes) * UINT64_C(1000000)) /
+                                        elapsed);
+    }
+}
+
+/**
+ *  Print the results of a calibration.
+ *
+ *  @param path Path to the port
+ *  @param adapter Identity of the adapter
+ *  @param results Results for each baudrate
+ *  @param best Index of the best result, or -1 if there is none
+ *  @param json Whether the results should be printed as JSON
+ */
+static void calibrate_print (const char *path, const char *adapter,
+                             const struct calibrate_result *results, int best,
+                             int json)
+{
+    if (json) {
+        printf("{\"port\":");
+        json_write_string(stdout, path);
+        printf(",\"adapter\":");
+        json_write_string(stdout, adapter);
+        printf(",\"baud\":%d,\"results\":[",
+               (best != -1) ? results[best].baudrate : 0);
+    } else {
+        printf("Port: %s\nAdapter: %s\n\n%-8s %10s %8s %12s %14s\n", path,
+               adapter, "Baud", "Exchanges", "Errors", "Latency",
+               "Throughput");
+    }
+    
+    for (int i = 0; i < (int)CALIBRATE_NUM_BAUDRATES; i++) {
+        const struct calibrate_result *r = &results[i];
+        
+        if (json) {
+            printf("%s{\"baud\":%d,\"exchanges\":%d,\"errors\":%d,"
+                   "\"latency_us\":%" PRIu32 ",\"throughput\":%" PRIu32 "}",
+                   (i == 0) ? "" : ",", r->baudrate, r->exchanges, r->errors,
+                   r->latency, r->throughput);
+        } else {
+            printf("%-8d %10d %8d %9" PRIu32 " us %10" PRIu32 " B/s%s\n",
+                   r->baudrate, r->exchanges, r->errors, r->latency,
+                   r->throughput, (i == best) ? " *" : "");
+        }
+    }
+    
+    if (json) {
+        printf("]}\n");
+    } else if (best != -1) {
+        printf("\nThe bootloader will be used at %d baud through this "
+               "adapter.\n", results[best].baudrate);
+    }
+}
+
+
+int calibrate_run (const char *path, int baudrate, struct adapter_db *db,
+                   int json)
+{
+    struct io_loop *loop;
+    struct serial_port *port;
+    int ret = -1;
+    
+    if (io_loop_init(&loop) != 0) {
+        return -1;
+    }
+    if (serial_port_open(loop, path, baudrate, &port) != 0) {
+        goto free_loop;
+    }
+    
+    /* The bootloader must answer at the baudrate that is known to work, the
+       checksum read here is what is expected at every other baudrate */
+    struct rn_bootloader_rsp_version *version = NULL;
+    uint16_t reference;
+    if ((rn_bootloader_get_version_info(port, &version) != 0) ||
+            (rn_bootloader_checksum(port, CALIBRATE_CHECKSUM_ADDRESS,
+                                    CALIBRATE_CHECKSUM_LENGTH,
+                                    &reference) != 0)) {
+        fprintf(stderr, "No bootloader answered on %s.\n", path);
+        free(version);
+        goto close_port;
+    }
+    free(version);
+    
+    /* Exchanges are expected to fail at baudrates which the adapter or cable
+       can not keep up with */
+    struct calibrate_result results[CALIBRATE_NUM_BAUDRATES];
+    int best = -1;
+    int was_quiet = serial_port_set_quiet(port, 1);
+    
+    for (int i = 0; i < (int)CALIBRATE_NUM_BAUDRATES; i++) {
+        calibrate_measure(port, calibrate_baudrates[i], reference,
+                          &results[i]);
+        if ((results[i].errors == 0) && ((best == -1) ||
+                (results[i].throughput > results[best].throughput))) {
+            best = i;
+        }
+    }
+    
+    serial_port_set_quiet(port, was_quiet);
+    if (serial_port_set_baud(port, baudrate) != 0) {
+        goto close_port;
+    }
+    
+    struct adapter_profile profile;
+    memset(&profile, 0, sizeof(profile));
+    adapter_db_identify(path, profile.adapter, sizeof(profile.adapter));
+    
+    calibrate_print(path, profile.adapter, results, best, json);
+    
+    if (best == -1) {
+        fprintf(stderr, "The bootloader did not answer reliably at any "
+                "baudrate on %s.\n", path);
+        goto close_port;
+    }
+    
+    profile.baudrate = results[best].baudrate;
+    profile.latency = results[best].latency;
+    profile.throughput = results[best].throughput;
+    profile.time = time(NULL);
+    ret = adapter_db_update(db, &profile);
+    
+close_port:
+    serial_port_close(port);
+free_loop:
+    io_loop_free(loop);
+    return ret;
+}
@@ -0,0 +1,41 @@
+//
+//  calibrate.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef calibrate_h
+#define calibrate_h
+
+#include "adapter-db.h"
+
+/** Number of each kind of exchange made at every candidate baudrate */
+#define CALIBRATE_EXCHANGES     16
+/** Number of failed exchanges after which a baudrate is given up on */
+#define CALIBRATE_MAX_ERRORS    3
+/** Address and length of the flash checksummed during calibration */
+#define CALIBRATE_CHECKSUM_ADDRESS  0x300
+#define CALIBRATE_CHECKSUM_LENGTH   0x100
+
+/**
+ *  Find the best link settings for the adapter that a port belongs to. The
+ *  module on the port must be waiting in its bootloader. A burst of
+ *  GET_VERSION and CHECKSUM exchanges is made at each candidate baudrate to
+ *  measure the module's turnaround time, the throughput of the link and how
+ *  many exchanges fail. The fastest baudrate at which nothing failed is
+ *  stored in the adapter database, so that later updates through the same
+ *  adapter talk to the bootloader at that baudrate.
+ *
+ *  @param path Path to the serial port
+ *  @param baudrate Baudrate that the module is known to work at
+ *  @param db Database in which the profile should be stored
+ *  @param json Whether the results should be printed as JSON
+ *
+ *  @return 0 if successfull
+ */
+extern int calibrate_run (const char *path, int baudrate,
+                          struct adapter_db *db, int json);
+
+#endif /* calibrate_h */
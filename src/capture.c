@@ -0,0 +1,127 @@
+//
+//  capture.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#include "capture.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "latency-stats.h"
+
+int capture_enabled = 0;
+
+static FILE *capture_file;
+/** Time of the last record */
+static uint64_t capture_time;
+
+static char *capture_ports[CAPTURE_MAX_PORTS];
+static int capture_num_ports;
+
+
+/**
+ *  Write a number as a varint.
+ */
+static void capture_write_varint (uint64_t value)
+{
+    while (value >= 0x80) {
+        fputc((int)((value & 0x7F) | 0x80), capture_file);
+        value >>= 7;
+    }
+    fputc((int)value, capture_file);
+}
+
+/**
+ *  Write a record.
+ */
+static void capture_write_record (enum capture_record type, int port,
+                                  const void *data, size_t length)
+{
+    uint64_t now = latency_stats_now();
+    
+    fputc((int)type, capture_file);
+    fputc(port, capture_file);
+    capture_write_varint(now - capture_time);
+    capture_write_varint(length);
+    fwrite(data, 1, length, capture_file);
+    
+    capture_time = now;
+}
+
+/**
+ *  Find the number of a port, writing a port record if it has not been seen
+ *  before.
+ *
+ *  @return The number of the port, or -1 if there are too many ports
+ */
+static int capture_port (const char *name)
+{
+    for (int i = 0; i < capture_num_ports; i++) {
+        if (strcmp(capture_ports[i], name) == 0) {
+            return i;
+        }
+    }
+    
+    if ((capture_num_ports == CAPTURE_MAX_PORTS) ||
+            ((capture_ports[capture_num_ports] = strdup(name)) == NULL)) {
+        return -1;
+    }
+    
+    capture_write_record(CAPTURE_RECORD_PORT, capture_num_ports, name,
+                         strlen(name));
+    return capture_num_ports++;
+}
+
+
+int capture_start (const char *path)
+{
+    capture_file = fopen(path, "wb");
+    if (capture_file == NULL) {
+        fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    
+    fwrite(CAPTURE_MAGIC, 1, CAPTURE_MAGIC_LENGTH, capture_file);
+    
+    capture_time = latency_stats_now();
+    capture_enabled = 1;
+    atexit(capture_finish);
+    return 0;
+}
+
+void capture_finish (void)
+{
+    if (!capture_enabled) {
+        return;
+    }
+    capture_enabled = 0;
+    
+    if (fclose(capture_file) != 0) {
+        fprintf(stderr, "Could not write capture: %s\n", strerror(errno));
+    }
+    
+    for (int i = 0; i < capture_num_ports; i++) {
+        free(capture_ports[i]);
+    }
+}
+
+void capture_data (const char *port, enum capture_record type,
+                   const uint8_t *data, size_t length)
+{
+    if (!capture_enabled) {
+        return;
+    }
+    
+    int port_num = capture_port(port);
+    if (port_num == -1) {
+        return;
+    }
+    
+    capture_write_record(type, port_num, data, length);
+}
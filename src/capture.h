@@ -0,0 +1,73 @@
+//
+//  capture.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef capture_h
+#define capture_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ *  A capture file starts with CAPTURE_MAGIC and is followed by records, each
+ *  made up of:
+ *      - the record type (one byte)
+ *      - the number of the port (one byte)
+ *      - the time since the previous record in microseconds (varint)
+ *      - the length of the data (varint)
+ *      - the data
+ *  Varints are little endian base 128, as in protocol buffers. A port record
+ *  gives the name of a port and comes before any data for that port.
+ */
+
+/** Bytes at the start of a capture file */
+#define CAPTURE_MAGIC           "RN2483C1"
+#define CAPTURE_MAGIC_LENGTH    8
+
+/** Maximum number of ports in a capture */
+#define CAPTURE_MAX_PORTS       256
+
+enum capture_record {
+    /** The data is the name of the port */
+    CAPTURE_RECORD_PORT = 0,
+    /** The data was sent to the module */
+    CAPTURE_RECORD_TX = 1,
+    /** The data was received from the module */
+    CAPTURE_RECORD_RX = 2
+};
+
+/** Non-zero while data is being captured, callers check this before calling
+    capture_data */
+extern int capture_enabled;
+
+/**
+ *  Start capturing all data sent and received on serial ports. The capture is
+ *  written as it is recorded and finished when the program exits.
+ *
+ *  @param path Path to the file where the capture should be written
+ *
+ *  @return 0 if successfull
+ */
+extern int capture_start (const char *path);
+
+/**
+ *  Stop capturing and close the capture file.
+ */
+extern void capture_finish (void);
+
+/**
+ *  Record data sent or received on a port.
+ *
+ *  @param port Name of the port
+ *  @param type CAPTURE_RECORD_TX or CAPTURE_RECORD_RX
+ *  @param data The data
+ *  @param length The length of the data
+ */
+extern void capture_data (const char *port, enum capture_record type,
+                          const uint8_t *data, size_t length);
+
+#endif /* capture_h */
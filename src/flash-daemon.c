@@ -0,0 +1,711 @@
+//
+//  flash-daemon.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#include "flash-daemon.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "io-loop.h"
+#include "serial-port.h"
+#include "image-cache.h"
+#include "flash-job.h"
+#include "signal-watch.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+struct flash_daemon;
+
+struct flash_daemon_client {
+    struct flash_daemon_client *next;
+    struct flash_daemon *daemon;
+    
+    int fd;
+    struct io_watch *watch;
+    
+    /* Partial request line */
+    char in[FLASH_DAEMON_MAX_LINE];
+    size_t in_length;
+    /* Set while discarding the rest of a line which is too long */
+    int discarding;
+    
+    /* Responses waiting to be written */
+    char *out;
+    size_t out_length;
+    size_t out_capacity;
+    
+    /* Close the connection once all responses have been written */
+    int closing;
+};
+
+struct flash_daemon_job {
+    struct flash_daemon_job *next;
+    struct flash_daemon *daemon;
+    
+    unsigned int id;
+    enum flash_mode mode;
+    char *port_path;
+    int baudrate;
+    int recover;
+    struct intel_hex_file *hex;
+    
+    /* Client which submitted the job, NULL if it has disconnected */
+    struct flash_daemon_client *client;
+    
+    struct flash_job flash;
+    int running;
+    /* Last progress percentage sent to the client */
+    int percent;
+};
+
+struct flash_daemon {
+    struct io_loop *loop;
+    struct image_cache *cache;
+    int baudrate;
+    int force;
+    struct adapter_db *adapters;
+    
+    int listen_fd;
+    struct io_watch *listen_watch;
+    
+    struct signal_watch *signal_watch;
+    
+    struct flash_daemon_client *clients;
+    /* Jobs in the order they were submitted */
+    struct flash_daemon_job *jobs;
+    
+    unsigned int next_id;
+    int stop;
+};
+
+static const char *const flash_daemon_modes[] = {
+    [FLASH_MODE_UPDATE] = "flash",
+    [FLASH_MODE_VERIFY] = "verify",
+    [FLASH_MODE_VERSION] = "version"
+};
+
+
+static void flash_daemon_client_close (struct flash_daemon_client *client);
+static void flash_daemon_schedule (struct flash_daemon *daemon);
+
+/**
+ *  Write as much of a client's queued output as possible.
+ *
+ *  @param client The client
+ *
+ *  @return 0 if successfull, -1 if the connection has failed
+ */
+static int flash_daemon_client_flush (struct flash_daemon_client *client)
+{
+    size_t offset = 0;
+    
+    while (offset < client->out_length) {
+        ssize_t n = send(client->fd, client->out + offset,
+                         client->out_length - offset, MSG_NOSIGNAL);
+        
+        if (n == -1) {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                break;
+            } else if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        offset += (size_t)n;
+    }
+    
+    memmove(client->out, client->out + offset, client->out_length - offset);
+    client->out_length -= offset;
+    
+    int events = IO_EVENT_READ;
+    if (client->out_length != 0) {
+        events |= IO_EVENT_WRITE;
+    }
+    return io_watch_set_events(client->watch, events);
+}
+
+/**
+ *  Send a line to a client.
+ *
+ *  @param client The client, or NULL to discard the line
+ *  @param format Format string for the line, without the line ending
+ */
+__attribute__((format(printf, 2, 3)))
+static void flash_daemon_send (struct flash_daemon_client *client,
+                               const char *format, ...)
+{
+    if ((client == NULL) || (client->fd == -1)) {
+        return;
+    }
+    
+    char line[FLASH_DAEMON_MAX_LINE];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line) - 1, format, args);
+    va_end(args);
+    
+    if (length < 0) {
+        return;
+    } else if ((size_t)length > (sizeof(line) - 2)) {
+        length = (int)sizeof(line) - 2;
+    }
+    line[length++] = '\n';
+    
+    if ((client->out_length + (size_t)length) > client->out_capacity) {
+        size_t capacity = (client->out_length + (size_t)length) * 2;
+        char *out = realloc(client->out, capacity);
+        
+        if (out == NULL) {
+            fprintf(stderr, "Could not allocate client output buffer.\n");
+            return;
+        }
+        client->out = out;
+        client->out_capacity = capacity;
+    }
+    
+    memcpy(client->out + client->out_length, line, (size_t)length);
+    client->out_length += (size_t)length;
+    
+    if (flash_daemon_client_flush(client) != 0) {
+        // Connection is closed once control returns to the client's watch
+        client->closing = 1;
+        client->out_length = 0;
+    }
+}
+
+/**
+ *  Free a job. If the job is running its port is closed first.
+ *
+ *  @param job The job to be freed
+ */
+static void flash_daemon_job_free (struct flash_daemon_job *job)
+{
+    flash_job_free(&job->flash);
+    if (job->hex != NULL) {
+        image_cache_release(job->daemon->cache, job->hex);
+    }
+    free(job->port_path);
+    free(job);
+}
+
+/**
+ *  Report the result of a finished job, free it and start any jobs that were
+ *  waiting for its port.
+ *
+ *  @param job The job which has finished
+ */
+static void flash_daemon_job_done (struct flash_daemon_job *job)
+{
+    struct flash_daemon *daemon = job->daemon;
+    struct flash_session *session = job->flash.session;
+    
+    if (session == NULL) {
+        flash_daemon_send(job->client, "DONE %u failed %s", job->id,
+                          job->flash.error);
+    } else if (flash_session_get_phase(session) == FLASH_PHASE_DONE) {
+        const char *detail = "";
+        if (job->mode == FLASH_MODE_UPDATE) {
+            detail = flash_session_get_new_version(session);
+        } else if (job->mode == FLASH_MODE_VERSION) {
+            detail = flash_session_get_old_version(session);
+        }
+        flash_daemon_send(job->client, "DONE %u done %s", job->id, detail);
+    } else {
+        flash_daemon_send(job->client, "DONE %u failed %s: %s", job->id,
+                          flash_phase_name(
+                                flash_session_get_failed_phase(session)),
+                          flash_session_get_error(session));
+    }
+    
+    struct flash_daemon_job **prev = &daemon->jobs;
+    while (*prev != job) {
+        prev = &(*prev)->next;
+    }
+    *prev = job->next;
+    flash_daemon_job_free(job);
+    
+    flash_daemon_schedule(daemon);
+}
+
+/**
+ *  Callback for events from a job.
+ */
+static void flash_daemon_job_event (struct flash_job *flash,
+                                    enum flash_event event, void *context)
+{
+    struct flash_daemon_job *job = (struct flash_daemon_job *)context;
+    
+    if (event == FLASH_EVENT_PHASE) {
+        job->percent = -1;
+        flash_daemon_send(job->client, "PHASE %u %s", job->id,
+                          flash_phase_name(
+                                flash_session_get_phase(flash->session)));
+    } else if (event == FLASH_EVENT_PROGRESS) {
+        int done, total;
+        flash_session_get_progress(flash->session, &done, &total);
+        
+        // Only send progress when the percentage changes
+        int percent = (100 * done) / total;
+        if (percent != job->percent) {
+            job->percent = percent;
+            flash_daemon_send(job->client, "PROGRESS %u %d %d", job->id, done,
+                              total);
+        }
+    } else if (event == FLASH_EVENT_DONE) {
+        flash_daemon_job_done(job);
+    }
+}
+
+/**
+ *  Start a job.
+ *
+ *  @param job The job to be started
+ */
+static void flash_daemon_start_job (struct flash_daemon_job *job)
+{
+    job->running = 1;
+    job->percent = -1;
+    
+    struct flash_options options;
+    flash_options_init(&options);
+    options.mode = job->mode;
+    options.confirm = 0;
+    options.recover = job->recover;
+    options.force = job->daemon->force;
+    options.bootloader_baudrate = adapter_db_baudrate(job->daemon->adapters,
+                                                      job->port_path);
+    
+    flash_job_start(&job->flash, job->port_path, job->baudrate, job->hex,
+                    &options);
+}
+
+/**
+ *  Start every queued job whose port is not busy with an earlier job.
+ *
+ *  @param daemon The daemon
+ */
+static void flash_daemon_schedule (struct flash_daemon *daemon)
+{
+    for (struct flash_daemon_job *job = daemon->jobs; job != NULL;
+         job = job->next) {
+        if (job->running) {
+            continue;
+        }
+        
+        int busy = 0;
+        for (struct flash_daemon_job *earlier = daemon->jobs; earlier != job;
+             earlier = earlier->next) {
+            if (strcmp(earlier->port_path, job->port_path) == 0) {
+                busy = 1;
+                break;
+            }
+        }
+        
+        if (!busy) {
+            flash_daemon_start_job(job);
+        }
+    }
+}
+
+/**
+ *  Handle a job request.
+ *
+ *  @param client The client which sent the request
+ *  @param mode The type of job
+ *  @param args Arguments from the request line
+ *  @param save Pointer used by strtok_r
+ */
+static void flash_daemon_submit (struct flash_daemon_client *client,
+                                 enum flash_mode mode, char **save)
+{
+    struct flash_daemon *daemon = client->daemon;
+    
+    char *port = strtok_r(NULL, " \t", save);
+    char *image = NULL;
+    if ((port != NULL) && (mode != FLASH_MODE_VERSION)) {
+        image = strtok_r(NULL, " \t", save);
+    }
+    
+    if ((port == NULL) || ((mode != FLASH_MODE_VERSION) && (image == NULL))) {
+        flash_daemon_send(client, "ERR Missing arguments");
+        return;
+    }
+    
+    int baudrate = daemon->baudrate;
+    int recover = 0;
+    
+    for (char *arg = strtok_r(NULL, " \t", save); arg != NULL;
+         arg = strtok_r(NULL, " \t", save)) {
+        if (strncasecmp(arg, "baud=", 5) == 0) {
+            char *end;
+            baudrate = (int)strtol(arg + 5, &end, 10);
+            if ((*end != '\0') || (baudrate <= 0)) {
+                flash_daemon_send(client, "ERR Invalid baudrate \"%s\"",
+                                  arg + 5);
+                return;
+            }
+        } else if ((mode == FLASH_MODE_UPDATE) &&
+                   (strcasecmp(arg, "recover") == 0)) {
+            recover = 1;
+        } else {
+            flash_daemon_send(client, "ERR Unexpected argument \"%s\"", arg);
+            return;
+        }
+    }
+    
+    struct intel_hex_file *hex = NULL;
+    if ((image != NULL) && (image_cache_get(daemon->cache, image, &hex) != 0)) {
+        flash_daemon_send(client, "ERR Could not load image \"%s\"", image);
+        return;
+    }
+    
+    struct flash_daemon_job *job = calloc(1, sizeof(struct flash_daemon_job));
+    if (job != NULL) {
+        job->port_path = strdup(port);
+    }
+    if ((job == NULL) || (job->port_path == NULL) ||
+            (flash_job_init(daemon->loop, &job->flash, flash_daemon_job_event,
+                            job) != 0)) {
+        if (job != NULL) {
+            free(job->port_path);
+        }
+        free(job);
+        if (hex != NULL) {
+            image_cache_release(daemon->cache, hex);
+        }
+        flash_daemon_send(client, "ERR Out of memory");
+        return;
+    }
+    
+    job->daemon = daemon;
+    job->id = daemon->next_id++;
+    job->mode = mode;
+    job->baudrate = baudrate;
+    job->recover = recover;
+    job->hex = hex;
+    job->client = client;
+    
+    struct flash_daemon_job **tail = &daemon->jobs;
+    while (*tail != NULL) {
+        tail = &(*tail)->next;
+    }
+    *tail = job;
+    
+    flash_daemon_send(client, "OK %u", job->id);
+    flash_daemon_schedule(daemon);
+}
+
+/**
+ *  Handle a request line from a client.
+ *
+ *  @param client The client which sent the request
+ *  @param line The request, without its line ending
+ */
+static void flash_daemon_handle_request (struct flash_daemon_client *client,
+                                         char *line)
+{
+    struct flash_daemon *daemon = client->daemon;
+    char *save;
+    char *command = strtok_r(line, " \t", &save);
+    
+    if (command == NULL) {
+        return;
+    } else if (strcasecmp(command, "FLASH") == 0) {
+        flash_daemon_submit(client, FLASH_MODE_UPDATE, &save);
+    } else if (strcasecmp(command, "VERIFY") == 0) {
+        flash_daemon_submit(client, FLASH_MODE_VERIFY, &save);
+    } else if (strcasecmp(command, "VERSION") == 0) {
+        flash_daemon_submit(client, FLASH_MODE_VERSION, &save);
+    } else if (strcasecmp(command, "STATUS") == 0) {
+        for (struct flash_daemon_job *job = daemon->jobs; job != NULL;
+             job = job->next) {
+            const char *state = "queued";
+            if (job->flash.session != NULL) {
+                state = flash_phase_name(
+                                flash_session_get_phase(job->flash.session));
+            }
+            flash_daemon_send(client, "JOB %u %s %s %s", job->id,
+                              job->port_path, flash_daemon_modes[job->mode],
+                              state);
+        }
+        flash_daemon_send(client, "END");
+    } else if (strcasecmp(command, "QUIT") == 0) {
+        client->closing = 1;
+    } else {
+        flash_daemon_send(client, "ERR Unknown command \"%s\"", command);
+    }
+}
+
+/**
+ *  Handle readiness of a client connection.
+ */
+static void flash_daemon_client_io (struct io_watch *watch, int events,
+                                    void *context)
+{
+    (void)watch;
+    struct flash_daemon_client *client = context;
+    
+    if (events & IO_EVENT_WRITE) {
+        if (flash_daemon_client_flush(client) != 0) {
+            flash_daemon_client_close(client);
+            return;
+        }
+    }
+    
+    if (!client->closing && (events & (IO_EVENT_READ | IO_EVENT_ERROR))) {
+        ssize_t n = recv(client->fd, client->in + client->in_length,
+                         sizeof(client->in) - client->in_length, 0);
+        
+        if ((n == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) ||
+                          (errno == EINTR))) {
+            return;
+        } else if (n <= 0) {
+            flash_daemon_client_close(client);
+            return;
+        }
+        
+        client->in_length += (size_t)n;
+        
+        /* Handle complete lines */
+        size_t start = 0;
+        for (size_t i = 0; (i < client->in_length) && !client->closing;
+             i++) {
+            if (client->in[i] != '\n') {
+                continue;
+            }
+            
+            client->in[i] = '\0';
+            if ((i > start) && (client->in[i - 1] == '\r')) {
+                client->in[i - 1] = '\0';
+            }
+            
+            if (!client->discarding) {
+                flash_daemon_handle_request(client, client->in + start);
+            }
+            client->discarding = 0;
+            start = i + 1;
+        }
+        
+        memmove(client->in, client->in + start, client->in_length - start);
+        client->in_length -= start;
+        
+        if (client->in_length == sizeof(client->in)) {
+            flash_daemon_send(client, "ERR Request too long");
+            client->discarding = 1;
+            client->in_length = 0;
+        }
+    }
+    
+    if (client->closing && (client->out_length == 0)) {
+        flash_daemon_client_close(client);
+    }
+}
+
+/**
+ *  Close a client connection. Its jobs keep running.
+ *
+ *  @param client The client to be closed
+ */
+static void flash_daemon_client_close (struct flash_daemon_client *client)
+{
+    struct flash_daemon *daemon = client->daemon;
+    
+    for (struct flash_daemon_job *job = daemon->jobs; job != NULL;
+         job = job->next) {
+        if (job->client == client) {
+            job->client = NULL;
+        }
+    }
+    
+    struct flash_daemon_client **prev = &daemon->clients;
+    while (*prev != client) {
+        prev = &(*prev)->next;
+    }
+    *prev = client->next;
+    
+    io_watch_remove(client->watch);
+    close(client->fd);
+    free(client->out);
+    free(client);
+}
+
+/**
+ *  Accept new client connections.
+ */
+static void flash_daemon_accept (struct io_watch *watch, int events,
+                                 void *context)
+{
+    (void)watch;
+    (void)events;
+    struct flash_daemon *daemon = context;
+    
+    for (;;) {
+        int fd = accept(daemon->listen_fd, NULL, NULL);
+        
+        if (fd == -1) {
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK) &&
+                (errno != EINTR)) {
+                fprintf(stderr, "Could not accept connection: %s\n",
+                        strerror(errno));
+            }
+            return;
+        }
+        
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        
+        struct flash_daemon_client *client = calloc(1,
+                                            sizeof(struct flash_daemon_client));
+        if (client == NULL) {
+            close(fd);
+            continue;
+        }
+        
+        client->daemon = daemon;
+        client->fd = fd;
+        
+        if (io_watch_add(daemon->loop, fd, IO_EVENT_READ,
+                         flash_daemon_client_io, client,
+                         &client->watch) != 0) {
+            close(fd);
+            free(client);
+            continue;
+        }
+        
+        client->next = daemon->clients;
+        daemon->clients = client;
+    }
+}
+
+/**
+ *  Create the listening socket.
+ *
+ *  @param path Path at which the socket should be created
+ *
+ *  @return The socket's file descriptor, or -1 on failure
+ */
+static int flash_daemon_listen (const char *path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path %s is too long.\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    
+    /* Remove a socket left behind by a previous daemon */
+    struct stat st;
+    if ((lstat(path, &st) == 0) && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+    
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        fprintf(stderr, "Could not create socket: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "Could not bind %s: %s\n", path, strerror(errno));
+        goto close_fd;
+    }
+    
+    if (listen(fd, 16) != 0) {
+        fprintf(stderr, "Could not listen on %s: %s\n", path,
+                strerror(errno));
+        goto unlink_path;
+    }
+    
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+    
+unlink_path:
+    unlink(path);
+close_fd:
+    close(fd);
+    return -1;
+}
+
+int flash_daemon_run (const char *socket_path, int baudrate, int force,
+                      struct adapter_db *adapters)
+{
+    struct flash_daemon daemon = { .baudrate = baudrate, .force = force,
+                                   .adapters = adapters, .next_id = 1 };
+    int ret = -1;
+    
+    if (io_loop_init(&daemon.loop) != 0) {
+        return -1;
+    }
+    
+    if (image_cache_init(&daemon.cache) != 0) {
+        goto free_loop;
+    }
+    
+    if (signal_watch_init(daemon.loop, &daemon.stop,
+                          &daemon.signal_watch) != 0) {
+        goto free_cache;
+    }
+    
+    daemon.listen_fd = flash_daemon_listen(socket_path);
+    if (daemon.listen_fd == -1) {
+        goto remove_signal_watch;
+    }
+    
+    if (io_watch_add(daemon.loop, daemon.listen_fd, IO_EVENT_READ,
+                     flash_daemon_accept, &daemon,
+                     &daemon.listen_watch) != 0) {
+        goto close_listen;
+    }
+    
+    printf("Listening on %s\n", socket_path);
+    fflush(stdout);
+    
+    /* Run until signalled */
+    ret = io_loop_run(daemon.loop, &daemon.stop);
+    
+    printf("Shutting down\n");
+    
+    /* Abandon running jobs and disconnect clients */
+    while (daemon.jobs != NULL) {
+        struct flash_daemon_job *job = daemon.jobs;
+        daemon.jobs = job->next;
+        flash_daemon_job_free(job);
+    }
+    while (daemon.clients != NULL) {
+        flash_daemon_client_close(daemon.clients);
+    }
+    
+    io_watch_remove(daemon.listen_watch);
+close_listen:
+    close(daemon.listen_fd);
+    unlink(socket_path);
+remove_signal_watch:
+    signal_watch_free(daemon.signal_watch);
+free_cache:
+    image_cache_free(daemon.cache);
+free_loop:
+    io_loop_free(daemon.loop);
+    return ret;
+}
@@ -0,0 +1,49 @@
+//
+//  flash-daemon.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef flash_daemon_h
+#define flash_daemon_h
+
+#include "adapter-db.h"
+
+/** Maximum length of a request line */
+#define FLASH_DAEMON_MAX_LINE   1024
+
+/**
+ *  Run a daemon which accepts jobs over a Unix domain socket until it receives
+ *  SIGINT or SIGTERM.
+ *
+ *  Clients send one request per line:
+ *      FLASH <port> <image> [baud=<baud>] [recover]
+ *      VERIFY <port> <image> [baud=<baud>]
+ *      VERSION <port> [baud=<baud>]
+ *      STATUS
+ *      QUIT
+ *
+ *  Job requests are answered with "OK <id>" or "ERR <message>". Jobs for
+ *  different ports run concurrently, jobs for the same port run in the order
+ *  they were submitted. The client which submitted a job is sent
+ *  "PHASE <id> <phase>" and "PROGRESS <id> <done> <total>" lines while it runs
+ *  and a final "DONE <id> <result> <detail>" line. STATUS lists every job as
+ *  "JOB <id> <port> <type> <state>" followed by "END".
+ *
+ *  Parsed images are kept in memory and are only parsed again if the file
+ *  changes, an image which has been replaced is freed once no job is using
+ *  it. Ports are opened when a job starts and closed when it finishes.
+ *
+ *  @param socket_path Path at which the socket should be created
+ *  @param baudrate Baudrate for jobs which do not specify one
+ *  @param force Update modules which already report the image's version
+ *  @param adapters Calibrated settings for USB serial adapters, or NULL
+ *
+ *  @return 0 if the daemon was stopped by a signal
+ */
+extern int flash_daemon_run (const char *socket_path, int baudrate, int force,
+                             struct adapter_db *adapters);
+
+#endif /* flash_daemon_h */
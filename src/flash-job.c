@@ -0,0 +1,124 @@
+//
+//  flash-job.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#include "flash-job.h"
+
+#include <stddef.h>
+
+
+/**
+ *  Report the end of a job.
+ */
+static void flash_job_handle_done (struct io_timer *timer, void *context)
+{
+    (void)timer;
+    struct flash_job *job = context;
+    
+    // The job may be freed by the callback
+    job->callback(job, FLASH_EVENT_DONE, job->context);
+}
+
+/**
+ *  Report that a job has ended once the current callback has returned.
+ */
+static void flash_job_finish (struct flash_job *job)
+{
+    io_timer_start(job->done, 0);
+}
+
+/**
+ *  Callback for events from a job's session.
+ */
+static void flash_job_session_event (struct flash_session *session,
+                                     enum flash_event event, void *context)
+{
+    (void)session;
+    struct flash_job *job = context;
+    
+    if (event == FLASH_EVENT_DONE) {
+        // The session can not be freed from its own callback
+        flash_job_finish(job);
+        return;
+    }
+    job->callback(job, event, job->context);
+}
+
+
+int flash_job_init (struct io_loop *loop, struct flash_job *job,
+                    flash_job_cb callback, void *context)
+{
+    job->session = NULL;
+    job->error = NULL;
+    job->loop = loop;
+    job->port = NULL;
+    job->callback = callback;
+    job->context = context;
+    
+    return io_timer_init(loop, flash_job_handle_done, job, &job->done);
+}
+
+void flash_job_free (struct flash_job *job)
+{
+    if (job->done == NULL) {
+        return;
+    }
+    
+    flash_job_release(job);
+    io_timer_free(job->done);
+    job->done = NULL;
+}
+
+void flash_job_start (struct flash_job *job, const char *path,
+                      int baudrate, struct intel_hex_file *hex,
+                      const struct flash_options *options)
+{
+    struct serial_port *port;
+    
+    flash_job_release(job);
+    job->error = NULL;
+    
+    if (serial_port_open(job->loop, path, baudrate, &port) != 0) {
+        job->error = "Could not open port.";
+        flash_job_finish(job);
+        return;
+    }
+    
+    flash_job_start_on_port(job, port, hex, options);
+}
+
+void flash_job_start_on_port (struct flash_job *job, struct serial_port *port,
+                              struct intel_hex_file *hex,
+                              const struct flash_options *options)
+{
+    flash_job_release(job);
+    job->port = port;
+    job->error = NULL;
+    
+    if (flash_session_init(port, hex, options, flash_job_session_event, job,
+                           &job->session) != 0) {
+        job->error = "Could not create session.";
+        flash_job_finish(job);
+        return;
+    }
+    
+    flash_session_start(job->session);
+}
+
+void flash_job_release (struct flash_job *job)
+{
+    io_timer_stop(job->done);
+    
+    if (job->port != NULL) {
+        serial_port_close(job->port);
+        job->port = NULL;
+    }
+    if (job->session != NULL) {
+        flash_session_free(job->session);
+        job->session = NULL;
+    }
+}
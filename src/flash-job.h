@@ -0,0 +1,107 @@
+//
+//  flash-job.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef flash_job_h
+#define flash_job_h
+
+#include "io-loop.h"
+#include "serial-port.h"
+#include "flash-session.h"
+
+struct flash_job;
+
+/**
+ *  Callback for events from a job. Events from the job's session are passed
+ *  on as they happen. FLASH_EVENT_DONE is sent once the session has finished
+ *  or could not be started, from outside of the session's callbacks, so the
+ *  job may be released, started again or freed from the callback.
+ *
+ *  @param job The job
+ *  @param event The event
+ *  @param context The context pointer given to flash_job_init
+ */
+typedef void (*flash_job_cb)(struct flash_job *job, enum flash_event event,
+                             void *context);
+
+/**
+ *  A flash session along with the port that it runs on. The structure is owned
+ *  by the caller and must remain valid until the job is freed.
+ */
+struct flash_job {
+    /* Results */
+    /** The job's session, or NULL if it could not be started */
+    struct flash_session *session;
+    /** Why the session could not be started */
+    const char *error;
+    
+    /* Private */
+    struct io_loop *loop;
+    struct serial_port *port;
+    /** Timer used to report the end of the job outside of its callbacks */
+    struct io_timer *done;
+    flash_job_cb callback;
+    void *context;
+};
+
+/**
+ *  Set up a job.
+ *
+ *  @param loop The loop that the job's port should be opened on
+ *  @param job Structure for the job's state
+ *  @param callback Function to be called for the job's events
+ *  @param context Pointer to be passed to callback
+ *
+ *  @return 0 if successfull
+ */
+extern int flash_job_init (struct io_loop *loop, struct flash_job *job,
+                           flash_job_cb callback, void *context);
+
+/**
+ *  Free everything that a job owns. A running job is abandoned. A job which
+ *  was never set up is left alone.
+ *
+ *  @param job The job
+ */
+extern void flash_job_free (struct flash_job *job);
+
+/**
+ *  Open a port and start a session on it. Whatever the job was left with by
+ *  an earlier run is released first.
+ *
+ *  @param job The job
+ *  @param path Path to the serial port
+ *  @param baudrate Baudrate that the port should be opened with
+ *  @param hex The image to be written
+ *  @param options Options for the session
+ */
+extern void flash_job_start (struct flash_job *job, const char *path,
+                             int baudrate, struct intel_hex_file *hex,
+                             const struct flash_options *options);
+
+/**
+ *  Start a session on a port which is already open. The job takes ownership of
+ *  the port.
+ *
+ *  @param job The job
+ *  @param port The port
+ *  @param hex The image to be written
+ *  @param options Options for the session
+ */
+extern void flash_job_start_on_port (struct flash_job *job,
+                                     struct serial_port *port,
+                                     struct intel_hex_file *hex,
+                                     const struct flash_options *options);
+
+/**
+ *  Close a job's port and free its session once its results have been read.
+ *
+ *  @param job The job
+ */
+extern void flash_job_release (struct flash_job *job);
+
+#endif /* flash_job_h */
@@ -0,0 +1,252 @@
+//
+//  flash-plan.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#include "flash-plan.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bootloader-commands.h"
+
+/** Maximum number of rows erased by a single command */
+#define FLASH_PLAN_MAX_ERASE_ROWS   256
+
+
+static const char *const flash_plan_step_names[] = {
+    [FLASH_PLAN_ERASE] = "erase",
+    [FLASH_PLAN_WRITE] = "write",
+    [FLASH_PLAN_VERIFY] = "verify"
+};
+
+
+/**
+ *  Add a command to a plan.
+ *
+ *  @return 0 if successfull
+ */
+static int flash_plan_add (struct flash_plan *plan, int *capacity,
+                           uint32_t address, uint16_t length, uint8_t *data)
+{
+    if (plan->num_commands == *capacity) {
+        *capacity = (*capacity == 0) ? 256 : (*capacity * 2);
+        struct flash_plan_command *commands = realloc(plan->commands,
+                                    (size_t)*capacity * sizeof(*commands));
+        if (commands == NULL) {
+            fprintf(stderr, "Could not allocate memory for plan.\n");
+            return -1;
+        }
+        plan->commands = commands;
+    }
+    
+    struct flash_plan_command *command = &plan->commands[plan->num_commands++];
+    command->address = address;
+    command->length = length;
+    command->data = data;
+    return 0;
+}
+
+/**
+ *  Add the erase commands for the application area.
+ *
+ *  @return 0 if successfull
+ */
+static int flash_plan_add_erase (struct flash_plan *plan, int *capacity)
+{
+    int rows = (VERIFY_APP_END - VERIFY_APP_START) / plan->erase_row_size;
+    // The length of each command is given to the bootloader operation in
+    // bytes, so it has to fit in 16 bits
+    int max_rows = UINT16_MAX / plan->erase_row_size;
+    if (max_rows > FLASH_PLAN_MAX_ERASE_ROWS) {
+        max_rows = FLASH_PLAN_MAX_ERASE_ROWS;
+    }
+    
+    uint32_t address = VERIFY_APP_START;
+    while (rows > 0) {
+        int n = (rows > max_rows) ? max_rows : rows;
+        uint16_t length = (uint16_t)(n * plan->erase_row_size);
+        
+        if (flash_plan_add(plan, capacity, address, length, NULL) != 0) {
+            return -1;
+        }
+        address += length;
+        rows -= n;
+    }
+    return 0;
+}
+
+/**
+ *  Add the write commands for the image. Erased flash reads as 0xFF, so
+ *  pieces of the application area which would only write 0xFF are left out.
+ *  They are still checked when the image is verified.
+ *
+ *  @return 0 if successfull
+ */
+static int flash_plan_add_write (struct flash_plan *plan, int *capacity,
+                                 struct intel_hex_file *hex)
+{
+    struct intel_hex_record *record = intel_hex_get_first_record(hex);
+    while (record != NULL) {
+        uint8_t *data;
+        uint32_t address;
+        uint8_t length;
+        record = intel_hex_get_next_record(record, &data, &address, &length);
+        
+        for (uint16_t offset = 0; offset < length;
+             offset += plan->write_latch_size) {
+            uint16_t n = length - offset;
+            if (n > plan->write_latch_size) {
+                n = plan->write_latch_size;
+            }
+            if (flash_plan_is_blank(address + offset, data + offset, n)) {
+                plan->blank_writes++;
+                continue;
+            }
+            if (flash_plan_add(plan, capacity, address + offset, n,
+                               data + offset) != 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+
+int flash_plan_init (struct intel_hex_file *hex, uint8_t erase_row_size,
+                     uint8_t write_latch_size, struct flash_plan **plan)
+{
+    if ((erase_row_size == 0) || (write_latch_size == 0)) {
+        fprintf(stderr, "Invalid erase row or write latch size.\n");
+        return -1;
+    }
+    
+    struct flash_plan *p = calloc(1, sizeof(struct flash_plan));
+    if (p == NULL) {
+        fprintf(stderr, "Could not allocate memory for plan.\n");
+        return -1;
+    }
+    p->erase_row_size = erase_row_size;
+    p->write_latch_size = write_latch_size;
+    
+    int capacity = 0;
+    
+    p->first[FLASH_PLAN_ERASE] = p->num_commands;
+    if (flash_plan_add_erase(p, &capacity) != 0) {
+        goto free_plan;
+    }
+    
+    p->first[FLASH_PLAN_WRITE] = p->num_commands;
+    if (flash_plan_add_write(p, &capacity, hex) != 0) {
+        goto free_plan;
+    }
+    
+    p->first[FLASH_PLAN_VERIFY] = p->num_commands;
+    if (verify_plan_init(hex, &p->verify) != 0) {
+        goto free_plan;
+    }
+    for (int i = 0; i < p->verify->num_ranges; i++) {
+        struct verify_range *range = &p->verify->ranges[i];
+        if (flash_plan_add(p, &capacity, range->address, range->length,
+                           NULL) != 0) {
+            goto free_plan;
+        }
+    }
+    p->first[FLASH_PLAN_NUM_STEPS] = p->num_commands;
+    
+    for (int step = 0; step < FLASH_PLAN_NUM_STEPS; step++) {
+        for (int i = p->first[step]; i < p->first[step + 1]; i++) {
+            p->bytes[step] += p->commands[i].length;
+        }
+    }
+    
+    *plan = p;
+    return 0;
+    
+free_plan:
+    flash_plan_free(p);
+    return -1;
+}
+
+void flash_plan_free (struct flash_plan *plan)
+{
+    if (plan->verify != NULL) {
+        verify_plan_free(plan->verify);
+    }
+    free(plan->commands);
+    free(plan);
+}
+
+void flash_plan_cost (const struct flash_plan *plan,
+                      enum flash_plan_step step, int baudrate, long latency,
+                      struct flash_plan_cost *cost)
+{
+    cost->commands = plan->first[step + 1] - plan->first[step];
+    cost->bytes_tx = 0;
+    cost->bytes_rx = 0;
+    cost->duration = 0;
+    
+    for (int i = plan->first[step]; i < plan->first[step + 1]; i++) {
+        const struct flash_plan_command *command = &plan->commands[i];
+        uint64_t tx = sizeof(struct rn_bootloader_cmd_pkt);
+        uint64_t rx = sizeof(struct rn_bootloader_rsp_status);
+        uint64_t busy = 0;
+        
+        switch (step) {
+            case FLASH_PLAN_ERASE:
+                busy = (uint64_t)(command->length / plan->erase_row_size) *
+                            FLASH_PLAN_ERASE_ROW_TIME;
+                break;
+            case FLASH_PLAN_WRITE:
+                tx += command->length;
+                busy = FLASH_PLAN_WRITE_TIME;
+                break;
+            case FLASH_PLAN_VERIFY:
+            case FLASH_PLAN_NUM_STEPS:
+                rx = sizeof(struct rn_bootloader_rsp_checksum);
+                break;
+        }
+        
+        cost->bytes_tx += tx;
+        cost->bytes_rx += rx;
+        // 8N1 framing, 10 bits per byte
+        cost->duration += (((tx + rx) * UINT64_C(10000000)) /
+                                (uint64_t)baudrate) + (uint64_t)latency + busy;
+    }
+}
+
+int flash_plan_is_blank (uint32_t address, const uint8_t *data,
+                         uint32_t length)
+{
+    // Only the application area is erased before it is written
+    if ((address < VERIFY_APP_START) ||
+            ((address + length) > VERIFY_APP_END)) {
+        return 0;
+    }
+    
+    // The data is combined a word at a time without branching, so that the
+    // compiler can use vector instructions for the loop
+    uint64_t words = UINT64_MAX;
+    uint8_t tail = 0xFF;
+    uint32_t i = 0;
+    
+    for (; (i + sizeof(uint64_t)) <= length; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        words &= word;
+    }
+    for (; i < length; i++) {
+        tail &= data[i];
+    }
+    
+    return (words == UINT64_MAX) && (tail == 0xFF);
+}
+
+const char *flash_plan_step_name (enum flash_plan_step step)
+{
+    return flash_plan_step_names[step];
+}
@@ -0,0 +1,147 @@
+//
+//  flash-plan.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef flash_plan_h
+#define flash_plan_h
+
+#include <inttypes.h>
+
+#include "intel-hex.h"
+#include "verify-plan.h"
+
+/** Erase row size of the RN2483's bootloader, for planning without a module */
+#define FLASH_PLAN_ERASE_ROW_SIZE       64
+/** Write latch size of the RN2483's bootloader, for planning without a
+    module */
+#define FLASH_PLAN_WRITE_LATCH_SIZE     64
+/** Time taken by the module to erase a row of flash in microseconds */
+#define FLASH_PLAN_ERASE_ROW_TIME       2800
+/** Time taken by the module to write a latch of flash in microseconds */
+#define FLASH_PLAN_WRITE_TIME           1000
+
+enum flash_plan_step {
+    /** ERASE commands covering the application area */
+    FLASH_PLAN_ERASE,
+    /** WRITE commands for the image */
+    FLASH_PLAN_WRITE,
+    /** CHECKSUM commands to verify the image */
+    FLASH_PLAN_VERIFY,
+    FLASH_PLAN_NUM_STEPS
+};
+
+/**
+ *  A bootloader command to be sent while updating a module.
+ */
+struct flash_plan_command {
+    uint32_t address;
+    /** Number of bytes of flash erased, written or checksummed */
+    uint16_t length;
+    /** Data to be written, from the image */
+    uint8_t *data;
+};
+
+/**
+ *  Every erase, write and checksum command needed to update a module with an
+ *  image, in the order in which they are sent.
+ */
+struct flash_plan {
+    struct flash_plan_command *commands;
+    int num_commands;
+    /** Index of the first command of each step, the commands for a step are
+        together and the last entry is the total number of commands */
+    int first[FLASH_PLAN_NUM_STEPS + 1];
+    /** Number of bytes of flash covered by the commands of each step */
+    uint32_t bytes[FLASH_PLAN_NUM_STEPS];
+    /** Number of write commands left out because they would only have
+        written 0xFF to erased flash */
+    int blank_writes;
+    
+    /** Checksums which the verify commands should return */
+    struct verify_plan *verify;
+    
+    uint8_t erase_row_size;
+    uint8_t write_latch_size;
+};
+
+/**
+ *  Cost of part of a plan.
+ */
+struct flash_plan_cost {
+    int commands;
+    /** Bytes sent to and received from the module */
+    uint64_t bytes_tx;
+    uint64_t bytes_rx;
+    /** Estimated time in microseconds */
+    uint64_t duration;
+};
+
+/**
+ *  Work out the commands needed to update a module. Commands are split up the
+ *  same way as the bootloader operations split them: erases into groups of
+ *  at most 256 rows and writes into pieces no larger than the write latch.
+ *  Writes of nothing but 0xFF to the erased application area are left out.
+ *
+ *  @param hex The image
+ *  @param erase_row_size The bootloader's erase row size
+ *  @param write_latch_size The bootloader's write latch size
+ *  @param plan Pointer to where pointer to new plan should be stored
+ *
+ *  @return 0 if successfull
+ */
+extern int flash_plan_init (struct intel_hex_file *hex, uint8_t erase_row_size,
+                            uint8_t write_latch_size,
+                            struct flash_plan **plan);
+
+/**
+ *  Free a plan.
+ *
+ *  @param plan The plan to be freed
+ */
+extern void flash_plan_free (struct flash_plan *plan);
+
+/**
+ *  Estimate the cost of a step of a plan. Each command takes the time to send
+ *  it and its response at the baud rate, the time the module spends erasing
+ *  or writing and a fixed latency.
+ *
+ *  @param plan The plan
+ *  @param step The step
+ *  @param baudrate The baud rate of the port
+ *  @param latency Time between the end of a command and the start of its
+ *                 response, not counting erasing or writing, in microseconds
+ *  @param cost Pointer to where the cost should be stored
+ */
+extern void flash_plan_cost (const struct flash_plan *plan,
+                             enum flash_plan_step step, int baudrate,
+                             long latency, struct flash_plan_cost *cost);
+
+/**
+ *  Check whether a block of an image need not be written at all. This is the
+ *  case when the block lies within the application area, which is erased
+ *  before anything is written, and every byte of it is 0xFF, which is what
+ *  erased flash reads as.
+ *
+ *  @param address Address of the block
+ *  @param data The block's data
+ *  @param length Number of bytes in the block
+ *
+ *  @return 1 if the block need not be written, 0 otherwise
+ */
+extern int flash_plan_is_blank (uint32_t address, const uint8_t *data,
+                                uint32_t length);
+
+/**
+ *  Get the name of a step.
+ *
+ *  @param step The step
+ *
+ *  @return The name of the step
+ */
+extern const char *flash_plan_step_name (enum flash_plan_step step);
+
+#endif /* flash_plan_h */
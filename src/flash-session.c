@@ -0,0 +1,1174 @@
+//
+//  flash-session.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#include "flash-session.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "probe.h"
+#include "rn2483.h"
+#include "trace.h"
+#include "metrics.h"
+#include "uart-bootloader.h"
+#include "flash-plan.h"
+
+/** Number of ranges which can be waiting to be checked while narrowing down a
+    mismatch */
+#define FLASH_NARROW_DEPTH  16
+/** Number of mismatched rows listed in the error message */
+#define FLASH_MISMATCH_LIST 4
+
+
+struct flash_session {
+    /** Serial connection to module */
+    struct serial_port *port;
+    /** Image being written, shared with other sessions */
+    struct intel_hex_file *hex;
+    
+    flash_session_cb callback;
+    void *context;
+    
+    struct flash_options options;
+    
+    enum flash_phase phase;
+    enum flash_phase failed_phase;
+    
+    /** Finds out whether the module is running its firmware or the
+        bootloader */
+    struct probe probe;
+    
+    /** Bootloader version information */
+    struct rn_bootloader_rsp_version *version;
+    
+    /** Time after which the module is given up on while waiting for it to
+        reset */
+    uint64_t wait_until;
+    /** Timeout for the next attempt to reach the bootloader */
+    long poll_timeout;
+    /** Whether the port was quiet before waiting for the module to reset */
+    int was_quiet;
+    /** Baudrate of the port when the session was created, which the
+        firmware uses */
+    int baudrate;
+    
+    /** Next record to be written or verified */
+    struct intel_hex_record *record;
+    /** Record currently being written or verified */
+    uint8_t *data;
+    uint32_t address;
+    uint8_t length;
+    /** Checksum read back from the module for the current record */
+    uint16_t checksum;
+    
+    int records_total;
+    int records_done;
+    /** Bytes of flash written or verified in the current phase */
+    uint32_t bytes_done;
+    
+    /** Commands used to erase, write and verify flash, made when they are
+        first needed */
+    struct flash_plan *plan;
+    /** Index of the next command in the plan to be sent */
+    int command_index;
+    /** Index of the next range in the plan to be checked */
+    int range_index;
+    /** Range currently being checked */
+    struct verify_range range;
+    /** Length of the range from the plan which is being checked, which stays
+        the same while a range that did not match is narrowed down */
+    uint32_t range_length;
+    /** Parts of ranges which did not match that are still to be checked */
+    struct verify_range narrow[FLASH_NARROW_DEPTH];
+    int num_narrow;
+    /** Rows found not to match the image */
+    uint32_t mismatches[FLASH_MISMATCH_LIST];
+    int num_mismatches;
+    /** Set if verification failed and the module is being reset anyway */
+    int verify_failed;
+    
+    /** Identity of the module and image for the state database */
+    char eui[STATE_DB_ID_LENGTH];
+    char usb[STATE_DB_ID_LENGTH];
+    uint64_t image_hash;
+    /** Index of the next record to be read while spot checking */
+    int record_index;
+    int spot_checks_done;
+    int spot_checks_total;
+    /** Number of times the EUI has been asked for */
+    int identify_attempts;
+    /** Set if the module already held the image */
+    int skipped;
+    
+    /** Progress through the provisioning script */
+    struct rn2483_script script;
+    
+    uint64_t start_time;
+    uint64_t end_time;
+    /** Time at which the current phase was entered */
+    uint64_t phase_time;
+    /** Time spent writing flash */
+    uint64_t write_time;
+    /** Number of bytes of the image written to flash */
+    uint64_t payload_bytes;
+    /** Port statistics when the session started */
+    uint64_t start_tx;
+    uint64_t start_rx;
+    
+    /** Version string embedded in the image, or an empty string */
+    char image_version[FLASH_VERSION_LENGTH];
+    char old_version[FLASH_VERSION_LENGTH];
+    char new_version[FLASH_VERSION_LENGTH];
+    char error[128];
+};
+
+
+static void flash_session_enter (struct flash_session *session,
+                                 enum flash_phase phase);
+
+
+static const char *const flash_phase_names[] = {
+    [FLASH_PHASE_CHECK_VERSION] = "checking version",
+    [FLASH_PHASE_IDENTIFY] = "identifying module",
+    [FLASH_PHASE_CONFIRM] = "waiting for confirmation",
+    [FLASH_PHASE_ENTER_BOOTLOADER] = "erasing firmware",
+    [FLASH_PHASE_WAIT_BOOTLOADER] = "waiting for bootloader",
+    [FLASH_PHASE_BOOTLOADER_VERSION] = "checking bootloader",
+    [FLASH_PHASE_SPOT_CHECK] = "checking flash",
+    [FLASH_PHASE_ERASE] = "erasing flash",
+    [FLASH_PHASE_WRITE] = "writing flash",
+    [FLASH_PHASE_VERIFY] = "verifying",
+    [FLASH_PHASE_RESET] = "reseting",
+    [FLASH_PHASE_WAIT_APPLICATION] = "waiting for firmware",
+    [FLASH_PHASE_NEW_VERSION] = "checking new version",
+    [FLASH_PHASE_PROVISION] = "provisioning",
+    [FLASH_PHASE_DONE] = "done",
+    [FLASH_PHASE_FAILED] = "failed",
+    [FLASH_PHASE_CANCELLED] = "cancelled"
+};
+
+/** Error message used when the operation for each phase fails */
+static const char *const flash_phase_errors[] = {
+    [FLASH_PHASE_CHECK_VERSION] = "Module did not respond.",
+    [FLASH_PHASE_ENTER_BOOTLOADER] = "Could not erase firmware.",
+    [FLASH_PHASE_WAIT_BOOTLOADER] = "Bootloader did not respond.",
+    [FLASH_PHASE_BOOTLOADER_VERSION] = "Could not get bootloader version.",
+    [FLASH_PHASE_SPOT_CHECK] = "Failed to check record.",
+    [FLASH_PHASE_ERASE] = "Failed to erase flash.",
+    [FLASH_PHASE_WRITE] = "Failed to write record.",
+    [FLASH_PHASE_VERIFY] = "Failed to check flash.",
+    [FLASH_PHASE_RESET] = "Failed to reset device.",
+    [FLASH_PHASE_WAIT_APPLICATION] = "Could not wait for firmware.",
+    [FLASH_PHASE_NEW_VERSION] = "Could not get new firmware version.",
+    [FLASH_PHASE_PROVISION] = "Could not run provisioning script."
+};
+
+
+/**
+ *  Record the end of the current phase in the trace and metrics, a new phase
+ *  starts now.
+ *
+ *  @param session The session which is changing phase
+ */
+static void flash_session_trace_phase (struct flash_session *session)
+{
+    uint64_t now = latency_stats_now();
+    
+    if (session->phase_time != 0) {
+        uint64_t duration = now - session->phase_time;
+        
+        if (session->phase == FLASH_PHASE_WRITE) {
+            session->write_time += duration;
+        }
+        if (trace_enabled) {
+            trace_complete(serial_port_get_name(session->port), "phase",
+                           flash_phase_names[session->phase],
+                           session->phase_time, now, NULL);
+        }
+        if (metrics_enabled) {
+            metrics_phase(flash_phase_names[session->phase], duration);
+        }
+    }
+    session->phase_time = now;
+}
+
+/**
+ *  Switch the port to the baudrate used in a phase. The bootloader phases use
+ *  the bootloader baudrate if one was given, everything else uses the
+ *  baudrate that the port was opened with.
+ *
+ *  @param session The session
+ *  @param phase The phase being entered
+ *
+ *  @return 0 if successfull
+ */
+static int flash_session_set_baud (struct flash_session *session,
+                                   enum flash_phase phase)
+{
+    if (session->options.bootloader_baudrate == 0) {
+        return 0;
+    }
+    
+    int bootloader = ((phase >= FLASH_PHASE_WAIT_BOOTLOADER) &&
+                      (phase <= FLASH_PHASE_RESET));
+    return serial_port_set_baud(session->port, bootloader ?
+                                    session->options.bootloader_baudrate :
+                                    session->baudrate);
+}
+
+/**
+ *  Finish a session.
+ *
+ *  @param session The session which has finished
+ *  @param phase The final phase of the session
+ */
+static void flash_session_finish (struct flash_session *session,
+                                  enum flash_phase phase)
+{
+    flash_session_trace_phase(session);
+    session->end_time = latency_stats_now();
+    session->phase = phase;
+    // Leave the port at the baudrate it was opened with
+    flash_session_set_baud(session, phase);
+    
+    if (metrics_enabled) {
+        struct serial_port_stats *stats = serial_port_get_stats(session->port);
+        struct metrics_session info = {
+            .port = serial_port_get_name(session->port),
+            .result = flash_phase_names[phase],
+            .payload_bytes = session->payload_bytes,
+            .write_time = session->write_time,
+            .bytes_tx = stats->bytes_tx - session->start_tx,
+            .bytes_rx = stats->bytes_rx - session->start_rx
+        };
+        metrics_session_done(&info);
+    }
+    
+    session->callback(session, FLASH_EVENT_DONE, session->context);
+}
+
+/**
+ *  Fail a session with the error message for the phase that it is in.
+ *
+ *  @param session The session which has failed
+ */
+static void flash_session_fail (struct flash_session *session)
+{
+    if (session->error[0] == '\0') {
+        const char *msg = flash_phase_errors[session->phase];
+        snprintf(session->error, sizeof(session->error), "%s",
+                 (msg != NULL) ? msg : "Unknown error.");
+    }
+    
+    session->failed_phase = session->phase;
+    flash_session_finish(session, FLASH_PHASE_FAILED);
+}
+
+/**
+ *  Make the plan for erasing, writing and verifying flash if it has not been
+ *  made yet.
+ *
+ *  @param session The session
+ *
+ *  @return 0 if successfull
+ */
+static int flash_session_make_plan (struct flash_session *session);
+
+/**
+ *  Start sending the next erase or write command in the plan.
+ *
+ *  @param session The session
+ *
+ *  @return 0 if successfull
+ */
+static int flash_session_next_command (struct flash_session *session);
+
+/**
+ *  Start reading back the checksum of the next range to be verified.
+ *
+ *  @param session The session
+ *
+ *  @return 0 if successfull
+ */
+static int flash_session_next_range (struct flash_session *session);
+
+/**
+ *  Start reading back the checksum of the next row to be spot checked.
+ *
+ *  @param session The session
+ *
+ *  @return 0 if successfull
+ */
+static int flash_session_next_spot_check (struct flash_session *session);
+
+/**
+ *  Calculate the checksum that the module should report for the current
+ *  record.
+ *
+ *  @param session The session
+ *  @param checksum Pointer to where the checksum should be stored
+ *
+ *  @return 0 if successfull
+ */
+static int flash_session_calc_checksum (struct flash_session *session,
+                                        uint16_t *checksum)
+{
+    if (session->address == 0x300000) {
+        // Configuration row is handled specially because masks need to be
+        // applied
+        if (session->length != 14) {
+            snprintf(session->error, sizeof(session->error),
+                     "Configuration row has unexpected length %d.",
+                     session->length);
+            return -1;
+        }
+        *checksum = rn_bootloader_calc_config_checksum(session->data);
+    } else {
+        *checksum = rn_bootloader_calc_checksum(session->data,
+                                                session->length);
+    }
+    return 0;
+}
+
+/**
+ *  Get the state database record for a session's module if it says that the
+ *  module holds the session's image.
+ *
+ *  @param session The session
+ *
+ *  @return The record, or NULL
+ */
+static const struct state_db_record *flash_session_get_state (
+                                            struct flash_session *session)
+{
+    if ((session->options.state == NULL) ||
+            (session->options.mode != FLASH_MODE_UPDATE)) {
+        return NULL;
+    }
+    
+    const struct state_db_record *record = state_db_lookup(
+                                                session->options.state,
+                                                session->eui, session->usb);
+    if ((record == NULL) || (record->image_hash != session->image_hash)) {
+        return NULL;
+    }
+    return record;
+}
+
+/**
+ *  Record in the state database what the module now holds.
+ *
+ *  @param session The session
+ *  @param version The version of the firmware, or an empty string if it is
+ *                 not known yet
+ */
+static void flash_session_save_state (struct flash_session *session,
+                                      const char *version)
+{
+    if ((session->options.state != NULL) &&
+            (session->options.mode == FLASH_MODE_UPDATE)) {
+        state_db_update(session->options.state, session->eui, session->usb,
+                        session->image_hash, version);
+    }
+}
+
+/**
+ *  Complete a session once the module runs the new firmware, provisioning it
+ *  first if there is a script.
+ *
+ *  @param session The session
+ */
+static void flash_session_complete (struct flash_session *session)
+{
+    if (session->options.provision != NULL) {
+        flash_session_enter(session, FLASH_PHASE_PROVISION);
+    } else {
+        flash_session_finish(session, FLASH_PHASE_DONE);
+    }
+}
+
+/**
+ *  Find out whether a module already has the image. It does if it runs the
+ *  version embedded in the image, or if the state database says that it was
+ *  last verified with the same image and it still runs the same version.
+ *
+ *  @param session The session
+ *
+ *  @return 1 if the module does not need to be updated
+ */
+static int flash_session_is_current (struct flash_session *session)
+{
+    if (session->options.force) {
+        return 0;
+    } else if ((session->image_version[0] != '\0') &&
+               (strcmp(session->image_version, session->old_version) == 0)) {
+        return 1;
+    }
+    
+    const struct state_db_record *record = flash_session_get_state(session);
+    
+    return ((record != NULL) && (record->version[0] != '\0') &&
+            (strcmp(record->version, session->old_version) == 0));
+}
+
+/**
+ *  Continue once the running firmware version and the module's identity are
+ *  known. If the module already has the image there is nothing to do.
+ *
+ *  @param session The session
+ */
+static void flash_session_checked (struct flash_session *session)
+{
+    if (flash_session_is_current(session)) {
+        session->skipped = 1;
+        strcpy(session->new_version, session->old_version);
+        flash_session_save_state(session, session->new_version);
+        flash_session_complete(session);
+    } else if (session->options.confirm) {
+        session->phase = FLASH_PHASE_CONFIRM;
+        session->callback(session, FLASH_EVENT_CONFIRM, session->context);
+    } else {
+        flash_session_enter(session, FLASH_PHASE_ENTER_BOOTLOADER);
+    }
+}
+
+/**
+ *  Finish verifying, once every range has been checked.
+ *
+ *  @param session The session
+ */
+static void flash_session_verified (struct flash_session *session)
+{
+    if (session->num_mismatches != 0) {
+        int length = snprintf(session->error, sizeof(session->error),
+                              "Flash differs from image in %d %s (",
+                              session->num_mismatches,
+                              (session->num_mismatches == 1) ? "row" : "rows");
+        for (int i = 0; (i < session->num_mismatches) &&
+                        (i < FLASH_MISMATCH_LIST); i++) {
+            length += snprintf(session->error + length,
+                               sizeof(session->error) - (size_t)length,
+                               "%s0x%04" PRIX32, (i == 0) ? "" : ", ",
+                               session->mismatches[i]);
+        }
+        snprintf(session->error + length,
+                 sizeof(session->error) - (size_t)length, "%s).",
+                 (session->num_mismatches > FLASH_MISMATCH_LIST) ? ", ..." :
+                 "");
+        
+        if (session->options.mode != FLASH_MODE_VERIFY) {
+            flash_session_fail(session);
+            return;
+        }
+        // Nothing has been changed, so the module can still be reset
+        session->verify_failed = 1;
+    } else {
+        flash_session_save_state(session, "");
+    }
+    
+    flash_session_enter(session, FLASH_PHASE_RESET);
+}
+
+/**
+ *  Handle the checksum for a range read back while verifying. A range which
+ *  does not match is split up until the rows which differ are found.
+ *
+ *  @param session The session
+ */
+static void flash_session_verify_step (struct flash_session *session)
+{
+    struct verify_range *range = &session->range;
+    
+    if (session->checksum != range->checksum) {
+        struct verify_range *first = &session->narrow[session->num_narrow + 1];
+        struct verify_range *second = &session->narrow[session->num_narrow];
+        
+        if (((session->num_narrow + 2) > FLASH_NARROW_DEPTH) ||
+                (verify_plan_split(session->plan->verify, range, first,
+                                   second) != 0)) {
+            if (session->num_mismatches < FLASH_MISMATCH_LIST) {
+                session->mismatches[session->num_mismatches] = range->address;
+            }
+            session->num_mismatches++;
+        } else {
+            // Check the first half next
+            session->num_narrow += 2;
+        }
+    }
+    
+    if (session->num_narrow == 0) {
+        session->records_done = session->range_index;
+        session->bytes_done += session->range_length;
+        session->callback(session, FLASH_EVENT_PROGRESS, session->context);
+    }
+    
+    if ((session->num_narrow != 0) ||
+            (session->range_index < session->plan->verify->num_ranges)) {
+        if (flash_session_next_range(session) != 0) {
+            flash_session_fail(session);
+        }
+    } else {
+        flash_session_verified(session);
+    }
+}
+
+/**
+ *  Handle the successfull completion of the operation for the current phase.
+ *
+ *  @param session The session
+ */
+static void flash_session_step (struct flash_session *session)
+{
+    switch (session->phase) {
+        case FLASH_PHASE_CHECK_VERSION:
+            if (session->options.mode == FLASH_MODE_VERSION) {
+                flash_session_finish(session, FLASH_PHASE_DONE);
+            } else if (session->options.state != NULL) {
+                flash_session_enter(session, FLASH_PHASE_IDENTIFY);
+            } else {
+                flash_session_checked(session);
+            }
+            break;
+        case FLASH_PHASE_IDENTIFY:
+            if (session->new_version[0] != '\0') {
+                // Identified after the update
+                flash_session_save_state(session, session->new_version);
+                flash_session_complete(session);
+            } else {
+                flash_session_checked(session);
+            }
+            break;
+        case FLASH_PHASE_ENTER_BOOTLOADER:
+            flash_session_enter(session, FLASH_PHASE_WAIT_BOOTLOADER);
+            break;
+        case FLASH_PHASE_WAIT_BOOTLOADER:
+            // The bootloader has already answered with its version
+            flash_session_trace_phase(session);
+            session->phase = FLASH_PHASE_BOOTLOADER_VERSION;
+            session->callback(session, FLASH_EVENT_PHASE, session->context);
+            flash_session_step(session);
+            break;
+        case FLASH_PHASE_BOOTLOADER_VERSION:
+            if (session->options.mode == FLASH_MODE_VERIFY) {
+                flash_session_enter(session, FLASH_PHASE_VERIFY);
+            } else if (session->options.recover &&
+                       (session->records_total != 0) &&
+                       (flash_session_get_state(session) != NULL)) {
+                // The image may already have been written by an update that
+                // failed after verifying
+                flash_session_enter(session, FLASH_PHASE_SPOT_CHECK);
+            } else {
+                flash_session_enter(session, FLASH_PHASE_ERASE);
+            }
+            break;
+        case FLASH_PHASE_SPOT_CHECK:
+            ;
+            uint16_t spot_checksum;
+            if (flash_session_calc_checksum(session, &spot_checksum) != 0) {
+                flash_session_fail(session);
+                return;
+            }
+        
+            if (session->checksum != spot_checksum) {
+                flash_session_enter(session, FLASH_PHASE_ERASE);
+            } else if (++session->spot_checks_done <
+                       session->spot_checks_total) {
+                if (flash_session_next_spot_check(session) != 0) {
+                    flash_session_fail(session);
+                }
+            } else {
+                session->skipped = 1;
+                flash_session_enter(session, FLASH_PHASE_RESET);
+            }
+            break;
+        case FLASH_PHASE_ERASE:
+            if (session->command_index <
+                    session->plan->first[FLASH_PLAN_WRITE]) {
+                if (flash_session_next_command(session) != 0) {
+                    flash_session_fail(session);
+                }
+            } else {
+                flash_session_enter(session, FLASH_PHASE_WRITE);
+            }
+            break;
+        case FLASH_PHASE_VERIFY:
+            flash_session_verify_step(session);
+            break;
+        case FLASH_PHASE_WRITE:
+            ;
+            struct flash_plan_command *written =
+                        &session->plan->commands[session->command_index - 1];
+            session->records_done++;
+            session->bytes_done += written->length;
+            session->payload_bytes += written->length;
+            session->callback(session, FLASH_EVENT_PROGRESS, session->context);
+        
+            if (session->command_index <
+                    session->plan->first[FLASH_PLAN_VERIFY]) {
+                if (flash_session_next_command(session) != 0) {
+                    flash_session_fail(session);
+                }
+            } else {
+                flash_session_enter(session, FLASH_PHASE_VERIFY);
+            }
+            break;
+        case FLASH_PHASE_RESET:
+            if (session->options.mode != FLASH_MODE_VERIFY) {
+                flash_session_enter(session, FLASH_PHASE_WAIT_APPLICATION);
+            } else if (session->verify_failed) {
+                session->failed_phase = FLASH_PHASE_VERIFY;
+                flash_session_finish(session, FLASH_PHASE_FAILED);
+            } else {
+                flash_session_finish(session, FLASH_PHASE_DONE);
+            }
+            break;
+        case FLASH_PHASE_WAIT_APPLICATION:
+            flash_session_enter(session, FLASH_PHASE_NEW_VERSION);
+            break;
+        case FLASH_PHASE_NEW_VERSION:
+            if ((session->options.state != NULL) &&
+                    (session->eui[0] == '\0')) {
+                flash_session_enter(session, FLASH_PHASE_IDENTIFY);
+            } else {
+                flash_session_save_state(session, session->new_version);
+                flash_session_complete(session);
+            }
+            break;
+        case FLASH_PHASE_PROVISION:
+            flash_session_finish(session, FLASH_PHASE_DONE);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ *  Callback for completion of module and bootloader operations.
+ */
+static void flash_session_op_done (struct serial_port *port, int status,
+                                   void *context);
+
+/**
+ *  Ask the bootloader for its version to find out whether the module has
+ *  finished resetting.
+ *
+ *  @param session The session
+ *
+ *  @return 0 if successfull
+ */
+static int flash_session_poll_bootloader (struct flash_session *session)
+{
+    // Drop anything left from an earlier attempt which was cut short
+    free(session->version);
+    session->version = NULL;
+    serial_port_discard_input(session->port);
+    
+    return rn_bootloader_get_version_info_async(session->port,
+                                                &session->version,
+                                                session->poll_timeout,
+                                                flash_session_op_done,
+                                                session);
+}
+
+static void flash_session_op_done (struct serial_port *port, int status,
+                                   void *context)
+{
+    struct flash_session *session = (struct flash_session *)context;
+    
+    if (session->phase == FLASH_PHASE_WAIT_BOOTLOADER) {
+        if ((status != 0) && (latency_stats_now() < session->wait_until)) {
+            // Still resetting, try again with a longer timeout in case the
+            // bootloader is only slow to answer
+            session->poll_timeout *= 2;
+            if (session->poll_timeout > FLASH_POLL_TIMEOUT_MAX) {
+                session->poll_timeout = FLASH_POLL_TIMEOUT_MAX;
+            }
+            if (flash_session_poll_bootloader(session) == 0) {
+                return;
+            }
+        }
+        
+        serial_port_set_quiet(port, session->was_quiet);
+        if (status != 0) {
+            flash_session_fail(session);
+        } else {
+            flash_session_step(session);
+        }
+    } else if (session->phase == FLASH_PHASE_WAIT_APPLICATION) {
+        // The firmware prints its version once it has started, but older
+        // firmware may not, in which case the module is asked anyway
+        serial_port_set_quiet(port, session->was_quiet);
+        flash_session_step(session);
+    } else if (session->phase == FLASH_PHASE_IDENTIFY) {
+        if ((status == 0) && ((strlen(session->eui) != 16) ||
+                (strspn(session->eui, "0123456789ABCDEFabcdef") != 16)) &&
+                (session->identify_attempts++ == 0)) {
+            // The line may have been left over from the previous command,
+            // such as the version that the firmware prints when it starts
+            if (rn2483_get_hweui_async(port, session->eui, STATE_DB_ID_LENGTH,
+                                       FLASH_APP_TIMEOUT,
+                                       flash_session_op_done, session) == 0) {
+                return;
+            }
+        }
+        
+        // Older firmware may not know its EUI, that only means the module
+        // can not be found in the state database
+        if ((status != 0) || (strlen(session->eui) != 16) ||
+                (strspn(session->eui, "0123456789ABCDEFabcdef") != 16)) {
+            session->eui[0] = '\0';
+        }
+        flash_session_step(session);
+    } else if ((status != 0) && (session->phase == FLASH_PHASE_PROVISION)) {
+        const struct rn2483_command *cmd =
+                        &session->script.commands[session->script.num_done];
+        if (session->script.response[0] != '\0') {
+            snprintf(session->error, sizeof(session->error),
+                     "Provisioning command \"%.40s\" got \"%.40s\".",
+                     cmd->command, session->script.response);
+        } else {
+            snprintf(session->error, sizeof(session->error),
+                     "No response to provisioning command \"%.40s\".",
+                     cmd->command);
+        }
+        flash_session_fail(session);
+    } else if (status != 0) {
+        flash_session_fail(session);
+    } else {
+        flash_session_step(session);
+    }
+}
+
+/**
+ *  Callback for completion of the probe which finds out what state the module
+ *  is in.
+ */
+static void flash_session_probed (struct probe *probe, void *context)
+{
+    struct flash_session *session = (struct flash_session *)context;
+    
+    switch (probe->state) {
+        case PROBE_STATE_APPLICATION:
+            snprintf(session->old_version, sizeof(session->old_version), "%s",
+                     probe->version);
+            flash_session_step(session);
+            break;
+        case PROBE_STATE_BOOTLOADER:
+            if (session->options.mode == FLASH_MODE_VERSION) {
+                snprintf(session->error, sizeof(session->error),
+                         "Module is in the bootloader.");
+                flash_session_fail(session);
+                break;
+            }
+            // The firmware is already gone, carry on from wherever an earlier
+            // update stopped
+            session->options.recover = 1;
+            flash_session_enter(session, FLASH_PHASE_BOOTLOADER_VERSION);
+            break;
+        case PROBE_STATE_NONE:
+            flash_session_fail(session);
+            break;
+    }
+}
+
+static int flash_session_make_plan (struct flash_session *session)
+{
+    if (session->plan != NULL) {
+        return 0;
+    }
+    
+    return flash_plan_init(session->hex,
+                (uint8_t)rn_bootloader_get_erase_size(session->version),
+                (uint8_t)rn_bootloader_get_write_size(session->version),
+                &session->plan);
+}
+
+static int flash_session_next_command (struct flash_session *session)
+{
+    struct flash_plan_command *command =
+                        &session->plan->commands[session->command_index++];
+    
+    if (session->phase == FLASH_PHASE_ERASE) {
+        return rn_bootloader_erase_async(session->port, command->address,
+                                         command->length, session->version,
+                                         flash_session_op_done, session);
+    }
+    
+    return rn_bootloader_write_async(session->port, command->address,
+                                     command->length, command->data,
+                                     session->version, flash_session_op_done,
+                                     session);
+}
+
+static int flash_session_next_range (struct flash_session *session)
+{
+    if (session->num_narrow != 0) {
+        session->range = session->narrow[--session->num_narrow];
+    } else {
+        session->range = session->plan->verify->ranges[session->range_index++];
+        session->range_length = session->range.length;
+    }
+    
+    return rn_bootloader_checksum_async(session->port, session->range.address,
+                                        session->range.length,
+                                        &session->checksum,
+                                        flash_session_op_done, session);
+}
+
+static int flash_session_next_spot_check (struct flash_session *session)
+{
+    /* Rows are spread evenly from the first record to the last */
+    int target = 0;
+    if (session->spot_checks_total > 1) {
+        target = (session->spot_checks_done * (session->records_total - 1)) /
+                    (session->spot_checks_total - 1);
+    }
+    
+    while (session->record_index <= target) {
+        session->record = intel_hex_get_next_record(session->record,
+                                                    &session->data,
+                                                    &session->address,
+                                                    &session->length);
+        session->record_index++;
+    }
+    
+    return rn_bootloader_checksum_async(session->port, session->address,
+                                        session->length, &session->checksum,
+                                        flash_session_op_done, session);
+}
+
+/**
+ *  Move a session into a new phase and start the operation for that phase.
+ *
+ *  @param session The session
+ *  @param phase The phase to be entered
+ */
+static void flash_session_enter (struct flash_session *session,
+                                 enum flash_phase phase)
+{
+    flash_session_trace_phase(session);
+    session->phase = phase;
+    // Progress is counted from the start of each phase
+    session->records_done = 0;
+    session->bytes_done = 0;
+    
+    // The totals reported from the phase event on come from the plan
+    if (((phase == FLASH_PHASE_ERASE) || (phase == FLASH_PHASE_VERIFY)) &&
+            (flash_session_make_plan(session) != 0)) {
+        flash_session_fail(session);
+        return;
+    }
+    session->callback(session, FLASH_EVENT_PHASE, session->context);
+    
+    int ret = flash_session_set_baud(session, phase);
+    if (ret != 0) {
+        flash_session_fail(session);
+        return;
+    }
+    
+    switch (phase) {
+        case FLASH_PHASE_CHECK_VERSION:
+            ret = probe_start(&session->probe, session->port,
+                              FLASH_APP_TIMEOUT, flash_session_probed,
+                              session);
+            break;
+        case FLASH_PHASE_IDENTIFY:
+            session->identify_attempts = 0;
+            ret = rn2483_get_hweui_async(session->port, session->eui,
+                                         STATE_DB_ID_LENGTH, FLASH_APP_TIMEOUT,
+                                         flash_session_op_done, session);
+            break;
+        case FLASH_PHASE_ENTER_BOOTLOADER:
+            if (session->options.state != NULL) {
+                state_db_forget(session->options.state, session->eui,
+                                session->usb);
+            }
+            ret = rn2483_erase_async(session->port, flash_session_op_done,
+                                     session);
+            break;
+        case FLASH_PHASE_WAIT_BOOTLOADER:
+            session->wait_until = latency_stats_now() +
+                    ((uint64_t)session->options.reset_timeout * 1000);
+            session->poll_timeout = FLASH_POLL_TIMEOUT;
+            session->was_quiet = serial_port_set_quiet(session->port, 1);
+            ret = flash_session_poll_bootloader(session);
+            if (ret != 0) {
+                serial_port_set_quiet(session->port, session->was_quiet);
+            }
+            break;
+        case FLASH_PHASE_WAIT_APPLICATION:
+            session->was_quiet = serial_port_set_quiet(session->port, 1);
+            ret = rn2483_wait_line_async(session->port, session->new_version,
+                                         FLASH_VERSION_LENGTH,
+                                         session->options.reset_timeout,
+                                         flash_session_op_done, session);
+            if (ret != 0) {
+                serial_port_set_quiet(session->port, session->was_quiet);
+            }
+            break;
+        case FLASH_PHASE_BOOTLOADER_VERSION:
+            ret = rn_bootloader_get_version_info_async(session->port,
+                                                       &session->version,
+                                                       RN_BOOTLOADER_TIMEOUT,
+                                                       flash_session_op_done,
+                                                       session);
+            break;
+        case FLASH_PHASE_SPOT_CHECK:
+            session->record = intel_hex_get_first_record(session->hex);
+            session->record_index = 0;
+            session->spot_checks_done = 0;
+            session->spot_checks_total = STATE_DB_SPOT_CHECKS;
+            if (session->spot_checks_total > session->records_total) {
+                session->spot_checks_total = session->records_total;
+            }
+            ret = flash_session_next_spot_check(session);
+            break;
+        case FLASH_PHASE_ERASE:
+            if (session->options.state != NULL) {
+                state_db_forget(session->options.state, session->eui,
+                                session->usb);
+            }
+            session->command_index = session->plan->first[FLASH_PLAN_ERASE];
+            ret = flash_session_next_command(session);
+            break;
+        case FLASH_PHASE_WRITE:
+            session->command_index = session->plan->first[FLASH_PLAN_WRITE];
+        
+            if (session->command_index ==
+                    session->plan->first[FLASH_PLAN_VERIFY]) {
+                // Empty image, nothing to write
+                flash_session_enter(session, FLASH_PHASE_VERIFY);
+                return;
+            }
+        
+            ret = flash_session_next_command(session);
+            break;
+        case FLASH_PHASE_VERIFY:
+            session->range_index = 0;
+            session->num_narrow = 0;
+            session->num_mismatches = 0;
+        
+            if (session->plan->verify->num_ranges == 0) {
+                // Empty image, nothing to verify
+                flash_session_verified(session);
+                return;
+            }
+        
+            ret = flash_session_next_range(session);
+            break;
+        case FLASH_PHASE_RESET:
+            ret = rn_bootloader_reset_async(session->port,
+                                            flash_session_op_done, session);
+            break;
+        case FLASH_PHASE_NEW_VERSION:
+            // Drop the version that the firmware prints when it starts so
+            // that the response to the next command is not mistaken for it
+            serial_port_discard_input(session->port);
+            ret = rn2483_get_version_async(session->port, session->new_version,
+                                           FLASH_VERSION_LENGTH,
+                                           FLASH_APP_TIMEOUT,
+                                           flash_session_op_done, session);
+            break;
+        case FLASH_PHASE_PROVISION:
+            session->script.commands = session->options.provision->commands;
+            session->script.num_commands =
+                                    session->options.provision->num_commands;
+            ret = rn2483_run_script_async(session->port, &session->script,
+                                          flash_session_op_done, session);
+            break;
+        default:
+            break;
+    }
+    
+    if (ret != 0) {
+        flash_session_fail(session);
+    }
+}
+
+
+int flash_image_version (struct intel_hex_file *hex, char *buffer,
+                         size_t length)
+{
+    return intel_hex_find_string(hex, FLASH_VERSION_PREFIX, buffer, length);
+}
+
+void flash_options_init (struct flash_options *options)
+{
+    memset(options, 0, sizeof(*options));
+    options->mode = FLASH_MODE_UPDATE;
+    options->confirm = 1;
+    options->reset_timeout = FLASH_RESET_TIMEOUT;
+}
+
+int flash_session_init (struct serial_port *port, struct intel_hex_file *hex,
+                        const struct flash_options *options,
+                        flash_session_cb callback, void *context,
+                        struct flash_session **session)
+{
+    struct flash_session *s = calloc(1, sizeof(struct flash_session));
+    
+    if (s == NULL) {
+        fprintf(stderr, "Could not allocate flash session.\n");
+        return -1;
+    }
+    
+    s->port = port;
+    s->hex = hex;
+    s->options = *options;
+    s->callback = callback;
+    s->context = context;
+    s->records_total = (hex != NULL) ? intel_hex_num_records(hex) : 0;
+    s->baudrate = serial_port_get_baud(port);
+    
+    if ((hex == NULL) || (flash_image_version(hex, s->image_version,
+                                              sizeof(s->image_version)) != 0)) {
+        s->image_version[0] = '\0';
+    }
+    
+    if ((s->options.state != NULL) && (hex != NULL)) {
+        s->image_hash = state_db_image_hash(hex);
+        state_db_usb_serial(serial_port_get_name(port), s->usb,
+                            sizeof(s->usb));
+    }
+    
+    *session = s;
+    return 0;
+}
+
+void flash_session_free (struct flash_session *session)
+{
+    if (session->plan != NULL) {
+        flash_plan_free(session->plan);
+    }
+    free(session->version);
+    free(session);
+}
+
+void flash_session_start (struct flash_session *session)
+{
+    session->start_time = latency_stats_now();
+    session->start_tx = serial_port_get_stats(session->port)->bytes_tx;
+    session->start_rx = serial_port_get_stats(session->port)->bytes_rx;
+    
+    if (session->options.mode == FLASH_MODE_VERIFY) {
+        flash_session_enter(session, FLASH_PHASE_BOOTLOADER_VERSION);
+    } else if (session->options.recover) {
+        flash_session_enter(session, FLASH_PHASE_WAIT_BOOTLOADER);
+    } else {
+        flash_session_enter(session, FLASH_PHASE_CHECK_VERSION);
+    }
+}
+
+void flash_session_confirm (struct flash_session *session, int proceed)
+{
+    if (session->phase != FLASH_PHASE_CONFIRM) {
+        return;
+    }
+    
+    if (proceed) {
+        flash_session_enter(session, FLASH_PHASE_ENTER_BOOTLOADER);
+    } else {
+        flash_session_finish(session, FLASH_PHASE_CANCELLED);
+    }
+}
+
+enum flash_phase flash_session_get_phase (struct flash_session *session)
+{
+    return session->phase;
+}
+
+enum flash_phase flash_session_get_failed_phase (struct flash_session *session)
+{
+    return session->failed_phase;
+}
+
+const char *flash_phase_name (enum flash_phase phase)
+{
+    return flash_phase_names[phase];
+}
+
+struct serial_port *flash_session_get_port (struct flash_session *session)
+{
+    return session->port;
+}
+
+const char *flash_session_get_error (struct flash_session *session)
+{
+    return session->error;
+}
+
+const char *flash_session_get_old_version (struct flash_session *session)
+{
+    return session->old_version;
+}
+
+const char *flash_session_get_new_version (struct flash_session *session)
+{
+    return session->new_version;
+}
+
+int flash_session_get_bootloader_info (struct flash_session *session,
+                                       int *version, int *device_id)
+{
+    if (session->version == NULL) {
+        return -1;
+    }
+    
+    *version = rn_bootloader_get_version(session->version);
+    *device_id = rn_bootloader_get_device_id(session->version);
+    return 0;
+}
+
+void flash_session_get_progress (struct flash_session *session, int *done,
+                                 int *total)
+{
+    *done = session->records_done;
+    *total = session->records_total;
+    
+    if (session->plan == NULL) {
+        return;
+    } else if (session->phase == FLASH_PHASE_WRITE) {
+        // Records are written a latch at a time
+        *total = session->plan->first[FLASH_PLAN_VERIFY] -
+                    session->plan->first[FLASH_PLAN_WRITE];
+    } else if (session->phase == FLASH_PHASE_VERIFY) {
+        // Verification is done in a few large ranges rather than by record
+        *total = session->plan->verify->num_ranges;
+    }
+}
+
+void flash_session_get_bytes (struct flash_session *session, uint64_t *done,
+                              uint64_t *total)
+{
+    *done = session->bytes_done;
+    *total = 0;
+    
+    if (session->plan == NULL) {
+        return;
+    } else if (session->phase == FLASH_PHASE_WRITE) {
+        *total = session->plan->bytes[FLASH_PLAN_WRITE];
+    } else if (session->phase == FLASH_PHASE_VERIFY) {
+        *total = session->plan->bytes[FLASH_PLAN_VERIFY];
+    }
+}
+
+int flash_session_get_skipped (struct flash_session *session)
+{
+    return session->skipped;
+}
+
+uint64_t flash_session_get_elapsed (struct flash_session *session)
+{
+    if (session->start_time == 0) {
+        return 0;
+    } else if (session->end_time == 0) {
+        return latency_stats_now() - session->start_time;
+    }
+    return session->end_time - session->start_time;
+}
@@ -0,0 +1,315 @@
+//
+//  flash-session.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef flash_session_h
+#define flash_session_h
+
+#include <inttypes.h>
+
+#include "serial-port.h"
+#include "intel-hex.h"
+#include "state-db.h"
+#include "provision.h"
+
+/** Maximum length of firmware version strings */
+#define FLASH_VERSION_LENGTH    64
+/** Default limit on the time to wait for the module to reset in
+    milliseconds */
+#define FLASH_RESET_TIMEOUT     3000
+/** Timeout for the first attempt to reach the bootloader after a reset, each
+    following attempt waits twice as long up to FLASH_POLL_TIMEOUT_MAX */
+#define FLASH_POLL_TIMEOUT      25
+#define FLASH_POLL_TIMEOUT_MAX  200
+/** Time to wait for a response from the application firmware */
+#define FLASH_APP_TIMEOUT       1000
+/** Start of the version string which the firmware reports, and which is
+    embedded in firmware images */
+#define FLASH_VERSION_PREFIX    "RN2483 "
+
+enum flash_phase {
+    /** Finding out whether the module is running its firmware or the
+        bootloader, and getting the version of the firmware */
+    FLASH_PHASE_CHECK_VERSION,
+    /** Getting the hardware EUI of the module */
+    FLASH_PHASE_IDENTIFY,
+    /** Waiting for flash_session_confirm to be called */
+    FLASH_PHASE_CONFIRM,
+    /** Erasing the running firmware so that the module enters the bootloader */
+    FLASH_PHASE_ENTER_BOOTLOADER,
+    /** Waiting for the module to reset into the bootloader */
+    FLASH_PHASE_WAIT_BOOTLOADER,
+    /** Getting the bootloader's version information */
+    FLASH_PHASE_BOOTLOADER_VERSION,
+    /** Comparing a few rows to find out whether the image is already written */
+    FLASH_PHASE_SPOT_CHECK,
+    /** Erasing the application area of flash */
+    FLASH_PHASE_ERASE,
+    /** Writing the image */
+    FLASH_PHASE_WRITE,
+    /** Comparing checksums of the written image */
+    FLASH_PHASE_VERIFY,
+    /** Resetting into the new firmware */
+    FLASH_PHASE_RESET,
+    /** Waiting for the module to reset into the new firmware */
+    FLASH_PHASE_WAIT_APPLICATION,
+    /** Getting the version of the new firmware */
+    FLASH_PHASE_NEW_VERSION,
+    /** Running the provisioning script */
+    FLASH_PHASE_PROVISION,
+    /** The update completed successfully */
+    FLASH_PHASE_DONE,
+    /** The update failed */
+    FLASH_PHASE_FAILED,
+    /** The update was not confirmed */
+    FLASH_PHASE_CANCELLED
+};
+
+enum flash_event {
+    /** The session has entered a new phase */
+    FLASH_EVENT_PHASE,
+    /** A record has been written or verified */
+    FLASH_EVENT_PROGRESS,
+    /** The session is waiting for flash_session_confirm to be called */
+    FLASH_EVENT_CONFIRM,
+    /** The session has finished, successfully or not */
+    FLASH_EVENT_DONE
+};
+
+enum flash_mode {
+    /** Update the module's firmware */
+    FLASH_MODE_UPDATE,
+    /** Compare the contents of flash with the image on a module which is
+        already running the bootloader, without modifying anything */
+    FLASH_MODE_VERIFY,
+    /** Only get the version of the running firmware */
+    FLASH_MODE_VERSION
+};
+
+struct flash_options {
+    /** What the session should do */
+    enum flash_mode mode;
+    /** The module is known to be running the bootloader and need not be
+        probed */
+    int recover;
+    /** Pause for confirmation after getting the running firmware version */
+    int confirm;
+    /** Update the module even if it already runs the image's firmware
+        version or the state database says it already has the image */
+    int force;
+    /** Longest time to wait for the module to reset in milliseconds */
+    long reset_timeout;
+    /** Baudrate used while talking to the bootloader, or 0 to use the port's
+        baudrate throughout. The firmware is always spoken to at the port's
+        baudrate. */
+    int bootloader_baudrate;
+    /** Database of what was last written to each module, or NULL */
+    struct state_db *state;
+    /** Commands to be run on the module once it runs the new firmware, or
+        NULL */
+    const struct provision_script *provision;
+};
+
+struct flash_session;
+
+/**
+ *  Callback for events from a flashing session. The session must not be freed
+ *  from within the callback.
+ *
+ *  @param session The session
+ *  @param event The event which occured
+ *  @param context The context pointer given when the session was created
+ */
+typedef void (*flash_session_cb)(struct flash_session *session,
+                                 enum flash_event event, void *context);
+
+/**
+ *  Fill a flash options structure with the default options.
+ *
+ *  @param options The structure to be filled
+ */
+extern void flash_options_init (struct flash_options *options);
+
+/**
+ *  Get the firmware version string embedded in an image, which the firmware
+ *  reports once it is running.
+ *
+ *  @param hex The image
+ *  @param buffer Buffer where the version should be stored
+ *  @param length Length of buffer
+ *
+ *  @return 0 if the image contains a version string
+ */
+extern int flash_image_version (struct intel_hex_file *hex, char *buffer,
+                                size_t length);
+
+/**
+ *  Create a session which updates the firmware on one module. The session runs
+ *  on the port's event loop. Many sessions can share the same hex file
+ *  structure, it is not modified.
+ *
+ *  @param port Serial connection to the module
+ *  @param hex Firmware image to be written, must outlive the session, may be
+ *             NULL in FLASH_MODE_VERSION
+ *  @param options Options for the session
+ *  @param callback Function to be called for session events
+ *  @param context Pointer to be passed to callback
+ *  @param session Pointer to where pointer to new session should be stored
+ *
+ *  @return 0 if successfull
+ */
+extern int flash_session_init (struct serial_port *port,
+                               struct intel_hex_file *hex,
+                               const struct flash_options *options,
+                               flash_session_cb callback, void *context,
+                               struct flash_session **session);
+
+/**
+ *  Free a session. A session which has not finished must have its port closed
+ *  before it is freed so that the operation in progress is abandoned.
+ *
+ *  @param session The session to be freed
+ */
+extern void flash_session_free (struct flash_session *session);
+
+/**
+ *  Start a session.
+ *
+ *  @param session The session to be started
+ */
+extern void flash_session_start (struct flash_session *session);
+
+/**
+ *  Continue or cancel a session which is waiting for confirmation.
+ *
+ *  @param session The session
+ *  @param proceed Non-zero to erase and update the module, zero to cancel
+ */
+extern void flash_session_confirm (struct flash_session *session, int proceed);
+
+/**
+ *  Get the phase that a session is in.
+ *
+ *  @param session The session
+ *
+ *  @return The session's current phase
+ */
+extern enum flash_phase flash_session_get_phase (
+                                            struct flash_session *session);
+
+/**
+ *  Get the phase that a failed session was in when it failed.
+ *
+ *  @param session The session
+ *
+ *  @return The phase in which the session failed
+ */
+extern enum flash_phase flash_session_get_failed_phase (
+                                            struct flash_session *session);
+
+/**
+ *  Get a human readable name for a phase.
+ *
+ *  @param phase The phase
+ *
+ *  @return Name of the phase
+ */
+extern const char *flash_phase_name (enum flash_phase phase);
+
+/**
+ *  Get the serial port used by a session.
+ *
+ *  @param session The session
+ *
+ *  @return The session's port
+ */
+extern struct serial_port *flash_session_get_port (
+                                            struct flash_session *session);
+
+/**
+ *  Get the error message for a failed session.
+ *
+ *  @param session The session
+ *
+ *  @return Description of the failure, or an empty string
+ */
+extern const char *flash_session_get_error (struct flash_session *session);
+
+/**
+ *  Get the firmware version that was running before the update.
+ *
+ *  @param session The session
+ *
+ *  @return The old version string, or an empty string if it is not known
+ */
+extern const char *flash_session_get_old_version (
+                                            struct flash_session *session);
+
+/**
+ *  Get the firmware version that is running after the update.
+ *
+ *  @param session The session
+ *
+ *  @return The new version string, or an empty string if it is not known
+ */
+extern const char *flash_session_get_new_version (
+                                            struct flash_session *session);
+
+/**
+ *  Get the bootloader version and device ID reported by the module.
+ *
+ *  @param session The session
+ *  @param version Pointer to where bootloader version should be stored
+ *  @param device_id Pointer to where device ID should be stored
+ *
+ *  @return 0 if the information is available
+ */
+extern int flash_session_get_bootloader_info (struct flash_session *session,
+                                              int *version, int *device_id);
+
+/**
+ *  Get the progress through the write or verify phase.
+ *
+ *  @param session The session
+ *  @param done Pointer to where number of records completed should be stored
+ *  @param total Pointer to where total number of records should be stored
+ */
+extern void flash_session_get_progress (struct flash_session *session,
+                                        int *done, int *total);
+
+/**
+ *  Get the number of bytes of flash written or verified so far in the write or
+ *  verify phase.
+ *
+ *  @param session The session
+ *  @param done Pointer to where number of bytes completed should be stored
+ *  @param total Pointer to where total number of bytes should be stored, zero
+ *               if it is not known
+ */
+extern void flash_session_get_bytes (struct flash_session *session,
+                                     uint64_t *done, uint64_t *total);
+
+/**
+ *  Find out whether a session found that its module already held the image.
+ *
+ *  @param session The session
+ *
+ *  @return 1 if nothing had to be written, 0 otherwise
+ */
+extern int flash_session_get_skipped (struct flash_session *session);
+
+/**
+ *  Get the time that a session has been running for, or ran for if it is
+ *  finished.
+ *
+ *  @param session The session
+ *
+ *  @return Elapsed time in microseconds
+ */
+extern uint64_t flash_session_get_elapsed (struct flash_session *session);
+
+#endif /* flash_session_h */
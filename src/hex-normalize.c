@@ -0,0 +1,214 @@
+//
+//  hex-normalize.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#include "hex-normalize.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "flash-plan.h"
+
+/**
+ *  A record from the image being normalized.
+ */
+struct hex_normalize_record {
+    uint32_t address;
+    uint8_t length;
+    uint8_t *data;
+    /** Position of the record in the image, so that sorting is stable */
+    int index;
+};
+
+/**
+ *  Contiguous data being collected from the sorted records.
+ */
+struct hex_normalize_segment {
+    uint32_t address;
+    uint32_t length;
+    uint8_t *data;
+    uint32_t capacity;
+};
+
+
+static int hex_normalize_compare (const void *a, const void *b)
+{
+    const struct hex_normalize_record *ra = a;
+    const struct hex_normalize_record *rb = b;
+    
+    if (ra->address != rb->address) {
+        return (ra->address < rb->address) ? -1 : 1;
+    }
+    return ra->index - rb->index;
+}
+
+/**
+ *  Split a segment into records and add them to the normalized image.
+ *
+ *  @param out The normalized image
+ *  @param segment The segment
+ *  @param latch The write latch size
+ *  @param trim Whether blank blocks should be left out
+ *
+ *  @return 0 if successfull
+ */
+static int hex_normalize_emit (struct intel_hex_file *out,
+                               const struct hex_normalize_segment *segment,
+                               uint8_t latch, int trim)
+{
+    uint32_t record_size = (HEX_NORMALIZE_MAX_RECORD / latch) * latch;
+    uint32_t start = 0;
+    uint32_t pos = 0;
+    
+    while (pos < segment->length) {
+        uint32_t address = segment->address + pos;
+        
+        // Blocks end at the next latch boundary, or at a 64 KiB boundary
+        // since records can not span one
+        uint32_t block_end = ((address / latch) + 1) * latch;
+        uint32_t next_64k = (address | 0xFFFF) + 1;
+        if ((next_64k != 0) && (next_64k < block_end)) {
+            block_end = next_64k;
+        }
+        block_end -= segment->address;
+        if (block_end > segment->length) {
+            block_end = segment->length;
+        }
+        
+        int skip = trim && flash_plan_is_blank(address, segment->data + pos,
+                                               block_end - pos);
+        int full = (block_end - start) > record_size;
+        int wrap = (address & 0xFFFF) == 0;
+        
+        if ((skip || full || wrap) && (pos > start)) {
+            if (intel_hex_add_record(out, segment->address + start,
+                                     segment->data + start,
+                                     (uint8_t)(pos - start)) != 0) {
+                return -1;
+            }
+            start = pos;
+        }
+        
+        pos = block_end;
+        if (skip) {
+            start = pos;
+        }
+    }
+    
+    if (pos > start) {
+        return intel_hex_add_record(out, segment->address + start,
+                                    segment->data + start,
+                                    (uint8_t)(pos - start));
+    }
+    return 0;
+}
+
+/**
+ *  Add a record to a segment, growing it as needed.
+ *
+ *  @return 0 if successfull
+ */
+static int hex_normalize_extend (struct hex_normalize_segment *segment,
+                                 const struct hex_normalize_record *record)
+{
+    uint32_t offset = record->address - segment->address;
+    uint32_t end = offset + record->length;
+    
+    if (end > segment->capacity) {
+        uint32_t capacity = (segment->capacity == 0) ? 4096 :
+                                                       segment->capacity;
+        while (capacity < end) {
+            capacity *= 2;
+        }
+        uint8_t *data = realloc(segment->data, capacity);
+        if (data == NULL) {
+            fprintf(stderr, "Could not allocate memory to normalize image.\n");
+            return -1;
+        }
+        segment->data = data;
+        segment->capacity = capacity;
+    }
+    
+    memcpy(segment->data + offset, record->data, record->length);
+    if (end > segment->length) {
+        segment->length = end;
+    }
+    return 0;
+}
+
+
+int hex_normalize (struct intel_hex_file *hex, uint8_t write_latch_size,
+                   int trim, struct intel_hex_file **normalized)
+{
+    if (write_latch_size == 0) {
+        fprintf(stderr, "Invalid write latch size.\n");
+        return -1;
+    }
+    
+    int num_records = intel_hex_num_records(hex);
+    struct hex_normalize_record *records = calloc((size_t)num_records + 1,
+                                                  sizeof(*records));
+    if (records == NULL) {
+        fprintf(stderr, "Could not allocate memory to normalize image.\n");
+        return -1;
+    }
+    
+    struct intel_hex_record *r = intel_hex_get_first_record(hex);
+    for (int i = 0; r != NULL; i++) {
+        records[i].index = i;
+        r = intel_hex_get_next_record(r, &records[i].data,
+                                      &records[i].address,
+                                      &records[i].length);
+    }
+    qsort(records, (size_t)num_records, sizeof(*records),
+          hex_normalize_compare);
+    
+    struct intel_hex_file *out;
+    if (create_intel_hex_file(&out) != 0) {
+        goto free_records;
+    }
+    
+    struct hex_normalize_segment segment = { 0, 0, NULL, 0 };
+    
+    for (int i = 0; i < num_records; i++) {
+        struct hex_normalize_record *record = &records[i];
+        
+        if ((segment.length != 0) &&
+                (record->address > (segment.address + segment.length))) {
+            // There is a gap, so this record starts a new segment
+            if (hex_normalize_emit(out, &segment, write_latch_size,
+                                   trim) != 0) {
+                goto free_out;
+            }
+            segment.length = 0;
+        }
+        if (segment.length == 0) {
+            segment.address = record->address;
+        }
+        if (hex_normalize_extend(&segment, record) != 0) {
+            goto free_out;
+        }
+    }
+    
+    if ((segment.length != 0) &&
+            (hex_normalize_emit(out, &segment, write_latch_size, trim) != 0)) {
+        goto free_out;
+    }
+    
+    free(segment.data);
+    free(records);
+    *normalized = out;
+    return 0;
+    
+free_out:
+    free(segment.data);
+    free_intel_hex_file(out);
+free_records:
+    free(records);
+    return -1;
+}
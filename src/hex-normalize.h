@@ -0,0 +1,41 @@
+//
+//  hex-normalize.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef hex_normalize_h
+#define hex_normalize_h
+
+#include <inttypes.h>
+
+#include "intel-hex.h"
+
+/** Largest amount of data that fits in an intel hex record */
+#define HEX_NORMALIZE_MAX_RECORD    255
+
+/**
+ *  Rewrite an image in a canonical form. Records are sorted by address and
+ *  contiguous data is merged, where records overlap the one at the higher
+ *  address wins. The data is then split into records which are as long as
+ *  possible while holding a whole number of write latches, so that every
+ *  record after a gap starts on a latch boundary and no latch is split between
+ *  records. The same data always gives the same records, however it was laid
+ *  out.
+ *
+ *  @param hex The image to be normalized
+ *  @param write_latch_size The bootloader's write latch size
+ *  @param trim Leave out latch sized blocks of the application area which are
+ *              entirely 0xFF, since that area is erased before it is written
+ *              and erased flash reads as 0xFF (see flash_plan_is_blank)
+ *  @param normalized Pointer to where pointer to the new image should be
+ *                    stored
+ *
+ *  @return 0 if successfull
+ */
+extern int hex_normalize (struct intel_hex_file *hex, uint8_t write_latch_size,
+                          int trim, struct intel_hex_file **normalized);
+
+#endif /* hex_normalize_h */
@@ -0,0 +1,600 @@
+//
+//  hotplug.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#define _GNU_SOURCE
+
+#include "hotplug.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+#ifdef __linux__
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <sys/inotify.h>
+
+#include "io-loop.h"
+#include "serial-port.h"
+#include "probe.h"
+#include "flash-job.h"
+#include "signal-watch.h"
+
+#define HOTPLUG_NUM_DIRS    2
+
+enum hotplug_device_state {
+    /** Waiting for the port to settle */
+    HOTPLUG_DEVICE_SETTLING,
+    /** Finding out what is attached */
+    HOTPLUG_DEVICE_PROBING,
+    /** Being flashed */
+    HOTPLUG_DEVICE_FLASHING,
+    /** Handled, nothing more is done until the port is removed */
+    HOTPLUG_DEVICE_IDLE
+};
+
+struct hotplug;
+
+struct hotplug_device {
+    struct hotplug_device *next;
+    struct hotplug *hotplug;
+    
+    /** Path at which the port was found and the path it resolves to */
+    char *path;
+    char *real_path;
+    
+    enum hotplug_device_state state;
+    /** Set when the device needs to be cleaned up */
+    int reap;
+    /** Set when the port has been removed */
+    int removed;
+    
+    struct io_timer *settle_timer;
+    /** Port used for probing, owned by the job once flashing starts */
+    struct serial_port *port;
+    struct probe probe;
+    struct flash_job flash;
+};
+
+struct hotplug_dir {
+    const char *path;
+    /** Default glob for port names in this directory */
+    const char *const *patterns;
+    int wd;
+};
+
+struct hotplug {
+    struct io_loop *loop;
+    struct intel_hex_file *hex;
+    const struct hotplug_options *options;
+    
+    int inotify_fd;
+    struct io_watch *inotify_watch;
+    struct hotplug_dir dirs[HOTPLUG_NUM_DIRS];
+    /** Timer used to add watches for directories which did not exist yet */
+    struct io_timer *rescan_timer;
+    
+    /** Timer used to clean up devices outside of their callbacks */
+    struct io_timer *reaper;
+    
+    struct hotplug_device *devices;
+    
+    unsigned int flashed;
+    unsigned int failed;
+    int stop;
+};
+
+static const char *const hotplug_dev_patterns[] = { "ttyUSB*", "ttyACM*",
+                                                    NULL };
+static const char *const hotplug_by_id_patterns[] = { "*", NULL };
+
+
+/**
+ *  Check whether a version string matches the target version. Either the
+ *  whole string ("RN2483 1.0.5 Oct 31 2018 15:06:52") or only the version
+ *  number ("1.0.5") may be given as the target.
+ */
+static int hotplug_version_matches (const char *version, const char *target)
+{
+    if (strcmp(version, target) == 0) {
+        return 1;
+    }
+    
+    const char *number = strchr(version, ' ');
+    if (number == NULL) {
+        return 0;
+    }
+    number++;
+    
+    size_t length = strcspn(number, " ");
+    return (strlen(target) == length) && (strncmp(number, target, length) == 0);
+}
+
+/**
+ *  Mark a device for cleanup once the current callback has returned.
+ */
+static void hotplug_device_finish (struct hotplug_device *device)
+{
+    device->reap = 1;
+    io_timer_start(device->hotplug->reaper, 0);
+}
+
+/**
+ *  Free a device and everything that it owns.
+ */
+static void hotplug_device_free (struct hotplug_device *device)
+{
+    if (device->port != NULL) {
+        serial_port_close(device->port);
+    }
+    flash_job_free(&device->flash);
+    io_timer_free(device->settle_timer);
+    free(device->path);
+    free(device->real_path);
+    free(device);
+}
+
+/**
+ *  Close a device's port and free its session once it has been handled.
+ */
+static void hotplug_device_release (struct hotplug_device *device)
+{
+    if (device->port != NULL) {
+        serial_port_close(device->port);
+        device->port = NULL;
+    }
+    flash_job_release(&device->flash);
+    device->state = HOTPLUG_DEVICE_IDLE;
+}
+
+/**
+ *  Clean up devices which have been handled or removed.
+ */
+static void hotplug_reap (struct io_timer *timer, void *context)
+{
+    (void)timer;
+    struct hotplug *hotplug = context;
+    
+    struct hotplug_device **prev = &hotplug->devices;
+    while (*prev != NULL) {
+        struct hotplug_device *device = *prev;
+        
+        if (device->reap) {
+            device->reap = 0;
+            hotplug_device_release(device);
+        }
+        
+        if (device->removed && (device->state == HOTPLUG_DEVICE_IDLE)) {
+            *prev = device->next;
+            hotplug_device_free(device);
+        } else {
+            prev = &device->next;
+        }
+    }
+}
+
+/**
+ *  Callback for events from a device's flash job.
+ */
+static void hotplug_job_event (struct flash_job *job, enum flash_event event,
+                               void *context)
+{
+    struct hotplug_device *device = context;
+    struct hotplug *hotplug = device->hotplug;
+    struct flash_session *session = job->session;
+    
+    if (event == FLASH_EVENT_CONFIRM) {
+        flash_session_confirm(session, 1);
+        return;
+    } else if (event != FLASH_EVENT_DONE) {
+        return;
+    }
+    
+    if (session == NULL) {
+        printf("%s: failed: %s\n", device->path, job->error);
+        fflush(stdout);
+        hotplug->failed++;
+        hotplug_device_finish(device);
+        return;
+    }
+    
+    enum flash_phase phase = flash_session_get_phase(session);
+    uint64_t elapsed = flash_session_get_elapsed(session);
+    
+    if ((phase == FLASH_PHASE_DONE) && flash_session_get_skipped(session) &&
+            (flash_session_get_old_version(session)[0] != '\0')) {
+        printf("%s: already updated with this image\n", device->path);
+    } else if (phase == FLASH_PHASE_DONE) {
+        printf("%s: updated to %s in %.1f s\n", device->path,
+               flash_session_get_new_version(session),
+               (double)elapsed / 1000000);
+        hotplug->flashed++;
+    } else {
+        printf("%s: failed during %s: %s\n", device->path,
+               flash_phase_name(flash_session_get_failed_phase(session)),
+               flash_session_get_error(session));
+        hotplug->failed++;
+    }
+    fflush(stdout);
+    
+    hotplug_device_finish(device);
+}
+
+/**
+ *  Decide what to do with a device once it has been probed.
+ */
+static void hotplug_probe_done (struct probe *probe, void *context)
+{
+    struct hotplug_device *device = context;
+    struct hotplug *hotplug = device->hotplug;
+    const char *target = hotplug->options->target_version;
+    
+    struct flash_options options;
+    flash_options_init(&options);
+    options.confirm = 0;
+    options.state = hotplug->options->state;
+    options.force = hotplug->options->force;
+    options.bootloader_baudrate =
+            adapter_db_baudrate(hotplug->options->adapters, device->path);
+    options.provision = hotplug->options->provision;
+    
+    switch (probe->state) {
+        case PROBE_STATE_NONE:
+            printf("%s: no module found\n", device->path);
+            fflush(stdout);
+            hotplug_device_finish(device);
+            return;
+        case PROBE_STATE_APPLICATION:
+            if ((target != NULL) &&
+                    hotplug_version_matches(probe->version, target)) {
+                printf("%s: already running %s\n", device->path,
+                       probe->version);
+                fflush(stdout);
+                hotplug_device_finish(device);
+                return;
+            }
+            printf("%s: found %s, updating\n", device->path, probe->version);
+            break;
+        case PROBE_STATE_BOOTLOADER:
+            printf("%s: found bootloader version %d, recovering\n",
+                   device->path, probe->bootloader_version);
+            options.recover = 1;
+            break;
+    }
+    fflush(stdout);
+    
+    device->state = HOTPLUG_DEVICE_FLASHING;
+    flash_job_start_on_port(&device->flash, device->port, hotplug->hex,
+                            &options);
+    device->port = NULL;
+}
+
+/**
+ *  Open and probe a device once its port has settled.
+ */
+static void hotplug_settled (struct io_timer *timer, void *context)
+{
+    (void)timer;
+    struct hotplug_device *device = context;
+    struct hotplug *hotplug = device->hotplug;
+    
+    if (serial_port_open(hotplug->loop, device->real_path,
+                         hotplug->options->baudrate, &device->port) != 0) {
+        hotplug_device_finish(device);
+        return;
+    }
+    
+    device->state = HOTPLUG_DEVICE_PROBING;
+    if (probe_start(&device->probe, device->port, PROBE_TIMEOUT,
+                    hotplug_probe_done, device) != 0) {
+        hotplug_device_finish(device);
+    }
+}
+
+/**
+ *  Start handling a port which has appeared.
+ */
+static void hotplug_add (struct hotplug *hotplug, const char *path)
+{
+    char *real_path = realpath(path, NULL);
+    if (real_path == NULL) {
+        // The port has already gone away or is a dangling link
+        return;
+    }
+    
+    /* Ports are often reachable through more than one name */
+    for (struct hotplug_device *d = hotplug->devices; d != NULL; d = d->next) {
+        if (strcmp(d->real_path, real_path) == 0) {
+            free(real_path);
+            return;
+        }
+    }
+    
+    struct hotplug_device *device = calloc(1, sizeof(struct hotplug_device));
+    if (device == NULL) {
+        fprintf(stderr, "Could not allocate device.\n");
+        free(real_path);
+        return;
+    }
+    
+    device->hotplug = hotplug;
+    device->real_path = real_path;
+    device->path = strdup(path);
+    if ((device->path == NULL) ||
+            (io_timer_init(hotplug->loop, hotplug_settled, device,
+                           &device->settle_timer) != 0) ||
+            (flash_job_init(hotplug->loop, &device->flash, hotplug_job_event,
+                            device) != 0)) {
+        if (device->settle_timer != NULL) {
+            io_timer_free(device->settle_timer);
+        }
+        free(device->path);
+        free(device->real_path);
+        free(device);
+        return;
+    }
+    
+    device->state = HOTPLUG_DEVICE_SETTLING;
+    device->next = hotplug->devices;
+    hotplug->devices = device;
+    
+    printf("%s: attached\n", path);
+    fflush(stdout);
+    
+    io_timer_start(device->settle_timer, hotplug->options->settle_delay);
+}
+
+/**
+ *  Forget a port which has been removed so that it is handled again if it
+ *  comes back.
+ */
+static void hotplug_remove (struct hotplug *hotplug, const char *path)
+{
+    for (struct hotplug_device *d = hotplug->devices; d != NULL; d = d->next) {
+        if ((strcmp(d->path, path) != 0) && (strcmp(d->real_path, path) != 0)) {
+            continue;
+        }
+        
+        if (d->state == HOTPLUG_DEVICE_SETTLING) {
+            io_timer_stop(d->settle_timer);
+            d->state = HOTPLUG_DEVICE_IDLE;
+        }
+        if (!d->removed && (d->state == HOTPLUG_DEVICE_IDLE)) {
+            printf("%s: detached\n", d->path);
+            fflush(stdout);
+        }
+        
+        /* A device which is still in use is freed once its session ends */
+        d->removed = 1;
+        io_timer_start(hotplug->reaper, 0);
+    }
+}
+
+/**
+ *  Check whether a port name matches the patterns for its directory.
+ */
+static int hotplug_matches (struct hotplug *hotplug, struct hotplug_dir *dir,
+                            const char *name)
+{
+    if (hotplug->options->match != NULL) {
+        return fnmatch(hotplug->options->match, name, 0) == 0;
+    }
+    
+    for (const char *const *p = dir->patterns; *p != NULL; p++) {
+        if (fnmatch(*p, name, 0) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ *  Handle inotify events.
+ */
+static void hotplug_handle_events (struct io_watch *watch, int events,
+                                   void *context)
+{
+    (void)watch;
+    (void)events;
+    struct hotplug *hotplug = context;
+    
+    char buffer[4096]
+            __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    
+    for (;;) {
+        ssize_t length = read(hotplug->inotify_fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            return;
+        }
+        
+        for (char *p = buffer; p < (buffer + length);
+             p += sizeof(struct inotify_event) +
+                    ((struct inotify_event *)p)->len) {
+            struct inotify_event *event = (struct inotify_event *)p;
+            
+            if (event->mask & IN_IGNORED) {
+                /* The directory was removed, watch for it to come back */
+                for (int i = 0; i < HOTPLUG_NUM_DIRS; i++) {
+                    if (hotplug->dirs[i].wd == event->wd) {
+                        hotplug->dirs[i].wd = -1;
+                        io_timer_start(hotplug->rescan_timer,
+                                       HOTPLUG_RESCAN_INTERVAL);
+                    }
+                }
+                continue;
+            } else if (event->len == 0) {
+                continue;
+            }
+            
+            struct hotplug_dir *dir = NULL;
+            for (int i = 0; i < HOTPLUG_NUM_DIRS; i++) {
+                if (hotplug->dirs[i].wd == event->wd) {
+                    dir = &hotplug->dirs[i];
+                }
+            }
+            if ((dir == NULL) || !hotplug_matches(hotplug, dir, event->name)) {
+                continue;
+            }
+            
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "%s/%s", dir->path, event->name);
+            
+            if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                hotplug_remove(hotplug, path);
+            } else {
+                hotplug_add(hotplug, path);
+            }
+        }
+    }
+}
+
+/**
+ *  Add watches for any directories which are not being watched yet.
+ */
+static void hotplug_rescan (struct io_timer *timer, void *context)
+{
+    (void)timer;
+    struct hotplug *hotplug = context;
+    int missing = 0;
+    
+    for (int i = 0; i < HOTPLUG_NUM_DIRS; i++) {
+        if (hotplug->dirs[i].wd != -1) {
+            continue;
+        }
+        
+        hotplug->dirs[i].wd = inotify_add_watch(hotplug->inotify_fd,
+                                                hotplug->dirs[i].path,
+                                                IN_CREATE | IN_MOVED_TO |
+                                                IN_DELETE | IN_MOVED_FROM);
+        if (hotplug->dirs[i].wd == -1) {
+            missing = 1;
+        } else {
+            printf("Watching %s\n", hotplug->dirs[i].path);
+            fflush(stdout);
+        }
+    }
+    
+    if (missing) {
+        io_timer_start(hotplug->rescan_timer, HOTPLUG_RESCAN_INTERVAL);
+    }
+}
+
+int hotplug_run (struct intel_hex_file *hex,
+                 const struct hotplug_options *options)
+{
+    struct hotplug hotplug = {
+        .hex = hex,
+        .options = options,
+        .dirs = {
+            { .path = "/dev", .patterns = hotplug_dev_patterns, .wd = -1 },
+            { .path = "/dev/serial/by-id", .patterns = hotplug_by_id_patterns,
+              .wd = -1 }
+        }
+    };
+    struct signal_watch *signals;
+    int ret = -1;
+    
+    hotplug.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (hotplug.inotify_fd == -1) {
+        fprintf(stderr, "Could not initialize inotify: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    if (io_loop_init(&hotplug.loop) != 0) {
+        goto close_inotify;
+    }
+    
+    if (io_timer_init(hotplug.loop, hotplug_reap, &hotplug,
+                      &hotplug.reaper) != 0) {
+        goto free_loop;
+    }
+    
+    if (io_timer_init(hotplug.loop, hotplug_rescan, &hotplug,
+                      &hotplug.rescan_timer) != 0) {
+        goto free_reaper;
+    }
+    
+    if (io_watch_add(hotplug.loop, hotplug.inotify_fd, IO_EVENT_READ,
+                     hotplug_handle_events, &hotplug,
+                     &hotplug.inotify_watch) != 0) {
+        goto free_rescan_timer;
+    }
+    
+    if (signal_watch_init(hotplug.loop, &hotplug.stop, &signals) != 0) {
+        goto remove_inotify_watch;
+    }
+    
+    hotplug_rescan(hotplug.rescan_timer, &hotplug);
+    if (hotplug.dirs[0].wd == -1) {
+        fprintf(stderr, "Could not watch %s: %s\n", hotplug.dirs[0].path,
+                strerror(errno));
+        goto free_signals;
+    }
+    
+    if (options->target_version != NULL) {
+        printf("Target version: %s\n", options->target_version);
+    }
+    printf("Waiting for modules to be attached\n");
+    fflush(stdout);
+    
+    /* Run until signalled */
+    ret = io_loop_run(hotplug.loop, &hotplug.stop);
+    
+    printf("\n%u modules updated, %u failed\n", hotplug.flashed,
+           hotplug.failed);
+    
+    /* Abandon anything that is still in progress */
+    while (hotplug.devices != NULL) {
+        struct hotplug_device *device = hotplug.devices;
+        hotplug.devices = device->next;
+        hotplug_device_free(device);
+    }
+    
+free_signals:
+    signal_watch_free(signals);
+remove_inotify_watch:
+    io_watch_remove(hotplug.inotify_watch);
+free_rescan_timer:
+    io_timer_free(hotplug.rescan_timer);
+free_reaper:
+    io_timer_free(hotplug.reaper);
+free_loop:
+    io_loop_free(hotplug.loop);
+close_inotify:
+    close(hotplug.inotify_fd);
+    return ret;
+}
+
+#else
+
+int hotplug_run (struct intel_hex_file *hex,
+                 const struct hotplug_options *options)
+{
+    (void)hex;
+    (void)options;
+    fprintf(stderr, "Watching for new ports is only supported on Linux.\n");
+    return -1;
+}
+
+#endif /* __linux__ */
+
+void hotplug_options_init (struct hotplug_options *options)
+{
+    options->baudrate = 57600;
+    options->match = NULL;
+    options->target_version = NULL;
+    options->settle_delay = HOTPLUG_SETTLE_DELAY;
+    options->state = NULL;
+    options->force = 0;
+    options->adapters = NULL;
+    options->provision = NULL;
+}
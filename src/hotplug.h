@@ -0,0 +1,64 @@
+//
+//  hotplug.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef hotplug_h
+#define hotplug_h
+
+#include "intel-hex.h"
+#include "state-db.h"
+#include "adapter-db.h"
+#include "provision.h"
+
+/** Time to wait after a port appears before opening it in milliseconds */
+#define HOTPLUG_SETTLE_DELAY    500
+/** Interval at which missing directories are checked for in milliseconds */
+#define HOTPLUG_RESCAN_INTERVAL 1000
+
+struct hotplug_options {
+    /** Baudrate used to talk to modules */
+    int baudrate;
+    /** Glob matched against port names, NULL to match USB serial adapters */
+    const char *match;
+    /** Version that modules should end up running, NULL to always flash */
+    const char *target_version;
+    /** Time to wait after a port appears before opening it */
+    long settle_delay;
+    /** Database of what was last written to each module, or NULL */
+    struct state_db *state;
+    /** Calibrated settings for USB serial adapters, or NULL */
+    struct adapter_db *adapters;
+    /** Update modules even if they already have the image */
+    int force;
+    /** Commands to be run on each module after it is updated, or NULL */
+    const struct provision_script *provision;
+};
+
+/**
+ *  Initialize hotplug options with their default values.
+ *
+ *  @param options The options to be initialized
+ */
+extern void hotplug_options_init (struct hotplug_options *options);
+
+/**
+ *  Watch /dev and /dev/serial/by-id for new serial ports until SIGINT or
+ *  SIGTERM is received. Each new port is probed and, if a module running
+ *  something other than the target version or a module waiting in the
+ *  bootloader is found, it is flashed with the given image. Ports which were
+ *  present when the watch started are left alone, as is a port which has
+ *  already been handled until it is removed.
+ *
+ *  @param hex The firmware image
+ *  @param options Watch options
+ *
+ *  @return 0 if the watch was stopped by a signal
+ */
+extern int hotplug_run (struct intel_hex_file *hex,
+                        const struct hotplug_options *options);
+
+#endif /* hotplug_h */
@@ -0,0 +1,170 @@
+//
+//  image-cache.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#include "image-cache.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#ifdef __APPLE__
+#define st_mtim st_mtimespec
+#endif
+
+struct image_cache_entry {
+    struct image_cache_entry *next;
+    /** Canonical path of the file */
+    char *path;
+    /** Identity of the file when it was parsed */
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    /** Set once a newer version of the file has been parsed */
+    int stale;
+    /** Number of times the image has been got and not yet given back */
+    int refs;
+    
+    struct intel_hex_file *hex;
+};
+
+struct image_cache {
+    struct image_cache_entry *entries;
+};
+
+
+/**
+ *  Remove an entry from a cache and free it.
+ *
+ *  @param link Pointer to the entry in the cache's list
+ */
+static void image_cache_remove (struct image_cache_entry **link)
+{
+    struct image_cache_entry *entry = *link;
+    
+    *link = entry->next;
+    free_intel_hex_file(entry->hex);
+    free(entry->path);
+    free(entry);
+}
+
+
+int image_cache_init (struct image_cache **cache)
+{
+    *cache = calloc(1, sizeof(struct image_cache));
+    
+    if (*cache == NULL) {
+        fprintf(stderr, "Could not allocate image cache.\n");
+        return -1;
+    }
+    return 0;
+}
+
+void image_cache_free (struct image_cache *cache)
+{
+    while (cache->entries != NULL) {
+        image_cache_remove(&cache->entries);
+    }
+    
+    free(cache);
+}
+
+int image_cache_get (struct image_cache *cache, const char *path,
+                     struct intel_hex_file **hex)
+{
+    char canonical[PATH_MAX];
+    struct stat st;
+    
+    if ((realpath(path, canonical) == NULL) || (stat(canonical, &st) != 0)) {
+        fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    
+    /* Look for an up to date entry */
+    struct image_cache_entry **link = &cache->entries;
+    while (*link != NULL) {
+        struct image_cache_entry *entry = *link;
+        
+        if (entry->stale || (strcmp(entry->path, canonical) != 0)) {
+            link = &entry->next;
+            continue;
+        }
+        
+        if ((entry->dev == st.st_dev) && (entry->ino == st.st_ino) &&
+            (entry->size == st.st_size) &&
+            (entry->mtime.tv_sec == st.st_mtim.tv_sec) &&
+            (entry->mtime.tv_nsec == st.st_mtim.tv_nsec)) {
+            entry->refs++;
+            *hex = entry->hex;
+            return 0;
+        }
+        
+        if (entry->refs == 0) {
+            image_cache_remove(link);
+            continue;
+        }
+        // File has changed, sessions may still be using the old image so it
+        // is kept until they have given it back
+        entry->stale = 1;
+        link = &entry->next;
+    }
+    
+    /* Parse file */
+    struct image_cache_entry *entry = calloc(1,
+                                             sizeof(struct image_cache_entry));
+    if (entry == NULL) {
+        fprintf(stderr, "Could not allocate image cache entry.\n");
+        return -1;
+    }
+    
+    entry->path = strdup(canonical);
+    if (entry->path == NULL) {
+        free(entry);
+        return -1;
+    }
+    
+    if (parse_intel_hex_file(canonical, &entry->hex) != 0) {
+        free(entry->path);
+        free(entry);
+        return -1;
+    }
+    
+    entry->dev = st.st_dev;
+    entry->ino = st.st_ino;
+    entry->size = st.st_size;
+    entry->mtime = st.st_mtim;
+    entry->refs = 1;
+    
+    entry->next = cache->entries;
+    cache->entries = entry;
+    
+    *hex = entry->hex;
+    return 0;
+}
+
+void image_cache_release (struct image_cache *cache,
+                          struct intel_hex_file *hex)
+{
+    for (struct image_cache_entry **link = &cache->entries; *link != NULL;
+         link = &(*link)->next) {
+        struct image_cache_entry *entry = *link;
+        
+        if (entry->hex != hex) {
+            continue;
+        }
+        
+        entry->refs--;
+        if (entry->stale && (entry->refs == 0)) {
+            image_cache_remove(link);
+        }
+        return;
+    }
+}
@@ -0,0 +1,58 @@
+//
+//  image-cache.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef image_cache_h
+#define image_cache_h
+
+#include "intel-hex.h"
+
+struct image_cache;
+
+/**
+ *  Create a cache of parsed firmware images.
+ *
+ *  @param cache Pointer to where pointer to new cache should be stored
+ *
+ *  @return 0 if successfull
+ */
+extern int image_cache_init (struct image_cache **cache);
+
+/**
+ *  Free a cache and all of the images in it.
+ *
+ *  @param cache The cache to be freed
+ */
+extern void image_cache_free (struct image_cache *cache);
+
+/**
+ *  Get a parsed image from the cache, parsing the file if it has not been
+ *  parsed before or if it has changed since it was parsed. The image stays
+ *  valid until it is given back with image_cache_release, even if it is
+ *  replaced by a newer version in the meantime.
+ *
+ *  @param cache The cache
+ *  @param path Path to the hex file
+ *  @param hex Pointer to where pointer to parsed image should be stored
+ *
+ *  @return 0 if successfull
+ */
+extern int image_cache_get (struct image_cache *cache, const char *path,
+                            struct intel_hex_file **hex);
+
+/**
+ *  Give back an image which was got from the cache. An image which has been
+ *  replaced by a newer version is freed once it has been given back as many
+ *  times as it was got.
+ *
+ *  @param cache The cache
+ *  @param hex The image
+ */
+extern void image_cache_release (struct image_cache *cache,
+                                 struct intel_hex_file *hex);
+
+#endif /* image_cache_h */
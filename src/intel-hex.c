@@ -14,6 +14,9 @@
 #include <errno.h>
 
 #define INTEL_HEX_RECORD_TYPE_MAX   0x05
+/** Longest line that can be parsed: a record with 255 bytes of data, line
+    delimiters and a null terminator */
+#define INTEL_HEX_LINE_LENGTH       (11 + (2 * 255) + 3)
 enum intel_hex_record_type {
     INTEL_HEX_RECORD_DATA = 0x00,
     INTEL_HEX_RECORD_EOF = 0x01,
@@ -33,6 +36,8 @@ struct intel_hex_record {
 
 struct intel_hex_file {
     struct intel_hex_record *head;
+    /** Where the next data record should be linked while parsing */
+    struct intel_hex_record **tail;
     
     int num_records;
     
@@ -258,6 +263,56 @@ static void free_record (struct intel_hex_record *record)
     free(record);
 }
 
+/**
+ *  Parse one line of an intel hex file and add the record it holds to a hex
+ *  file structure.
+ *
+ *  @param file The hex file structure the record belongs to
+ *  @param line The line, line delimiters are trimmed from it
+ *
+ *  @return 0 if successfull
+ */
+static int parse_line (struct intel_hex_file *file, char *line)
+{
+    // Trim line delimiters from line
+    size_t length = strlen(line);
+    while ((length > 0) && ((line[length - 1] == '\n') ||
+                            (line[length - 1] == '\r'))) {
+        line[--length] = '\0';
+    }
+    // Check for empty line
+    if (*line == '\0') {
+        return 0;
+    }
+    // Check if we are about to parse a record that it past the EOF record
+    if (file->has_eof) {
+        fprintf(stderr, "Hit EOF record in hex file before end of file.\n");
+        return -1;
+    }
+    // Parse line
+    int ret = parse_record(line, file->tail, file);
+    if (ret != 0) {
+        return -1;
+    }
+    // If a new record was stored, updated our pointer to the next record
+    if (*file->tail != NULL) {
+        file->tail = &((*file->tail)->next);
+    }
+    return 0;
+}
+
+int create_intel_hex_file (struct intel_hex_file **file)
+{
+    *file = calloc(1, sizeof(struct intel_hex_file));
+    
+    if (*file == NULL) {
+        fprintf(stderr, "Could not alocate memory for hex file.\n");
+        return -1;
+    }
+    (*file)->tail = &(*file)->head;
+    return 0;
+}
+
 int parse_intel_hex_file (const char *name, struct intel_hex_file **file)
 {
     /* Open file */
@@ -269,43 +324,16 @@ int parse_intel_hex_file (const char *name, struct intel_hex_file **file)
     }
     
     /* Allocate and initialize a intel_hex_file struct */
-    *file = calloc(1, sizeof(struct intel_hex_file));
-    
-    if (*file == NULL) {
-        fprintf(stderr, "Could not alocate memory to parse hex file.\n");
+    if (create_intel_hex_file(file) != 0) {
         goto close_file;
     }
     
     /* Parse records */
-    char line[256];
-    struct intel_hex_record **record = &((*file)->head);
-    while (fgets(line, 256, f)) {
-        // Trim line delimiters from line
-        if ((line[strlen(line) - 2] == '\n') ||
-            (line[strlen(line) - 2] == '\r')) {
-            line[strlen(line) - 2] = '\0';
-        } else if ((line[strlen(line) - 1] == '\n') ||
-                   (line[strlen(line) - 1] == '\r')) {
-            line[strlen(line) - 1] = '\0';
-        }
-        // Check for empty line
-        if (*line == '\0') {
-            continue;
-        }
-        // Check if we are about to parse a record that it past the EOF record
-        if ((*file)->has_eof) {
-            fprintf(stderr, "Hit EOF record in hex file before end of file.\n");
-            goto free_records;
-        }
-        // Parse line
-        int ret = parse_record(line, record, *file);
-        if (ret != 0) {
+    char line[INTEL_HEX_LINE_LENGTH];
+    while (fgets(line, INTEL_HEX_LINE_LENGTH, f)) {
+        if (parse_line(*file, line) != 0) {
             goto free_records;
         }
-        // If a new record was stored, updated our pointer to the next record
-        if (*record != NULL) {
-            record = &((*record)->next);
-        }
     }
     
     if (!(*file)->has_eof) {
@@ -314,6 +342,7 @@ int parse_intel_hex_file (const char *name, struct intel_hex_file **file)
         goto free_records;
     }
     
+    fclose(f);
     return 0;
     
 free_records:
@@ -323,6 +352,131 @@ close_file:
     return -1;
 }
 
+int parse_intel_hex_buffer (const char *buffer, size_t length,
+                            struct intel_hex_file **file)
+{
+    if (create_intel_hex_file(file) != 0) {
+        return -1;
+    }
+    
+    /* Parse records */
+    char line[INTEL_HEX_LINE_LENGTH];
+    for (size_t offset = 0; offset < length;) {
+        const char *start = buffer + offset;
+        const char *newline = memchr(start, '\n', length - offset);
+        size_t line_length = ((newline != NULL) ? (size_t)(newline - start) :
+                                                  (length - offset));
+        
+        if (line_length >= sizeof(line)) {
+            fprintf(stderr, "Line in hex file is too long.\n");
+            goto free_records;
+        }
+        memcpy(line, start, line_length);
+        line[line_length] = '\0';
+        offset += line_length + 1;
+        
+        if (parse_line(*file, line) != 0) {
+            goto free_records;
+        }
+    }
+    
+    if (!(*file)->has_eof) {
+        // Reached end of buffer without reading an EOF record
+        fprintf(stderr, "No EOF record in hex file.\n");
+        goto free_records;
+    }
+    
+    return 0;
+    
+free_records:
+    free_intel_hex_file(*file);
+    return -1;
+}
+
+int intel_hex_add_record (struct intel_hex_file *file, uint32_t address,
+                          const uint8_t *data, uint8_t length)
+{
+    struct intel_hex_record *record = malloc(sizeof(struct intel_hex_record));
+    if (record == NULL) {
+        fprintf(stderr, "Could not allocate memory for record.\n");
+        return -1;
+    }
+    
+    record->data = malloc(length);
+    if ((record->data == NULL) && (length != 0)) {
+        fprintf(stderr, "Could not allocate memory for record data.\n");
+        free(record);
+        return -1;
+    }
+    if (length != 0) {
+        memcpy(record->data, data, length);
+    }
+    record->next = NULL;
+    record->address = address;
+    record->length = length;
+    
+    *file->tail = record;
+    file->tail = &record->next;
+    file->num_records++;
+    return 0;
+}
+
+/**
+ *  Write a record to a file.
+ *
+ *  @param f The file to write to
+ *  @param type The type of the record
+ *  @param address The low 16 bits of the record's address
+ *  @param data The record's data
+ *  @param length The length of the record's data
+ *
+ *  @return 0 if successfull
+ */
+static int write_record (FILE *f, enum intel_hex_record_type type,
+                         uint16_t address, const uint8_t *data, uint8_t length)
+{
+    uint8_t sum = (uint8_t)(length + (address >> 8) + (address & 0xFF) + type);
+    
+    fprintf(f, ":%02X%04X%02X", length, address, type);
+    for (uint8_t i = 0; i < length; i++) {
+        fprintf(f, "%02X", data[i]);
+        sum += data[i];
+    }
+    return (fprintf(f, "%02X\r\n", (uint8_t)(0x100 - sum)) < 0) ? -1 : 0;
+}
+
+int write_intel_hex_file (const char *name, struct intel_hex_file *file)
+{
+    FILE *f = fopen(name, "w");
+    
+    if (f == NULL) {
+        fprintf(stderr, "Could not open file %s: %s.\n", name, strerror(errno));
+        return -1;
+    }
+    
+    int ret = 0;
+    uint16_t upper = 0;
+    
+    for (struct intel_hex_record *r = file->head; r != NULL; r = r->next) {
+        if ((r->address >> 16) != upper) {
+            upper = (uint16_t)(r->address >> 16);
+            uint8_t ext[2] = { (uint8_t)(upper >> 8), (uint8_t)upper };
+            ret |= write_record(f, INTEL_HEX_RECORD_EXT_LIN_ADDR, 0, ext, 2);
+        }
+        ret |= write_record(f, INTEL_HEX_RECORD_DATA,
+                            (uint16_t)(r->address & 0xFFFF), r->data,
+                            r->length);
+    }
+    ret |= write_record(f, INTEL_HEX_RECORD_EOF, 0, NULL, 0);
+    
+    if ((fclose(f) != 0) || (ret != 0)) {
+        fprintf(stderr, "Could not write file %s: %s.\n", name,
+                strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
 struct intel_hex_record *intel_hex_get_first_record (
                                                 struct intel_hex_file *file)
 {
@@ -357,6 +511,50 @@ void free_intel_hex_file (struct intel_hex_file *file)
     free(file);
 }
 
+int intel_hex_find_string (struct intel_hex_file *file, const char *prefix,
+                           char *buffer, size_t length)
+{
+    size_t prefix_length = strlen(prefix);
+    size_t n = 0;
+    uint32_t next_address = 0;
+    
+    if (length <= prefix_length) {
+        return -1;
+    }
+    
+    for (struct intel_hex_record *r = file->head; r != NULL; r = r->next) {
+        if (r->address != next_address) {
+            // The string can not continue across a gap
+            if (n >= prefix_length) {
+                break;
+            }
+            n = 0;
+        }
+        next_address = r->address + r->length;
+        
+        for (uint8_t i = 0; i < r->length; i++) {
+            char c = (char)r->data[i];
+            
+            if (n < prefix_length) {
+                // Still looking for the prefix
+                n = (c == prefix[n]) ? (n + 1) : ((c == prefix[0]) ? 1 : 0);
+                continue;
+            } else if ((c < 0x20) || (c > 0x7e) || (n == (length - 1))) {
+                goto found;
+            }
+            buffer[n++] = c;
+        }
+    }
+    
+    if (n < prefix_length) {
+        return -1;
+    }
+found:
+    memcpy(buffer, prefix, prefix_length);
+    buffer[n] = '\0';
+    return 0;
+}
+
 int intel_hex_num_records (struct intel_hex_file *file)
 {
     return file->num_records;
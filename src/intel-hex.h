@@ -10,6 +10,7 @@
 #define intel_hex_h
 
 #include <inttypes.h>
+#include <stddef.h>
 
 struct intel_hex_record;
 struct intel_hex_file;
@@ -25,6 +26,55 @@ struct intel_hex_file;
 extern int parse_intel_hex_file (const char *name,
                                  struct intel_hex_file **file);
 
+/**
+ *  Parse an intel hex file which is already in memory into a hex file
+ *  structure.
+ *
+ *  @param buffer The contents of the file, need not be null terminated
+ *  @param length The length of the contents in bytes
+ *  @param file Pointer to where pointer to hex file structure should be placed
+ *
+ *  @return 0 if successfull
+ */
+extern int parse_intel_hex_buffer (const char *buffer, size_t length,
+                                   struct intel_hex_file **file);
+
+/**
+ *  Create an empty hex file structure, to which records can be added with
+ *  intel_hex_add_record.
+ *
+ *  @param file Pointer to where pointer to hex file structure should be placed
+ *
+ *  @return 0 if successfull
+ */
+extern int create_intel_hex_file (struct intel_hex_file **file);
+
+/**
+ *  Add a data record to the end of a hex file structure.
+ *
+ *  @param file The hex file structure
+ *  @param address Address of the record
+ *  @param data Data for the record, it is copied
+ *  @param length Length of the data
+ *
+ *  @return 0 if successfull
+ */
+extern int intel_hex_add_record (struct intel_hex_file *file, uint32_t address,
+                                 const uint8_t *data, uint8_t length);
+
+/**
+ *  Write a hex file structure to a file. Extended linear address records are
+ *  added wherever the upper 16 bits of the address change, records must not
+ *  span a 64 KiB boundary.
+ *
+ *  @param name The name of the file to be written
+ *  @param file The hex file structure to be written
+ *
+ *  @return 0 if successfull
+ */
+extern int write_intel_hex_file (const char *name,
+                                 struct intel_hex_file *file);
+
 /**
  *  Free a hex file data structue and all of the records it contains.
  *
@@ -69,6 +119,22 @@ extern struct intel_hex_record *intel_hex_get_next_record (
  */
 extern uint8_t intel_hex_get_record_length (struct intel_hex_record *record);
 
+/**
+ *  Find a string of printable characters which starts with a prefix in the
+ *  data of a hex file. The string may span records as long as they follow on
+ *  from each other without a gap.
+ *
+ *  @param file The hex file structure to be searched
+ *  @param prefix The prefix that the string starts with
+ *  @param buffer Buffer where the string should be stored
+ *  @param length Length of buffer, the string is truncated to fit
+ *
+ *  @return 0 if a string was found
+ */
+extern int intel_hex_find_string (struct intel_hex_file *file,
+                                  const char *prefix, char *buffer,
+                                  size_t length);
+
 /**
  *  Get the total number of data record in an intel hex file structure.
  *
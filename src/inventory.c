@@ -0,0 +1,230 @@
+//
+//  inventory.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#include "inventory.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <glob.h>
+
+#include "io-loop.h"
+#include "serial-port.h"
+#include "probe.h"
+#include "json.h"
+
+struct inventory_entry {
+    const char *path;
+    struct serial_port *port;
+    struct probe probe;
+};
+
+struct inventory {
+    struct inventory_entry *entries;
+    int num_entries;
+    /** Number of probes which have not finished yet */
+    int pending;
+    /** Set when every probe has finished */
+    int done;
+};
+
+
+/**
+ *  Callback for completion of a probe.
+ */
+static void inventory_probe_done (struct probe *probe, void *context)
+{
+    (void)probe;
+    struct inventory *inventory = context;
+    
+    if (--inventory->pending == 0) {
+        inventory->done = 1;
+    }
+}
+
+/**
+ *  Get a name for the state of an entry.
+ */
+static const char *inventory_state_name (struct inventory_entry *entry)
+{
+    if (entry->port == NULL) {
+        return "unavailable";
+    }
+    return probe_state_name(entry->probe.state);
+}
+
+/**
+ *  Print the results of an inventory as a table.
+ */
+static void inventory_print_table (struct inventory *inventory)
+{
+    printf("%-24s %-12s %-10s %-9s %s\n", "Port", "State", "Bootloader",
+           "Device ID", "Firmware version");
+    
+    for (int i = 0; i < inventory->num_entries; i++) {
+        struct inventory_entry *entry = &inventory->entries[i];
+        char bootloader[16] = "-";
+        char device_id[16] = "-";
+        const char *version = "-";
+        
+        if ((entry->port != NULL) &&
+                (entry->probe.state == PROBE_STATE_BOOTLOADER)) {
+            snprintf(bootloader, sizeof(bootloader), "%d",
+                     entry->probe.bootloader_version);
+            snprintf(device_id, sizeof(device_id), "0x%04X",
+                     entry->probe.device_id);
+        } else if ((entry->port != NULL) &&
+                   (entry->probe.state == PROBE_STATE_APPLICATION)) {
+            version = entry->probe.version;
+        }
+        
+        printf("%-24s %-12s %-10s %-9s %s\n", entry->path,
+               inventory_state_name(entry), bootloader, device_id, version);
+    }
+}
+
+/**
+ *  Print the results of an inventory as one JSON object per line.
+ */
+static void inventory_print_json (struct inventory *inventory)
+{
+    for (int i = 0; i < inventory->num_entries; i++) {
+        struct inventory_entry *entry = &inventory->entries[i];
+        
+        printf("{\"port\":");
+        json_write_string(stdout, entry->path);
+        printf(",\"state\":\"%s\"", inventory_state_name(entry));
+        
+        if ((entry->port != NULL) &&
+                (entry->probe.state == PROBE_STATE_APPLICATION)) {
+            printf(",\"version\":");
+            json_write_string(stdout, entry->probe.version);
+        } else if ((entry->port != NULL) &&
+                   (entry->probe.state == PROBE_STATE_BOOTLOADER)) {
+            printf(",\"bootloader_version\":%d,\"device_id\":%d",
+                   entry->probe.bootloader_version, entry->probe.device_id);
+        }
+        
+        printf("}\n");
+    }
+}
+
+/**
+ *  Add a path to the list of ports to be probed, skipping duplicates.
+ */
+static void inventory_add_path (const char **paths, int *num_paths,
+                                const char *path)
+{
+    for (int i = 0; i < *num_paths; i++) {
+        if (strcmp(paths[i], path) == 0) {
+            return;
+        }
+    }
+    paths[(*num_paths)++] = path;
+}
+
+int inventory_run (char *const *ports, int num_ports, int baudrate,
+                   enum inventory_format format)
+{
+    glob_t matches;
+    int ret = -1;
+    
+    memset(&matches, 0, sizeof(matches));
+    
+    /* Expand any patterns, paths without patterns are kept as they are */
+    for (int i = 0; i < num_ports; i++) {
+        int flags = (i == 0) ? 0 : GLOB_APPEND;
+        if (strpbrk(ports[i], "*?[") == NULL) {
+            flags |= GLOB_NOCHECK;
+        }
+        
+        int g = glob(ports[i], flags, NULL, &matches);
+        if (g == GLOB_NOMATCH) {
+            fprintf(stderr, "No ports match %s\n", ports[i]);
+        } else if (g != 0) {
+            fprintf(stderr, "Could not expand %s\n", ports[i]);
+            goto free_matches;
+        }
+    }
+    
+    const char **paths = calloc(matches.gl_pathc + 1, sizeof(const char *));
+    if (paths == NULL) {
+        fprintf(stderr, "Could not allocate memory for ports.\n");
+        goto free_matches;
+    }
+    
+    int num_paths = 0;
+    for (size_t i = 0; i < matches.gl_pathc; i++) {
+        inventory_add_path(paths, &num_paths, matches.gl_pathv[i]);
+    }
+    
+    if (num_paths == 0) {
+        fprintf(stderr, "No ports to probe\n");
+        goto free_paths;
+    }
+    
+    struct inventory inventory = { .num_entries = num_paths };
+    inventory.entries = calloc((size_t)num_paths,
+                               sizeof(struct inventory_entry));
+    if (inventory.entries == NULL) {
+        fprintf(stderr, "Could not allocate memory for ports.\n");
+        goto free_paths;
+    }
+    
+    struct io_loop *loop;
+    if (io_loop_init(&loop) != 0) {
+        goto free_entries;
+    }
+    
+    /* Start probing every port */
+    for (int i = 0; i < num_paths; i++) {
+        struct inventory_entry *entry = &inventory.entries[i];
+        entry->path = paths[i];
+        
+        if (serial_port_open(loop, entry->path, baudrate, &entry->port) != 0) {
+            continue;
+        }
+        
+        if (probe_start(&entry->probe, entry->port, PROBE_TIMEOUT,
+                        inventory_probe_done, &inventory) != 0) {
+            continue;
+        }
+        inventory.pending++;
+    }
+    
+    if (inventory.pending != 0) {
+        io_loop_run(loop, &inventory.done);
+    }
+    
+    if (format == INVENTORY_FORMAT_JSON) {
+        inventory_print_json(&inventory);
+    } else {
+        inventory_print_table(&inventory);
+    }
+    
+    ret = 0;
+    for (int i = 0; i < num_paths; i++) {
+        struct inventory_entry *entry = &inventory.entries[i];
+        if ((entry->port == NULL) ||
+                (entry->probe.state == PROBE_STATE_NONE)) {
+            ret = -1;
+        }
+        if (entry->port != NULL) {
+            serial_port_close(entry->port);
+        }
+    }
+    
+    io_loop_free(loop);
+free_entries:
+    free(inventory.entries);
+free_paths:
+    free(paths);
+free_matches:
+    globfree(&matches);
+    return ret;
+}
@@ -0,0 +1,34 @@
+//
+//  inventory.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef inventory_h
+#define inventory_h
+
+enum inventory_format {
+    /** Human readable table */
+    INVENTORY_FORMAT_TABLE,
+    /** One JSON object per port, one per line */
+    INVENTORY_FORMAT_JSON
+};
+
+/**
+ *  Find out what is attached to a set of ports. All of the ports are probed at
+ *  the same time, so the whole inventory takes about as long as probing a
+ *  single port. Arguments which contain glob characters are expanded.
+ *
+ *  @param ports Paths or glob patterns for the ports to be probed
+ *  @param num_ports Number of entries in ports
+ *  @param baudrate Baudrate used to talk to modules
+ *  @param format Format in which results should be printed
+ *
+ *  @return 0 if a module was found on every port
+ */
+extern int inventory_run (char *const *ports, int num_ports, int baudrate,
+                          enum inventory_format format);
+
+#endif /* inventory_h */
@@ -0,0 +1,708 @@
+//
+//  io-loop.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#include "io-loop.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+#if defined(__linux__) && !defined(IO_LOOP_USE_POLL)
+#define IO_LOOP_EPOLL   1
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#else
+#define IO_LOOP_EPOLL   0
+#include <poll.h>
+#include <time.h>
+#endif
+
+/** Maximum number of events to be handled in one iteration of the loop */
+#define IO_LOOP_MAX_EVENTS  64
+
+enum io_source_type {
+    IO_SOURCE_WATCH,
+    IO_SOURCE_TIMER
+};
+
+/**
+ *  Common header for watches and timers.
+ */
+struct io_source {
+    struct io_loop *loop;
+    /* Links in the loop's list of sources (or garbage list once removed) */
+    struct io_source *next;
+    struct io_source *prev;
+    
+    enum io_source_type type;
+    /* Watched file descriptor, or timerfd for timers when using epoll */
+    int fd;
+    /* Set once the source has been removed, memory is freed after dispatch */
+    int removed;
+};
+
+struct io_watch {
+    struct io_source source;
+    
+    io_watch_cb callback;
+    void *context;
+    
+    int events;
+};
+
+struct io_timer {
+    struct io_source source;
+    
+    io_timer_cb callback;
+    void *context;
+    
+    /* Next timer in list of timers that expire immediately */
+    struct io_timer *next_immediate;
+    
+    uint8_t armed;
+    uint8_t immediate;
+    uint8_t in_immediate_list;
+#if !IO_LOOP_EPOLL
+    struct timespec deadline;
+#endif
+};
+
+struct io_loop {
+#if IO_LOOP_EPOLL
+    int epoll_fd;
+#else
+    struct pollfd *pollfds;
+    struct io_watch **pollwatches;
+    size_t pollfds_size;
+#endif
+    /* All live sources */
+    struct io_source *sources;
+    /* Sources that have been removed but not yet freed */
+    struct io_source *garbage;
+    /* Timers which have been started with a timeout of zero */
+    struct io_timer *immediate;
+    
+    /* Number of watches and armed timers */
+    int num_watches;
+    int num_armed_timers;
+};
+
+
+/**
+ *  Add a source to the loop's list of sources.
+ *
+ *  @param loop The loop the source belongs to
+ *  @param source The source to be added
+ */
+static void io_source_link (struct io_loop *loop, struct io_source *source)
+{
+    source->loop = loop;
+    source->prev = NULL;
+    source->next = loop->sources;
+    if (loop->sources != NULL) {
+        loop->sources->prev = source;
+    }
+    loop->sources = source;
+}
+
+/**
+ *  Remove a source from the loop's list of sources and place it on the garbage
+ *  list so that it can be freed once no events can refer to it anymore.
+ *
+ *  @param source The source to be removed
+ */
+static void io_source_unlink (struct io_source *source)
+{
+    struct io_loop *loop = source->loop;
+    
+    if (source->prev != NULL) {
+        source->prev->next = source->next;
+    } else {
+        loop->sources = source->next;
+    }
+    if (source->next != NULL) {
+        source->next->prev = source->prev;
+    }
+    
+    source->removed = 1;
+    source->prev = NULL;
+    source->next = loop->garbage;
+    loop->garbage = source;
+}
+
+/**
+ *  Free all of the sources on the garbage list.
+ *
+ *  @param loop The loop for which garbage should be collected
+ */
+static void io_loop_collect_garbage (struct io_loop *loop)
+{
+    while (loop->garbage != NULL) {
+        struct io_source *source = loop->garbage;
+        loop->garbage = source->next;
+        
+        if (source->type == IO_SOURCE_TIMER) {
+#if IO_LOOP_EPOLL
+            close(source->fd);
+#endif
+        }
+        free(source);
+    }
+}
+
+#if IO_LOOP_EPOLL
+/**
+ *  Convert a mask of IO_EVENT_* values to a mask of epoll events.
+ */
+static uint32_t io_loop_epoll_events (int events)
+{
+    return (((events & IO_EVENT_READ) ? EPOLLIN : 0) |
+            ((events & IO_EVENT_WRITE) ? EPOLLOUT : 0));
+}
+#else
+/**
+ *  Get the current time from the monotonic clock.
+ */
+static struct timespec io_loop_now (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts;
+}
+
+/**
+ *  Get the number of milliseconds from one time to another, rounded up.
+ */
+static long io_loop_millis_until (const struct timespec *from,
+                                  const struct timespec *to)
+{
+    long nanos = (((long)(to->tv_sec - from->tv_sec) * 1000000000L) +
+                  (to->tv_nsec - from->tv_nsec));
+    return (nanos <= 0) ? 0 : ((nanos + 999999L) / 1000000L);
+}
+#endif
+
+
+int io_loop_init (struct io_loop **loop)
+{
+    *loop = calloc(1, sizeof(struct io_loop));
+    
+    if (*loop == NULL) {
+        fprintf(stderr, "Could not allocate memory for event loop.\n");
+        return -1;
+    }
+    
+#if IO_LOOP_EPOLL
+    (*loop)->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    
+    if ((*loop)->epoll_fd == -1) {
+        fprintf(stderr, "Could not create epoll instance: %s.\n",
+                strerror(errno));
+        free(*loop);
+        return -1;
+    }
+#endif
+    
+    return 0;
+}
+
+void io_loop_free (struct io_loop *loop)
+{
+    while (loop->sources != NULL) {
+        io_source_unlink(loop->sources);
+    }
+    io_loop_collect_garbage(loop);
+    
+#if IO_LOOP_EPOLL
+    close(loop->epoll_fd);
+#else
+    free(loop->pollfds);
+    free(loop->pollwatches);
+#endif
+    free(loop);
+}
+
+/**
+ *  Run the callbacks for all of the timers which were started with a timeout of
+ *  zero.
+ *
+ *  @param loop The loop for which immediate timers should be run
+ */
+static void io_loop_run_immediate (struct io_loop *loop)
+{
+    struct io_timer *list = loop->immediate;
+    loop->immediate = NULL;
+    
+    while (list != NULL) {
+        struct io_timer *timer = list;
+        list = timer->next_immediate;
+        timer->in_immediate_list = 0;
+        
+        if (timer->source.removed || !timer->armed || !timer->immediate) {
+            continue;
+        }
+        
+        timer->armed = 0;
+        timer->immediate = 0;
+        loop->num_armed_timers--;
+        timer->callback(timer, timer->context);
+    }
+}
+
+/**
+ *  Handle the expiry of a timer.
+ *
+ *  @param timer The timer that has expired
+ */
+static void io_timer_expire (struct io_timer *timer)
+{
+    if (timer->source.removed || !timer->armed || timer->immediate) {
+        return;
+    }
+    
+#if IO_LOOP_EPOLL
+    /* Clear the expiration count, if the timer was restarted since the event
+       was generated this will fail and the event is ignored */
+    uint64_t expirations;
+    if (read(timer->source.fd, &expirations, sizeof(expirations)) !=
+            (ssize_t)sizeof(expirations)) {
+        return;
+    }
+#endif
+    
+    timer->armed = 0;
+    timer->source.loop->num_armed_timers--;
+    timer->callback(timer, timer->context);
+}
+
+#if IO_LOOP_EPOLL
+int io_loop_run_once (struct io_loop *loop, long timeout)
+{
+    struct epoll_event events[IO_LOOP_MAX_EVENTS];
+    
+    if (loop->immediate != NULL) {
+        timeout = 0;
+    }
+    
+    int n = epoll_wait(loop->epoll_fd, events, IO_LOOP_MAX_EVENTS,
+                       (timeout > INT32_MAX) ? INT32_MAX : (int)timeout);
+    
+    if (n == -1) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        fprintf(stderr, "Could not wait for events: %s.\n", strerror(errno));
+        return -1;
+    }
+    
+    for (int i = 0; i < n; i++) {
+        struct io_source *source = events[i].data.ptr;
+        
+        if (source->removed) {
+            continue;
+        }
+        
+        if (source->type == IO_SOURCE_TIMER) {
+            io_timer_expire((struct io_timer *)source);
+        } else {
+            struct io_watch *watch = (struct io_watch *)source;
+            int ready = (((events[i].events & EPOLLIN) ? IO_EVENT_READ : 0) |
+                         ((events[i].events & EPOLLOUT) ? IO_EVENT_WRITE : 0) |
+                         ((events[i].events & (EPOLLERR | EPOLLHUP)) ?
+                                                        IO_EVENT_ERROR : 0));
+            watch->callback(watch, ready, watch->context);
+        }
+    }
+    
+    io_loop_run_immediate(loop);
+    io_loop_collect_garbage(loop);
+    
+    return 0;
+}
+#else
+int io_loop_run_once (struct io_loop *loop, long timeout)
+{
+    /* Make sure that there is space for all watches */
+    if (loop->pollfds_size < (size_t)loop->num_watches) {
+        size_t size = (size_t)loop->num_watches * 2;
+        struct pollfd *fds = realloc(loop->pollfds, size * sizeof(*fds));
+        if (fds == NULL) {
+            fprintf(stderr, "Could not allocate memory for poll.\n");
+            return -1;
+        }
+        loop->pollfds = fds;
+        struct io_watch **watches = realloc(loop->pollwatches,
+                                            size * sizeof(*watches));
+        if (watches == NULL) {
+            fprintf(stderr, "Could not allocate memory for poll.\n");
+            return -1;
+        }
+        loop->pollwatches = watches;
+        loop->pollfds_size = size;
+    }
+    
+    /* Collect file descriptors and find the closest deadline */
+    struct timespec now = io_loop_now();
+    nfds_t nfds = 0;
+    
+    for (struct io_source *s = loop->sources; s != NULL; s = s->next) {
+        if (s->type == IO_SOURCE_WATCH) {
+            struct io_watch *watch = (struct io_watch *)s;
+            loop->pollfds[nfds].fd = s->fd;
+            loop->pollfds[nfds].events = (
+                            ((watch->events & IO_EVENT_READ) ? POLLIN : 0) |
+                            ((watch->events & IO_EVENT_WRITE) ? POLLOUT : 0));
+            loop->pollfds[nfds].revents = 0;
+            loop->pollwatches[nfds] = watch;
+            nfds++;
+        } else {
+            struct io_timer *timer = (struct io_timer *)s;
+            if (!timer->armed || timer->immediate) {
+                continue;
+            }
+            long remaining = io_loop_millis_until(&now, &timer->deadline);
+            if ((timeout < 0) || (remaining < timeout)) {
+                timeout = remaining;
+            }
+        }
+    }
+    
+    if (loop->immediate != NULL) {
+        timeout = 0;
+    }
+    
+    int n = poll(loop->pollfds, nfds,
+                 (timeout > INT32_MAX) ? INT32_MAX : (int)timeout);
+    
+    if (n == -1) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        fprintf(stderr, "Could not wait for events: %s.\n", strerror(errno));
+        return -1;
+    }
+    
+    for (nfds_t i = 0; (n > 0) && (i < nfds); i++) {
+        struct io_watch *watch = loop->pollwatches[i];
+        short revents = loop->pollfds[i].revents;
+        
+        if ((revents == 0) || watch->source.removed) {
+            continue;
+        }
+        
+        int ready = (((revents & POLLIN) ? IO_EVENT_READ : 0) |
+                     ((revents & POLLOUT) ? IO_EVENT_WRITE : 0) |
+                     ((revents & (POLLERR | POLLHUP | POLLNVAL)) ?
+                                                        IO_EVENT_ERROR : 0));
+        watch->callback(watch, ready, watch->context);
+    }
+    
+    /* Run expired timers */
+    now = io_loop_now();
+    for (struct io_source *s = loop->sources; s != NULL;) {
+        struct io_source *next = s->next;
+        if (s->type == IO_SOURCE_TIMER) {
+            struct io_timer *timer = (struct io_timer *)s;
+            if (timer->armed && !timer->immediate &&
+                    (io_loop_millis_until(&now, &timer->deadline) == 0)) {
+                io_timer_expire(timer);
+            }
+        }
+        /* The next source may have been removed by the callback, in that case
+           its next pointer points into the garbage list so start over from
+           the beginning of the list rather than walking into it */
+        s = ((next != NULL) && next->removed) ? loop->sources : next;
+    }
+    
+    io_loop_run_immediate(loop);
+    io_loop_collect_garbage(loop);
+    
+    return 0;
+}
+#endif
+
+int io_loop_get_fd (struct io_loop *loop)
+{
+#if IO_LOOP_EPOLL
+    return loop->epoll_fd;
+#else
+    (void)loop;
+    return -1;
+#endif
+}
+
+long io_loop_get_timeout (struct io_loop *loop)
+{
+    if (loop->immediate != NULL) {
+        return 0;
+    }
+    
+#if IO_LOOP_EPOLL
+    /* Timers are timerfds which are watched by the epoll descriptor */
+    return -1;
+#else
+    struct timespec now = io_loop_now();
+    long timeout = -1;
+    
+    for (struct io_source *s = loop->sources; s != NULL; s = s->next) {
+        if (s->type != IO_SOURCE_TIMER) {
+            continue;
+        }
+        struct io_timer *timer = (struct io_timer *)s;
+        if (!timer->armed || timer->source.removed) {
+            continue;
+        }
+        long remaining = io_loop_millis_until(&now, &timer->deadline);
+        if ((timeout < 0) || (remaining < timeout)) {
+            timeout = remaining;
+        }
+    }
+    return timeout;
+#endif
+}
+
+int io_loop_run (struct io_loop *loop, const volatile int *done)
+{
+    while (!*done) {
+        if ((loop->num_watches == 0) && (loop->num_armed_timers == 0)) {
+            fprintf(stderr, "Event loop has nothing left to wait for.\n");
+            return -1;
+        }
+        
+        if (io_loop_run_once(loop, -1) != 0) {
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+
+int io_watch_add (struct io_loop *loop, int fd, int events,
+                  io_watch_cb callback, void *context, struct io_watch **watch)
+{
+    *watch = calloc(1, sizeof(struct io_watch));
+    
+    if (*watch == NULL) {
+        fprintf(stderr, "Could not allocate memory for watch.\n");
+        return -1;
+    }
+    
+    (*watch)->source.type = IO_SOURCE_WATCH;
+    (*watch)->source.fd = fd;
+    (*watch)->callback = callback;
+    (*watch)->context = context;
+    (*watch)->events = events;
+    
+#if IO_LOOP_EPOLL
+    struct epoll_event event = {
+        .events = io_loop_epoll_events(events),
+        .data.ptr = *watch
+    };
+    
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        fprintf(stderr, "Could not add file descriptor to epoll: %s.\n",
+                strerror(errno));
+        free(*watch);
+        return -1;
+    }
+#endif
+    
+    io_source_link(loop, &(*watch)->source);
+    loop->num_watches++;
+    
+    return 0;
+}
+
+int io_watch_set_events (struct io_watch *watch, int events)
+{
+    if (watch->events == events) {
+        return 0;
+    }
+    
+#if IO_LOOP_EPOLL
+    struct epoll_event event = {
+        .events = io_loop_epoll_events(events),
+        .data.ptr = watch
+    };
+    
+    if (epoll_ctl(watch->source.loop->epoll_fd, EPOLL_CTL_MOD, watch->source.fd,
+                  &event) != 0) {
+        fprintf(stderr, "Could not modify epoll events: %s.\n",
+                strerror(errno));
+        return -1;
+    }
+#endif
+    
+    watch->events = events;
+    return 0;
+}
+
+void io_watch_remove (struct io_watch *watch)
+{
+    if (watch->source.removed) {
+        return;
+    }
+    
+#if IO_LOOP_EPOLL
+    epoll_ctl(watch->source.loop->epoll_fd, EPOLL_CTL_DEL, watch->source.fd,
+              NULL);
+#endif
+    
+    watch->source.loop->num_watches--;
+    io_source_unlink(&watch->source);
+}
+
+
+int io_timer_init (struct io_loop *loop, io_timer_cb callback, void *context,
+                   struct io_timer **timer)
+{
+    *timer = calloc(1, sizeof(struct io_timer));
+    
+    if (*timer == NULL) {
+        fprintf(stderr, "Could not allocate memory for timer.\n");
+        return -1;
+    }
+    
+    (*timer)->source.type = IO_SOURCE_TIMER;
+    (*timer)->source.fd = -1;
+    (*timer)->callback = callback;
+    (*timer)->context = context;
+    
+#if IO_LOOP_EPOLL
+    (*timer)->source.fd = timerfd_create(CLOCK_MONOTONIC,
+                                         TFD_NONBLOCK | TFD_CLOEXEC);
+    
+    if ((*timer)->source.fd == -1) {
+        fprintf(stderr, "Could not create timerfd: %s.\n", strerror(errno));
+        free(*timer);
+        return -1;
+    }
+    
+    struct epoll_event event = {
+        .events = EPOLLIN,
+        .data.ptr = *timer
+    };
+    
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, (*timer)->source.fd,
+                  &event) != 0) {
+        fprintf(stderr, "Could not add timer to epoll: %s.\n",
+                strerror(errno));
+        close((*timer)->source.fd);
+        free(*timer);
+        return -1;
+    }
+#endif
+    
+    io_source_link(loop, &(*timer)->source);
+    
+    return 0;
+}
+
+int io_timer_start (struct io_timer *timer, long timeout)
+{
+    struct io_loop *loop = timer->source.loop;
+    
+    io_timer_stop(timer);
+    
+    if (timeout <= 0) {
+        timer->immediate = 1;
+        if (!timer->in_immediate_list) {
+            timer->in_immediate_list = 1;
+            timer->next_immediate = loop->immediate;
+            loop->immediate = timer;
+        }
+    } else {
+#if IO_LOOP_EPOLL
+        struct itimerspec spec = {
+            .it_interval = { 0, 0 },
+            .it_value = {
+                .tv_sec = timeout / 1000,
+                .tv_nsec = (timeout % 1000) * 1000000L
+            }
+        };
+        
+        if (timerfd_settime(timer->source.fd, 0, &spec, NULL) != 0) {
+            fprintf(stderr, "Could not start timer: %s.\n", strerror(errno));
+            return -1;
+        }
+#else
+        timer->deadline = io_loop_now();
+        timer->deadline.tv_sec += timeout / 1000;
+        timer->deadline.tv_nsec += (timeout % 1000) * 1000000L;
+        if (timer->deadline.tv_nsec >= 1000000000L) {
+            timer->deadline.tv_sec++;
+            timer->deadline.tv_nsec -= 1000000000L;
+        }
+#endif
+    }
+    
+    timer->armed = 1;
+    loop->num_armed_timers++;
+    
+    return 0;
+}
+
+void io_timer_stop (struct io_timer *timer)
+{
+    if (!timer->armed) {
+        return;
+    }
+    
+#if IO_LOOP_EPOLL
+    if (!timer->immediate) {
+        struct itimerspec spec;
+        memset(&spec, 0, sizeof(spec));
+        timerfd_settime(timer->source.fd, 0, &spec, NULL);
+    }
+#endif
+    
+    timer->armed = 0;
+    timer->immediate = 0;
+    timer->source.loop->num_armed_timers--;
+}
+
+int io_timer_is_armed (struct io_timer *timer)
+{
+    return timer->armed;
+}
+
+void io_timer_free (struct io_timer *timer)
+{
+    if (timer->source.removed) {
+        return;
+    }
+    
+    io_timer_stop(timer);
+    
+    // The timer is freed with the rest of the garbage, so it must not be left
+    // where the next run of immediate timers would find it. A timer on the
+    // list that is being run is not on the loop's list, and is skipped since
+    // it has been removed.
+    if (timer->in_immediate_list) {
+        struct io_timer **link = &timer->source.loop->immediate;
+        while (*link != NULL) {
+            if (*link == timer) {
+                *link = timer->next_immediate;
+                timer->in_immediate_list = 0;
+                break;
+            }
+            link = &(*link)->next_immediate;
+        }
+    }
+    
+#if IO_LOOP_EPOLL
+    epoll_ctl(timer->source.loop->epoll_fd, EPOLL_CTL_DEL, timer->source.fd,
+              NULL);
+#endif
+    
+    io_source_unlink(&timer->source);
+}
@@ -0,0 +1,191 @@
+//
+//  io-loop.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef io_loop_h
+#define io_loop_h
+
+/** The file descriptor is readable */
+#define IO_EVENT_READ   0x1
+/** The file descriptor is writable */
+#define IO_EVENT_WRITE  0x2
+/** An error or hangup occured on the file descriptor */
+#define IO_EVENT_ERROR  0x4
+
+struct io_loop;
+struct io_watch;
+struct io_timer;
+
+/**
+ *  Callback for readiness events on a watched file descriptor.
+ *
+ *  @param watch The watch which has become ready
+ *  @param events Mask of IO_EVENT_* values describing the readiness
+ *  @param context The context pointer given when the watch was added
+ */
+typedef void (*io_watch_cb)(struct io_watch *watch, int events, void *context);
+
+/**
+ *  Callback for an expired timer.
+ *
+ *  @param timer The timer which has expired
+ *  @param context The context pointer given when the timer was created
+ */
+typedef void (*io_timer_cb)(struct io_timer *timer, void *context);
+
+
+/**
+ *  Create a new event loop. On Linux the loop is based on epoll and timerfds,
+ *  on other platforms poll() is used.
+ *
+ *  @param loop Pointer to where pointer to new loop should be stored
+ *
+ *  @return 0 if successfull
+ */
+extern int io_loop_init (struct io_loop **loop);
+
+/**
+ *  Free an event loop. All watches and timers which are still registered with
+ *  the loop are freed as well.
+ *
+ *  @param loop The loop to be freed
+ */
+extern void io_loop_free (struct io_loop *loop);
+
+/**
+ *  Wait for events and dispatch callbacks for all of the events that are
+ *  ready.
+ *
+ *  @param loop The loop to be run
+ *  @param timeout Maximum time to wait in milliseconds, -1 to wait forever
+ *
+ *  @return 0 if successfull
+ */
+extern int io_loop_run_once (struct io_loop *loop, long timeout);
+
+/**
+ *  Get a file descriptor which becomes readable when the loop has events to
+ *  dispatch, so that the loop can be driven from another event loop. When it
+ *  is readable, or once the time from io_loop_get_timeout has passed, call
+ *  io_loop_run_once with a timeout of 0.
+ *
+ *  @param loop The loop
+ *
+ *  @return The file descriptor, or -1 if the loop is based on poll() and has
+ *          no such descriptor, in which case io_loop_run_once must be called
+ *          with the timeout from io_loop_get_timeout instead
+ */
+extern int io_loop_get_fd (struct io_loop *loop);
+
+/**
+ *  Get the longest time that may pass before io_loop_run_once should be called
+ *  when waiting on the loop's file descriptor from another event loop.
+ *
+ *  @param loop The loop
+ *
+ *  @return Time in milliseconds, or -1 if there is no limit
+ */
+extern long io_loop_get_timeout (struct io_loop *loop);
+
+/**
+ *  Run an event loop until a flag is set by one of the callbacks.
+ *
+ *  @param loop The loop to be run
+ *  @param done Pointer to flag which ends the loop when it becomes non-zero
+ *
+ *  @return 0 if successfull, -1 if an error occured or there are no more
+ *          watches or timers that could ever set the flag
+ */
+extern int io_loop_run (struct io_loop *loop, const volatile int *done);
+
+
+/**
+ *  Start watching a file descriptor for readiness. The file descriptor should
+ *  be in non-blocking mode.
+ *
+ *  @param loop The loop which should watch the file descriptor
+ *  @param fd The file descriptor to be watched
+ *  @param events Mask of IO_EVENT_READ and IO_EVENT_WRITE
+ *  @param callback Function to be called when the file descriptor is ready
+ *  @param context Pointer passed to callback
+ *  @param watch Pointer to where pointer to new watch should be stored
+ *
+ *  @return 0 if successfull
+ */
+extern int io_watch_add (struct io_loop *loop, int fd, int events,
+                         io_watch_cb callback, void *context,
+                         struct io_watch **watch);
+
+/**
+ *  Change the set of events which a watch is interested in.
+ *
+ *  @param watch The watch to be modified
+ *  @param events Mask of IO_EVENT_READ and IO_EVENT_WRITE
+ *
+ *  @return 0 if successfull
+ */
+extern int io_watch_set_events (struct io_watch *watch, int events);
+
+/**
+ *  Stop watching a file descriptor and free the watch. It is safe to call this
+ *  from within any callback. The file descriptor is not closed.
+ *
+ *  @param watch The watch to be removed
+ */
+extern void io_watch_remove (struct io_watch *watch);
+
+
+/**
+ *  Create a new one-shot timer. The timer is not started.
+ *
+ *  @param loop The loop which the timer should belong to
+ *  @param callback Function to be called when the timer expires
+ *  @param context Pointer passed to callback
+ *  @param timer Pointer to where pointer to new timer should be stored
+ *
+ *  @return 0 if successfull
+ */
+extern int io_timer_init (struct io_loop *loop, io_timer_cb callback,
+                          void *context, struct io_timer **timer);
+
+/**
+ *  Start (or restart) a timer.
+ *
+ *  @note A timeout of 0 causes the callback to be run on the next iteration of
+ *        the loop, this can be used to defer work out of the current callback.
+ *
+ *  @param timer The timer to be started
+ *  @param timeout Time until the timer expires in milliseconds
+ *
+ *  @return 0 if successfull
+ */
+extern int io_timer_start (struct io_timer *timer, long timeout);
+
+/**
+ *  Stop a timer if it is running.
+ *
+ *  @param timer The timer to be stopped
+ */
+extern void io_timer_stop (struct io_timer *timer);
+
+/**
+ *  Check whether a timer is running.
+ *
+ *  @param timer The timer to be checked
+ *
+ *  @return Non-zero if the timer is armed
+ */
+extern int io_timer_is_armed (struct io_timer *timer);
+
+/**
+ *  Stop and free a timer. It is safe to call this from within any callback.
+ *
+ *  @param timer The timer to be freed
+ */
+extern void io_timer_free (struct io_timer *timer);
+
+#endif /* io_loop_h */
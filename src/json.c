@@ -0,0 +1,248 @@
+//
+//  json.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#include "json.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/**
+ *  Skip whitespace.
+ *
+ *  @param p Pointer into text
+ *
+ *  @return Pointer to first non-whitespace character
+ */
+static const char *json_skip_space (const char *p)
+{
+    while (isspace((unsigned char)*p)) {
+        p++;
+    }
+    return p;
+}
+
+/**
+ *  Parse a four digit hex value from a \u escape.
+ *
+ *  @param p Pointer to the first digit
+ *
+ *  @return The value, or -1 if the digits are not valid
+ */
+static long json_parse_hex4 (const char *p)
+{
+    long value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        value <<= 4;
+        if ((c >= '0') && (c <= '9')) {
+            value |= c - '0';
+        } else if ((c >= 'a') && (c <= 'f')) {
+            value |= c - 'a' + 10;
+        } else if ((c >= 'A') && (c <= 'F')) {
+            value |= c - 'A' + 10;
+        } else {
+            return -1;
+        }
+    }
+    return value;
+}
+
+/**
+ *  Parse a quoted string, unescaping it into a buffer. The unescaped string is
+ *  never longer than the escaped one.
+ *
+ *  @param p Pointer to the opening quote
+ *  @param out Buffer for the unescaped string
+ *
+ *  @return Pointer to the character after the closing quote, or NULL if the
+ *          string is not valid
+ */
+static const char *json_parse_string (const char *p, char *out)
+{
+    p++;
+    
+    while (*p != '"') {
+        if ((*p == '\0') || ((unsigned char)*p < 0x20)) {
+            return NULL;
+        } else if (*p != '\\') {
+            *out++ = *p++;
+            continue;
+        }
+        
+        p++;
+        switch (*p) {
+            case '"':
+            case '\\':
+            case '/':
+                *out++ = *p;
+                break;
+            case 'b':
+                *out++ = '\b';
+                break;
+            case 'f':
+                *out++ = '\f';
+                break;
+            case 'n':
+                *out++ = '\n';
+                break;
+            case 'r':
+                *out++ = '\r';
+                break;
+            case 't':
+                *out++ = '\t';
+                break;
+            case 'u':
+                ;
+                long c = json_parse_hex4(p + 1);
+                if ((c <= 0) || ((c >= 0xD800) && (c <= 0xDFFF))) {
+                    // Null characters and surrogate pairs are not supported
+                    return NULL;
+                } else if (c < 0x80) {
+                    *out++ = (char)c;
+                } else if (c < 0x800) {
+                    *out++ = (char)(0xC0 | (c >> 6));
+                    *out++ = (char)(0x80 | (c & 0x3F));
+                } else {
+                    *out++ = (char)(0xE0 | (c >> 12));
+                    *out++ = (char)(0x80 | ((c >> 6) & 0x3F));
+                    *out++ = (char)(0x80 | (c & 0x3F));
+                }
+                p += 4;
+                break;
+            default:
+                return NULL;
+        }
+        p++;
+    }
+    
+    *out = '\0';
+    return p + 1;
+}
+
+int json_parse_object (const char *text, json_member_cb callback,
+                       void *context)
+{
+    // Keys and values can never be longer than the text itself
+    size_t size = strlen(text) + 1;
+    char *key = malloc(size);
+    char *value = malloc(size);
+    int ret = -1;
+    
+    if ((key == NULL) || (value == NULL)) {
+        goto done;
+    }
+    
+    const char *p = json_skip_space(text);
+    if (*p++ != '{') {
+        goto done;
+    }
+    
+    p = json_skip_space(p);
+    if (*p == '}') {
+        p++;
+        goto end;
+    }
+    
+    for (;;) {
+        /* Key */
+        if (*p != '"') {
+            goto done;
+        }
+        p = json_parse_string(p, key);
+        if (p == NULL) {
+            goto done;
+        }
+        
+        p = json_skip_space(p);
+        if (*p++ != ':') {
+            goto done;
+        }
+        p = json_skip_space(p);
+        
+        /* Value */
+        enum json_type type;
+        if (*p == '"') {
+            type = JSON_STRING;
+            p = json_parse_string(p, value);
+            if (p == NULL) {
+                goto done;
+            }
+        } else if (strncmp(p, "true", 4) == 0) {
+            type = JSON_BOOL;
+            strcpy(value, "true");
+            p += 4;
+        } else if (strncmp(p, "false", 5) == 0) {
+            type = JSON_BOOL;
+            strcpy(value, "false");
+            p += 5;
+        } else if (strncmp(p, "null", 4) == 0) {
+            type = JSON_NULL;
+            strcpy(value, "null");
+            p += 4;
+        } else if ((*p == '-') || isdigit((unsigned char)*p)) {
+            type = JSON_NUMBER;
+            size_t len = strspn(p, "+-0123456789.eE");
+            memcpy(value, p, len);
+            value[len] = '\0';
+            p += len;
+        } else {
+            goto done;
+        }
+        
+        int cb_ret = callback(key, type, value, context);
+        if (cb_ret != 0) {
+            ret = cb_ret;
+            goto done;
+        }
+        
+        p = json_skip_space(p);
+        if (*p == '}') {
+            p++;
+            break;
+        } else if (*p++ != ',') {
+            goto done;
+        }
+        p = json_skip_space(p);
+    }
+    
+end:
+    if (*json_skip_space(p) == '\0') {
+        ret = 0;
+    }
+done:
+    free(key);
+    free(value);
+    return ret;
+}
+
+void json_write_string (FILE *file, const char *str)
+{
+    fputc('"', file);
+    
+    for (const char *p = str; *p != '\0'; p++) {
+        unsigned char c = (unsigned char)*p;
+        
+        if ((c == '"') || (c == '\\')) {
+            fputc('\\', file);
+            fputc(c, file);
+        } else if (c == '\n') {
+            fputs("\\n", file);
+        } else if (c == '\r') {
+            fputs("\\r", file);
+        } else if (c == '\t') {
+            fputs("\\t", file);
+        } else if (c < 0x20) {
+            fprintf(file, "\\u%04x", c);
+        } else {
+            fputc(c, file);
+        }
+    }
+    
+    fputc('"', file);
+}
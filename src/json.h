@@ -0,0 +1,56 @@
+//
+//  json.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef json_h
+#define json_h
+
+#include <stdio.h>
+
+enum json_type {
+    JSON_STRING,
+    JSON_NUMBER,
+    JSON_BOOL,
+    JSON_NULL
+};
+
+/**
+ *  Callback for each member of a parsed JSON object.
+ *
+ *  @param key The member's name
+ *  @param type The type of the member's value
+ *  @param value The value as a string, strings are unescaped
+ *  @param context The context pointer given to json_parse_object
+ *
+ *  @return 0 to continue parsing, anything else stops parsing and is returned
+ *          from json_parse_object
+ */
+typedef int (*json_member_cb)(const char *key, enum json_type type,
+                              const char *value, void *context);
+
+/**
+ *  Parse a flat JSON object. Nested objects and arrays are not supported.
+ *
+ *  @param text Null terminated text containing the object
+ *  @param callback Function to be called for each member of the object
+ *  @param context Pointer to be passed to callback
+ *
+ *  @return 0 if successfull, -1 if the text is not a valid object, or the
+ *          value returned by a callback which stopped parsing
+ */
+extern int json_parse_object (const char *text, json_member_cb callback,
+                              void *context);
+
+/**
+ *  Write a string to a file as a quoted and escaped JSON string.
+ *
+ *  @param file The file to write to
+ *  @param str The string to be written
+ */
+extern void json_write_string (FILE *file, const char *str);
+
+#endif /* json_h */
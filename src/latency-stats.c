@@ -0,0 +1,172 @@
+//
+//  latency-stats.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#include "latency-stats.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <inttypes.h>
+
+/**
+ *  Find the histogram bucket for a value. Values below the number of sub
+ *  buckets get their own bucket, above that each power of two is split into
+ *  LATENCY_STATS_SUB_BUCKETS linear buckets.
+ *
+ *  @param value The value
+ *
+ *  @return The index of the bucket
+ */
+static unsigned int latency_stats_bucket (uint64_t value)
+{
+    if (value < LATENCY_STATS_SUB_BUCKETS) {
+        return (unsigned int)value;
+    }
+    
+    unsigned int msb = 63 - (unsigned int)__builtin_clzll(value);
+    unsigned int shift = msb - 3;
+    unsigned int index = ((shift + 1) * LATENCY_STATS_SUB_BUCKETS) +
+                                (unsigned int)((value >> shift) & 0x7);
+    
+    return (index >= LATENCY_STATS_BUCKETS) ? (LATENCY_STATS_BUCKETS - 1) :
+                                              index;
+}
+
+/**
+ *  Get the smallest value that falls in a histogram bucket.
+ *
+ *  @param index The index of the bucket
+ *
+ *  @return The lower bound of the bucket
+ */
+static uint64_t latency_stats_bucket_floor (unsigned int index)
+{
+    if (index < LATENCY_STATS_SUB_BUCKETS) {
+        return index;
+    }
+    
+    unsigned int shift = (index / LATENCY_STATS_SUB_BUCKETS) - 1;
+    uint64_t sub = index % LATENCY_STATS_SUB_BUCKETS;
+    
+    return (LATENCY_STATS_SUB_BUCKETS + sub) << shift;
+}
+
+uint64_t latency_stats_now (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000) + (uint64_t)(ts.tv_nsec / 1000);
+}
+
+void latency_stats_reset (struct latency_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+void latency_stats_add (struct latency_stats *stats, uint64_t micros)
+{
+    if ((stats->count == 0) || (micros < stats->min)) {
+        stats->min = micros;
+    }
+    if (micros > stats->max) {
+        stats->max = micros;
+    }
+    
+    stats->count++;
+    double delta = (double)micros - stats->mean;
+    stats->mean += delta / (double)stats->count;
+    stats->m2 += delta * ((double)micros - stats->mean);
+    
+    stats->buckets[latency_stats_bucket(micros)]++;
+}
+
+void latency_stats_merge (struct latency_stats *dest,
+                          const struct latency_stats *src)
+{
+    if (src->count == 0) {
+        return;
+    } else if (dest->count == 0) {
+        memcpy(dest, src, sizeof(*dest));
+        return;
+    }
+    
+    /* Combine means and variances (Chan et al.) */
+    double count = (double)(dest->count + src->count);
+    double delta = src->mean - dest->mean;
+    
+    dest->m2 += src->m2 + ((delta * delta) * (double)dest->count *
+                           (double)src->count / count);
+    dest->mean += delta * (double)src->count / count;
+    dest->count += src->count;
+    
+    if (src->min < dest->min) {
+        dest->min = src->min;
+    }
+    if (src->max > dest->max) {
+        dest->max = src->max;
+    }
+    
+    for (unsigned int i = 0; i < LATENCY_STATS_BUCKETS; i++) {
+        dest->buckets[i] += src->buckets[i];
+    }
+}
+
+double latency_stats_stddev (const struct latency_stats *stats)
+{
+    if (stats->count < 2) {
+        return 0;
+    }
+    return sqrt(stats->m2 / (double)(stats->count - 1));
+}
+
+uint64_t latency_stats_percentile (const struct latency_stats *stats,
+                                   double percentile)
+{
+    if (stats->count == 0) {
+        return 0;
+    }
+    
+    double rank = ceil((percentile / 100) * (double)stats->count);
+    uint64_t target = (uint64_t)rank;
+    uint64_t seen = 0;
+    
+    if (target == 0) {
+        return stats->min;
+    }
+    
+    for (unsigned int i = 0; i < LATENCY_STATS_BUCKETS; i++) {
+        seen += stats->buckets[i];
+        if (seen >= target) {
+            uint64_t value = latency_stats_bucket_floor(i);
+            // Clamp to the observed range
+            if (value < stats->min) {
+                return stats->min;
+            } else if (value > stats->max) {
+                return stats->max;
+            }
+            return value;
+        }
+    }
+    
+    return stats->max;
+}
+
+void latency_stats_print (const struct latency_stats *stats, const char *label)
+{
+    if (stats->count == 0) {
+        printf("%s: no samples\n", label);
+        return;
+    }
+    
+    printf("%s: n=%" PRIu64 " mean=%.0fus stddev=%.0fus min=%" PRIu64 "us "
+           "p50=%" PRIu64 "us p99=%" PRIu64 "us max=%" PRIu64 "us\n", label,
+           stats->count, stats->mean, latency_stats_stddev(stats), stats->min,
+           latency_stats_percentile(stats, 50),
+           latency_stats_percentile(stats, 99), stats->max);
+}
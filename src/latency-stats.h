@@ -0,0 +1,96 @@
+//
+//  latency-stats.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef latency_stats_h
+#define latency_stats_h
+
+#include <stdint.h>
+
+/** Number of histogram buckets for each power of two */
+#define LATENCY_STATS_SUB_BUCKETS   8
+/** Number of powers of two covered by the histogram (up to about 4 minutes) */
+#define LATENCY_STATS_OCTAVES       26
+/** Total number of histogram buckets */
+#define LATENCY_STATS_BUCKETS   (LATENCY_STATS_SUB_BUCKETS * \
+                                 LATENCY_STATS_OCTAVES)
+
+/**
+ *  Summary statistics and a log-linear histogram of latency samples.
+ */
+struct latency_stats {
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    /* Running mean and sum of squared differences (Welford's method) */
+    double mean;
+    double m2;
+    
+    uint32_t buckets[LATENCY_STATS_BUCKETS];
+};
+
+/**
+ *  Get the current time from the monotonic clock.
+ *
+ *  @return The current time in microseconds
+ */
+extern uint64_t latency_stats_now (void);
+
+/**
+ *  Reset a set of statistics.
+ *
+ *  @param stats The statistics to be reset
+ */
+extern void latency_stats_reset (struct latency_stats *stats);
+
+/**
+ *  Add a sample to a set of statistics.
+ *
+ *  @param stats The statistics to which the sample should be added
+ *  @param micros The sample in microseconds
+ */
+extern void latency_stats_add (struct latency_stats *stats, uint64_t micros);
+
+/**
+ *  Merge one set of statistics into another.
+ *
+ *  @param dest The statistics to be added to
+ *  @param src The statistics to be added
+ */
+extern void latency_stats_merge (struct latency_stats *dest,
+                                 const struct latency_stats *src);
+
+/**
+ *  Get the standard deviation of the samples.
+ *
+ *  @param stats The statistics
+ *
+ *  @return Standard deviation in microseconds
+ */
+extern double latency_stats_stddev (const struct latency_stats *stats);
+
+/**
+ *  Estimate a percentile from the histogram.
+ *
+ *  @param stats The statistics
+ *  @param percentile The percentile to be found, from 0 to 100
+ *
+ *  @return The estimated value in microseconds
+ */
+extern uint64_t latency_stats_percentile (const struct latency_stats *stats,
+                                          double percentile);
+
+/**
+ *  Print a one line summary of a set of statistics.
+ *
+ *  @param stats The statistics to be printed
+ *  @param label Label to print before the summary
+ */
+extern void latency_stats_print (const struct latency_stats *stats,
+                                 const char *label);
+
+#endif /* latency_stats_h */
@@ -10,339 +10,730 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <errno.h>
+#include <limits.h>
 #include <string.h>
 #include <strings.h>
 #include <getopt.h>
-#include <fcntl.h>
-#include <termios.h>
-#include <sys/select.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 #include <assert.h>
 
 #include "intel-hex.h"
-#include "rn2483.h"
-#include "uart-bootloader.h"
+#include "io-loop.h"
+#include "serial-port.h"
+#include "flash-session.h"
+#include "image-cache.h"
+#include "manifest.h"
+#include "batch.h"
+#include "flash-daemon.h"
+#include "hotplug.h"
+#include "inventory.h"
+#include "state-db.h"
+#include "provision.h"
+#include "realtime.h"
+#include "trace.h"
+#include "metrics.h"
+#include "capture.h"
+#include "flash-plan.h"
+#include "json.h"
+#include "progress.h"
+#include "hex-normalize.h"
+#include "adapter-db.h"
+#include "calibrate.h"
 
 
 static struct option longopts[] = {
     { "baud-rate", required_argument, NULL, 'b' },
     { "recover", no_argument, NULL, 'r' },
+    { "realtime", no_argument, NULL, 'R' },
+    { "cpu", required_argument, NULL, 'c' },
+    { "rtt-stats", no_argument, NULL, 'S' },
+    { "yes", no_argument, NULL, 'y' },
+    { "batch", required_argument, NULL, 'B' },
+    { "parallel", required_argument, NULL, 'j' },
+    { "on-failure", required_argument, NULL, 'F' },
+    { "retries", required_argument, NULL, 'T' },
+    { "log", required_argument, NULL, 'L' },
+    { "daemon", required_argument, NULL, 'D' },
+    { "watch", no_argument, NULL, 'W' },
+    { "target-version", required_argument, NULL, 'V' },
+    { "match", required_argument, NULL, 'M' },
+    { "inventory", no_argument, NULL, 'I' },
+    { "json", no_argument, NULL, 'J' },
+    { "state", required_argument, NULL, 'X' },
+    { "provision", required_argument, NULL, 'P' },
+    { "verify", no_argument, NULL, 'v' },
+    { "trace", required_argument, NULL, 'E' },
+    { "metrics", required_argument, NULL, 'O' },
+    { "capture", required_argument, NULL, 'C' },
+    { "plan", no_argument, NULL, 'A' },
+    { "latency", required_argument, NULL, 'U' },
+    { "erase-row-size", required_argument, NULL, 'G' },
+    { "write-latch-size", required_argument, NULL, 'H' },
+    { "progress", required_argument, NULL, 'Z' },
+    { "force", no_argument, NULL, 'f' },
+    { "normalize", required_argument, NULL, 'N' },
+    { "trim", no_argument, NULL, 'K' },
+    { "calibrate", no_argument, NULL, 'Q' },
+    { "adapters", required_argument, NULL, 'Y' },
     { "help", no_argument, NULL, 'h' },
     { NULL, 0, NULL, 0 }
 };
 
 /**
- *  Get a the baudrate constant for a given integer baudrate.
+ *  Ask the user whether they would like to continue.
  *
- *  @param baud The desired baudrate in baud
- *
- *  @return The corresponding speed value
+ *  @return 1 if the user answered yes, 0 otherwise
  */
-static int get_baud(int baud)
+static int ask_to_continue (void)
 {
-    switch (baud) {
-        case 9600:
-            return B9600;
-        case 19200:
-            return B19200;
-        case 38400:
-            return B38400;
-        case 57600:
-            return B57600;
-        case 115200:
-            return B115200;
-        case 230400:
-            return B230400;
-        default:
-            return -1;
+    for (;;) {
+        char *resp = readline("Are you sure that you would like to continue? "
+                              "(y/n): ");
+        
+        if (resp == NULL) {
+            return 0;
+        } else if ((strcasecmp("y", resp) == 0) ||
+                   (strcasecmp("yes", resp) == 0)) {
+            free(resp);
+            return 1;
+        } else if ((strcasecmp("n", resp) == 0) ||
+                   (strcasecmp("no", resp) == 0)) {
+            free(resp);
+            return 0;
+        } else {
+            free(resp);
+        }
     }
 }
 
 /**
- *  Configure a serial interface.
- *
- *  @param fd File descriptor for serial interface
- *  @param baudrate Desired baudrate in baud
- *
- *  @return 0 if successfull
+ *  State shared between all of the sessions in a run.
  */
-static int configure_tty (int fd, int baudrate)
+struct flash_run {
+    struct flash_session **sessions;
+    int count;
+    /** What the sessions are doing */
+    enum flash_mode mode;
+    /** Number of sessions waiting for confirmation */
+    int waiting;
+    /** Number of sessions which have finished */
+    int finished;
+    /** Set when no sessions have anything left to do */
+    int done;
+    /** Display for the progress of writing and verifying, or NULL */
+    struct progress *progress;
+};
+
+/**
+ *  Print events from a session as detailed progress for a single module.
+ */
+static void print_single_event (struct flash_session *session,
+                                enum flash_event event, enum flash_mode mode)
 {
-    struct termios term;
+    /* Phase for which a message was last printed */
+    static enum flash_phase last_phase = FLASH_PHASE_CHECK_VERSION;
+    enum flash_phase phase = flash_session_get_phase(session);
+    int version, device_id;
     
-    if (tcgetattr(fd, &term) < 0) {
-        printf("Error from tcgetattr: %s\n", strerror(errno));
-        return -1;
+    if (event == FLASH_EVENT_DONE) {
+        if ((phase == FLASH_PHASE_DONE) &&
+                (last_phase == FLASH_PHASE_PROVISION)) {
+            printf(" done\n");
+        }
+        
+        if (mode == FLASH_MODE_VERIFY) {
+            if (last_phase == FLASH_PHASE_RESET) {
+                printf(" done\n\n");
+            }
+            if (phase == FLASH_PHASE_DONE) {
+                printf("Flash matches the image.\n");
+            } else if (phase == FLASH_PHASE_FAILED) {
+                if (last_phase == FLASH_PHASE_VERIFY) {
+                    printf("\n");
+                }
+                fprintf(stderr, "%s\n", flash_session_get_error(session));
+            }
+        } else if ((phase == FLASH_PHASE_DONE) &&
+                   flash_session_get_skipped(session) &&
+                   (flash_session_get_old_version(session)[0] != '\0')) {
+            printf("Module already runs the firmware in this image.\nFirmware "
+                   "version is: %s\n", flash_session_get_new_version(session));
+        } else if (phase == FLASH_PHASE_DONE) {
+            printf("%s\nUpdate completed successfully!\nFirmware version "
+                   "is now: %s\n", (last_phase == FLASH_PHASE_PROVISION) ?
+                   "" : " done\n", flash_session_get_new_version(session));
+        } else if (phase == FLASH_PHASE_FAILED) {
+            if (flash_session_get_failed_phase(session) >=
+                    FLASH_PHASE_WAIT_BOOTLOADER) {
+                printf("\n");
+            }
+            fprintf(stderr, "%s\n", flash_session_get_error(session));
+        }
+        return;
+    } else if (event != FLASH_EVENT_PHASE) {
+        return;
     }
     
-    int speed = get_baud(baudrate);
-    
-    if (speed == -1) {
-        printf("Unkown baud rate: %d\n", baudrate);
-        return -1;
+    switch (phase) {
+        case FLASH_PHASE_ENTER_BOOTLOADER:
+            printf("\nErasing firmware...\n");
+            break;
+        case FLASH_PHASE_WAIT_APPLICATION:
+            printf(" done\n");
+            // fallthrough
+        case FLASH_PHASE_WAIT_BOOTLOADER:
+            printf("Waiting for module to reset...");
+            break;
+        case FLASH_PHASE_BOOTLOADER_VERSION:
+            if (last_phase == FLASH_PHASE_WAIT_BOOTLOADER) {
+                printf(" done\n");
+            } else if (mode == FLASH_MODE_VERIFY) {
+                printf("Connecting to bootloader...");
+            } else {
+                printf("Module is in the bootloader, resuming update.\n");
+            }
+            break;
+        case FLASH_PHASE_SPOT_CHECK:
+        case FLASH_PHASE_ERASE:
+            if (last_phase == FLASH_PHASE_SPOT_CHECK) {
+                printf(" image differs\n");
+            } else {
+                flash_session_get_bootloader_info(session, &version,
+                                                  &device_id);
+                printf("\nBootloader version: 0x%04X\nDevice ID: 0x%04X\n\n",
+                       version, device_id);
+            }
+            printf((phase == FLASH_PHASE_ERASE) ? "Erasing flash..." :
+                   "Checking for image from previous update...");
+            break;
+        case FLASH_PHASE_WRITE:
+            printf(" done\nWriting flash...\n");
+            break;
+        case FLASH_PHASE_VERIFY:
+            if (last_phase == FLASH_PHASE_BOOTLOADER_VERSION) {
+                flash_session_get_bootloader_info(session, &version,
+                                                  &device_id);
+                printf(" done\n\nBootloader version: 0x%04X\nDevice ID: "
+                       "0x%04X\n", version, device_id);
+            }
+            printf("\nVerifying...\n");
+            break;
+        case FLASH_PHASE_RESET:
+            if (last_phase == FLASH_PHASE_SPOT_CHECK) {
+                printf(" found\n");
+            }
+            printf("\nReseting device...");
+            break;
+        case FLASH_PHASE_PROVISION:
+            if (!flash_session_get_skipped(session) ||
+                    (flash_session_get_old_version(session)[0] == '\0')) {
+                // Finish the line for waiting for the new firmware
+                printf(" done\n");
+            }
+            printf("Provisioning module...");
+            break;
+        default:
+            break;
     }
+    last_phase = phase;
+    fflush(stdout);
+}
 
-    cfsetospeed(&term, (speed_t)speed);
-    cfsetispeed(&term, (speed_t)speed);
-
-    term.c_cflag |= (CLOCAL | CREAD);    /* ignore modem controls */
-    term.c_cflag &= ~CSIZE;
-    term.c_cflag |= CS8;         /* 8-bit characters */
-    term.c_cflag &= ~PARENB;     /* no parity bit */
-    term.c_cflag &= ~CSTOPB;     /* only need 1 stop bit */
-    term.c_cflag &= ~CRTSCTS;    /* no hardware flowcontrol */
-
-    /* setup for non-canonical mode */
-    term.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL
-                      | IXON);
-    term.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
-    term.c_oflag &= ~OPOST;
+/**
+ *  Print events from a session as one line per phase, prefixed with the name
+ *  of the module's port.
+ */
+static void print_device_event (struct flash_session *session,
+                                enum flash_event event, enum flash_mode mode)
+{
+    const char *name = serial_port_get_name(flash_session_get_port(session));
+    enum flash_phase phase = flash_session_get_phase(session);
+    
+    if (event == FLASH_EVENT_PHASE) {
+        printf("%s: %s\n", name, flash_phase_name(phase));
+    } else if ((event == FLASH_EVENT_DONE) && (phase == FLASH_PHASE_DONE) &&
+               (mode == FLASH_MODE_VERIFY)) {
+        printf("%s: flash matches the image\n", name);
+    } else if ((event == FLASH_EVENT_DONE) && (phase == FLASH_PHASE_DONE) &&
+               flash_session_get_skipped(session) &&
+               (flash_session_get_old_version(session)[0] != '\0')) {
+        printf("%s: already updated, firmware version is: %s\n", name,
+               flash_session_get_new_version(session));
+    } else if ((event == FLASH_EVENT_DONE) && (phase == FLASH_PHASE_DONE)) {
+        printf("%s: done, firmware version is now: %s\n", name,
+               flash_session_get_new_version(session));
+    } else if ((event == FLASH_EVENT_DONE) && (phase == FLASH_PHASE_FAILED)) {
+        printf("%s: failed while %s: %s\n", name,
+               flash_phase_name(flash_session_get_failed_phase(session)),
+               flash_session_get_error(session));
+    }
+}
 
-    /* fetch bytes as they become available */
-    term.c_cc[VMIN] = 1;
-    term.c_cc[VTIME] = 1;
+/**
+ *  Sample how far a session has got through writing or verifying flash.
+ */
+static void sample_session (void *source, struct progress_sample *sample)
+{
+    struct flash_session *session = (struct flash_session *)source;
+    
+    flash_session_get_bytes(session, &sample->bytes_done,
+                            &sample->bytes_total);
+    flash_session_get_progress(session, &sample->commands_done,
+                               &sample->commands_total);
+}
 
-    if (tcsetattr(fd, TCSANOW, &term) != 0) {
-        printf("Error from tcsetattr: %s\n", strerror(errno));
-        return -1;
+/**
+ *  Callback for events from the sessions in a run.
+ */
+static void flash_run_event (struct flash_session *session,
+                             enum flash_event event, void *context)
+{
+    struct flash_run *run = (struct flash_run *)context;
+    enum flash_phase phase = flash_session_get_phase(session);
+    
+    if (event == FLASH_EVENT_PROGRESS) {
+        // Progress is sampled by the display's timer instead
+        return;
+    } else if ((run->progress != NULL) && ((event == FLASH_EVENT_PHASE) ||
+                                           (event == FLASH_EVENT_DONE))) {
+        // Whatever was being shown has finished
+        progress_end(run->progress, session, phase != FLASH_PHASE_FAILED);
     }
-    return 0;
+    
+    if (run->count == 1) {
+        print_single_event(session, event, run->mode);
+    } else {
+        print_device_event(session, event, run->mode);
+    }
+    
+    if ((run->progress != NULL) && (event == FLASH_EVENT_PHASE) &&
+            ((phase == FLASH_PHASE_WRITE) || (phase == FLASH_PHASE_VERIFY))) {
+        progress_begin(run->progress,
+                       serial_port_get_name(flash_session_get_port(session)),
+                       flash_phase_name(phase), sample_session, session);
+    }
+    
+    if (event == FLASH_EVENT_CONFIRM) {
+        run->waiting++;
+    } else if (event == FLASH_EVENT_DONE) {
+        run->finished++;
+    }
+    
+    run->done = ((run->waiting + run->finished) >= run->count);
 }
 
 /**
- *  Print a progress bar.
+ *  Print a table with the result for each module in a run.
+ *
+ *  @param run The run for which results should be printed
  *
- *  @param percentage Percent completion to be displayed
- *  @param width The width of the progress bar
  */
-static void print_progress (int percentage, int width)
+static void print_results (struct flash_run *run)
 {
-    printf("\r%3d%% [", percentage);
-    for (int i = 0; i < width; i++) {
-        if (i <= ((percentage * width) / 100)) {
-            printf("|");
+    int succeeded = 0;
+    
+    printf("\n%-24s %-10s %8s  %s\n", "Port", "Result", "Time",
+           "Firmware version");
+    
+    for (int i = 0; i < run->count; i++) {
+        struct flash_session *session = run->sessions[i];
+        enum flash_phase phase = flash_session_get_phase(session);
+        
+        const char *version = flash_session_get_new_version(session);
+        if (phase == FLASH_PHASE_DONE) {
+            succeeded++;
+        } else if (phase == FLASH_PHASE_FAILED) {
+            version = flash_session_get_error(session);
         } else {
-            printf(" ");
+            version = flash_session_get_old_version(session);
+        }
+        
+        const char *result = flash_phase_name(phase);
+        if ((phase == FLASH_PHASE_DONE) && (run->mode == FLASH_MODE_VERIFY)) {
+            result = "match";
+        } else if ((phase == FLASH_PHASE_DONE) &&
+                   flash_session_get_skipped(session)) {
+            result = "current";
         }
+        
+        uint64_t elapsed = flash_session_get_elapsed(session);
+        printf("%-24s %-10s %7.1fs  %s\n",
+               serial_port_get_name(flash_session_get_port(session)),
+               result, (double)elapsed / 1000000, version);
     }
-    printf("]");
+    
+    printf("\n%d of %d modules %s.\n", succeeded, run->count,
+           (run->mode == FLASH_MODE_VERIFY) ? "match the image" :
+           "updated successfully");
 }
 
 /**
- *  Get module firmware version, ask user for confirmation and erase module.
+ *  Update the firmware on a set of modules concurrently. The user is asked for
+ *  confirmation once all of the modules have reported their current firmware
+ *  versions.
  *
- *  @param fd File descriptor for module
+ *  @param run Run containing sessions for each module
+ *  @param loop The event loop which the modules' ports belong to
  *  @param file Name of new firmware file
  *
- *  @return 0 if successfull
+ *  @return 0 if all of the modules were updated successfully
  */
-static int enter_bootloader (int fd, char *file)
+static int flash_modules (struct flash_run *run, struct io_loop *loop,
+                          const char *file)
 {
-    char buffer[40];
-    
-    /* Check existing firmware version */
-    int ret = rn2483_get_version(fd, buffer, 40, 1000);
+    for (int i = 0; i < run->count; i++) {
+        flash_session_start(run->sessions[i]);
+    }
     
-    if (ret != 0) {
+    if (!run->done && (io_loop_run(loop, &run->done) != 0)) {
         return -1;
     }
     
-    /* Ask for confirmation */
-    printf("Current firwmare version: %s\nNew firmware: %s\n\n"
-           "The firmware on the radio module will now be erased.\n", buffer,
-           file);
-    
-    for (;;) {
-        char *resp = readline("Are you sure that you would like to continue? "
-                              "(y/n): ");
+    if (run->waiting != 0) {
+        /* Ask for confirmation */
+        for (int i = 0; i < run->count; i++) {
+            struct flash_session *session = run->sessions[i];
+            
+            if (flash_session_get_phase(session) != FLASH_PHASE_CONFIRM) {
+                continue;
+            } else if (run->count == 1) {
+                printf("Current firwmare version: %s\n",
+                       flash_session_get_old_version(session));
+            } else {
+                printf("%s: current firmware version: %s\n",
+                       serial_port_get_name(flash_session_get_port(session)),
+                       flash_session_get_old_version(session));
+            }
+        }
         
-        if (resp == NULL) {
+        printf("New firmware: %s\n\nThe firmware on %s will now be "
+               "erased.\n", file, (run->waiting == 1) ? "the radio module" :
+               "the radio modules");
+        
+        int proceed = ask_to_continue();
+        
+        run->waiting = 0;
+        run->done = 0;
+        for (int i = 0; i < run->count; i++) {
+            flash_session_confirm(run->sessions[i], proceed);
+        }
+        
+        if (!run->done && (io_loop_run(loop, &run->done) != 0)) {
             return -1;
-        } else if ((strcasecmp("y", resp) == 0) ||
-                   (strcasecmp("yes", resp) == 0)) {
-            free(resp);
-            break;
-        } else if ((strcasecmp("n", resp) == 0) ||
-                   (strcasecmp("no", resp) == 0)) {
-            free(resp);
-            exit(0);
-        } else {
-            free(resp);
         }
     }
     
-    /* Erase existing firmware */
-    printf("\nErasing firmware...\n");
-    ret = rn2483_erase(fd);
+    if (run->count > 1) {
+        print_results(run);
+    }
     
-    if (ret != 0) {
-        return -1;
+    int failed = 0;
+    int recoverable = 0;
+    for (int i = 0; i < run->count; i++) {
+        struct flash_session *session = run->sessions[i];
+        
+        if (flash_session_get_phase(session) != FLASH_PHASE_FAILED) {
+            continue;
+        }
+        
+        failed = 1;
+        enum flash_phase phase = flash_session_get_failed_phase(session);
+        if ((run->mode != FLASH_MODE_VERIFY) &&
+            (phase >= FLASH_PHASE_WAIT_BOOTLOADER) &&
+            (phase <= FLASH_PHASE_RESET)) {
+            recoverable = 1;
+        }
     }
     
-    return 0;
+    if (recoverable) {
+        printf("Module may be stuck in bootloader. To try and complete the "
+               "update process you can run this tool again.\nYou may need to "
+               "power cycle the module.\n");
+    }
+    
+    return failed ? -1 : 0;
 }
 
 /**
- *  Erase flash, write firmware and verify checksums.
+ *  Run the jobs from a batch manifest.
  *
- *  @param fd File desriptor for module
- *  @param hex Hex file structure to be written to module
+ *  @param path Path to the manifest
+ *  @param baudrate Baudrate for jobs which do not specify one
+ *  @param options Options for the batch
+ *  @param log_path Path to file to which job results should be appended, or
+ *                  NULL
  *
- *  @return 0 if successfull
+ *  @return 0 if all of the jobs succeeded
  */
-static int download_firmware (int fd, struct intel_hex_file *hex)
+static int run_batch (const char *path, int baudrate,
+                      const struct batch_options *options,
+                      const char *log_path)
 {
-    /* Check bootloader version */
-    struct rn_bootloader_rsp_version *version;
-    
-    int ret = rn_bootloader_get_version_info (fd, &version);
-    
-    if (ret != 0) {
-        fprintf(stderr, "Could not get bootloader version.\n");
-        goto free_version;
+    struct manifest *manifest;
+    if (manifest_parse(path, baudrate, &manifest) != 0) {
+        return 1;
     }
     
-    printf("\nBootloader version: 0x%04X\nDevice ID: 0x%04X\n\n",
-           rn_bootloader_get_version(version),
-           rn_bootloader_get_device_id(version));
+    int ret = 1;
     
-    /* Erase flash */
-    printf("Erasing flash...");
+    FILE *log = NULL;
+    if (log_path != NULL) {
+        log = fopen(log_path, "a");
+        if (log == NULL) {
+            fprintf(stderr, "Could not open %s: %s\n", log_path,
+                    strerror(errno));
+            goto free_manifest;
+        }
+    }
     
-    ret = rn_bootloader_erase(fd, 0x300, 0x10000 - 0x300, version);
+    struct io_loop *loop;
+    if (io_loop_init(&loop) != 0) {
+        goto close_log;
+    }
     
-    if (ret != 0) {
-        printf("\n");
-        fprintf(stderr, "Failed to erase flash.\n");
-        goto free_version;
+    struct image_cache *cache;
+    if (image_cache_init(&cache) != 0) {
+        goto free_loop;
     }
     
-    printf(" done\n");
+    printf("Running %d jobs from %s\n\n", manifest->num_jobs, path);
     
-    /* Write flash */
-    printf("Writing flash...\n");
+    ret = batch_run(loop, manifest, cache, options, log);
     
-    struct intel_hex_record *record = intel_hex_get_first_record(hex);
-    int total_records = intel_hex_num_records(hex);
-    int records_complete = 0;
+    image_cache_free(cache);
+free_loop:
+    io_loop_free(loop);
+close_log:
+    if (log != NULL) {
+        fclose(log);
+    }
+free_manifest:
+    manifest_free(manifest);
+    return ret;
+}
+
+/**
+ *  Print the commands that would be needed to write an image and an estimate
+ *  of how long they would take, without touching a port.
+ *
+ *  @param path Path to the image
+ *  @param baudrate Baudrate of the port
+ *  @param latency Turnaround time of the module in microseconds
+ *  @param erase_row_size The bootloader's erase row size
+ *  @param write_latch_size The bootloader's write latch size
+ *  @param json Whether the plan should be printed as JSON
+ *
+ *  @return 0 if successfull
+ */
+static int run_plan (const char *path, int baudrate, long latency,
+                     uint8_t erase_row_size, uint8_t write_latch_size,
+                     int json)
+{
+    struct intel_hex_file *hex;
+    if (parse_intel_hex_file(path, &hex) != 0) {
+        return 1;
+    }
     
-    while (record != NULL) {
-        print_progress((100 * records_complete) / total_records, 60);
-        
-        uint8_t *data;
-        uint32_t address;
-        uint8_t length;
-        
-        record = intel_hex_get_next_record(record, &data, &address, &length);
-        
-        ret = rn_bootloader_write(fd, address, length, data, version);
-        
-        if (ret != 0) {
-            printf("\n");
-            fprintf(stderr, "Failed to write record.\n");
-            goto free_version;
-        }
-        
-        records_complete++;
+    struct flash_plan *plan;
+    if (flash_plan_init(hex, erase_row_size, write_latch_size, &plan) != 0) {
+        free_intel_hex_file(hex);
+        return 1;
     }
     
-    print_progress(100, 60);
-    printf("\n");
+    struct flash_plan_cost total = { 0, 0, 0, 0 };
     
-    /* Get checksum */
-    printf("Verifying...\n");
+    if (json) {
+        printf("{\"image\":");
+        json_write_string(stdout, path);
+        printf(",\"records\":%d,\"baud\":%d,\"latency_us\":%ld,"
+               "\"erase_row_size\":%d,\"write_latch_size\":%d,"
+               "\"blank_writes\":%d", intel_hex_num_records(hex), baudrate,
+               latency, erase_row_size, write_latch_size, plan->blank_writes);
+    } else {
+        printf("Image: %s (%d records)\nBaudrate: %d\nLatency: %ld us\n"
+               "Erase row size: %d\nWrite latch size: %d\n"
+               "Blank writes skipped: %d\n\n"
+               "%-8s %10s %12s %12s %12s\n", path, intel_hex_num_records(hex),
+               baudrate, latency, erase_row_size, write_latch_size,
+               plan->blank_writes, "Step", "Commands", "Bytes sent",
+               "Bytes recv", "Estimate");
+    }
     
-    record = intel_hex_get_first_record(hex);;
-    records_complete = 0;
-    while (record != NULL) {
-        print_progress((100 * records_complete) / total_records, 60);
-        
-        uint8_t *data;
-        uint32_t address;
-        uint8_t length;
-        
-        record = intel_hex_get_next_record(record, &data, &address, &length);
-        
-        
-        uint16_t checksum;
-        ret = rn_bootloader_checksum(fd, address, length, &checksum);
+    for (int i = 0; i < FLASH_PLAN_NUM_STEPS; i++) {
+        struct flash_plan_cost cost;
+        flash_plan_cost(plan, (enum flash_plan_step)i, baudrate, latency,
+                        &cost);
         
-        if (ret != 0) {
-            fprintf(stderr, "Failed to check record.\n");
-            goto free_version;
-        }
-        
-        uint16_t calc_checksum = 0;
-        if (address == 0x300000) {
-            // Configuration row is handled specially because masks need to be
-            // applied
-            assert(length == 14);
-            calc_checksum = rn_bootloader_calc_config_checksum(data);
+        if (json) {
+            printf(",\"%s\":{\"commands\":%d,\"bytes_tx\":%" PRIu64
+                   ",\"bytes_rx\":%" PRIu64 ",\"duration_ms\":%" PRIu64 "}",
+                   flash_plan_step_name((enum flash_plan_step)i),
+                   cost.commands, cost.bytes_tx, cost.bytes_rx,
+                   cost.duration / 1000);
         } else {
-            calc_checksum = rn_bootloader_calc_checksum(data, length);
-        }
-        
-        
-        if (checksum != calc_checksum) {
-            printf("\n");
-            fprintf(stderr, "Checksum for address 0x%04X failed (got %04X, "
-                            "calculated %04X).\n", address, checksum,
-                    calc_checksum);
-            goto free_version;
+            printf("%-8s %10d %12" PRIu64 " %12" PRIu64 " %10.2f s\n",
+                   flash_plan_step_name((enum flash_plan_step)i),
+                   cost.commands, cost.bytes_tx, cost.bytes_rx,
+                   (double)cost.duration / 1000000.0);
         }
         
-        records_complete++;
+        total.commands += cost.commands;
+        total.bytes_tx += cost.bytes_tx;
+        total.bytes_rx += cost.bytes_rx;
+        total.duration += cost.duration;
     }
     
-    print_progress(100, 60);
-    printf("\n");
-    
-    /* Reset device */
-    printf("Reseting device...");
-    
-    ret = rn_bootloader_reset(fd);
-    
-    if (ret != 0) {
-        printf("\n");
-        fprintf(stderr, "Failed to reset device.\n");
-        goto free_version;
+    if (json) {
+        printf(",\"total\":{\"commands\":%d,\"bytes_tx\":%" PRIu64
+               ",\"bytes_rx\":%" PRIu64 ",\"duration_ms\":%" PRIu64 "}}\n",
+               total.commands, total.bytes_tx, total.bytes_rx,
+               total.duration / 1000);
+    } else {
+        printf("%-8s %10d %12" PRIu64 " %12" PRIu64 " %10.2f s\n\n"
+               "The estimate does not include waiting for the module to "
+               "reset.\n", "total", total.commands, total.bytes_tx,
+               total.bytes_rx, (double)total.duration / 1000000.0);
     }
     
-    printf(" done\n");
-    free(version);
-    
+    flash_plan_free(plan);
+    free_intel_hex_file(hex);
     return 0;
-free_version:
-    free(version);
-    return -1;
 }
 
 /**
- *  Wait for a given amount of time and print a message about waiting.
+ *  Count the bytes of data in an image.
+ *
+ *  @param hex The image
  *
- *  @param microseconds The amount of time to wait in microseconds
+ *  @return The total length of the image's data records
  */
-static void wait_for_reset (useconds_t microseconds)
+static uint64_t image_bytes (struct intel_hex_file *hex)
 {
-    printf("Waiting for module to reset...");
-    fflush(stdout);
-    usleep(microseconds);
-    printf(" done\n");
+    uint64_t bytes = 0;
+    uint8_t *data;
+    uint32_t address;
+    uint8_t length;
+    
+    struct intel_hex_record *record = intel_hex_get_first_record(hex);
+    while (record != NULL) {
+        record = intel_hex_get_next_record(record, &data, &address, &length);
+        bytes += length;
+    }
+    return bytes;
+}
+
+/**
+ *  Write an image in a canonical form, with sorted and merged records which
+ *  are as long as possible, and print its hash.
+ *
+ *  @param path Path to the image
+ *  @param out_path Path to which the normalized image should be written
+ *  @param write_latch_size The bootloader's write latch size
+ *  @param trim Whether latch sized blocks of 0xFF should be left out
+ *  @param json Whether the summary should be printed as JSON
+ *
+ *  @return 0 if successfull
+ */
+static int run_normalize (const char *path, const char *out_path,
+                          uint8_t write_latch_size, int trim, int json)
+{
+    struct intel_hex_file *hex;
+    if (parse_intel_hex_file(path, &hex) != 0) {
+        return 1;
+    }
+    
+    int ret = 1;
+    
+    struct intel_hex_file *normalized;
+    if (hex_normalize(hex, write_latch_size, trim, &normalized) != 0) {
+        goto free_hex;
+    }
+    
+    if (write_intel_hex_file(out_path, normalized) != 0) {
+        goto free_normalized;
+    }
+    
+    uint64_t bytes_in = image_bytes(hex);
+    uint64_t bytes_out = image_bytes(normalized);
+    
+    // The state database identifies images by the same hash
+    uint64_t hash = state_db_image_hash(normalized);
+    
+    if (json) {
+        printf("{\"image\":");
+        json_write_string(stdout, out_path);
+        printf(",\"records_in\":%d,\"records_out\":%d,\"bytes_in\":%"
+               PRIu64 ",\"bytes_out\":%" PRIu64 ",\"hash\":\"%016" PRIx64
+               "\"}\n", intel_hex_num_records(hex),
+               intel_hex_num_records(normalized), bytes_in, bytes_out, hash);
+    } else {
+        printf("Records: %d -> %d\nBytes: %" PRIu64 " -> %" PRIu64 "\n"
+               "Hash: %016" PRIx64 "\n", intel_hex_num_records(hex),
+               intel_hex_num_records(normalized), bytes_in, bytes_out, hash);
+    }
+    ret = 0;
+    
+free_normalized:
+    free_intel_hex_file(normalized);
+free_hex:
+    free_intel_hex_file(hex);
+    return ret;
 }
 
 int main(int argc, char * argv[])
 {
-    char *dev = NULL;
+    char **devs = calloc((size_t)argc, sizeof(char *));
+    int num_devs = 0;
     int baudrate = 57600;
     char *file = NULL;
     
+    if (devs == NULL) {
+        fprintf(stderr, "Could not allocate memory for arguments.\n");
+        return 1;
+    }
+    
     int recover = 0;
+    int realtime = 0;
+    int cpu = -1;
+    int rtt_stats = 0;
+    int yes = 0;
+    int verify = 0;
+    int force = 0;
+    
+    char *batch_file = NULL;
+    char *socket_path = NULL;
+    char *log_file = NULL;
+    struct batch_options batch_options;
+    batch_options_init(&batch_options);
+    int watch = 0;
+    struct hotplug_options hotplug_options;
+    hotplug_options_init(&hotplug_options);
+    int inventory = 0;
+    int json_output = 0;
+    char *state_file = NULL;
+    struct state_db *state = NULL;
+    char *provision_file = NULL;
+    struct provision_script *provision = NULL;
+    char *trace_file = NULL;
+    char *metrics_file = NULL;
+    char *capture_file = NULL;
+    int plan = 0;
+    long latency = 1000;
+    uint8_t erase_row_size = FLASH_PLAN_ERASE_ROW_SIZE;
+    uint8_t write_latch_size = FLASH_PLAN_WRITE_LATCH_SIZE;
+    enum progress_format progress_format = PROGRESS_FORMAT_BAR;
+    char *normalize_file = NULL;
+    int trim = 0;
+    int calibrate = 0;
+    char *adapters_file = NULL;
+    char adapters_path[PATH_MAX];
+    struct adapter_db *adapters = NULL;
     
     /* Parse arguments */
     int c;
     while (optind < argc) {
-        c = getopt_long(argc, argv, "+hrb:", longopts, NULL);
+        c = getopt_long(argc, argv, "+hyrRb:c:j:", longopts, NULL);
         if (c != -1) {
             // Option
             switch (c) {
@@ -358,14 +749,233 @@ int main(int argc, char * argv[])
                 case 'r':
                     recover = 1;
                     break;
+                case 'R':
+                    realtime = 1;
+                    rtt_stats = 1;
+                    break;
+                case 'c':
+                    ;
+                    char *cpu_end;
+                    cpu = (int)strtol(optarg, &cpu_end, 10);
+                    if ((*cpu_end != '\0') || (cpu < 0)) {
+                        fprintf(stderr, "Invalid CPU \"%s\"\n", optarg);
+                        return 1;
+                    }
+                    break;
+                case 'S':
+                    rtt_stats = 1;
+                    break;
+                case 'y':
+                    yes = 1;
+                    break;
+                case 'v':
+                    verify = 1;
+                    break;
+                case 'f':
+                    force = 1;
+                    break;
+                case 'N':
+                    normalize_file = optarg;
+                    break;
+                case 'K':
+                    trim = 1;
+                    break;
+                case 'Q':
+                    calibrate = 1;
+                    break;
+                case 'Y':
+                    adapters_file = optarg;
+                    break;
+                case 'B':
+                    batch_file = optarg;
+                    break;
+                case 'j':
+                    ;
+                    char *parallel_end;
+                    batch_options.parallel = (int)strtol(optarg,
+                                                         &parallel_end, 10);
+                    if ((*parallel_end != '\0') ||
+                        (batch_options.parallel < 0)) {
+                        fprintf(stderr, "Invalid parallelism \"%s\"\n",
+                                optarg);
+                        return 1;
+                    }
+                    break;
+                case 'F':
+                    if (strcasecmp(optarg, "continue") == 0) {
+                        batch_options.on_failure = BATCH_FAILURE_CONTINUE;
+                    } else if (strcasecmp(optarg, "stop") == 0) {
+                        batch_options.on_failure = BATCH_FAILURE_STOP;
+                    } else {
+                        fprintf(stderr, "Invalid failure policy \"%s\"\n",
+                                optarg);
+                        return 1;
+                    }
+                    break;
+                case 'T':
+                    ;
+                    char *retries_end;
+                    batch_options.retries = (int)strtol(optarg, &retries_end,
+                                                        10);
+                    if ((*retries_end != '\0') ||
+                        (batch_options.retries < 0)) {
+                        fprintf(stderr, "Invalid number of retries \"%s\"\n",
+                                optarg);
+                        return 1;
+                    }
+                    break;
+                case 'L':
+                    log_file = optarg;
+                    break;
+                case 'D':
+                    socket_path = optarg;
+                    break;
+                case 'W':
+                    watch = 1;
+                    break;
+                case 'V':
+                    hotplug_options.target_version = optarg;
+                    break;
+                case 'M':
+                    hotplug_options.match = optarg;
+                    break;
+                case 'I':
+                    inventory = 1;
+                    break;
+                case 'J':
+                    json_output = 1;
+                    break;
+                case 'X':
+                    state_file = optarg;
+                    break;
+                case 'P':
+                    provision_file = optarg;
+                    break;
+                case 'E':
+                    trace_file = optarg;
+                    break;
+                case 'O':
+                    metrics_file = optarg;
+                    break;
+                case 'C':
+                    capture_file = optarg;
+                    break;
+                case 'A':
+                    plan = 1;
+                    break;
+                case 'U':
+                    ;
+                    char *latency_end;
+                    latency = strtol(optarg, &latency_end, 10);
+                    if ((*latency_end != '\0') || (latency < 0)) {
+                        fprintf(stderr, "Invalid latency \"%s\"\n", optarg);
+                        return 1;
+                    }
+                    break;
+                case 'G':
+                case 'H':
+                    ;
+                    char *size_end;
+                    long size = strtol(optarg, &size_end, 10);
+                    if ((*size_end != '\0') || (size <= 0) || (size > 255)) {
+                        fprintf(stderr, "Invalid size \"%s\"\n", optarg);
+                        return 1;
+                    }
+                    if (c == 'G') {
+                        erase_row_size = (uint8_t)size;
+                    } else {
+                        write_latch_size = (uint8_t)size;
+                    }
+                    break;
+                case 'Z':
+                    if (strcasecmp(optarg, "bar") == 0) {
+                        progress_format = PROGRESS_FORMAT_BAR;
+                    } else if (strcasecmp(optarg, "json") == 0) {
+                        progress_format = PROGRESS_FORMAT_JSON;
+                    } else if (strcasecmp(optarg, "none") == 0) {
+                        progress_format = PROGRESS_FORMAT_NONE;
+                    } else {
+                        fprintf(stderr, "Invalid progress format \"%s\"\n",
+                                optarg);
+                        return 1;
+                    }
+                    break;
                 case 'h':
                     printf("This is a tool for updateing the firware on "
                            "Microchip RN2483 radio modules.\nIt is used as "
                            "follows:\n\trn2483-loader [options] port "
-                           "firmware_image\nThe -b option allows a baud rate to"
-                           " be specified.\nThe -r option tries to complete the"
-                           " update process on a module that is already in the "
-                           "bootloader mode.\nUse the smaller firmware image "
+                           "[port...] firmware_image\n\trn2483-loader [options] "
+                           "--batch manifest\n\trn2483-loader [options] --daemon "
+                           "socket\n\trn2483-loader [options] --watch "
+                           "firmware_image\n\trn2483-loader [options] "
+                           "--inventory port [port...]\nIf more than one port "
+                           "is given "
+                           "the modules are all updated at the same time.\nThe"
+                           " -b option allows a baud rate to be specified.\nThe"
+                           " -r option skips checking whether a module is "
+                           "already in the bootloader mode, which is found "
+                           "out automatically otherwise.\n"
+                           "The -y option skips the confirmation prompt.\nThe "
+                           "--batch option runs the jobs in a manifest file "
+                           "without prompting, one job per line as CSV (port,"
+                           "image,baud,policy,script) or JSON objects. The -j "
+                           "option "
+                           "limits how many jobs run at once, --on-failure "
+                           "continue|stop sets what happens when a job fails, "
+                           "--retries sets how many times a failed job is "
+                           "retried and --log appends a JSON result line for "
+                           "each job to a file.\nThe --daemon option accepts "
+                           "FLASH, VERIFY, VERSION and STATUS requests on a "
+                           "Unix domain socket.\nThe --watch option waits for "
+                           "new serial ports to appear and updates any module "
+                           "attached to them, --target-version skips modules "
+                           "which already run that version and --match "
+                           "selects which port names are considered.\nThe "
+                           "--inventory option reports what is attached to "
+                           "each port, ports may be given as glob patterns and "
+                           "--json prints the results as JSON lines.\nThe "
+                           "--state option keeps a record of the image last "
+                           "written to each module in a file so that modules "
+                           "which already have the image are skipped.\nModules "
+                           "which already run the firmware version found in "
+                           "the image are not updated unless --force is given."
+                           "\nThe "
+                           "--provision option runs the commands in a file on "
+                           "each module after it has been updated.\nThe "
+                           "--verify option compares the flash of modules "
+                           "which are in the bootloader with the image and "
+                           "resets them, without changing anything.\nThe "
+                           "--trace option records the time taken by each "
+                           "phase and command in a file in the Chrome trace "
+                           "event format.\nThe --metrics option writes "
+                           "command, phase and throughput metrics to a file in "
+                           "the Prometheus text format after each update.\n"
+                           "The --capture option records every byte sent and "
+                           "received in a file which can be played back with "
+                           "rn2483-replay.\nThe --plan option prints the "
+                           "commands needed to write an image and estimates "
+                           "how long they would take at the baud rate with "
+                           "--latency microseconds per command, without "
+                           "touching a port. The bootloader's row and latch "
+                           "sizes can be set with --erase-row-size and "
+                           "--write-latch-size.\nThe --progress option "
+                           "selects how the progress of writing and verifying "
+                           "is shown: bar (the default), json for one JSON "
+                           "object per line or none.\nThe --normalize option "
+                           "writes the image to a file with its records "
+                           "sorted, merged and split on write latch "
+                           "boundaries, --trim leaves out blocks of 0xFF in "
+                           "the application area.\n"
+                           "The --calibrate option measures the link to a "
+                           "module waiting in the bootloader at several baud "
+                           "rates and stores the fastest reliable one for the "
+                           "port's USB adapter, later updates through that "
+                           "adapter talk to the bootloader at that rate. "
+                           "Profiles are kept in "
+                           "~/.config/rn2483-loader/adapters.jsonl unless "
+                           "--adapters gives another file.\n"
+                           "Use the "
+                           "smaller firmware image "
                            "from the archive provided by Microchip, the one "
                            "in the 'offset' folder, not the 'combined' image."
                            "\n");
@@ -374,98 +984,327 @@ int main(int argc, char * argv[])
                     return 1;
             }
         } else {
-            // Positional argument
-            if (dev == NULL) {
-                dev = argv[optind];
-            } else if (file == NULL) {
-                file = argv[optind];
-            } else {
-                // Already have a device and file
-                fprintf(stderr, "Unexpected positional argument \"%s\"\n",
-                        argv[optind]);
-                return 1;
+            // Positional argument, the last one is the hex file and all of
+            // the others are devices
+            if (file != NULL) {
+                devs[num_devs++] = file;
             }
-           
+            file = argv[optind];
+            
             optind++;
         }
     }
     
-    /* Check arguments */
-    if (dev == NULL) {
-        fprintf(stderr, "No serial device specified\n");
+    if (realtime) {
+        if (realtime_enable(cpu) == -1) {
+            return 1;
+        }
+        printf("\n");
+    } else if (cpu != -1) {
+        fprintf(stderr, "The -c option requires realtime mode (-R)\n");
         return 1;
     }
-    if (file == NULL) {
-        fprintf(stderr, "No hex file specified\n");
+    
+    if ((trace_file != NULL) && (trace_start(trace_file) != 0)) {
         return 1;
     }
     
-    printf("Device: %s\n", dev);
-    printf("Baudrate: %d\n\n", baudrate);
-    
-    /* Open and configure tty */
-    int fd = open(dev, O_RDWR | O_NOCTTY | O_SYNC | O_NONBLOCK);
-    if (fd == -1) {
-        fprintf(stderr, "Could not open %s: %s\n", dev, strerror(errno));
+    if ((metrics_file != NULL) && (metrics_start(metrics_file) != 0)) {
         return 1;
     }
     
-    if (!isatty(fd)) {
-        fprintf(stderr, "File %s is not a tty.\n", dev);
+    if ((capture_file != NULL) && (capture_start(capture_file) != 0)) {
         return 1;
     }
     
-    int ret = configure_tty(fd, baudrate);
-    if (ret == -1) {
+    if ((state_file != NULL) && ((socket_path != NULL) || inventory)) {
+        fprintf(stderr, "The --state option can not be used with --daemon or "
+                "--inventory\n");
+        return 1;
+    }
+    if (verify && ((socket_path != NULL) || inventory || watch ||
+                   (batch_file != NULL) || (state_file != NULL) ||
+                   (provision_file != NULL))) {
+        fprintf(stderr, "The --verify option can only be used with ports and "
+                "an image\n");
+        return 1;
+    }
+    if ((provision_file != NULL) && ((socket_path != NULL) || inventory)) {
+        fprintf(stderr, "The --provision option can not be used with --daemon "
+                "or --inventory\n");
         return 1;
     }
     
-    /* Parse hex file */
-    struct intel_hex_file *hex;
-    ret = parse_intel_hex_file(file, &hex);
+    if (plan) {
+        if ((file == NULL) || (num_devs != 0)) {
+            fprintf(stderr, "The --plan option takes only a firmware image\n");
+            return 1;
+        }
+        free(devs);
+        return run_plan(file, baudrate, latency, erase_row_size,
+                        write_latch_size, json_output);
+    }
     
-    if (ret != 0) {
-        return -1;
+    if (normalize_file != NULL) {
+        if ((file == NULL) || (num_devs != 0)) {
+            fprintf(stderr, "The --normalize option takes only a firmware "
+                    "image\n");
+            return 1;
+        }
+        free(devs);
+        return run_normalize(file, normalize_file, write_latch_size, trim,
+                             json_output);
+    }
+    
+    if ((adapters_file == NULL) &&
+            (adapter_db_default_path(adapters_path,
+                                     sizeof(adapters_path)) == 0)) {
+        adapters_file = adapters_path;
+    }
+    
+    if (calibrate) {
+        if ((file == NULL) || (num_devs != 0)) {
+            fprintf(stderr, "The --calibrate option takes only one port\n");
+            return 1;
+        }
+        if (adapters_file == NULL) {
+            fprintf(stderr, "No home directory, use --adapters to choose "
+                    "where profiles are stored\n");
+            return 1;
+        }
+        free(devs);
+        if (adapter_db_open(adapters_file, &adapters) != 0) {
+            return 1;
+        }
+        int calibrate_ret = calibrate_run(file, baudrate, adapters,
+                                          json_output);
+        adapter_db_free(adapters);
+        return (calibrate_ret == 0) ? 0 : 1;
+    }
+    
+    if (socket_path != NULL) {
+        if ((file != NULL) || (batch_file != NULL)) {
+            fprintf(stderr, "The --daemon option can not be combined with "
+                    "ports or a batch manifest\n");
+            return 1;
+        }
+        free(devs);
+        if ((adapters_file != NULL) &&
+                (adapter_db_open(adapters_file, &adapters) != 0)) {
+            return 1;
+        }
+        int daemon_ret = flash_daemon_run(socket_path, baudrate, force,
+                                          adapters);
+        if (adapters != NULL) {
+            adapter_db_free(adapters);
+        }
+        return (daemon_ret == 0) ? 0 : 1;
+    }
+    
+    if (inventory) {
+        if (file == NULL) {
+            fprintf(stderr, "No serial device specified\n");
+            return 1;
+        }
+        /* Every positional argument is a port */
+        devs[num_devs++] = file;
+        enum inventory_format inventory_format = (json_output ?
+                                                  INVENTORY_FORMAT_JSON :
+                                                  INVENTORY_FORMAT_TABLE);
+        int inventory_ret = inventory_run(devs, num_devs, baudrate,
+                                          inventory_format);
+        free(devs);
+        return (inventory_ret == 0) ? 0 : 1;
+    }
+    
+    if ((state_file != NULL) && (state_db_open(state_file, &state) != 0)) {
+        return 1;
+    }
+    if ((provision_file != NULL) &&
+            (provision_script_load(provision_file, &provision) != 0)) {
+        return 1;
+    }
+    if ((adapters_file != NULL) &&
+            (adapter_db_open(adapters_file, &adapters) != 0)) {
+        return 1;
     }
     
-    /* Enter bootloader on module */
-    if (!recover) {
-        ret = enter_bootloader(fd, file);
+    if (watch) {
+        if ((file == NULL) || (num_devs != 0) || (batch_file != NULL)) {
+            fprintf(stderr, "The --watch option takes only a firmware image\n");
+            return 1;
+        }
+        free(devs);
         
-        if (ret != 0) {
-            return -1;
+        struct intel_hex_file *watch_hex;
+        if (parse_intel_hex_file(file, &watch_hex) != 0) {
+            return 1;
+        }
+        hotplug_options.baudrate = baudrate;
+        hotplug_options.state = state;
+        hotplug_options.force = force;
+        hotplug_options.provision = provision;
+        hotplug_options.adapters = adapters;
+        int watch_ret = hotplug_run(watch_hex, &hotplug_options);
+        free_intel_hex_file(watch_hex);
+        if (adapters != NULL) {
+            adapter_db_free(adapters);
+        }
+        if (state != NULL) {
+            state_db_free(state);
+        }
+        if (provision != NULL) {
+            provision_script_free(provision);
+        }
+        return (watch_ret == 0) ? 0 : 1;
+    }
+    
+    if (batch_file != NULL) {
+        if (file != NULL) {
+            fprintf(stderr, "Unexpected positional argument \"%s\" in batch "
+                    "mode\n", file);
+            return 1;
+        }
+        free(devs);
+        batch_options.state = state;
+        batch_options.force = force;
+        batch_options.provision = provision;
+        batch_options.adapters = adapters;
+        int batch_ret = run_batch(batch_file, baudrate, &batch_options,
+                                  log_file);
+        if (adapters != NULL) {
+            adapter_db_free(adapters);
+        }
+        if (state != NULL) {
+            state_db_free(state);
         }
+        if (provision != NULL) {
+            provision_script_free(provision);
+        }
+        return batch_ret;
     }
     
-    /* Give the module some time to reset */
-    wait_for_reset(500000);
+    /* Check arguments */
+    if (file == NULL) {
+        fprintf(stderr, "No serial device specified\n");
+        return 1;
+    }
+    if (num_devs == 0) {
+        fprintf(stderr, "No hex file specified\n");
+        return 1;
+    }
+    
+    for (int i = 0; i < num_devs; i++) {
+        int bootloader_baudrate = adapter_db_baudrate(adapters, devs[i]);
+        if (bootloader_baudrate != 0) {
+            printf("Device: %s (bootloader at %d baud)\n", devs[i],
+                   bootloader_baudrate);
+        } else {
+            printf("Device: %s\n", devs[i]);
+        }
+    }
+    printf("Baudrate: %d\n\n", baudrate);
     
-    /* Download firmware */
-    ret = download_firmware (fd, hex);
+    /* Parse hex file, the parsed image is shared by all of the sessions */
+    struct intel_hex_file *hex;
+    uint64_t parse_start = latency_stats_now();
+    int ret = parse_intel_hex_file(file, &hex);
     
     if (ret != 0) {
-        printf("Module may be stuck in bootloader. To try and complete the "
-               "update process you can use this tool with the --recover option."
-               "\nYou may need to power cycle the module.\n");
         return -1;
     }
+    trace_complete("host", "host", "parse image", parse_start,
+                   latency_stats_now(), NULL);
     
-    /* Give the module some time to reset */
-    wait_for_reset(500000);
-    
-    /* Display new version */
-    char buffer[40];
-    ret = rn2483_get_version(fd, buffer, 40, 1000);
+    char image_version[FLASH_VERSION_LENGTH];
+    if (flash_image_version(hex, image_version, sizeof(image_version)) == 0) {
+        printf("Image firmware version: %s\n\n", image_version);
+    }
     
+    /* Open and configure ttys */
+    struct io_loop *loop;
+    ret = io_loop_init(&loop);
     if (ret != 0) {
-        fprintf(stderr, "Could not get new firmware version.\n");
-        return -1;
+        return 1;
+    }
+    
+    struct serial_port **ports = calloc((size_t)num_devs,
+                                       sizeof(struct serial_port *));
+    struct flash_session **sessions = calloc((size_t)num_devs,
+                                             sizeof(struct flash_session *));
+    if ((ports == NULL) || (sessions == NULL)) {
+        fprintf(stderr, "Could not allocate memory for sessions.\n");
+        return 1;
+    }
+    
+    struct flash_run run = { .sessions = sessions, .count = num_devs,
+                             .mode = verify ? FLASH_MODE_VERIFY :
+                                              FLASH_MODE_UPDATE };
+    
+    // Several modules print a line per phase which a bar would overwrite
+    if ((progress_format == PROGRESS_FORMAT_JSON) ||
+            ((progress_format == PROGRESS_FORMAT_BAR) && (num_devs == 1))) {
+        if (progress_init(loop, progress_format, &run.progress) != 0) {
+            return 1;
+        }
+    }
+    
+    struct flash_options options;
+    flash_options_init(&options);
+    options.recover = recover;
+    options.confirm = !yes;
+    options.mode = run.mode;
+    options.state = state;
+    options.force = force;
+    options.provision = provision;
+    
+    for (int i = 0; i < num_devs; i++) {
+        ret = serial_port_open(loop, devs[i], baudrate, &ports[i]);
+        if (ret != 0) {
+            return 1;
+        }
+        
+        options.bootloader_baudrate = adapter_db_baudrate(adapters, devs[i]);
+        ret = flash_session_init(ports[i], hex, &options, flash_run_event,
+                                 &run, &sessions[i]);
+        if (ret != 0) {
+            return 1;
+        }
     }
     
-    printf("\nUpdate completed successfully!\nFirmware version is now: %s\n",
-           buffer);
+    /* Update modules */
+    ret = flash_modules(&run, loop, file);
+    
+    if (rtt_stats) {
+        struct latency_stats rtt;
+        latency_stats_reset(&rtt);
+        for (int i = 0; i < num_devs; i++) {
+            latency_stats_merge(&rtt, &serial_port_get_stats(ports[i])->rtt);
+        }
+        latency_stats_print(&rtt, "\nCommand round trip time");
+    }
     
+    for (int i = 0; i < num_devs; i++) {
+        serial_port_close(ports[i]);
+        flash_session_free(sessions[i]);
+    }
+    free(sessions);
+    free(ports);
+    free(devs);
     free_intel_hex_file(hex);
+    if (run.progress != NULL) {
+        progress_free(run.progress);
+    }
+    io_loop_free(loop);
+    if (state != NULL) {
+        state_db_free(state);
+    }
+    if (provision != NULL) {
+        provision_script_free(provision);
+    }
+    if (adapters != NULL) {
+        adapter_db_free(adapters);
+    }
     
-    return 0;
+    return ret;
 }
@@ -0,0 +1,338 @@
+//
+//  manifest.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#define _GNU_SOURCE
+
+#include "manifest.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "json.h"
+
+/** Names of the fields of a job, in the order they appear in CSV lines */
+static const char *const manifest_fields[] = { "port", "image", "baud",
+                                               "policy", "script" };
+#define MANIFEST_NUM_FIELDS (sizeof(manifest_fields) / sizeof(char *))
+
+static const char *const manifest_policy_names[] = {
+    [MANIFEST_POLICY_UPDATE] = "update",
+    [MANIFEST_POLICY_RECOVER] = "recover"
+};
+
+/** State used while parsing a single line */
+struct manifest_line {
+    struct manifest_job *job;
+    const char *path;
+    /** Directory containing the manifest, with a trailing slash */
+    const char *dir;
+};
+
+
+/**
+ *  Set one field of a job.
+ *
+ *  @param line The line being parsed
+ *  @param key Name of the field
+ *  @param value Value of the field
+ *
+ *  @return 0 if successfull
+ */
+static int manifest_set_field (struct manifest_line *line, const char *key,
+                               const char *value)
+{
+    struct manifest_job *job = line->job;
+    
+    if (*value == '\0') {
+        // Empty fields take their default values
+        return 0;
+    }
+    
+    if (strcmp(key, "port") == 0) {
+        free(job->port);
+        job->port = strdup(value);
+        if (job->port == NULL) {
+            return -1;
+        }
+    } else if ((strcmp(key, "image") == 0) || (strcmp(key, "script") == 0)) {
+        char **path = (key[0] == 'i') ? &job->image : &job->script;
+        free(*path);
+        if (value[0] == '/') {
+            *path = strdup(value);
+        } else if (asprintf(path, "%s%s", line->dir, value) == -1) {
+            *path = NULL;
+        }
+        if (*path == NULL) {
+            return -1;
+        }
+    } else if (strcmp(key, "baud") == 0) {
+        char *end;
+        long baud = strtol(value, &end, 10);
+        if ((*end != '\0') || (baud <= 0)) {
+            fprintf(stderr, "%s:%d: Invalid baudrate \"%s\"\n", line->path,
+                    job->line, value);
+            return -1;
+        }
+        job->baudrate = (int)baud;
+    } else if (strcmp(key, "policy") == 0) {
+        size_t i;
+        for (i = 0; i < (sizeof(manifest_policy_names) / sizeof(char *));
+             i++) {
+            if (strcasecmp(value, manifest_policy_names[i]) == 0) {
+                job->policy = (enum manifest_policy)i;
+                break;
+            }
+        }
+        if (i == (sizeof(manifest_policy_names) / sizeof(char *))) {
+            fprintf(stderr, "%s:%d: Unknown policy \"%s\"\n", line->path,
+                    job->line, value);
+            return -1;
+        }
+    } else {
+        fprintf(stderr, "%s:%d: Unknown field \"%s\"\n", line->path,
+                job->line, key);
+        return -1;
+    }
+    
+    return 0;
+}
+
+/**
+ *  Callback for members of a JSON job.
+ */
+static int manifest_json_member (const char *key, enum json_type type,
+                                 const char *value, void *context)
+{
+    if (type == JSON_NULL) {
+        return 0;
+    }
+    return manifest_set_field((struct manifest_line *)context, key, value);
+}
+
+/**
+ *  Parse a line of comma separated values. Fields may be surrounded by double
+ *  quotes, in which case two double quotes represent one.
+ *
+ *  @param line The line being parsed
+ *  @param text The text of the line, modified while parsing
+ *  @param header Pointer to flag which is set if the line is a header
+ *
+ *  @return 0 if successfull
+ */
+static int manifest_parse_csv (struct manifest_line *line, char *text,
+                               int *header)
+{
+    char *p = text;
+    
+    for (size_t field = 0;; field++) {
+        while ((*p == ' ') || (*p == '\t')) {
+            p++;
+        }
+        
+        /* Extract field */
+        char *value = p;
+        int last;
+        if (*p == '"') {
+            char *out = value;
+            p++;
+            for (;;) {
+                if (*p == '\0') {
+                    fprintf(stderr, "%s:%d: Unterminated quote\n", line->path,
+                            line->job->line);
+                    return -1;
+                } else if ((p[0] == '"') && (p[1] == '"')) {
+                    *out++ = '"';
+                    p += 2;
+                } else if (*p == '"') {
+                    p++;
+                    break;
+                } else {
+                    *out++ = *p++;
+                }
+            }
+            *out = '\0';
+            while ((*p == ' ') || (*p == '\t')) {
+                p++;
+            }
+            if ((*p != ',') && (*p != '\0')) {
+                fprintf(stderr, "%s:%d: Unexpected text after quote\n",
+                        line->path, line->job->line);
+                return -1;
+            }
+            last = (*p == '\0');
+            p++;
+        } else {
+            p += strcspn(p, ",");
+            char *end = p;
+            while ((end > value) && isspace((unsigned char)end[-1])) {
+                end--;
+            }
+            last = (*p == '\0');
+            p++;
+            *end = '\0';
+        }
+        
+        if (field >= MANIFEST_NUM_FIELDS) {
+            fprintf(stderr, "%s:%d: Too many fields\n", line->path,
+                    line->job->line);
+            return -1;
+        } else if ((field == 0) && (strcasecmp(value, "port") == 0)) {
+            *header = 1;
+            return 0;
+        } else if (manifest_set_field(line, manifest_fields[field],
+                                      value) != 0) {
+            return -1;
+        }
+        
+        if (last) {
+            return 0;
+        }
+    }
+}
+
+
+int manifest_parse (const char *path, int default_baudrate,
+                    struct manifest **manifest)
+{
+    FILE *file = fopen(path, "r");
+    
+    if (file == NULL) {
+        fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    
+    *manifest = calloc(1, sizeof(struct manifest));
+    if (*manifest == NULL) {
+        fprintf(stderr, "Could not allocate manifest.\n");
+        goto close_file;
+    }
+    
+    /* Relative image paths are relative to the manifest's directory */
+    char *dir = strdup(path);
+    if (dir == NULL) {
+        goto free_manifest;
+    }
+    char *slash = strrchr(dir, '/');
+    if (slash != NULL) {
+        slash[1] = '\0';
+    } else {
+        dir[0] = '\0';
+    }
+    
+    char *text = NULL;
+    size_t text_size = 0;
+    int capacity = 0;
+    int line_num = 0;
+    
+    while (getline(&text, &text_size, file) != -1) {
+        line_num++;
+        text[strcspn(text, "\r\n")] = '\0';
+        
+        char *start = text;
+        while (isspace((unsigned char)*start)) {
+            start++;
+        }
+        if ((*start == '\0') || (*start == '#')) {
+            continue;
+        }
+        
+        /* Add job */
+        if ((*manifest)->num_jobs == capacity) {
+            capacity = (capacity == 0) ? 16 : (capacity * 2);
+            struct manifest_job *jobs = realloc((*manifest)->jobs,
+                                    (size_t)capacity * sizeof(*jobs));
+            if (jobs == NULL) {
+                fprintf(stderr, "Could not allocate manifest jobs.\n");
+                goto free_text;
+            }
+            (*manifest)->jobs = jobs;
+        }
+        
+        struct manifest_job *job = &(*manifest)->jobs[(*manifest)->num_jobs];
+        memset(job, 0, sizeof(*job));
+        job->baudrate = default_baudrate;
+        job->line = line_num;
+        (*manifest)->num_jobs++;
+        
+        struct manifest_line line = { .job = job, .path = path, .dir = dir };
+        int header = 0;
+        int ret;
+        
+        if (*start == '{') {
+            ret = json_parse_object(start, manifest_json_member, &line);
+            if (ret == -1) {
+                fprintf(stderr, "%s:%d: Invalid JSON object\n", path,
+                        line_num);
+            }
+        } else {
+            ret = manifest_parse_csv(&line, start, &header);
+        }
+        
+        if (ret != 0) {
+            goto free_text;
+        } else if (header) {
+            free(job->port);
+            (*manifest)->num_jobs--;
+            continue;
+        }
+        
+        /* Check job */
+        if ((job->port == NULL) || (job->image == NULL)) {
+            fprintf(stderr, "%s:%d: A port and an image are required\n", path,
+                    line_num);
+            goto free_text;
+        }
+        
+        for (int i = 0; i < ((*manifest)->num_jobs - 1); i++) {
+            if (strcmp((*manifest)->jobs[i].port, job->port) == 0) {
+                fprintf(stderr, "%s:%d: Port %s is already used on line %d\n",
+                        path, line_num, job->port, (*manifest)->jobs[i].line);
+                goto free_text;
+            }
+        }
+    }
+    
+    if ((*manifest)->num_jobs == 0) {
+        fprintf(stderr, "%s: Manifest does not contain any jobs\n", path);
+        goto free_text;
+    }
+    
+    free(text);
+    free(dir);
+    fclose(file);
+    return 0;
+    
+free_text:
+    free(text);
+    free(dir);
+free_manifest:
+    manifest_free(*manifest);
+close_file:
+    fclose(file);
+    return -1;
+}
+
+void manifest_free (struct manifest *manifest)
+{
+    for (int i = 0; i < manifest->num_jobs; i++) {
+        free(manifest->jobs[i].port);
+        free(manifest->jobs[i].image);
+        free(manifest->jobs[i].script);
+    }
+    free(manifest->jobs);
+    free(manifest);
+}
+
+const char *manifest_policy_name (enum manifest_policy policy)
+{
+    return manifest_policy_names[policy];
+}
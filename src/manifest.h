@@ -0,0 +1,72 @@
+//
+//  manifest.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef manifest_h
+#define manifest_h
+
+enum manifest_policy {
+    /** Update a module which is running its application firmware */
+    MANIFEST_POLICY_UPDATE,
+    /** Complete the update of a module which is already in the bootloader */
+    MANIFEST_POLICY_RECOVER
+};
+
+struct manifest_job {
+    /** Path to the module's serial port */
+    char *port;
+    /** Path to the firmware image, relative paths are resolved relative to
+        the manifest */
+    char *image;
+    /** Baudrate for the module's serial port */
+    int baudrate;
+    enum manifest_policy policy;
+    /** Path to a provisioning script to be run after the update, or NULL.
+        Relative paths are resolved relative to the manifest */
+    char *script;
+    /** Line of the manifest which the job was read from */
+    int line;
+};
+
+struct manifest {
+    struct manifest_job *jobs;
+    int num_jobs;
+};
+
+/**
+ *  Parse a batch job manifest. Each line of the manifest describes one job,
+ *  either as comma separated values in the order port, image, baud, policy,
+ *  script or as a JSON object with members of the same names. Only the port and image
+ *  are required. Blank lines and lines starting with # are ignored, as is a
+ *  CSV header line.
+ *
+ *  @param path Path to the manifest file
+ *  @param default_baudrate Baudrate used for jobs which do not specify one
+ *  @param manifest Pointer to where pointer to parsed manifest should be stored
+ *
+ *  @return 0 if successfull
+ */
+extern int manifest_parse (const char *path, int default_baudrate,
+                           struct manifest **manifest);
+
+/**
+ *  Free a parsed manifest.
+ *
+ *  @param manifest The manifest to be freed
+ */
+extern void manifest_free (struct manifest *manifest);
+
+/**
+ *  Get the name of a job policy.
+ *
+ *  @param policy The policy
+ *
+ *  @return Name of the policy as used in manifests
+ */
+extern const char *manifest_policy_name (enum manifest_policy policy);
+
+#endif /* manifest_h */
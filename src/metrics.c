@@ -0,0 +1,392 @@
+//
+//  metrics.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#include "metrics.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+
+/** Maximum length of a command name */
+#define METRICS_NAME_LENGTH 32
+
+/** Upper bounds of the command round trip time histogram buckets in
+    microseconds */
+static const uint64_t metrics_buckets[] = {
+    500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000,
+    1000000, 2000000, 5000000
+};
+#define METRICS_NUM_BUCKETS (sizeof(metrics_buckets) / \
+                             sizeof(metrics_buckets[0]))
+
+struct metrics_command_series {
+    const char *layer;
+    char command[METRICS_NAME_LENGTH];
+    /** Number of completed commands which took no longer than each bound */
+    uint64_t buckets[METRICS_NUM_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t failures;
+};
+
+struct metrics_phase_series {
+    const char *phase;
+    uint64_t count;
+    uint64_t sum;
+};
+
+struct metrics_port_series {
+    char *port;
+    uint64_t done;
+    uint64_t failed;
+    uint64_t cancelled;
+    uint64_t payload_bytes;
+    uint64_t bytes_tx;
+    uint64_t bytes_rx;
+    /** Throughput and overhead of the last session which wrote flash */
+    double throughput;
+    double overhead;
+};
+
+int metrics_enabled = 0;
+
+static char *metrics_path;
+
+static struct metrics_command_series *metrics_commands;
+static int metrics_num_commands;
+static struct metrics_phase_series *metrics_phases;
+static int metrics_num_phases;
+static struct metrics_port_series *metrics_ports;
+static int metrics_num_ports;
+
+
+/**
+ *  Grow an array by one element.
+ *
+ *  @param array Pointer to the array
+ *  @param count Number of elements in the array
+ *  @param size Size of each element
+ *
+ *  @return Pointer to the new element, which is zeroed, or NULL
+ */
+static void *metrics_append (void *array, int count, size_t size)
+{
+    void **a = array;
+    uint8_t *grown = realloc(*a, (size_t)(count + 1) * size);
+    if (grown == NULL) {
+        return NULL;
+    }
+    *a = grown;
+    memset(grown + ((size_t)count * size), 0, size);
+    return grown + ((size_t)count * size);
+}
+
+/**
+ *  Write a label value with the escaping required by the text format.
+ */
+static void metrics_write_label (FILE *file, const char *value)
+{
+    for (const char *c = value; *c != '\0'; c++) {
+        if ((*c == '\\') || (*c == '"')) {
+            fprintf(file, "\\%c", *c);
+        } else if (*c == '\n') {
+            fprintf(file, "\\n");
+        } else {
+            fputc(*c, file);
+        }
+    }
+}
+
+/**
+ *  Write a duration in microseconds as seconds.
+ */
+static void metrics_write_seconds (FILE *file, uint64_t micros)
+{
+    fprintf(file, "%" PRIu64 ".%06" PRIu64, micros / 1000000,
+            micros % 1000000);
+}
+
+/**
+ *  Write the command round trip time histograms.
+ */
+static void metrics_write_commands (FILE *file)
+{
+    fprintf(file, "# HELP rn2483_loader_command_duration_seconds Time from "
+            "sending a command to its response.\n# TYPE "
+            "rn2483_loader_command_duration_seconds histogram\n");
+    for (int i = 0; i < metrics_num_commands; i++) {
+        struct metrics_command_series *c = &metrics_commands[i];
+        
+        for (size_t b = 0; b < METRICS_NUM_BUCKETS; b++) {
+            fprintf(file, "rn2483_loader_command_duration_seconds_bucket"
+                    "{layer=\"%s\",command=\"", c->layer);
+            metrics_write_label(file, c->command);
+            fprintf(file, "\",le=\"");
+            metrics_write_seconds(file, metrics_buckets[b]);
+            fprintf(file, "\"} %" PRIu64 "\n", c->buckets[b]);
+        }
+        fprintf(file, "rn2483_loader_command_duration_seconds_bucket{layer="
+                "\"%s\",command=\"", c->layer);
+        metrics_write_label(file, c->command);
+        fprintf(file, "\",le=\"+Inf\"} %" PRIu64 "\n", c->count);
+        
+        fprintf(file, "rn2483_loader_command_duration_seconds_sum{layer="
+                "\"%s\",command=\"", c->layer);
+        metrics_write_label(file, c->command);
+        fprintf(file, "\"} ");
+        metrics_write_seconds(file, c->sum);
+        fprintf(file, "\nrn2483_loader_command_duration_seconds_count{layer="
+                "\"%s\",command=\"", c->layer);
+        metrics_write_label(file, c->command);
+        fprintf(file, "\"} %" PRIu64 "\n", c->count);
+    }
+    
+    fprintf(file, "# HELP rn2483_loader_command_failures_total Commands "
+            "which timed out or failed.\n# TYPE "
+            "rn2483_loader_command_failures_total counter\n");
+    for (int i = 0; i < metrics_num_commands; i++) {
+        struct metrics_command_series *c = &metrics_commands[i];
+        fprintf(file, "rn2483_loader_command_failures_total{layer=\"%s\","
+                "command=\"", c->layer);
+        metrics_write_label(file, c->command);
+        fprintf(file, "\"} %" PRIu64 "\n", c->failures);
+    }
+}
+
+/**
+ *  Write the phase durations.
+ */
+static void metrics_write_phases (FILE *file)
+{
+    fprintf(file, "# HELP rn2483_loader_phase_duration_seconds Time spent in "
+            "each phase of an update.\n# TYPE "
+            "rn2483_loader_phase_duration_seconds summary\n");
+    for (int i = 0; i < metrics_num_phases; i++) {
+        struct metrics_phase_series *p = &metrics_phases[i];
+        fprintf(file, "rn2483_loader_phase_duration_seconds_sum{phase=\"%s\"} ",
+                p->phase);
+        metrics_write_seconds(file, p->sum);
+        fprintf(file, "\nrn2483_loader_phase_duration_seconds_count{phase="
+                "\"%s\"} %" PRIu64 "\n", p->phase, p->count);
+    }
+}
+
+/**
+ *  Write the per port counters and gauges.
+ */
+static void metrics_write_ports (FILE *file)
+{
+    fprintf(file, "# HELP rn2483_loader_sessions_total Sessions which have "
+            "finished, by result.\n# TYPE rn2483_loader_sessions_total "
+            "counter\n");
+    for (int i = 0; i < metrics_num_ports; i++) {
+        struct metrics_port_series *p = &metrics_ports[i];
+        const char *results[] = { "done", "failed", "cancelled" };
+        uint64_t counts[] = { p->done, p->failed, p->cancelled };
+        for (int r = 0; r < 3; r++) {
+            fprintf(file, "rn2483_loader_sessions_total{port=\"");
+            metrics_write_label(file, p->port);
+            fprintf(file, "\",result=\"%s\"} %" PRIu64 "\n", results[r],
+                    counts[r]);
+        }
+    }
+    
+    fprintf(file, "# HELP rn2483_loader_payload_bytes_total Bytes of images "
+            "written to flash.\n# TYPE rn2483_loader_payload_bytes_total "
+            "counter\n");
+    for (int i = 0; i < metrics_num_ports; i++) {
+        fprintf(file, "rn2483_loader_payload_bytes_total{port=\"");
+        metrics_write_label(file, metrics_ports[i].port);
+        fprintf(file, "\"} %" PRIu64 "\n", metrics_ports[i].payload_bytes);
+    }
+    
+    fprintf(file, "# HELP rn2483_loader_wire_bytes_total Bytes sent and "
+            "received on the port.\n# TYPE rn2483_loader_wire_bytes_total "
+            "counter\n");
+    for (int i = 0; i < metrics_num_ports; i++) {
+        fprintf(file, "rn2483_loader_wire_bytes_total{port=\"");
+        metrics_write_label(file, metrics_ports[i].port);
+        fprintf(file, "\",direction=\"tx\"} %" PRIu64 "\n",
+                metrics_ports[i].bytes_tx);
+        fprintf(file, "rn2483_loader_wire_bytes_total{port=\"");
+        metrics_write_label(file, metrics_ports[i].port);
+        fprintf(file, "\",direction=\"rx\"} %" PRIu64 "\n",
+                metrics_ports[i].bytes_rx);
+    }
+    
+    fprintf(file, "# HELP rn2483_loader_write_throughput_bytes_per_second "
+            "Bytes of image written per second of writing in the last update."
+            "\n# TYPE rn2483_loader_write_throughput_bytes_per_second gauge\n");
+    for (int i = 0; i < metrics_num_ports; i++) {
+        fprintf(file, "rn2483_loader_write_throughput_bytes_per_second{port="
+                "\"");
+        metrics_write_label(file, metrics_ports[i].port);
+        fprintf(file, "\"} %.1f\n", metrics_ports[i].throughput);
+    }
+    
+    fprintf(file, "# HELP rn2483_loader_wire_overhead_ratio Bytes on the wire "
+            "for each byte of image written in the last update.\n# TYPE "
+            "rn2483_loader_wire_overhead_ratio gauge\n");
+    for (int i = 0; i < metrics_num_ports; i++) {
+        fprintf(file, "rn2483_loader_wire_overhead_ratio{port=\"");
+        metrics_write_label(file, metrics_ports[i].port);
+        fprintf(file, "\"} %.3f\n", metrics_ports[i].overhead);
+    }
+}
+
+/**
+ *  Write the metrics when the program exits.
+ */
+static void metrics_exit (void)
+{
+    if (metrics_enabled) {
+        metrics_write();
+    }
+}
+
+
+int metrics_start (const char *path)
+{
+    metrics_path = strdup(path);
+    if (metrics_path == NULL) {
+        fprintf(stderr, "Could not allocate memory for metrics.\n");
+        return -1;
+    }
+    
+    metrics_enabled = 1;
+    atexit(metrics_exit);
+    return 0;
+}
+
+int metrics_write (void)
+{
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", metrics_path);
+    
+    FILE *file = fopen(tmp_path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open %s: %s\n", tmp_path, strerror(errno));
+        return -1;
+    }
+    
+    metrics_write_commands(file);
+    metrics_write_phases(file);
+    metrics_write_ports(file);
+    
+    if ((fclose(file) != 0) || (rename(tmp_path, metrics_path) != 0)) {
+        fprintf(stderr, "Could not write %s: %s\n", metrics_path,
+                strerror(errno));
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+void metrics_command (const char *layer, const char *command, uint64_t rtt,
+                      int ok)
+{
+    struct metrics_command_series *c = NULL;
+    for (int i = 0; i < metrics_num_commands; i++) {
+        if ((metrics_commands[i].layer == layer) &&
+                (strcmp(metrics_commands[i].command, command) == 0)) {
+            c = &metrics_commands[i];
+            break;
+        }
+    }
+    
+    if (c == NULL) {
+        c = metrics_append(&metrics_commands, metrics_num_commands,
+                           sizeof(*c));
+        if (c == NULL) {
+            return;
+        }
+        metrics_num_commands++;
+        c->layer = layer;
+        snprintf(c->command, sizeof(c->command), "%s", command);
+    }
+    
+    if (!ok) {
+        c->failures++;
+        return;
+    }
+    
+    for (size_t b = 0; b < METRICS_NUM_BUCKETS; b++) {
+        if (rtt <= metrics_buckets[b]) {
+            c->buckets[b]++;
+        }
+    }
+    c->count++;
+    c->sum += rtt;
+}
+
+void metrics_phase (const char *phase, uint64_t duration)
+{
+    struct metrics_phase_series *p = NULL;
+    for (int i = 0; i < metrics_num_phases; i++) {
+        if (metrics_phases[i].phase == phase) {
+            p = &metrics_phases[i];
+            break;
+        }
+    }
+    
+    if (p == NULL) {
+        p = metrics_append(&metrics_phases, metrics_num_phases, sizeof(*p));
+        if (p == NULL) {
+            return;
+        }
+        metrics_num_phases++;
+        p->phase = phase;
+    }
+    
+    p->count++;
+    p->sum += duration;
+}
+
+void metrics_session_done (const struct metrics_session *session)
+{
+    struct metrics_port_series *p = NULL;
+    for (int i = 0; i < metrics_num_ports; i++) {
+        if (strcmp(metrics_ports[i].port, session->port) == 0) {
+            p = &metrics_ports[i];
+            break;
+        }
+    }
+    
+    if (p == NULL) {
+        p = metrics_append(&metrics_ports, metrics_num_ports, sizeof(*p));
+        if ((p == NULL) || ((p->port = strdup(session->port)) == NULL)) {
+            return;
+        }
+        metrics_num_ports++;
+    }
+    
+    if (strcmp(session->result, "done") == 0) {
+        p->done++;
+    } else if (strcmp(session->result, "cancelled") == 0) {
+        p->cancelled++;
+    } else {
+        p->failed++;
+    }
+    
+    p->payload_bytes += session->payload_bytes;
+    p->bytes_tx += session->bytes_tx;
+    p->bytes_rx += session->bytes_rx;
+    
+    if ((session->payload_bytes != 0) && (session->write_time != 0)) {
+        p->throughput = ((double)session->payload_bytes * 1000000.0) /
+                            (double)session->write_time;
+        p->overhead = (double)(session->bytes_tx + session->bytes_rx) /
+                            (double)session->payload_bytes;
+    }
+    
+    metrics_write();
+}
@@ -0,0 +1,81 @@
+//
+//  metrics.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef metrics_h
+#define metrics_h
+
+#include <stdint.h>
+
+/** Non-zero while metrics are being collected, callers check this before
+    doing any work to describe a measurement */
+extern int metrics_enabled;
+
+/**
+ *  What is known about a session which has finished.
+ */
+struct metrics_session {
+    /** Name of the module's port */
+    const char *port;
+    /** How the session ended, such as "done" or "failed" */
+    const char *result;
+    /** Number of bytes of the image which were written to flash */
+    uint64_t payload_bytes;
+    /** Time spent writing flash in microseconds */
+    uint64_t write_time;
+    /** Number of bytes sent and received on the port during the session */
+    uint64_t bytes_tx;
+    uint64_t bytes_rx;
+};
+
+/**
+ *  Start collecting metrics. They are written to the file after each session
+ *  finishes and when the program exits.
+ *
+ *  @param path Path to the file where metrics should be written, in the
+ *              Prometheus text format
+ *
+ *  @return 0 if successfull
+ */
+extern int metrics_start (const char *path);
+
+/**
+ *  Write the metrics collected so far. The file is replaced atomically so that
+ *  a collector never sees it half written.
+ *
+ *  @return 0 if successfull
+ */
+extern int metrics_write (void);
+
+/**
+ *  Record the completion of a command.
+ *
+ *  @param layer What the command was sent to, "bootloader" or "module"
+ *  @param command Name of the command
+ *  @param rtt Time from sending the command to its completion in microseconds
+ *  @param ok Non-zero if the command completed, zero if it timed out or
+ *            failed
+ */
+extern void metrics_command (const char *layer, const char *command,
+                             uint64_t rtt, int ok);
+
+/**
+ *  Record the time spent in a phase of a session.
+ *
+ *  @param phase Name of the phase
+ *  @param duration Time spent in the phase in microseconds
+ */
+extern void metrics_phase (const char *phase, uint64_t duration);
+
+/**
+ *  Record the end of a session and write the metrics.
+ *
+ *  @param session What is known about the session
+ */
+extern void metrics_session_done (const struct metrics_session *session);
+
+#endif /* metrics_h */
@@ -0,0 +1,175 @@
+//
+//  probe.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#include "probe.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "bootloader-commands.h"
+
+/** Request for the application's version, preceded by an end of line so that
+    anything left in the firmware's line buffer is not taken as part of it */
+#define PROBE_APP_REQUEST   "\r\nsys get ver\r\n"
+/** Response that the application gives to the bootloader request */
+#define PROBE_APP_ERROR     "invalid_param"
+
+static const char *const probe_state_names[] = {
+    [PROBE_STATE_NONE] = "none",
+    [PROBE_STATE_APPLICATION] = "application",
+    [PROBE_STATE_BOOTLOADER] = "bootloader"
+};
+
+
+/**
+ *  Finish a probe and report its results.
+ */
+static void probe_finish (struct probe *probe, enum probe_state state)
+{
+    probe->state = state;
+    serial_port_set_receiver(probe->port, NULL, NULL);
+    serial_port_set_deadline(probe->port, 0);
+    probe->callback(probe, probe->context);
+}
+
+/**
+ *  Ask the firmware for its version, once the bootloader has not answered.
+ *
+ *  @return 0 if successfull
+ */
+static int probe_ask_application (struct probe *probe)
+{
+    probe->asked_application = 1;
+    
+    if ((serial_port_write(probe->port, PROBE_APP_REQUEST,
+                           strlen(PROBE_APP_REQUEST)) != 0) ||
+            (serial_port_set_deadline(probe->port, probe->timeout) != 0)) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ *  Read a little endian field from a bootloader response.
+ */
+static int probe_get_16 (const uint8_t *data, size_t offset)
+{
+    return data[offset] | (data[offset + 1] << 8);
+}
+
+/**
+ *  Handle the responses to a probe.
+ */
+static size_t probe_receive (struct serial_port *port,
+                             enum serial_port_event event, const uint8_t *data,
+                             size_t length, void *context)
+{
+    (void)port;
+    struct probe *probe = context;
+    size_t consumed = 0;
+    
+    switch (event) {
+        case SERIAL_PORT_EVENT_DATA:
+            break;
+        case SERIAL_PORT_EVENT_WRITTEN:
+        case SERIAL_PORT_EVENT_CLOSED:
+            return 0;
+        case SERIAL_PORT_EVENT_TIMEOUT:
+            if (!probe->asked_application &&
+                    (probe_ask_application(probe) == 0)) {
+                return 0;
+            }
+            probe_finish(probe, PROBE_STATE_NONE);
+            return 0;
+        case SERIAL_PORT_EVENT_ERROR:
+            probe_finish(probe, PROBE_STATE_NONE);
+            return 0;
+    }
+    
+    while (consumed < length) {
+        const uint8_t *line = data + consumed;
+        size_t left = length - consumed;
+        
+        if (line[0] == RN_BOOTLOADER_MAGIC) {
+            // The bootloader echoes the command at the start of its response
+            if (left < sizeof(struct rn_bootloader_rsp_version)) {
+                return consumed;
+            } else if (line[1] == RN_BOOTLOADER_CMD_GET_VERSION) {
+                probe->bootloader_version = probe_get_16(line,
+                            offsetof(struct rn_bootloader_rsp_version,
+                                     version));
+                probe->device_id = probe_get_16(line,
+                            offsetof(struct rn_bootloader_rsp_version,
+                                     device_id));
+                probe_finish(probe, PROBE_STATE_BOOTLOADER);
+                return consumed + sizeof(struct rn_bootloader_rsp_version);
+            }
+        }
+        
+        const uint8_t *end = memchr(line, '\n', left);
+        if (end == NULL) {
+            // Wait for the rest of the line
+            return consumed;
+        }
+        consumed += (size_t)(end - line) + 1;
+        
+        size_t line_length = (size_t)(end - line);
+        if ((line_length > 0) && (line[line_length - 1] == '\r')) {
+            line_length--;
+        }
+        if ((line_length == 0) || ((line_length == strlen(PROBE_APP_ERROR)) &&
+                (memcmp(line, PROBE_APP_ERROR, line_length) == 0))) {
+            // Not the answer to the version request
+            continue;
+        }
+        
+        if (line_length > (PROBE_VERSION_LENGTH - 1)) {
+            line_length = PROBE_VERSION_LENGTH - 1;
+        }
+        memcpy(probe->version, line, line_length);
+        probe->version[line_length] = '\0';
+        probe_finish(probe, PROBE_STATE_APPLICATION);
+        return consumed;
+    }
+    
+    return consumed;
+}
+
+
+int probe_start (struct probe *probe, struct serial_port *port, long timeout,
+                 probe_cb callback, void *context)
+{
+    memset(probe, 0, sizeof(*probe));
+    probe->state = PROBE_STATE_NONE;
+    probe->port = port;
+    probe->callback = callback;
+    probe->context = context;
+    probe->timeout = timeout;
+    
+    /* The bootloader is asked first, a bootloader would take the first byte
+       of the firmware's request as the autobaud character of a command */
+    struct rn_bootloader_cmd_pkt request;
+    memset(&request, 0, sizeof(request));
+    request.magic = RN_BOOTLOADER_MAGIC;
+    request.command = RN_BOOTLOADER_CMD_GET_VERSION;
+    
+    serial_port_discard_input(port);
+    serial_port_set_receiver(port, probe_receive, probe);
+    
+    if ((serial_port_write(port, &request, sizeof(request)) != 0) ||
+            (serial_port_set_deadline(port, PROBE_BOOTLOADER_TIMEOUT) != 0)) {
+        serial_port_set_receiver(port, NULL, NULL);
+        return -1;
+    }
+    return 0;
+}
+
+const char *probe_state_name (enum probe_state state)
+{
+    return probe_state_names[state];
+}
@@ -0,0 +1,92 @@
+//
+//  probe.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef probe_h
+#define probe_h
+
+#include "serial-port.h"
+
+/** Maximum length of the firmware version string found by a probe */
+#define PROBE_VERSION_LENGTH    64
+/** Default time to wait for a probe response in milliseconds */
+#define PROBE_TIMEOUT           300
+/** Time to wait for the bootloader to answer before asking the firmware in
+    milliseconds */
+#define PROBE_BOOTLOADER_TIMEOUT    100
+
+enum probe_state {
+    /** Nothing answered */
+    PROBE_STATE_NONE,
+    /** A module running its application firmware answered */
+    PROBE_STATE_APPLICATION,
+    /** A module waiting in the bootloader answered */
+    PROBE_STATE_BOOTLOADER
+};
+
+struct probe;
+
+/**
+ *  Callback for completion of a probe.
+ *
+ *  @param probe The probe, with its results filled in
+ *  @param context The context pointer given to probe_start
+ */
+typedef void (*probe_cb)(struct probe *probe, void *context);
+
+/**
+ *  State and results of a probe. The structure is owned by the caller and must
+ *  remain valid until the probe completes or its port is closed.
+ */
+struct probe {
+    /* Results */
+    enum probe_state state;
+    /** Firmware version string, if the application answered */
+    char version[PROBE_VERSION_LENGTH];
+    /** Bootloader version and device ID, if the bootloader answered */
+    int bootloader_version;
+    int device_id;
+    
+    /* Private */
+    struct serial_port *port;
+    probe_cb callback;
+    void *context;
+    long timeout;
+    /** Set once the firmware has been asked for its version */
+    int asked_application;
+};
+
+/**
+ *  Find out what is listening on a port. The bootloader is asked for its
+ *  version first, since the bootloader takes the first byte of anything it is
+ *  sent as the autobaud character of a command. The firmware answers the
+ *  bootloader's request with invalid_param once the line is ended. Only if
+ *  nothing answers within PROBE_BOOTLOADER_TIMEOUT is the firmware asked for
+ *  its version. Timeouts are expected while probing and are not reported. If
+ *  the port is closed while the probe is running the callback is not called.
+ *
+ *  @param probe Structure for the probe's state and results
+ *  @param port The port to be probed
+ *  @param timeout Time to wait for the firmware to respond in milliseconds
+ *  @param callback Function to be called when the probe completes
+ *  @param context Pointer to be passed to callback
+ *
+ *  @return 0 if the probe was started
+ */
+extern int probe_start (struct probe *probe, struct serial_port *port,
+                        long timeout, probe_cb callback, void *context);
+
+/**
+ *  Get a human readable name for a probe state.
+ *
+ *  @param state The state
+ *
+ *  @return Name of the state
+ */
+extern const char *probe_state_name (enum probe_state state);
+
+#endif /* probe_h */
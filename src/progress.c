@@ -0,0 +1,324 @@
+//
+//  progress.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#include "progress.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "latency-stats.h"
+#include "json.h"
+
+struct progress_task {
+    const char *name;
+    const char *phase;
+    progress_sample_cb sample;
+    void *source;
+    /** Time at which the task was started */
+    uint64_t start_time;
+    /** Sample which was last shown, so that unchanged samples are skipped */
+    struct progress_sample last;
+    int shown;
+};
+
+struct progress {
+    enum progress_format format;
+    struct io_timer *timer;
+    
+    struct progress_task *tasks;
+    int num_tasks;
+    int capacity;
+};
+
+
+/**
+ *  Work out the throughput of a task and the time left until it finishes.
+ *
+ *  @param task The task
+ *  @param sample How far the task has got
+ *  @param rate Pointer to where throughput in bytes per second should be
+ *              stored
+ *
+ *  @return Estimated number of seconds remaining, or -1 if it is not known
+ */
+static long progress_estimate (const struct progress_task *task,
+                               const struct progress_sample *sample,
+                               double *rate)
+{
+    uint64_t elapsed = latency_stats_now() - task->start_time;
+    
+    *rate = 0;
+    if ((elapsed == 0) || (sample->bytes_done == 0)) {
+        return -1;
+    }
+    
+    *rate = ((double)sample->bytes_done * 1000000.0) / (double)elapsed;
+    
+    if (sample->bytes_done >= sample->bytes_total) {
+        return 0;
+    }
+    return (long)((double)(sample->bytes_total - sample->bytes_done) / *rate);
+}
+
+/**
+ *  Get the percent completion of a task.
+ */
+static int progress_percent (const struct progress_sample *sample)
+{
+    if (sample->bytes_total != 0) {
+        return (int)((100 * sample->bytes_done) / sample->bytes_total);
+    } else if (sample->commands_total != 0) {
+        return (100 * sample->commands_done) / sample->commands_total;
+    }
+    return 0;
+}
+
+/**
+ *  Redraw the progress bar for a task. The whole line is formatted first and
+ *  written at once.
+ */
+static void progress_show_bar (const struct progress_task *task,
+                               const struct progress_sample *sample)
+{
+    char bar[PROGRESS_BAR_WIDTH + 1];
+    char eta[32];
+    double rate;
+    
+    int percent = progress_percent(sample);
+    if (percent > 100) {
+        percent = 100;
+    }
+    int filled = (percent * PROGRESS_BAR_WIDTH) / 100;
+    memset(bar, '|', (size_t)filled);
+    memset(bar + filled, ' ', (size_t)(PROGRESS_BAR_WIDTH - filled));
+    bar[PROGRESS_BAR_WIDTH] = '\0';
+    
+    long remaining = progress_estimate(task, sample, &rate);
+    if (remaining < 0) {
+        snprintf(eta, sizeof(eta), "--:--");
+    } else {
+        snprintf(eta, sizeof(eta), "%ld:%02ld", remaining / 60,
+                 remaining % 60);
+    }
+    
+    printf("\r%3d%% [%s] %7.1f KiB/s  ETA %-6s", percent, bar, rate / 1024,
+           eta);
+    fflush(stdout);
+}
+
+/**
+ *  Print a JSON object describing the progress of a task on its own line.
+ */
+static void progress_show_json (const struct progress_task *task,
+                                const struct progress_sample *sample)
+{
+    double rate;
+    long remaining = progress_estimate(task, sample, &rate);
+    
+    printf("{\"event\":\"progress\",\"name\":");
+    json_write_string(stdout, task->name);
+    printf(",\"phase\":");
+    json_write_string(stdout, task->phase);
+    printf(",\"bytes_done\":%" PRIu64 ",\"bytes_total\":%" PRIu64 ","
+           "\"commands_done\":%d,\"commands_total\":%d,"
+           "\"bytes_per_second\":%.0f,", sample->bytes_done,
+           sample->bytes_total, sample->commands_done, sample->commands_total,
+           rate);
+    if (remaining < 0) {
+        printf("\"eta_seconds\":null}\n");
+    } else {
+        printf("\"eta_seconds\":%ld}\n", remaining);
+    }
+    fflush(stdout);
+}
+
+/**
+ *  Show the progress of a task in the display's format.
+ */
+static void progress_draw (struct progress *progress,
+                           const struct progress_task *task,
+                           const struct progress_sample *sample)
+{
+    switch (progress->format) {
+        case PROGRESS_FORMAT_BAR:
+            progress_show_bar(task, sample);
+            break;
+        case PROGRESS_FORMAT_JSON:
+            progress_show_json(task, sample);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ *  Sample a task and show its progress if it has changed.
+ *
+ *  @param progress The display
+ *  @param task The task
+ *  @param force Show the progress even if it has not changed
+ */
+static void progress_show (struct progress *progress,
+                           struct progress_task *task, int force)
+{
+    struct progress_sample sample;
+    
+    memset(&sample, 0, sizeof(sample));
+    task->sample(task->source, &sample);
+    
+    if (!force && task->shown &&
+            (memcmp(&sample, &task->last, sizeof(sample)) == 0)) {
+        return;
+    }
+    task->last = sample;
+    task->shown = 1;
+    
+    progress_draw(progress, task, &sample);
+}
+
+/**
+ *  Timer callback which redraws every task.
+ */
+static void progress_timer_cb (struct io_timer *timer, void *context)
+{
+    struct progress *progress = (struct progress *)context;
+    
+    if (progress->num_tasks == 0) {
+        return;
+    }
+    
+    if (progress->format == PROGRESS_FORMAT_BAR) {
+        // There is only one line to draw on
+        progress_show(progress, &progress->tasks[0], 0);
+    } else {
+        for (int i = 0; i < progress->num_tasks; i++) {
+            progress_show(progress, &progress->tasks[i], 0);
+        }
+    }
+    
+    io_timer_start(timer, PROGRESS_INTERVAL);
+}
+
+/**
+ *  Find the task for a source.
+ *
+ *  @return Index of the task, or -1 if there is none
+ */
+static int progress_find (struct progress *progress, void *source)
+{
+    for (int i = 0; i < progress->num_tasks; i++) {
+        if (progress->tasks[i].source == source) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+int progress_init (struct io_loop *loop, enum progress_format format,
+                   struct progress **progress)
+{
+    struct progress *p = calloc(1, sizeof(struct progress));
+    if (p == NULL) {
+        fprintf(stderr, "Could not allocate memory for progress display.\n");
+        return -1;
+    }
+    p->format = format;
+    
+    if (io_timer_init(loop, progress_timer_cb, p, &p->timer) != 0) {
+        free(p);
+        return -1;
+    }
+    
+    *progress = p;
+    return 0;
+}
+
+void progress_free (struct progress *progress)
+{
+    io_timer_free(progress->timer);
+    free(progress->tasks);
+    free(progress);
+}
+
+enum progress_format progress_get_format (struct progress *progress)
+{
+    return progress->format;
+}
+
+int progress_begin (struct progress *progress, const char *name,
+                    const char *phase, progress_sample_cb sample, void *source)
+{
+    if (progress->format == PROGRESS_FORMAT_NONE) {
+        return 0;
+    }
+    
+    int index = progress_find(progress, source);
+    if (index < 0) {
+        if (progress->num_tasks == progress->capacity) {
+            int capacity = (progress->capacity == 0) ? 4 :
+                                (progress->capacity * 2);
+            struct progress_task *tasks = realloc(progress->tasks,
+                                    (size_t)capacity * sizeof(*tasks));
+            if (tasks == NULL) {
+                fprintf(stderr, "Could not allocate memory for progress "
+                        "display.\n");
+                return -1;
+            }
+            progress->tasks = tasks;
+            progress->capacity = capacity;
+        }
+        index = progress->num_tasks++;
+    }
+    
+    struct progress_task *task = &progress->tasks[index];
+    memset(task, 0, sizeof(*task));
+    task->name = name;
+    task->phase = phase;
+    task->sample = sample;
+    task->source = source;
+    task->start_time = latency_stats_now();
+    
+    if ((progress->format != PROGRESS_FORMAT_BAR) || (index == 0)) {
+        progress_show(progress, task, 1);
+    }
+    
+    if (!io_timer_is_armed(progress->timer)) {
+        io_timer_start(progress->timer, PROGRESS_INTERVAL);
+    }
+    return 0;
+}
+
+void progress_end (struct progress *progress, void *source, int complete)
+{
+    int index = progress_find(progress, source);
+    if (index < 0) {
+        return;
+    }
+    
+    struct progress_task *task = &progress->tasks[index];
+    struct progress_sample *sample = &task->last;
+    if (complete) {
+        sample->bytes_done = sample->bytes_total;
+        sample->commands_done = sample->commands_total;
+    }
+    if ((progress->format != PROGRESS_FORMAT_BAR) || (index == 0)) {
+        progress_draw(progress, task, sample);
+    }
+    
+    progress->num_tasks--;
+    memmove(&progress->tasks[index], &progress->tasks[index + 1],
+            (size_t)(progress->num_tasks - index) *
+                sizeof(struct progress_task));
+    
+    if (progress->num_tasks == 0) {
+        io_timer_stop(progress->timer);
+    }
+}
@@ -0,0 +1,112 @@
+//
+//  progress.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef progress_h
+#define progress_h
+
+#include <stdint.h>
+
+#include "io-loop.h"
+
+/** Time between updates of the progress display in milliseconds */
+#define PROGRESS_INTERVAL   200
+/** Width of the progress bar in characters */
+#define PROGRESS_BAR_WIDTH  40
+
+enum progress_format {
+    /** A progress bar with throughput and time remaining on standard output */
+    PROGRESS_FORMAT_BAR,
+    /** One JSON object per line on standard output for each update */
+    PROGRESS_FORMAT_JSON,
+    /** Nothing is shown */
+    PROGRESS_FORMAT_NONE
+};
+
+/**
+ *  How far a task has got.
+ */
+struct progress_sample {
+    uint64_t bytes_done;
+    /** Total number of bytes, zero if it is not known */
+    uint64_t bytes_total;
+    int commands_done;
+    int commands_total;
+};
+
+struct progress;
+
+/**
+ *  Callback used to find out how far a task has got.
+ *
+ *  @param source The source pointer given when the task was started
+ *  @param sample Structure to be filled
+ */
+typedef void (*progress_sample_cb)(void *source,
+                                   struct progress_sample *sample);
+
+/**
+ *  Create a progress display. Tasks are sampled from a timer on the event loop
+ *  at most once every PROGRESS_INTERVAL so the work being tracked never waits
+ *  on the display.
+ *
+ *  @param loop The event loop on which the display's timer runs
+ *  @param format How progress should be shown
+ *  @param progress Pointer to where pointer to new display should be stored
+ *
+ *  @return 0 if successfull
+ */
+extern int progress_init (struct io_loop *loop, enum progress_format format,
+                          struct progress **progress);
+
+/**
+ *  Free a progress display.
+ *
+ *  @param progress The display to be freed
+ */
+extern void progress_free (struct progress *progress);
+
+/**
+ *  Get the format of a progress display.
+ *
+ *  @param progress The display
+ *
+ *  @return The display's format
+ */
+extern enum progress_format progress_get_format (struct progress *progress);
+
+/**
+ *  Start showing the progress of a task. A task which is already being shown
+ *  for the same source is replaced.
+ *
+ *  @param progress The display
+ *  @param name Name of the task, such as the name of a port, must remain valid
+ *              until progress_end is called
+ *  @param phase What the task is doing, such as "write", must remain valid
+ *               until progress_end is called
+ *  @param sample Function to be called to find out how far the task has got
+ *  @param source Pointer to be passed to sample and used to identify the task
+ *
+ *  @return 0 if successfull
+ */
+extern int progress_begin (struct progress *progress, const char *name,
+                           const char *phase, progress_sample_cb sample,
+                           void *source);
+
+/**
+ *  Stop showing the progress of a task. The progress is shown one last time,
+ *  from the last sample since the task may already have moved on.
+ *
+ *  @param progress The display
+ *  @param source The source pointer given when the task was started
+ *  @param complete Non-zero if the task finished, its progress is then shown
+ *                  as complete
+ */
+extern void progress_end (struct progress *progress, void *source,
+                          int complete);
+
+#endif /* progress_h */
@@ -0,0 +1,277 @@
+//
+//  provision.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#include "provision.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+
+/**
+ *  Commands which get a second response once they have finished, along with
+ *  the pattern that the second response must match when the script does not
+ *  give one.
+ */
+static const struct {
+    const char *prefix;
+    const char *expect_second;
+} provision_second_responses[] = {
+    { "mac join ", "accepted" },
+    // Either mac_tx_ok or mac_rx followed by a downlink, but not mac_err
+    { "mac tx ", "mac_[tr]x*" },
+    { "radio tx ", "radio_tx_ok" },
+    { "radio rx ", "radio_rx *" }
+};
+
+#define PROVISION_NUM_SECOND_RESPONSES (sizeof(provision_second_responses) / \
+                                        sizeof(provision_second_responses[0]))
+
+
+/**
+ *  Remove whitespace from the end of a string.
+ */
+static void provision_trim (char *str)
+{
+    size_t length = strlen(str);
+    while ((length > 0) && isspace((unsigned char)str[length - 1])) {
+        str[--length] = '\0';
+    }
+}
+
+/**
+ *  Check whether a command reads a setting from the module, in which case the
+ *  response is the value of the setting rather than "ok".
+ */
+static int provision_is_get (const char *command)
+{
+    const char *space = strchr(command, ' ');
+    return (space != NULL) && (strncmp(space, " get ", 5) == 0);
+}
+
+/**
+ *  Check whether a command makes the module busy for long enough that
+ *  commands sent after it may be lost, such as saving settings or resetting.
+ */
+static int provision_is_exclusive (const char *command)
+{
+    if (strcmp(command, "mac save") == 0) {
+        return 1;
+    }
+    return (strncmp(command, "sys ", 4) == 0) &&
+                (strncmp(command, "sys get ", 8) != 0) &&
+                (strncmp(command, "sys set ", 8) != 0);
+}
+
+/**
+ *  Find the pattern for the second response to a command.
+ *
+ *  @return The pattern, or NULL if the command only gets one response
+ */
+static const char *provision_second_response (const char *command)
+{
+    for (size_t i = 0; i < PROVISION_NUM_SECOND_RESPONSES; i++) {
+        const char *prefix = provision_second_responses[i].prefix;
+        if (strncmp(command, prefix, strlen(prefix)) == 0) {
+            return provision_second_responses[i].expect_second;
+        }
+    }
+    return NULL;
+}
+
+/**
+ *  Parse one line of a script into a command. The command points into the
+ *  text of the line.
+ *
+ *  @param script The script being loaded
+ *  @param text The text of the line, modified while parsing
+ *  @param line_num The number of the line
+ *  @param cmd The command to be filled in
+ *
+ *  @return 0 if successfull
+ */
+static int provision_parse_line (struct provision_script *script, char *text,
+                                 int line_num, struct rn2483_command *cmd)
+{
+    char *arrow = strstr(text, "=>");
+    const char *second = NULL;
+    
+    cmd->expect = NULL;
+    cmd->timeout = PROVISION_TIMEOUT;
+    
+    if (arrow != NULL) {
+        *arrow = '\0';
+        
+        /* Pattern and options follow the arrow */
+        char *save;
+        for (char *token = strtok_r(arrow + 2, " \t", &save); token != NULL;
+             token = strtok_r(NULL, " \t", &save)) {
+            if (strncmp(token, "timeout=", 8) == 0) {
+                char *end;
+                cmd->timeout = strtol(token + 8, &end, 10);
+                if ((*end != '\0') || (cmd->timeout <= 0)) {
+                    fprintf(stderr, "%s:%d: Invalid timeout \"%s\"\n",
+                            script->path, line_num, token + 8);
+                    return -1;
+                }
+            } else if (cmd->expect == NULL) {
+                cmd->expect = token;
+            } else if (second == NULL) {
+                second = token;
+            } else {
+                fprintf(stderr, "%s:%d: Unexpected \"%s\"\n", script->path,
+                        line_num, token);
+                return -1;
+            }
+        }
+    }
+    
+    provision_trim(text);
+    if (*text == '\0') {
+        fprintf(stderr, "%s:%d: Missing command\n", script->path, line_num);
+        return -1;
+    }
+    
+    cmd->command = text;
+    if ((cmd->expect == NULL) && !provision_is_get(text)) {
+        cmd->expect = "ok";
+    }
+    
+    cmd->expect_second = provision_second_response(text);
+    if ((second != NULL) && (cmd->expect_second == NULL)) {
+        fprintf(stderr, "%s:%d: \"%s\" only gets one response\n",
+                script->path, line_num, text);
+        return -1;
+    } else if (second != NULL) {
+        cmd->expect_second = second;
+    }
+    
+    cmd->exclusive = provision_is_exclusive(text);
+    return 0;
+}
+
+/**
+ *  Read the whole of a file into memory.
+ *
+ *  @param path Path to the file
+ *
+ *  @return The contents of the file as a string, or NULL
+ */
+static char *provision_read_file (const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    
+    char *text = NULL;
+    size_t length = 0;
+    size_t capacity = 0;
+    
+    for (;;) {
+        if ((capacity - length) < 2) {
+            capacity = (capacity == 0) ? 1024 : (capacity * 2);
+            char *new_text = realloc(text, capacity);
+            if (new_text == NULL) {
+                fprintf(stderr, "Could not allocate memory for %s.\n", path);
+                free(text);
+                fclose(file);
+                return NULL;
+            }
+            text = new_text;
+        }
+        
+        size_t n = fread(text + length, 1, capacity - length - 1, file);
+        length += n;
+        if (n == 0) {
+            break;
+        }
+    }
+    
+    if (ferror(file)) {
+        fprintf(stderr, "Could not read %s.\n", path);
+        free(text);
+        fclose(file);
+        return NULL;
+    }
+    
+    text[length] = '\0';
+    fclose(file);
+    return text;
+}
+
+
+int provision_script_load (const char *path, struct provision_script **script)
+{
+    struct provision_script *s = calloc(1, sizeof(struct provision_script));
+    if (s == NULL) {
+        fprintf(stderr, "Could not allocate provisioning script.\n");
+        return -1;
+    }
+    
+    s->path = strdup(path);
+    s->text = provision_read_file(path);
+    if ((s->path == NULL) || (s->text == NULL)) {
+        provision_script_free(s);
+        return -1;
+    }
+    
+    int capacity = 0;
+    int line_num = 0;
+    char *next = s->text;
+    
+    while (next != NULL) {
+        char *line = strsep(&next, "\n");
+        line_num++;
+        
+        char *text = line + strspn(line, " \t");
+        provision_trim(text);
+        if ((*text == '\0') || (*text == '#')) {
+            continue;
+        }
+        
+        if (s->num_commands == capacity) {
+            capacity = (capacity == 0) ? 16 : (capacity * 2);
+            struct rn2483_command *commands = realloc(s->commands,
+                                    (size_t)capacity * sizeof(*commands));
+            if (commands == NULL) {
+                fprintf(stderr, "Could not allocate provisioning script.\n");
+                provision_script_free(s);
+                return -1;
+            }
+            s->commands = commands;
+        }
+        
+        if (provision_parse_line(s, text, line_num,
+                                 &s->commands[s->num_commands]) != 0) {
+            provision_script_free(s);
+            return -1;
+        }
+        s->num_commands++;
+    }
+    
+    if (s->num_commands == 0) {
+        fprintf(stderr, "%s: No commands in provisioning script\n", path);
+        provision_script_free(s);
+        return -1;
+    }
+    
+    *script = s;
+    return 0;
+}
+
+void provision_script_free (struct provision_script *script)
+{
+    free(script->commands);
+    free(script->text);
+    free(script->path);
+    free(script);
+}
@@ -0,0 +1,63 @@
+//
+//  provision.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef provision_h
+#define provision_h
+
+#include "rn2483.h"
+
+/** Default time to wait for the response to a provisioning command */
+#define PROVISION_TIMEOUT   1000
+
+/**
+ *  Commands to be run on a module once its firmware has been updated.
+ */
+struct provision_script {
+    /** Path to the file that the script was loaded from */
+    char *path;
+    /** Text of the script, which the commands point into */
+    char *text;
+    struct rn2483_command *commands;
+    int num_commands;
+};
+
+/**
+ *  Load a provisioning script. Each line of the script is a command to be sent
+ *  to the module, optionally followed by "=>", a glob pattern which the
+ *  response must match and "timeout=" with a time in milliseconds:
+ *
+ *      mac set appeui 70B3D57ED0000000
+ *      mac save => ok timeout=2000
+ *      sys get hweui => 0004A30B*
+ *      mac join otaa => ok accepted timeout=10000
+ *
+ *  Without a pattern "get" commands accept any response other than
+ *  invalid_param and all other commands expect "ok". The commands which get a
+ *  second response when they finish ("mac join", "mac tx", "radio tx" and
+ *  "radio rx") can be given a second pattern for it, otherwise "accepted",
+ *  "mac_tx_ok" or "mac_rx ...", "radio_tx_ok" and "radio_rx ..." are
+ *  expected. The timeout applies to each response. A second pattern for any
+ *  other command is an error. Blank lines and lines starting with # are
+ *  ignored.
+ *
+ *  @param path Path to the script
+ *  @param script Pointer to where pointer to loaded script should be stored
+ *
+ *  @return 0 if successfull
+ */
+extern int provision_script_load (const char *path,
+                                  struct provision_script **script);
+
+/**
+ *  Free a provisioning script.
+ *
+ *  @param script The script to be freed
+ */
+extern void provision_script_free (struct provision_script *script);
+
+#endif /* provision_h */
@@ -0,0 +1,109 @@
+//
+//  realtime.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "realtime.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+/** Amount of stack to touch so that it is resident before locking memory */
+#define REALTIME_STACK_PREFAULT (64 * 1024)
+
+/**
+ *  Touch a region of the stack so that page faults do not happen later while
+ *  time critical code is running.
+ */
+static void __attribute__((noinline)) realtime_prefault_stack (void)
+{
+    volatile unsigned char stack[REALTIME_STACK_PREFAULT];
+    
+    for (size_t i = 0; i < sizeof(stack); i += 4096) {
+        stack[i] = 0;
+    }
+}
+
+int realtime_enable (int cpu)
+{
+    int fallback = 0;
+    
+    /* Pin to CPU */
+    if (cpu >= 0) {
+#ifdef __linux__
+        if (cpu >= CPU_SETSIZE) {
+            fprintf(stderr, "Invalid CPU %d.\n", cpu);
+            return -1;
+        }
+        
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+            fprintf(stderr, "Could not pin to CPU %d: %s.\n", cpu,
+                    strerror(errno));
+            return -1;
+        }
+        printf("Pinned to CPU %d\n", cpu);
+#else
+        fprintf(stderr, "Pinning to a CPU is not supported on this "
+                        "platform.\n");
+        return -1;
+#endif
+    }
+    
+    /* Lock memory */
+    realtime_prefault_stack();
+    
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        fprintf(stderr, "Could not lock memory: %s.\n", strerror(errno));
+        fallback = 1;
+    }
+    
+    /* Set scheduling policy */
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = ((sched_get_priority_min(SCHED_FIFO) +
+                             sched_get_priority_max(SCHED_FIFO)) / 2);
+    
+    int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    
+    if (ret == 0) {
+        printf("Using SCHED_FIFO with priority %d\n", param.sched_priority);
+    } else {
+        fprintf(stderr, "Could not use SCHED_FIFO: %s.\n", strerror(ret));
+        fallback = 1;
+        
+        // Try to at least get ahead of other normal processes
+        if (setpriority(PRIO_PROCESS, 0, -10) == 0) {
+            printf("Using normal scheduling with nice value -10\n");
+        } else {
+            printf("Using normal scheduling\n");
+        }
+    }
+    
+#ifdef __linux__
+    // Wake up from timers as close as possible to when they expire
+    prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+#endif
+    
+    return fallback;
+}
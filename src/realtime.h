@@ -0,0 +1,26 @@
+//
+//  realtime.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef realtime_h
+#define realtime_h
+
+/**
+ *  Reduce scheduling jitter for the calling thread. Memory is locked, the
+ *  thread is pinned to a CPU if one is given and the SCHED_FIFO policy is used
+ *  if the process is allowed to. Locking memory and SCHED_FIFO are reported
+ *  and skipped if they are not permitted, so this can be used without special
+ *  privileges. A CPU which was asked for must be used.
+ *
+ *  @param cpu CPU to pin the thread to, or -1 to leave affinity unchanged
+ *
+ *  @return 0 if all settings were applied, 1 if some settings fell back to
+ *          their defaults, -1 if the CPU is invalid or could not be used
+ */
+extern int realtime_enable (int cpu);
+
+#endif /* realtime_h */
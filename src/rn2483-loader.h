@@ -0,0 +1,49 @@
+//
+//  rn2483-loader.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef rn2483_loader_h
+#define rn2483_loader_h
+
+/*
+ *  Public interface of librn2483loader, which updates RN2483 modules without
+ *  blocking and without threads.
+ *
+ *  Every session runs on an io_loop. A program with its own event loop waits
+ *  for the descriptor from io_loop_get_fd to become readable, or for the time
+ *  from io_loop_get_timeout to pass, and then calls io_loop_run_once with a
+ *  timeout of 0. A program without one can call io_loop_run_once or
+ *  io_loop_run directly.
+ *
+ *      struct io_loop *loop;
+ *      struct intel_hex_file *hex;
+ *      struct serial_port *port;
+ *      struct flash_session *session;
+ *      struct flash_options options;
+ *
+ *      io_loop_init(&loop);
+ *      parse_intel_hex_buffer(image, image_length, &hex);
+ *      serial_port_open(loop, "/dev/ttyUSB0", 57600, &port);
+ *
+ *      flash_options_init(&options);
+ *      options.confirm = 0;
+ *      flash_session_init(port, hex, &options, callback, context, &session);
+ *      flash_session_start(session);
+ *
+ *  The callback is given FLASH_EVENT_PHASE when the session moves on,
+ *  FLASH_EVENT_PROGRESS as flash is written and verified (see
+ *  flash_session_get_bytes) and FLASH_EVENT_DONE when it has finished, after
+ *  which flash_session_get_phase and flash_session_get_error tell how it
+ *  went. Any number of sessions can share one loop and one image.
+ */
+
+#include "io-loop.h"
+#include "intel-hex.h"
+#include "serial-port.h"
+#include "flash-session.h"
+
+#endif /* rn2483_loader_h */
@@ -9,111 +9,555 @@
 #include "rn2483.h"
 
 #include <stdio.h>
-#include <unistd.h>
-#include <time.h>
+#include <stdlib.h>
 #include <string.h>
-#include <errno.h>
-#include <sys/select.h>
+#include <fnmatch.h>
 
-static long get_millis(void) {
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return ((long)ts.tv_sec * 1000) + (long)(ts.tv_nsec / 1000000L);
+#include "trace.h"
+#include "metrics.h"
+
+/**
+ *  State for a command which is in progress on a port.
+ */
+struct rn2483_op {
+    rn2483_cb callback;
+    void *context;
+    
+    char *response;
+    int length;
+    
+    /* Time at which the command was sent */
+    uint64_t sent_at;
+    /* Command which was sent, or NULL, for tracing */
+    const char *command;
+};
+
+/**
+ *  Complete a command, free it and call its callback.
+ *
+ *  @param port The port on which the command was run
+ *  @param op The command which has completed
+ *  @param status The status to be passed to the callback
+ */
+static void rn2483_op_finish (struct serial_port *port, struct rn2483_op *op,
+                              int status)
+{
+    rn2483_cb callback = op->callback;
+    void *context = op->context;
+    
+    serial_port_set_receiver(port, NULL, NULL);
+    serial_port_set_deadline(port, 0);
+    free(op);
+    
+    callback(port, status, context);
+}
+
+/**
+ *  Record the end of a command in the trace and metrics.
+ *
+ *  @param port The port on which the command was run
+ *  @param op The command
+ *  @param bytes_in Length of the response
+ *  @param result What happened to the command
+ */
+static void rn2483_record (struct serial_port *port, struct rn2483_op *op,
+                           size_t bytes_in, const char *result)
+{
+    uint64_t now = latency_stats_now();
+    char name[32];
+    size_t bytes_out = 0;
+    
+    if (op->command != NULL) {
+        bytes_out = strlen(op->command);
+        // Leave the end of line off of the name
+        snprintf(name, sizeof(name), "%.*s",
+                 (int)strcspn(op->command, "\r\n"), op->command);
+    } else {
+        snprintf(name, sizeof(name), "wait for line");
+    }
+    
+    if (metrics_enabled) {
+        metrics_command("module", name, now - op->sent_at,
+                        strcmp(result, "ok") == 0);
+    }
+    
+    char args[TRACE_ARGS_LENGTH];
+    snprintf(args, sizeof(args), "\"bytes_out\":%zu,\"bytes_in\":%zu,"
+             "\"result\":\"%s\"", bytes_out, bytes_in, result);
+    trace_complete(serial_port_get_name(port), "module", name, op->sent_at,
+                   now, args);
+}
+
+/**
+ *  Handle events from the serial port while a command is in progress.
+ */
+static size_t rn2483_receive (struct serial_port *port,
+                              enum serial_port_event event, const uint8_t *data,
+                              size_t length, void *context)
+{
+    struct rn2483_op *op = context;
+    
+    switch (event) {
+        case SERIAL_PORT_EVENT_DATA:
+            if (op->response == NULL) {
+                return 0;
+            }
+            
+            const uint8_t *end = memchr(data, '\n', length);
+            
+            if (end == NULL) {
+                // Wait for the rest of the line
+                return 0;
+            }
+            
+            size_t line_length = (size_t)(end - data);
+            
+            // Remove end of line characters (last two chars should be "\r\n")
+            if ((line_length > 0) && (data[line_length - 1] == '\r')) {
+                line_length--;
+            }
+            // Make sure that response is terminated
+            if (line_length > (size_t)(op->length - 1)) {
+                line_length = (size_t)(op->length - 1);
+            }
+            
+            memcpy(op->response, data, line_length);
+            op->response[line_length] = '\0';
+            
+            latency_stats_add(&serial_port_get_stats(port)->rtt,
+                              latency_stats_now() - op->sent_at);
+            if (trace_enabled || metrics_enabled) {
+                rn2483_record(port, op, (size_t)(end - data) + 1, "ok");
+            }
+            
+            rn2483_op_finish(port, op, 0);
+            return (size_t)(end - data) + 1;
+        case SERIAL_PORT_EVENT_WRITTEN:
+            if (op->response == NULL) {
+                // No response expected
+                if (trace_enabled || metrics_enabled) {
+                    rn2483_record(port, op, 0, "ok");
+                }
+                rn2483_op_finish(port, op, 0);
+            }
+            return 0;
+        case SERIAL_PORT_EVENT_TIMEOUT:
+            if (!serial_port_is_quiet(port)) {
+                fprintf(stderr, "Timed out waiting for response from "
+                        "RN2483.\n");
+            }
+            if (trace_enabled || metrics_enabled) {
+                rn2483_record(port, op, 0, "timeout");
+            }
+            rn2483_op_finish(port, op, -1);
+            return 0;
+        case SERIAL_PORT_EVENT_ERROR:
+            if (trace_enabled || metrics_enabled) {
+                rn2483_record(port, op, 0, "error");
+            }
+            rn2483_op_finish(port, op, -1);
+            return 0;
+        case SERIAL_PORT_EVENT_CLOSED:
+            free(op);
+            return 0;
+    }
+    
+    return 0;
 }
 
 /**
  * Send a command to the radio module and wait for a response.
  *
- * @param fd File descriptor for serial connection to radio
- * @param command Command string to be sent
+ * @param port Serial connection to radio
+ * @param command Command string to be sent, or NULL to only wait for a line
  * @param response String where response should be stored
  * @param length Maximum response length
  * @param timeout Timeout in milliseconds
+ * @param callback Function to be called when the command completes
+ * @param context Pointer to be passed to callback
+ *
+ * @return 0 if the command was started
  */
-static int rn2483_do_command (int fd, const char *command, char *response,
-                              int length, long timeout)
+static int rn2483_do_command (struct serial_port *port, const char *command,
+                              char *response, int length, long timeout,
+                              rn2483_cb callback, void *context)
 {
-    ssize_t len = 0;
+    struct rn2483_op *op = calloc(1, sizeof(struct rn2483_op));
+    
+    if (op == NULL) {
+        fprintf(stderr, "Could not allocate memory for RN2483 command.\n");
+        return -1;
+    }
+    
+    op->callback = callback;
+    op->context = context;
+    op->command = command;
+    
+    if ((response != NULL) && (length != 0)) {
+        op->response = response;
+        op->length = length;
+    }
     
     /* Send command */
-    while (len < (ssize_t)strlen(command)) {
-        ssize_t nbytes = write(fd, command + len, strlen(command) - len);
-        
-        if (nbytes == -1) {
-            fprintf(stderr, "Could not write command to RN2483: %s.\n",
-                    strerror(errno));
-            return -1;
-        }
-        
-        len += nbytes;
+    serial_port_set_receiver(port, rn2483_receive, op);
+    op->sent_at = latency_stats_now();
+    
+    if ((command != NULL) &&
+            (serial_port_write(port, command, strlen(command)) != 0)) {
+        fprintf(stderr, "Could not write command to RN2483.\n");
+        serial_port_set_receiver(port, NULL, NULL);
+        free(op);
+        return -1;
     }
     
-    if ((response == NULL) || (length == 0)) {
-        // No response expected
-        return 0;
+    if ((op->response != NULL) &&
+            (serial_port_set_deadline(port, timeout) != 0)) {
+        serial_port_set_receiver(port, NULL, NULL);
+        free(op);
+        return -1;
     }
     
-    long start_time = get_millis();
+    return 0;
+}
+
+/**
+ *  State for a script which is in progress on a port.
+ */
+struct rn2483_pipeline {
+    struct rn2483_script *script;
     
-    len = 0;
-    int have_line = 0;
-    /* Get response */
-    while (!have_line && (len < (length - 1))) {
-        fd_set set;
-        FD_SET(fd, &set);
-        
-        // Calculate remaining timeout
-        long remaining_time = 0;
-        struct timeval t;
+    rn2483_cb callback;
+    void *context;
+    
+    /** Number of commands which have been sent */
+    int num_sent;
+    /** Number of bytes of commands which have not been answered yet */
+    size_t in_flight;
+    /** Set once the first response to a command with two responses has been
+        received */
+    int awaiting_second;
+};
+
+/**
+ *  Complete a script, free its state and call its callback.
+ *
+ *  @param port The port on which the script was run
+ *  @param pipeline The script which has completed
+ *  @param status The status to be passed to the callback
+ */
+static void rn2483_pipeline_finish (struct serial_port *port,
+                                    struct rn2483_pipeline *pipeline,
+                                    int status)
+{
+    rn2483_cb callback = pipeline->callback;
+    void *context = pipeline->context;
+    
+    serial_port_set_receiver(port, NULL, NULL);
+    serial_port_set_deadline(port, 0);
+    free(pipeline);
+    
+    callback(port, status, context);
+}
+
+/**
+ *  Check whether a command must be run without any other commands in flight.
+ */
+static int rn2483_command_is_exclusive (const struct rn2483_command *cmd)
+{
+    return cmd->exclusive || (cmd->expect_second != NULL);
+}
+
+/**
+ *  Send as many of the remaining commands in a script as the module can
+ *  buffer.
+ *
+ *  @param port The port on which the script is running
+ *  @param pipeline The script
+ *
+ *  @return 0 if successfull
+ */
+static int rn2483_pipeline_fill (struct serial_port *port,
+                                 struct rn2483_pipeline *pipeline)
+{
+    struct rn2483_script *script = pipeline->script;
+    
+    while (pipeline->num_sent < script->num_commands) {
+        const struct rn2483_command *cmd =
+                                        &script->commands[pipeline->num_sent];
+        size_t length = strlen(cmd->command);
         
-        if (timeout) {
-            remaining_time = timeout - (get_millis() - start_time);
-            
-            if (remaining_time <= 0) {
-                fprintf(stderr, "Timed out waiting for response from RN2483.\n");
-                return -1;
-            }
-            
-            t.tv_sec = remaining_time / 1000;
-            t.tv_usec = (remaining_time % 1000) * 1000;
+        if ((pipeline->num_sent != script->num_done) &&
+                (rn2483_command_is_exclusive(cmd) ||
+                 rn2483_command_is_exclusive(
+                                &script->commands[pipeline->num_sent - 1]) ||
+                 ((pipeline->in_flight + length + 2) >
+                  RN2483_PIPELINE_BYTES))) {
+            // Wait for responses to the commands that have been sent
+            break;
         }
         
-        select(fd + 1, &set, NULL, NULL, timeout ? &t : NULL);
-        
-        if (FD_ISSET(fd, &set)) {
-            // There is data available to be read from the file descriptor
-            ssize_t nbytes = read(fd, response + len, length - len);
-            len += nbytes;
-            
-            if (nbytes == -1) {
-                fprintf(stderr, "Could not read from RN2483: %s.\n",
-                        strerror(errno));
-                return -1;
-            } else if (strchr(response, '\n')) {
-                // Add terminating char
-                response[len] = '\0';
-                // Remove end of line characters
-                // (last two chars should be "\r\n")
-                response[len - 2] = '\0';
-                break;
-            }
+        if ((serial_port_write(port, cmd->command, length) != 0) ||
+                (serial_port_write(port, "\r\n", 2) != 0)) {
+            fprintf(stderr, "Could not write command to RN2483.\n");
+            return -1;
         }
+        
+        pipeline->in_flight += length + 2;
+        pipeline->num_sent++;
     }
     
-    // Make sure that response is terminated
-    if (!have_line) {
-        response[length - 1] = '\0';
+    return 0;
+}
+
+/**
+ *  Check whether a response is the one expected for a command.
+ *
+ *  @param expect Pattern for the response, or NULL
+ *  @param response The response
+ *
+ *  @return 1 if the response is acceptable
+ */
+static int rn2483_response_matches (const char *expect, const char *response)
+{
+    if (expect == NULL) {
+        return strcmp(response, "invalid_param") != 0;
+    }
+    return fnmatch(expect, response, 0) == 0;
+}
+
+/**
+ *  Handle events from the serial port while a script is in progress.
+ */
+static size_t rn2483_pipeline_receive (struct serial_port *port,
+                                       enum serial_port_event event,
+                                       const uint8_t *data, size_t length,
+                                       void *context)
+{
+    struct rn2483_pipeline *pipeline = context;
+    struct rn2483_script *script = pipeline->script;
+    size_t consumed = 0;
+    
+    switch (event) {
+        case SERIAL_PORT_EVENT_DATA:
+            for (;;) {
+                const uint8_t *line = data + consumed;
+                const uint8_t *end = memchr(line, '\n', length - consumed);
+                
+                if (end == NULL) {
+                    // Wait for the rest of the line
+                    return consumed;
+                }
+                
+                size_t line_length = (size_t)(end - line);
+                consumed += line_length + 1;
+                
+                if ((line_length > 0) && (line[line_length - 1] == '\r')) {
+                    line_length--;
+                }
+                if (line_length == 0) {
+                    continue;
+                }
+                if (line_length > (RN2483_RESPONSE_LENGTH - 1)) {
+                    line_length = RN2483_RESPONSE_LENGTH - 1;
+                }
+                
+                memcpy(script->response, line, line_length);
+                script->response[line_length] = '\0';
+                
+                /* Responses come back in the order the commands were sent */
+                const struct rn2483_command *cmd =
+                                        &script->commands[script->num_done];
+                const char *expect = pipeline->awaiting_second ?
+                                            cmd->expect_second : cmd->expect;
+                
+                if (!rn2483_response_matches(expect, script->response)) {
+                    rn2483_pipeline_finish(port, pipeline, -1);
+                    return consumed;
+                }
+                
+                if (!pipeline->awaiting_second) {
+                    pipeline->in_flight -= strlen(cmd->command) + 2;
+                }
+                if ((cmd->expect_second != NULL) &&
+                        !pipeline->awaiting_second) {
+                    // Nothing else is sent until the second response arrives
+                    pipeline->awaiting_second = 1;
+                    if (serial_port_set_deadline(port, cmd->timeout) != 0) {
+                        rn2483_pipeline_finish(port, pipeline, -1);
+                        return consumed;
+                    }
+                    continue;
+                }
+                pipeline->awaiting_second = 0;
+                
+                if (++script->num_done == script->num_commands) {
+                    rn2483_pipeline_finish(port, pipeline, 0);
+                    return consumed;
+                }
+                
+                script->response[0] = '\0';
+                if ((rn2483_pipeline_fill(port, pipeline) != 0) ||
+                        (serial_port_set_deadline(port,
+                            script->commands[script->num_done].timeout) != 0)) {
+                    rn2483_pipeline_finish(port, pipeline, -1);
+                    return consumed;
+                }
+            }
+        case SERIAL_PORT_EVENT_WRITTEN:
+            return 0;
+        case SERIAL_PORT_EVENT_TIMEOUT:
+            if (!serial_port_is_quiet(port)) {
+                fprintf(stderr, "Timed out waiting for response to \"%s\" "
+                        "from RN2483.\n",
+                        script->commands[script->num_done].command);
+            }
+            rn2483_pipeline_finish(port, pipeline, -1);
+            return 0;
+        case SERIAL_PORT_EVENT_ERROR:
+            rn2483_pipeline_finish(port, pipeline, -1);
+            return 0;
+        case SERIAL_PORT_EVENT_CLOSED:
+            free(pipeline);
+            return 0;
     }
     
     return 0;
 }
 
-int rn2483_get_version (int fd, char *response, int length, long timeout)
+/**
+ *  State used to wait for a command to complete.
+ */
+struct rn2483_sync {
+    int done;
+    int status;
+};
+
+static void rn2483_sync_done (struct serial_port *port, int status,
+                              void *context)
+{
+    (void)port;
+    struct rn2483_sync *sync = context;
+    
+    sync->status = status;
+    sync->done = 1;
+}
+
+/**
+ *  Run the port's event loop until a command completes.
+ *
+ *  @param port The port on which the command is running
+ *  @param sync The state for the command
+ *
+ *  @return The status of the command
+ */
+static int rn2483_sync_wait (struct serial_port *port, struct rn2483_sync *sync)
+{
+    if (io_loop_run(serial_port_get_loop(port), &sync->done) != 0) {
+        return -1;
+    }
+    
+    return sync->status;
+}
+
+int rn2483_get_version_async (struct serial_port *port, char *response,
+                              int length, long timeout, rn2483_cb callback,
+                              void *context)
 {
-    return rn2483_do_command(fd, "sys get ver\r\n", response, length, timeout);
+    return rn2483_do_command(port, "sys get ver\r\n", response, length, timeout,
+                             callback, context);
 }
 
-extern int rn2483_erase (int fd)
+int rn2483_get_version (struct serial_port *port, char *response, int length,
+                        long timeout)
 {
-    return rn2483_do_command(fd, "sys eraseFW\r\n", NULL, 0, 0);
+    struct rn2483_sync sync = { 0, 0 };
+    
+    if (rn2483_get_version_async(port, response, length, timeout,
+                                 rn2483_sync_done, &sync) != 0) {
+        return -1;
+    }
+    
+    return rn2483_sync_wait(port, &sync);
+}
+
+int rn2483_get_hweui_async (struct serial_port *port, char *response,
+                            int length, long timeout, rn2483_cb callback,
+                            void *context)
+{
+    return rn2483_do_command(port, "sys get hweui\r\n", response, length,
+                             timeout, callback, context);
+}
+
+int rn2483_wait_line_async (struct serial_port *port, char *response,
+                            int length, long timeout, rn2483_cb callback,
+                            void *context)
+{
+    return rn2483_do_command(port, NULL, response, length, timeout, callback,
+                             context);
+}
+
+int rn2483_erase_async (struct serial_port *port, rn2483_cb callback,
+                        void *context)
+{
+    return rn2483_do_command(port, "sys eraseFW\r\n", NULL, 0, 0, callback,
+                             context);
+}
+
+int rn2483_erase (struct serial_port *port)
+{
+    struct rn2483_sync sync = { 0, 0 };
+    
+    if (rn2483_erase_async(port, rn2483_sync_done, &sync) != 0) {
+        return -1;
+    }
+    
+    return rn2483_sync_wait(port, &sync);
+}
+
+int rn2483_run_script_async (struct serial_port *port,
+                             struct rn2483_script *script, rn2483_cb callback,
+                             void *context)
+{
+    if (script->num_commands == 0) {
+        fprintf(stderr, "RN2483 command script is empty.\n");
+        return -1;
+    }
+    
+    struct rn2483_pipeline *pipeline = calloc(1,
+                                              sizeof(struct rn2483_pipeline));
+    
+    if (pipeline == NULL) {
+        fprintf(stderr, "Could not allocate memory for RN2483 script.\n");
+        return -1;
+    }
+    
+    pipeline->script = script;
+    pipeline->callback = callback;
+    pipeline->context = context;
+    
+    script->num_done = 0;
+    script->response[0] = '\0';
+    
+    serial_port_set_receiver(port, rn2483_pipeline_receive, pipeline);
+    
+    if ((rn2483_pipeline_fill(port, pipeline) != 0) ||
+            (serial_port_set_deadline(port,
+                                      script->commands[0].timeout) != 0)) {
+        serial_port_set_receiver(port, NULL, NULL);
+        free(pipeline);
+        return -1;
+    }
+    
+    return 0;
+}
+
+int rn2483_run_script (struct serial_port *port, struct rn2483_script *script)
+{
+    struct rn2483_sync sync = { 0, 0 };
+    
+    if (rn2483_run_script_async(port, script, rn2483_sync_done, &sync) != 0) {
+        return -1;
+    }
+    
+    return rn2483_sync_wait(port, &sync);
 }
@@ -9,25 +9,174 @@
 #ifndef rn2483_h
 #define rn2483_h
 
+#include "serial-port.h"
+
+/** Maximum length of a response kept by a command script */
+#define RN2483_RESPONSE_LENGTH  64
+/** Number of bytes of commands which may be waiting for responses at once,
+    kept well within what the module's UART can buffer while it is busy */
+#define RN2483_PIPELINE_BYTES   128
+
+/**
+ *  A command in a script of commands to be run on a module. Every command gets
+ *  one line in response, and commands such as "mac join" and "mac tx" get a
+ *  second line once they have finished.
+ */
+struct rn2483_command {
+    /** Command to be sent, without a line ending */
+    const char *command;
+    /** Glob pattern which the response must match, or NULL to accept any
+        response other than invalid_param */
+    const char *expect;
+    /** Glob pattern which a second response must match, or NULL if the
+        command only gets one response. Commands with a second response are
+        run on their own, since it could otherwise be taken as the response to
+        a later command. */
+    const char *expect_second;
+    /** Time to wait for each response in milliseconds */
+    long timeout;
+    /** Wait for all earlier commands to be answered before sending the
+        command, and for it to be answered before sending any later ones */
+    int exclusive;
+};
+
+/**
+ *  A script of commands to be run on a module.
+ */
+struct rn2483_script {
+    const struct rn2483_command *commands;
+    int num_commands;
+    /** Number of commands which have got the expected response */
+    int num_done;
+    /** Last response received, empty if the command which failed did not get
+        a response */
+    char response[RN2483_RESPONSE_LENGTH];
+};
+
+/**
+ *  Callback for completion of an asynchronous radio module command.
+ *
+ *  @param port The port on which the command was run
+ *  @param status 0 if the command was successfull, -1 otherwise
+ *  @param context The context pointer given when the command was started
+ */
+typedef void (*rn2483_cb)(struct serial_port *port, int status, void *context);
+
 /**
  *  Get the version string from a RN2483 radio module.
  *
- *  @param fd File descriptor for serial connection to radio
+ *  @param port Serial connection to radio
  *  @param str Pointer to memory where version string should be placed
  *  @param length Maximum length of version string to be read
  *  @param timeout Timeout in milliseconds
  *
  *  @return 0 if successfull
  */
-extern int rn2483_get_version (int fd, char *str, int length, long timeout);
+extern int rn2483_get_version (struct serial_port *port, char *str, int length,
+                               long timeout);
+
+/**
+ *  Start getting the version string from a RN2483 radio module.
+ *
+ *  @param port Serial connection to radio
+ *  @param str Pointer to memory where version string should be placed, must
+ *             remain valid until the command completes
+ *  @param length Maximum length of version string to be read
+ *  @param timeout Timeout in milliseconds
+ *  @param callback Function to be called when the command completes
+ *  @param context Pointer to be passed to callback
+ *
+ *  @return 0 if the command was started
+ */
+extern int rn2483_get_version_async (struct serial_port *port, char *str,
+                                     int length, long timeout,
+                                     rn2483_cb callback, void *context);
+
+/**
+ *  Start getting the hardware EUI of a RN2483 radio module.
+ *
+ *  @param port Serial connection to radio
+ *  @param str Pointer to memory where EUI string should be placed, must remain
+ *             valid until the command completes
+ *  @param length Maximum length of EUI string to be read
+ *  @param timeout Timeout in milliseconds
+ *  @param callback Function to be called when the command completes
+ *  @param context Pointer to be passed to callback
+ *
+ *  @return 0 if the command was started
+ */
+extern int rn2483_get_hweui_async (struct serial_port *port, char *str,
+                                   int length, long timeout,
+                                   rn2483_cb callback, void *context);
+
+/**
+ *  Start waiting for a line from a RN2483 radio module without sending a
+ *  command, such as the version that the firmware prints when it starts.
+ *
+ *  @param port Serial connection to radio
+ *  @param str Pointer to memory where the line should be placed, must remain
+ *             valid until the line is received
+ *  @param length Maximum length of line to be read
+ *  @param timeout Timeout in milliseconds
+ *  @param callback Function to be called when the line is received
+ *  @param context Pointer to be passed to callback
+ *
+ *  @return 0 if the wait was started
+ */
+extern int rn2483_wait_line_async (struct serial_port *port, char *str,
+                                   int length, long timeout,
+                                   rn2483_cb callback, void *context);
 
 /**
  *  Erase an RN2483 radio module and have it enter the bootloader.
  *
- *  @param fd File descriptor for serial connection to radio
+ *  @param port Serial connection to radio
  *
  *  @return 0 if successfull
  */
-extern int rn2483_erase (int fd);
+extern int rn2483_erase (struct serial_port *port);
+
+/**
+ *  Start erasing an RN2483 radio module and have it enter the bootloader. The
+ *  command completes once it has been written to the port.
+ *
+ *  @param port Serial connection to radio
+ *  @param callback Function to be called when the command completes
+ *  @param context Pointer to be passed to callback
+ *
+ *  @return 0 if the command was started
+ */
+extern int rn2483_erase_async (struct serial_port *port, rn2483_cb callback,
+                               void *context);
+
+/**
+ *  Run a script of commands on an RN2483 radio module.
+ *
+ *  @param port Serial connection to radio
+ *  @param script The script to be run
+ *
+ *  @return 0 if every command got the expected response
+ */
+extern int rn2483_run_script (struct serial_port *port,
+                              struct rn2483_script *script);
+
+/**
+ *  Start running a script of commands on an RN2483 radio module. Commands are
+ *  sent ahead of the responses to earlier commands as long as the module can
+ *  buffer them, and responses are matched to commands in order. The script
+ *  stops at the first command which does not get the expected response in
+ *  time.
+ *
+ *  @param port Serial connection to radio
+ *  @param script The script to be run, must contain at least one command and
+ *                remain valid until the script completes
+ *  @param callback Function to be called when the script completes
+ *  @param context Pointer to be passed to callback
+ *
+ *  @return 0 if the script was started
+ */
+extern int rn2483_run_script_async (struct serial_port *port,
+                                    struct rn2483_script *script,
+                                    rn2483_cb callback, void *context);
 
 #endif /* rn2483_h */
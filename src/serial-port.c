@@ -0,0 +1,643 @@
+//
+//  serial-port.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#include "serial-port.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+
+#include "capture.h"
+
+/** Size of the buffer for received data */
+#define SERIAL_PORT_RX_BUFFER_SIZE  512
+
+struct serial_port {
+    struct io_loop *loop;
+    struct io_watch *watch;
+    /* Timer for receiver's deadline */
+    struct io_timer *deadline;
+    /* Timer used to deliver written events outside of serial_port_write */
+    struct io_timer *written;
+    /* Timer used to change the baudrate once written data has gone out */
+    struct io_timer *drain;
+    
+    char *name;
+    int fd;
+    /* Baudrate that the tty is configured for */
+    int baudrate;
+    /* Baudrate to switch to once written data has gone out, or 0 */
+    int next_baudrate;
+    
+    serial_port_cb callback;
+    void *context;
+    
+    /* Queued data to be written */
+    uint8_t *tx_buffer;
+    size_t tx_capacity;
+    size_t tx_length;
+    size_t tx_offset;
+    
+    /* Received data that has not yet been consumed */
+    uint8_t rx_buffer[SERIAL_PORT_RX_BUFFER_SIZE];
+    size_t rx_length;
+    
+    struct serial_port_stats stats;
+    
+    /* Number of port callbacks currently on the stack */
+    int busy;
+    uint8_t closed;
+    uint8_t quiet;
+};
+
+/**
+ *  Get a the baudrate constant for a given integer baudrate.
+ *
+ *  @param baud The desired baudrate in baud
+ *
+ *  @return The corresponding speed value
+ */
+static int get_baud(int baud)
+{
+    switch (baud) {
+        case 9600:
+            return B9600;
+        case 19200:
+            return B19200;
+        case 38400:
+            return B38400;
+        case 57600:
+            return B57600;
+        case 115200:
+            return B115200;
+        case 230400:
+            return B230400;
+        default:
+            return -1;
+    }
+}
+
+/**
+ *  Configure a serial interface.
+ *
+ *  @param fd File descriptor for serial interface
+ *  @param baudrate Desired baudrate in baud
+ *
+ *  @return 0 if successfull
+ */
+static int configure_tty (int fd, int baudrate)
+{
+    struct termios term;
+    
+    if (tcgetattr(fd, &term) < 0) {
+        printf("Error from tcgetattr: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    int speed = get_baud(baudrate);
+    
+    if (speed == -1) {
+        printf("Unkown baud rate: %d\n", baudrate);
+        return -1;
+    }
+    
+    cfsetospeed(&term, (speed_t)speed);
+    cfsetispeed(&term, (speed_t)speed);
+    
+    term.c_cflag |= (CLOCAL | CREAD);    /* ignore modem controls */
+    term.c_cflag &= ~CSIZE;
+    term.c_cflag |= CS8;         /* 8-bit characters */
+    term.c_cflag &= ~PARENB;     /* no parity bit */
+    term.c_cflag &= ~CSTOPB;     /* only need 1 stop bit */
+    term.c_cflag &= ~CRTSCTS;    /* no hardware flowcontrol */
+    
+    /* setup for non-canonical mode */
+    term.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL
+                      | IXON);
+    term.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+    term.c_oflag &= ~OPOST;
+    
+    /* fetch bytes as they become available */
+    term.c_cc[VMIN] = 1;
+    term.c_cc[VTIME] = 1;
+    
+    if (tcsetattr(fd, TCSANOW, &term) != 0) {
+        printf("Error from tcsetattr: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ *  Change the baudrate that a tty is configured for.
+ *
+ *  @param port The port
+ *  @param baudrate Desired baudrate in baud
+ *
+ *  @return 0 if successfull
+ */
+static int serial_port_apply_baud (struct serial_port *port, int baudrate)
+{
+    struct termios term;
+    if (tcgetattr(port->fd, &term) < 0) {
+        fprintf(stderr, "Error from tcgetattr: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    int speed = get_baud(baudrate);
+    cfsetospeed(&term, (speed_t)speed);
+    cfsetispeed(&term, (speed_t)speed);
+    
+    if (tcsetattr(port->fd, TCSANOW, &term) != 0) {
+        fprintf(stderr, "Error from tcsetattr: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    port->baudrate = baudrate;
+    return 0;
+}
+
+/**
+ *  Find how long the data which the tty has not yet sent will take to go out.
+ *
+ *  @param port The port
+ *
+ *  @return Time in milliseconds, or 0 if nothing is left to be sent
+ */
+static long serial_port_drain_time (struct serial_port *port)
+{
+    int queued = 0;
+    if ((ioctl(port->fd, TIOCOUTQ, &queued) != 0) || (queued <= 0)) {
+        return 0;
+    }
+    // 10 bits per byte, rounded up
+    return (((long)queued * 10000) / port->baudrate) + 1;
+}
+
+/**
+ *  Free a port structure once it is closed and no callbacks are running.
+ *
+ *  @param port The port to be freed
+ */
+static void serial_port_release (struct serial_port *port)
+{
+    if (port->closed && (port->busy == 0)) {
+        free(port->tx_buffer);
+        free(port->name);
+        free(port);
+    }
+}
+
+/**
+ *  Pass an event to the port's receiver.
+ *
+ *  @return The number of bytes consumed by the receiver
+ */
+static size_t serial_port_notify (struct serial_port *port,
+                                  enum serial_port_event event,
+                                  const uint8_t *data, size_t length)
+{
+    if (port->callback == NULL) {
+        return 0;
+    }
+    return port->callback(port, event, data, length, port->context);
+}
+
+/**
+ *  Present buffered data to the receiver until it stops consuming data.
+ *
+ *  @param port The port for which data should be delivered
+ */
+static void serial_port_deliver (struct serial_port *port)
+{
+    while (!port->closed && (port->callback != NULL) &&
+           (port->rx_length != 0)) {
+        size_t consumed = serial_port_notify(port, SERIAL_PORT_EVENT_DATA,
+                                             port->rx_buffer, port->rx_length);
+        
+        if (port->closed || (consumed == 0)) {
+            break;
+        } else if (consumed > port->rx_length) {
+            consumed = port->rx_length;
+        }
+        
+        port->rx_length -= consumed;
+        memmove(port->rx_buffer, port->rx_buffer + consumed, port->rx_length);
+    }
+    
+    if (!port->closed && (port->rx_length == SERIAL_PORT_RX_BUFFER_SIZE)) {
+        // Nobody wants this data, drop it to make room for more
+        port->rx_length = 0;
+    }
+}
+
+/**
+ *  Report an error to the receiver. The port stops watching its file
+ *  descriptor since a hung up device would otherwise keep it ready forever.
+ *
+ *  @param port The port on which the error occured
+ */
+static void serial_port_fail (struct serial_port *port)
+{
+    io_watch_remove(port->watch);
+    port->watch = NULL;
+    port->tx_length = 0;
+    port->tx_offset = 0;
+    serial_port_notify(port, SERIAL_PORT_EVENT_ERROR, NULL, 0);
+}
+
+/**
+ *  Write as much queued data as the port will accept.
+ *
+ *  @param port The port for which queued data should be written
+ *
+ *  @return 1 if all data is written, 0 if some data remains, -1 on error
+ */
+static int serial_port_flush (struct serial_port *port)
+{
+    while (port->tx_offset < port->tx_length) {
+        ssize_t nbytes = write(port->fd, port->tx_buffer + port->tx_offset,
+                               port->tx_length - port->tx_offset);
+        
+        if (nbytes == -1) {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                return 0;
+            } else if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Could not write to %s: %s.\n", port->name,
+                    strerror(errno));
+            return -1;
+        }
+        
+        if (capture_enabled) {
+            capture_data(port->name, CAPTURE_RECORD_TX,
+                         port->tx_buffer + port->tx_offset, (size_t)nbytes);
+        }
+        port->tx_offset += (size_t)nbytes;
+        port->stats.bytes_tx += (uint64_t)nbytes;
+    }
+    
+    port->tx_length = 0;
+    port->tx_offset = 0;
+    return 1;
+}
+
+/**
+ *  Handle readiness of the port's file descriptor.
+ */
+static void serial_port_handle_io (struct io_watch *watch, int events,
+                                   void *context)
+{
+    (void)watch;
+    struct serial_port *port = context;
+    
+    port->busy++;
+    
+    if (events & IO_EVENT_WRITE) {
+        int ret = serial_port_flush(port);
+        
+        if (ret == -1) {
+            serial_port_fail(port);
+            events = 0;
+        } else if (ret == 1) {
+            io_watch_set_events(port->watch, IO_EVENT_READ);
+            serial_port_notify(port, SERIAL_PORT_EVENT_WRITTEN, NULL, 0);
+        }
+    }
+    
+    if (!port->closed && (events & (IO_EVENT_READ | IO_EVENT_ERROR))) {
+        ssize_t nbytes = read(port->fd, port->rx_buffer + port->rx_length,
+                              SERIAL_PORT_RX_BUFFER_SIZE - port->rx_length);
+        
+        if ((nbytes == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) ||
+                               (errno == EINTR))) {
+            // Spurious wakeup
+        } else if (nbytes <= 0) {
+            fprintf(stderr, "Could not read from %s: %s.\n", port->name,
+                    (nbytes == 0) ? "Device disconnected" : strerror(errno));
+            serial_port_fail(port);
+        } else {
+            if (capture_enabled) {
+                capture_data(port->name, CAPTURE_RECORD_RX,
+                             port->rx_buffer + port->rx_length,
+                             (size_t)nbytes);
+            }
+            port->rx_length += (size_t)nbytes;
+            port->stats.bytes_rx += (uint64_t)nbytes;
+            serial_port_deliver(port);
+        }
+    }
+    
+    port->busy--;
+    serial_port_release(port);
+}
+
+/**
+ *  Handle expiry of the receiver's deadline.
+ */
+static void serial_port_handle_deadline (struct io_timer *timer, void *context)
+{
+    (void)timer;
+    struct serial_port *port = context;
+    
+    port->busy++;
+    serial_port_notify(port, SERIAL_PORT_EVENT_TIMEOUT, NULL, 0);
+    port->busy--;
+    serial_port_release(port);
+}
+
+/**
+ *  Deliver a written event for data which was written without waiting for the
+ *  port to become writable.
+ */
+static void serial_port_handle_written (struct io_timer *timer, void *context)
+{
+    (void)timer;
+    struct serial_port *port = context;
+    
+    port->busy++;
+    if (port->tx_length == 0) {
+        serial_port_notify(port, SERIAL_PORT_EVENT_WRITTEN, NULL, 0);
+    }
+    port->busy--;
+    serial_port_release(port);
+}
+
+/**
+ *  Switch to a new baudrate once the tty has sent everything which was written
+ *  at the old one, then write anything queued in the meantime.
+ */
+static void serial_port_handle_drain (struct io_timer *timer, void *context)
+{
+    (void)timer;
+    struct serial_port *port = context;
+    long remaining = serial_port_drain_time(port);
+    
+    port->busy++;
+    if (port->watch == NULL) {
+        // The port has failed, nothing more will be written
+        port->next_baudrate = 0;
+    } else if (remaining != 0) {
+        if (io_timer_start(port->drain, remaining) != 0) {
+            serial_port_fail(port);
+        }
+    } else if (serial_port_apply_baud(port, port->next_baudrate) != 0) {
+        port->next_baudrate = 0;
+        serial_port_fail(port);
+    } else {
+        port->next_baudrate = 0;
+        if ((port->tx_length != 0) &&
+                (io_watch_set_events(port->watch,
+                                     IO_EVENT_READ | IO_EVENT_WRITE) != 0)) {
+            serial_port_fail(port);
+        }
+    }
+    port->busy--;
+    serial_port_release(port);
+}
+
+int serial_port_open (struct io_loop *loop, const char *path, int baudrate,
+                      struct serial_port **port)
+{
+    *port = calloc(1, sizeof(struct serial_port));
+    
+    if (*port == NULL) {
+        fprintf(stderr, "Could not allocate memory for serial port.\n");
+        return -1;
+    }
+    
+    (*port)->loop = loop;
+    (*port)->name = strdup(path);
+    
+    if ((*port)->name == NULL) {
+        fprintf(stderr, "Could not allocate memory for serial port.\n");
+        goto free_port;
+    }
+    
+    /* Open and configure tty */
+    (*port)->fd = open(path, O_RDWR | O_NOCTTY | O_SYNC | O_NONBLOCK);
+    if ((*port)->fd == -1) {
+        fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+        goto free_port;
+    }
+    
+    if (!isatty((*port)->fd)) {
+        fprintf(stderr, "File %s is not a tty.\n", path);
+        goto close_fd;
+    }
+    
+    if (configure_tty((*port)->fd, baudrate) != 0) {
+        goto close_fd;
+    }
+    (*port)->baudrate = baudrate;
+    
+    /* Drop anything left over from whoever had the port open before */
+    tcflush((*port)->fd, TCIOFLUSH);
+    
+    /* Register with event loop */
+    if (io_watch_add(loop, (*port)->fd, IO_EVENT_READ, serial_port_handle_io,
+                     *port, &(*port)->watch) != 0) {
+        goto close_fd;
+    }
+    
+    if (io_timer_init(loop, serial_port_handle_deadline, *port,
+                      &(*port)->deadline) != 0) {
+        goto remove_watch;
+    }
+    
+    if (io_timer_init(loop, serial_port_handle_written, *port,
+                      &(*port)->written) != 0) {
+        goto free_deadline;
+    }
+    
+    if (io_timer_init(loop, serial_port_handle_drain, *port,
+                      &(*port)->drain) != 0) {
+        goto free_written;
+    }
+    
+    return 0;
+    
+free_written:
+    io_timer_free((*port)->written);
+free_deadline:
+    io_timer_free((*port)->deadline);
+remove_watch:
+    io_watch_remove((*port)->watch);
+close_fd:
+    close((*port)->fd);
+free_port:
+    free((*port)->name);
+    free(*port);
+    *port = NULL;
+    return -1;
+}
+
+void serial_port_close (struct serial_port *port)
+{
+    if (port->closed) {
+        return;
+    }
+    
+    port->busy++;
+    serial_port_notify(port, SERIAL_PORT_EVENT_CLOSED, NULL, 0);
+    port->busy--;
+    
+    port->closed = 1;
+    port->callback = NULL;
+    
+    io_timer_free(port->drain);
+    io_timer_free(port->written);
+    io_timer_free(port->deadline);
+    if (port->watch != NULL) {
+        io_watch_remove(port->watch);
+    }
+    close(port->fd);
+    
+    serial_port_release(port);
+}
+
+void serial_port_set_receiver (struct serial_port *port,
+                               serial_port_cb callback, void *context)
+{
+    port->callback = callback;
+    port->context = context;
+}
+
+int serial_port_write (struct serial_port *port, const void *data,
+                       size_t length)
+{
+    if (port->watch == NULL) {
+        fprintf(stderr, "Could not write to %s: Port has failed.\n",
+                port->name);
+        return -1;
+    }
+    
+    /* Queue data */
+    if ((port->tx_length + length) > port->tx_capacity) {
+        size_t capacity = (port->tx_length + length) * 2;
+        uint8_t *buffer = realloc(port->tx_buffer, capacity);
+        
+        if (buffer == NULL) {
+            fprintf(stderr, "Could not allocate memory for write queue.\n");
+            return -1;
+        }
+        
+        port->tx_buffer = buffer;
+        port->tx_capacity = capacity;
+    }
+    
+    int was_empty = (port->tx_length == 0);
+    
+    memcpy(port->tx_buffer + port->tx_length, data, length);
+    port->tx_length += length;
+    
+    if (!was_empty || (port->next_baudrate != 0)) {
+        // Already waiting for the port to become writable, or for the
+        // baudrate to change
+        return 0;
+    }
+    
+    /* Try to write immediately */
+    int ret = serial_port_flush(port);
+    
+    if (ret == -1) {
+        port->tx_length = 0;
+        port->tx_offset = 0;
+        return -1;
+    } else if (ret == 0) {
+        return io_watch_set_events(port->watch,
+                                   IO_EVENT_READ | IO_EVENT_WRITE);
+    }
+    
+    return io_timer_start(port->written, 0);
+}
+
+int serial_port_set_deadline (struct serial_port *port, long timeout)
+{
+    if (timeout == 0) {
+        io_timer_stop(port->deadline);
+        return 0;
+    }
+    return io_timer_start(port->deadline, timeout);
+}
+
+int serial_port_set_baud (struct serial_port *port, int baudrate)
+{
+    if (baudrate == serial_port_get_baud(port)) {
+        return 0;
+    } else if (port->tx_length != 0) {
+        fprintf(stderr, "Can not change baud rate of %s while writing.\n",
+                port->name);
+        return -1;
+    } else if (get_baud(baudrate) == -1) {
+        fprintf(stderr, "Unkown baud rate: %d\n", baudrate);
+        return -1;
+    }
+    
+    if (port->next_baudrate != 0) {
+        // Already waiting for the tty to send what was written
+        port->next_baudrate = (baudrate == port->baudrate) ? 0 : baudrate;
+        if (port->next_baudrate == 0) {
+            io_timer_stop(port->drain);
+        }
+        return 0;
+    }
+    
+    /* Let anything already written go out at the old speed, without waiting
+       for it here */
+    long remaining = serial_port_drain_time(port);
+    if (remaining == 0) {
+        return serial_port_apply_baud(port, baudrate);
+    }
+    
+    port->next_baudrate = baudrate;
+    return io_timer_start(port->drain, remaining);
+}
+
+int serial_port_get_baud (struct serial_port *port)
+{
+    return (port->next_baudrate != 0) ? port->next_baudrate : port->baudrate;
+}
+
+void serial_port_discard_input (struct serial_port *port)
+{
+    port->rx_length = 0;
+}
+
+struct io_loop *serial_port_get_loop (struct serial_port *port)
+{
+    return port->loop;
+}
+
+struct serial_port_stats *serial_port_get_stats (struct serial_port *port)
+{
+    return &port->stats;
+}
+
+const char *serial_port_get_name (struct serial_port *port)
+{
+    return port->name;
+}
+
+int serial_port_set_quiet (struct serial_port *port, int quiet)
+{
+    int previous = port->quiet;
+    port->quiet = (quiet != 0);
+    return previous;
+}
+
+int serial_port_is_quiet (struct serial_port *port)
+{
+    return port->quiet;
+}
@@ -0,0 +1,199 @@
+//
+//  serial-port.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef serial_port_h
+#define serial_port_h
+
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "io-loop.h"
+#include "latency-stats.h"
+
+struct serial_port;
+
+/**
+ *  Counters kept for each port.
+ */
+struct serial_port_stats {
+    /* Number of bytes written to the port */
+    uint64_t bytes_tx;
+    /* Number of bytes read from the port */
+    uint64_t bytes_rx;
+    /* Time from sending a command to receiving its response */
+    struct latency_stats rtt;
+};
+
+enum serial_port_event {
+    /** Data has been received, the receiver returns the number of bytes it
+        consumed */
+    SERIAL_PORT_EVENT_DATA,
+    /** All queued data has been written to the port */
+    SERIAL_PORT_EVENT_WRITTEN,
+    /** The deadline set with serial_port_set_deadline has passed */
+    SERIAL_PORT_EVENT_TIMEOUT,
+    /** A read or write error occured */
+    SERIAL_PORT_EVENT_ERROR,
+    /** The port is being closed, the receiver should release its state */
+    SERIAL_PORT_EVENT_CLOSED
+};
+
+/**
+ *  Callback for events on a serial port.
+ *
+ *  @param port The port on which the event occured
+ *  @param event The type of event
+ *  @param data Received data for SERIAL_PORT_EVENT_DATA, otherwise NULL
+ *  @param length Number of bytes of received data available
+ *  @param context The context pointer given to serial_port_set_receiver
+ *
+ *  @return The number of bytes of data consumed, unconsumed data is kept and
+ *          presented again when more data arrives
+ */
+typedef size_t (*serial_port_cb)(struct serial_port *port,
+                                 enum serial_port_event event,
+                                 const uint8_t *data, size_t length,
+                                 void *context);
+
+/**
+ *  Open and configure a serial port and register it with an event loop.
+ *
+ *  @param loop The loop which should handle I/O for the port
+ *  @param path Path to the serial device
+ *  @param baudrate Desired baudrate in baud
+ *  @param port Pointer to where pointer to new port structure should be stored
+ *
+ *  @return 0 if successfull
+ */
+extern int serial_port_open (struct io_loop *loop, const char *path,
+                             int baudrate, struct serial_port **port);
+
+/**
+ *  Close a serial port. If there is a receiver it gets a
+ *  SERIAL_PORT_EVENT_CLOSED event. It is safe to call this from within a
+ *  callback for the port.
+ *
+ *  @param port The port to be closed
+ */
+extern void serial_port_close (struct serial_port *port);
+
+/**
+ *  Set the function which handles events for a port. Any data which is
+ *  buffered is presented to the new receiver the next time data arrives.
+ *
+ *  @param port The port for which the receiver should be set
+ *  @param callback Function to handle events, or NULL to only buffer data
+ *  @param context Pointer to be passed to callback
+ */
+extern void serial_port_set_receiver (struct serial_port *port,
+                                      serial_port_cb callback, void *context);
+
+/**
+ *  Queue data to be written to a port. As much data as possible is written
+ *  immediately, the rest is written when the port becomes writable.
+ *
+ *  @param port The port to write to
+ *  @param data Data to be written
+ *  @param length Number of bytes to be written
+ *
+ *  @return 0 if successfull
+ */
+extern int serial_port_write (struct serial_port *port, const void *data,
+                              size_t length);
+
+/**
+ *  Set a deadline after which the receiver gets a SERIAL_PORT_EVENT_TIMEOUT
+ *  event. Setting a new deadline replaces any previous one.
+ *
+ *  @param port The port for which the deadline should be set
+ *  @param timeout Timeout in milliseconds, or 0 to clear the deadline
+ *
+ *  @return 0 if successfull
+ */
+extern int serial_port_set_deadline (struct serial_port *port, long timeout);
+
+/**
+ *  Change the baudrate of a port. The RN2483's bootloader detects the baudrate
+ *  from the start of each command, so it can be changed between commands.
+ *  This does not block. If the tty has not yet sent everything that was
+ *  written, the change is made once it has, and anything written in the
+ *  meantime is held until then.
+ *
+ *  @param port The port
+ *  @param baudrate Desired baudrate in baud
+ *
+ *  @return 0 if successfull, -1 if the baudrate is not supported or data is
+ *          still waiting to be written
+ */
+extern int serial_port_set_baud (struct serial_port *port, int baudrate);
+
+/**
+ *  Get the baudrate of a port.
+ *
+ *  @param port The port
+ *
+ *  @return The port's baudrate in baud
+ */
+extern int serial_port_get_baud (struct serial_port *port);
+
+/**
+ *  Discard any received data that has been buffered but not consumed.
+ *
+ *  @param port The port for which received data should be discarded
+ */
+extern void serial_port_discard_input (struct serial_port *port);
+
+/**
+ *  Get the event loop that a port belongs to.
+ *
+ *  @param port The port
+ *
+ *  @return The port's event loop
+ */
+extern struct io_loop *serial_port_get_loop (struct serial_port *port);
+
+/**
+ *  Get the counters for a port.
+ *
+ *  @param port The port
+ *
+ *  @return Pointer to the port's statistics
+ */
+extern struct serial_port_stats *serial_port_get_stats (
+                                                    struct serial_port *port);
+
+/**
+ *  Get the path that a port was opened with.
+ *
+ *  @param port The port
+ *
+ *  @return The path to the port's device
+ */
+extern const char *serial_port_get_name (struct serial_port *port);
+
+/**
+ *  Set whether timeouts on a port are expected. Operations on a quiet port do
+ *  not print a message when they time out.
+ *
+ *  @param port The port
+ *  @param quiet Non-zero if timeouts should not be reported
+ *
+ *  @return The previous setting
+ */
+extern int serial_port_set_quiet (struct serial_port *port, int quiet);
+
+/**
+ *  Check whether timeouts on a port should be reported.
+ *
+ *  @param port The port
+ *
+ *  @return Non-zero if the port is quiet
+ */
+extern int serial_port_is_quiet (struct serial_port *port);
+
+#endif /* serial_port_h */
@@ -0,0 +1,113 @@
+//
+//  signal-watch.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#include "signal-watch.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+
+struct signal_watch {
+    struct io_watch *watch;
+    int *flag;
+};
+
+/** Pipe used to get signals into the event loop */
+static int signal_watch_pipe[2] = { -1, -1 };
+
+
+/**
+ *  Signal handler which passes the signal to the event loop.
+ */
+static void signal_watch_handler (int signum)
+{
+    int saved_errno = errno;
+    unsigned char c = (unsigned char)signum;
+    if (write(signal_watch_pipe[1], &c, 1) < 0) {
+        // Nothing useful can be done here
+    }
+    errno = saved_errno;
+}
+
+/**
+ *  Handle signals once they have reached the event loop.
+ */
+static void signal_watch_handle (struct io_watch *watch, int events,
+                                 void *context)
+{
+    (void)watch;
+    (void)events;
+    struct signal_watch *sw = context;
+    
+    unsigned char c;
+    while (read(signal_watch_pipe[0], &c, 1) == 1) {
+        *sw->flag = 1;
+    }
+}
+
+
+int signal_watch_init (struct io_loop *loop, int *flag,
+                       struct signal_watch **watch)
+{
+    *watch = calloc(1, sizeof(struct signal_watch));
+    if (*watch == NULL) {
+        fprintf(stderr, "Could not allocate signal watch.\n");
+        return -1;
+    }
+    (*watch)->flag = flag;
+    
+    if (pipe(signal_watch_pipe) != 0) {
+        fprintf(stderr, "Could not create pipe: %s\n", strerror(errno));
+        goto free_watch;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(signal_watch_pipe[i], F_SETFD, FD_CLOEXEC);
+        fcntl(signal_watch_pipe[i], F_SETFL,
+              fcntl(signal_watch_pipe[i], F_GETFL) | O_NONBLOCK);
+    }
+    
+    if (io_watch_add(loop, signal_watch_pipe[0], IO_EVENT_READ,
+                     signal_watch_handle, *watch, &(*watch)->watch) != 0) {
+        goto close_pipe;
+    }
+    
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = signal_watch_handler;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    
+    return 0;
+    
+close_pipe:
+    close(signal_watch_pipe[0]);
+    close(signal_watch_pipe[1]);
+    signal_watch_pipe[0] = -1;
+    signal_watch_pipe[1] = -1;
+free_watch:
+    free(*watch);
+    return -1;
+}
+
+void signal_watch_free (struct signal_watch *watch)
+{
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    
+    io_watch_remove(watch->watch);
+    close(signal_watch_pipe[0]);
+    close(signal_watch_pipe[1]);
+    signal_watch_pipe[0] = -1;
+    signal_watch_pipe[1] = -1;
+    free(watch);
+}
@@ -0,0 +1,39 @@
+//
+//  signal-watch.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef signal_watch_h
+#define signal_watch_h
+
+#include "io-loop.h"
+
+struct signal_watch;
+
+/**
+ *  Catch SIGINT and SIGTERM and set a flag from within an event loop when
+ *  either is received. Because the flag is set by a loop callback, a loop
+ *  which is run with io_loop_run on the same flag stops promptly.
+ *
+ *  @note Only one signal watch can exist at a time.
+ *
+ *  @param loop The loop in which the flag should be set
+ *  @param flag Flag to be set to 1 when a signal is received
+ *  @param watch Pointer to where pointer to new signal watch should be stored
+ *
+ *  @return 0 if successfull
+ */
+extern int signal_watch_init (struct io_loop *loop, int *flag,
+                              struct signal_watch **watch);
+
+/**
+ *  Stop catching signals and restore their default handling.
+ *
+ *  @param watch The signal watch to be freed
+ */
+extern void signal_watch_free (struct signal_watch *watch);
+
+#endif /* signal_watch_h */
@@ -0,0 +1,374 @@
+//
+//  state-db.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#include "state-db.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <libgen.h>
+#include <unistd.h>
+
+#include "json.h"
+
+/** FNV-1a parameters */
+#define STATE_DB_FNV_OFFSET UINT64_C(0xcbf29ce484222325)
+#define STATE_DB_FNV_PRIME  UINT64_C(0x100000001b3)
+
+struct state_db {
+    char *path;
+    
+    struct state_db_record *records;
+    int num_records;
+    int capacity;
+};
+
+
+/**
+ *  Callback for members of a record read from the database file.
+ */
+static int state_db_member (const char *key, enum json_type type,
+                            const char *value, void *context)
+{
+    struct state_db_record *record = context;
+    
+    if (strcmp(key, "eui") == 0) {
+        snprintf(record->eui, sizeof(record->eui), "%s", value);
+    } else if (strcmp(key, "usb") == 0) {
+        snprintf(record->usb, sizeof(record->usb), "%s", value);
+    } else if (strcmp(key, "version") == 0) {
+        snprintf(record->version, sizeof(record->version), "%s", value);
+    } else if (strcmp(key, "image") == 0) {
+        if (sscanf(value, "%" SCNx64, &record->image_hash) != 1) {
+            return -1;
+        }
+    } else if ((strcmp(key, "time") == 0) && (type == JSON_NUMBER)) {
+        record->time = (time_t)strtol(value, NULL, 10);
+    }
+    return 0;
+}
+
+/**
+ *  Get a new record at the end of the database.
+ *
+ *  @return The record, or NULL if memory could not be allocated
+ */
+static struct state_db_record *state_db_append (struct state_db *db)
+{
+    if (db->num_records == db->capacity) {
+        int capacity = (db->capacity == 0) ? 16 : (db->capacity * 2);
+        struct state_db_record *records = realloc(db->records,
+                                    (size_t)capacity * sizeof(*records));
+        if (records == NULL) {
+            fprintf(stderr, "Could not allocate memory for state database.\n");
+            return NULL;
+        }
+        db->records = records;
+        db->capacity = capacity;
+    }
+    
+    struct state_db_record *record = &db->records[db->num_records++];
+    memset(record, 0, sizeof(*record));
+    return record;
+}
+
+/**
+ *  Load records from the database file.
+ *
+ *  @return 0 if successfull
+ */
+static int state_db_load (struct state_db *db)
+{
+    FILE *file = fopen(db->path, "r");
+    if (file == NULL) {
+        if (errno == ENOENT) {
+            // Nothing has been recorded yet
+            return 0;
+        }
+        fprintf(stderr, "Could not open %s: %s\n", db->path, strerror(errno));
+        return -1;
+    }
+    
+    char *line = NULL;
+    size_t line_capacity = 0;
+    int line_num = 0;
+    int ret = 0;
+    
+    while (getline(&line, &line_capacity, file) != -1) {
+        line_num++;
+        
+        if (line[strspn(line, " \t\r\n")] == '\0') {
+            continue;
+        }
+        
+        struct state_db_record *record = state_db_append(db);
+        if (record == NULL) {
+            ret = -1;
+            break;
+        }
+        
+        if (json_parse_object(line, state_db_member, record) != 0) {
+            // A damaged record only means that some work is repeated
+            fprintf(stderr, "%s:%d: Ignoring invalid record\n", db->path,
+                    line_num);
+            db->num_records--;
+        }
+    }
+    
+    free(line);
+    fclose(file);
+    return ret;
+}
+
+/**
+ *  Write the database to its file. The file is replaced atomically so that it
+ *  is never left half written.
+ *
+ *  @return 0 if successfull
+ */
+static int state_db_save (struct state_db *db)
+{
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", db->path);
+    
+    FILE *file = fopen(tmp_path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open %s: %s\n", tmp_path, strerror(errno));
+        return -1;
+    }
+    
+    for (int i = 0; i < db->num_records; i++) {
+        struct state_db_record *record = &db->records[i];
+        
+        fprintf(file, "{\"eui\":");
+        json_write_string(file, record->eui);
+        fprintf(file, ",\"usb\":");
+        json_write_string(file, record->usb);
+        fprintf(file, ",\"image\":\"%016" PRIx64 "\",\"version\":",
+                record->image_hash);
+        json_write_string(file, record->version);
+        fprintf(file, ",\"time\":%ld}\n", (long)record->time);
+    }
+    
+    if ((fclose(file) != 0) || (rename(tmp_path, db->path) != 0)) {
+        fprintf(stderr, "Could not write %s: %s\n", db->path, strerror(errno));
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ *  Find the index of the record for a module.
+ *
+ *  @return The index of the record, or -1 if there is none
+ */
+static int state_db_find (struct state_db *db, const char *eui,
+                          const char *usb)
+{
+    if ((eui != NULL) && (eui[0] != '\0')) {
+        for (int i = 0; i < db->num_records; i++) {
+            if (strcmp(db->records[i].eui, eui) == 0) {
+                return i;
+            }
+        }
+        return -1;
+    }
+    
+    if ((usb != NULL) && (usb[0] != '\0')) {
+        for (int i = 0; i < db->num_records; i++) {
+            if (strcmp(db->records[i].usb, usb) == 0) {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+
+int state_db_open (const char *path, struct state_db **db)
+{
+    *db = calloc(1, sizeof(struct state_db));
+    if (*db == NULL) {
+        fprintf(stderr, "Could not allocate state database.\n");
+        return -1;
+    }
+    
+    (*db)->path = strdup(path);
+    if ((*db)->path == NULL) {
+        fprintf(stderr, "Could not allocate state database.\n");
+        free(*db);
+        return -1;
+    }
+    
+    if (state_db_load(*db) != 0) {
+        state_db_free(*db);
+        return -1;
+    }
+    return 0;
+}
+
+void state_db_free (struct state_db *db)
+{
+    free(db->records);
+    free(db->path);
+    free(db);
+}
+
+const struct state_db_record *state_db_lookup (struct state_db *db,
+                                               const char *eui,
+                                               const char *usb)
+{
+    int i = state_db_find(db, eui, usb);
+    return (i == -1) ? NULL : &db->records[i];
+}
+
+int state_db_update (struct state_db *db, const char *eui, const char *usb,
+                     uint64_t image_hash, const char *version)
+{
+    int i = state_db_find(db, eui, usb);
+    struct state_db_record *record;
+    
+    if ((i == -1) && (eui != NULL) && (eui[0] != '\0')) {
+        // Adopt a record made before the module's EUI was known
+        i = state_db_find(db, NULL, usb);
+        if ((i != -1) && (db->records[i].eui[0] != '\0')) {
+            i = -1;
+        }
+    }
+    
+    if (i != -1) {
+        record = &db->records[i];
+    } else if ((record = state_db_append(db)) == NULL) {
+        return -1;
+    }
+    
+    /* An adapter only belongs to one module at a time */
+    if ((usb != NULL) && (usb[0] != '\0')) {
+        for (int j = 0; j < db->num_records; j++) {
+            if ((&db->records[j] != record) &&
+                    (strcmp(db->records[j].usb, usb) == 0)) {
+                db->records[j].usb[0] = '\0';
+            }
+        }
+        snprintf(record->usb, sizeof(record->usb), "%s", usb);
+    }
+    if ((eui != NULL) && (eui[0] != '\0')) {
+        snprintf(record->eui, sizeof(record->eui), "%s", eui);
+    }
+    
+    record->image_hash = image_hash;
+    snprintf(record->version, sizeof(record->version), "%s", version);
+    record->time = time(NULL);
+    
+    return state_db_save(db);
+}
+
+int state_db_forget (struct state_db *db, const char *eui, const char *usb)
+{
+    int i = state_db_find(db, eui, usb);
+    if (i == -1) {
+        return 0;
+    }
+    
+    memmove(&db->records[i], &db->records[i + 1],
+            (size_t)(db->num_records - i - 1) * sizeof(*db->records));
+    db->num_records--;
+    
+    return state_db_save(db);
+}
+
+uint64_t state_db_image_hash (struct intel_hex_file *hex)
+{
+    uint64_t hash = STATE_DB_FNV_OFFSET;
+    
+    struct intel_hex_record *record = intel_hex_get_first_record(hex);
+    while (record != NULL) {
+        uint8_t *data;
+        uint32_t address;
+        uint8_t length;
+        record = intel_hex_get_next_record(record, &data, &address, &length);
+        
+        uint8_t header[5] = {
+            (uint8_t)(address >> 24), (uint8_t)(address >> 16),
+            (uint8_t)(address >> 8), (uint8_t)address, length
+        };
+        for (size_t i = 0; i < sizeof(header); i++) {
+            hash = (hash ^ header[i]) * STATE_DB_FNV_PRIME;
+        }
+        for (int i = 0; i < length; i++) {
+            hash = (hash ^ data[i]) * STATE_DB_FNV_PRIME;
+        }
+    }
+    
+    return hash;
+}
+
+/**
+ *  Use the name of a link in /dev/serial/by-id, which is made from the
+ *  adapter's serial number, when the serial number can not be read from sysfs.
+ *
+ *  @return 0 if the path is a link in /dev/serial/by-id
+ */
+static int state_db_by_id_name (const char *path, char *serial, size_t length)
+{
+    const char *by_id = strstr(path, "/serial/by-id/");
+    if (by_id == NULL) {
+        return -1;
+    }
+    snprintf(serial, length, "%s", by_id + strlen("/serial/by-id/"));
+    return 0;
+}
+
+int state_db_usb_serial (const char *path, char *serial, size_t length)
+{
+    /* Links in /dev/serial/by-id are resolved so that an adapter has the same
+       serial number whichever name its port was opened by */
+    char *real_path = realpath(path, NULL);
+    if (real_path == NULL) {
+        return state_db_by_id_name(path, serial, length);
+    }
+    
+    /* Find the USB device that the tty belongs to through sysfs */
+    char device_link[PATH_MAX];
+    snprintf(device_link, sizeof(device_link), "/sys/class/tty/%s/device",
+             basename(real_path));
+    free(real_path);
+    
+    char *dir = realpath(device_link, NULL);
+    if (dir == NULL) {
+        return state_db_by_id_name(path, serial, length);
+    }
+    
+    int ret = -1;
+    while (strcmp(dir, "/sys/devices") > 0) {
+        char serial_path[PATH_MAX];
+        snprintf(serial_path, sizeof(serial_path), "%s/serial", dir);
+        
+        FILE *file = fopen(serial_path, "r");
+        if (file != NULL) {
+            if (fgets(serial, (int)length, file) != NULL) {
+                serial[strcspn(serial, "\r\n")] = '\0';
+                ret = (serial[0] != '\0') ? 0 : -1;
+            }
+            fclose(file);
+            break;
+        }
+        
+        char *slash = strrchr(dir, '/');
+        if (slash == NULL) {
+            break;
+        }
+        *slash = '\0';
+    }
+    
+    free(dir);
+    return (ret == 0) ? 0 : state_db_by_id_name(path, serial, length);
+}
@@ -0,0 +1,129 @@
+//
+//  state-db.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef state_db_h
+#define state_db_h
+
+#include <inttypes.h>
+#include <time.h>
+
+#include "intel-hex.h"
+
+/** Maximum length of a module identity string */
+#define STATE_DB_ID_LENGTH      64
+/** Maximum length of a version string in a record */
+#define STATE_DB_VERSION_LENGTH 64
+/** Number of rows that are compared to confirm that a module holds an image */
+#define STATE_DB_SPOT_CHECKS    8
+
+/**
+ *  What is known about the last image that was written to a module and
+ *  verified.
+ */
+struct state_db_record {
+    /** Hardware EUI of the module, empty if unknown */
+    char eui[STATE_DB_ID_LENGTH];
+    /** Serial number of the USB adapter the module is attached to, empty if
+        unknown */
+    char usb[STATE_DB_ID_LENGTH];
+    /** Hash of the image, from state_db_image_hash */
+    uint64_t image_hash;
+    /** Firmware version reported after the image was written */
+    char version[STATE_DB_VERSION_LENGTH];
+    /** Time at which the image was verified */
+    time_t time;
+};
+
+struct state_db;
+
+/**
+ *  Open a state database, loading any records from the file if it exists.
+ *
+ *  @param path Path to the file in which records are stored
+ *  @param db Pointer to where pointer to new database should be stored
+ *
+ *  @return 0 if successfull
+ */
+extern int state_db_open (const char *path, struct state_db **db);
+
+/**
+ *  Free a state database.
+ *
+ *  @param db The database to be freed
+ */
+extern void state_db_free (struct state_db *db);
+
+/**
+ *  Find the record for a module. If the hardware EUI is known only a record
+ *  with the same EUI matches, otherwise a record for the same USB adapter
+ *  matches.
+ *
+ *  @param db The database
+ *  @param eui Hardware EUI of the module, or NULL if unknown
+ *  @param usb Serial number of the module's USB adapter, or NULL if unknown
+ *
+ *  @return The record, or NULL if there is none
+ */
+extern const struct state_db_record *state_db_lookup (struct state_db *db,
+                                                      const char *eui,
+                                                      const char *usb);
+
+/**
+ *  Record that a module has been verified to hold an image and save the
+ *  database.
+ *
+ *  @param db The database
+ *  @param eui Hardware EUI of the module, or NULL if unknown
+ *  @param usb Serial number of the module's USB adapter, or NULL if unknown
+ *  @param image_hash Hash of the image
+ *  @param version Firmware version reported by the module
+ *
+ *  @return 0 if successfull
+ */
+extern int state_db_update (struct state_db *db, const char *eui,
+                            const char *usb, uint64_t image_hash,
+                            const char *version);
+
+/**
+ *  Forget what is known about a module, because its flash is about to be
+ *  changed, and save the database.
+ *
+ *  @param db The database
+ *  @param eui Hardware EUI of the module, or NULL if unknown
+ *  @param usb Serial number of the module's USB adapter, or NULL if unknown
+ *
+ *  @return 0 if successfull
+ */
+extern int state_db_forget (struct state_db *db, const char *eui,
+                            const char *usb);
+
+/**
+ *  Calculate a hash of the addresses and contents of every record in an image.
+ *
+ *  @param hex The image
+ *
+ *  @return The hash
+ */
+extern uint64_t state_db_image_hash (struct intel_hex_file *hex);
+
+/**
+ *  Find the serial number of the USB adapter that a serial port belongs to.
+ *  Links in /dev/serial/by-id are resolved and the serial number is read from
+ *  sysfs, so a port gives the same result whichever name it is opened by. The
+ *  name of a /dev/serial/by-id link is only used if sysfs has no serial
+ *  number for the adapter.
+ *
+ *  @param path Path to the serial port
+ *  @param serial Buffer where the serial number should be stored
+ *  @param length Size of the buffer
+ *
+ *  @return 0 if a serial number was found
+ */
+extern int state_db_usb_serial (const char *path, char *serial, size_t length);
+
+#endif /* state_db_h */
@@ -0,0 +1,173 @@
+//
+//  trace.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#include "trace.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "json.h"
+#include "latency-stats.h"
+
+/** Maximum length of an event name */
+#define TRACE_NAME_LENGTH   32
+
+struct trace_event {
+    int track;
+    const char *category;
+    char name[TRACE_NAME_LENGTH];
+    uint64_t start;
+    uint64_t duration;
+    char args[TRACE_ARGS_LENGTH];
+};
+
+int trace_enabled = 0;
+
+static char *trace_path;
+/** Time at which recording started, event times are relative to it */
+static uint64_t trace_epoch;
+
+static struct trace_event *trace_events;
+static size_t trace_num_events;
+static size_t trace_capacity;
+
+static char **trace_tracks;
+static int trace_num_tracks;
+
+
+/**
+ *  Find the number of a track, adding it if it has not been seen before.
+ *
+ *  @return The number of the track, or -1 if memory could not be allocated
+ */
+static int trace_track (const char *name)
+{
+    for (int i = 0; i < trace_num_tracks; i++) {
+        if (strcmp(trace_tracks[i], name) == 0) {
+            return i;
+        }
+    }
+    
+    char **tracks = realloc(trace_tracks, (size_t)(trace_num_tracks + 1) *
+                                            sizeof(*tracks));
+    if (tracks == NULL) {
+        return -1;
+    }
+    trace_tracks = tracks;
+    
+    if ((trace_tracks[trace_num_tracks] = strdup(name)) == NULL) {
+        return -1;
+    }
+    return trace_num_tracks++;
+}
+
+
+int trace_start (const char *path)
+{
+    trace_path = strdup(path);
+    if (trace_path == NULL) {
+        fprintf(stderr, "Could not allocate memory for trace.\n");
+        return -1;
+    }
+    
+    trace_epoch = latency_stats_now();
+    trace_enabled = 1;
+    atexit(trace_finish);
+    return 0;
+}
+
+void trace_finish (void)
+{
+    if (!trace_enabled) {
+        return;
+    }
+    trace_enabled = 0;
+    
+    FILE *file = fopen(trace_path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open %s: %s\n", trace_path,
+                strerror(errno));
+    } else {
+        fprintf(file, "{\"traceEvents\":[\n");
+        
+        /* Name the rows after their tracks */
+        int pid = (int)getpid();
+        for (int i = 0; i < trace_num_tracks; i++) {
+            fprintf(file, "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,"
+                    "\"tid\":%d,\"args\":{\"name\":", pid, i);
+            json_write_string(file, trace_tracks[i]);
+            fprintf(file, "}},\n");
+        }
+        
+        for (size_t i = 0; i < trace_num_events; i++) {
+            struct trace_event *event = &trace_events[i];
+            fprintf(file, "{\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"cat\":", pid,
+                    event->track);
+            json_write_string(file, event->category);
+            fprintf(file, ",\"name\":");
+            json_write_string(file, event->name);
+            fprintf(file, ",\"ts\":%" PRIu64 ",\"dur\":%" PRIu64
+                    ",\"args\":{%s}},\n", event->start, event->duration,
+                    event->args);
+        }
+        
+        fprintf(file, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,"
+                "\"args\":{\"name\":\"rn2483-loader\"}}\n]}\n", pid);
+        
+        if (fclose(file) != 0) {
+            fprintf(stderr, "Could not write %s: %s\n", trace_path,
+                    strerror(errno));
+        }
+    }
+    
+    for (int i = 0; i < trace_num_tracks; i++) {
+        free(trace_tracks[i]);
+    }
+    free(trace_tracks);
+    free(trace_events);
+    free(trace_path);
+}
+
+void trace_complete (const char *track, const char *category,
+                     const char *name, uint64_t start, uint64_t end,
+                     const char *args)
+{
+    if (!trace_enabled) {
+        return;
+    }
+    
+    if (trace_num_events == trace_capacity) {
+        size_t capacity = (trace_capacity == 0) ? 1024 : (trace_capacity * 2);
+        struct trace_event *events = realloc(trace_events,
+                                             capacity * sizeof(*events));
+        if (events == NULL) {
+            // Losing events is better than failing the update
+            return;
+        }
+        trace_events = events;
+        trace_capacity = capacity;
+    }
+    
+    int track_num = trace_track(track);
+    if (track_num == -1) {
+        return;
+    }
+    
+    struct trace_event *event = &trace_events[trace_num_events++];
+    event->track = track_num;
+    event->category = category;
+    snprintf(event->name, sizeof(event->name), "%s", name);
+    event->start = (start > trace_epoch) ? (start - trace_epoch) : 0;
+    event->duration = (end > start) ? (end - start) : 0;
+    snprintf(event->args, sizeof(event->args), "%s",
+             (args != NULL) ? args : "");
+}
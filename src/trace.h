@@ -0,0 +1,53 @@
+//
+//  trace.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef trace_h
+#define trace_h
+
+#include <stdint.h>
+
+/** Maximum length of the arguments recorded with an event */
+#define TRACE_ARGS_LENGTH   96
+
+/** Non-zero while events are being recorded, callers check this before
+    doing any work to describe an event */
+extern int trace_enabled;
+
+/**
+ *  Start recording events. Events are kept in memory until trace_finish is
+ *  called, which is registered to happen when the program exits.
+ *
+ *  @param path Path to the file where the trace should be written
+ *
+ *  @return 0 if successfull
+ */
+extern int trace_start (const char *path);
+
+/**
+ *  Stop recording events and write them out in the Chrome trace event format,
+ *  which can be opened with Perfetto or chrome://tracing.
+ */
+extern void trace_finish (void);
+
+/**
+ *  Record something which took place over a period of time. Events with the
+ *  same track, such as the name of a port, are shown on the same row.
+ *
+ *  @param track Name of the row on which the event is shown
+ *  @param category Category of the event, such as "bootloader"
+ *  @param name Name of the event
+ *  @param start Time at which the event started, from latency_stats_now
+ *  @param end Time at which the event ended, from latency_stats_now
+ *  @param args Members of a JSON object with details of the event, such as
+ *              "\"address\":768", or NULL
+ */
+extern void trace_complete (const char *track, const char *category,
+                            const char *name, uint64_t start, uint64_t end,
+                            const char *args);
+
+#endif /* trace_h */
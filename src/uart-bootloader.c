@@ -17,7 +17,9 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <arpa/inet.h>
-#include <sys/select.h>
+
+#include "trace.h"
+#include "metrics.h"
 
 
 #define HOST_TO_LE_16(x) __builtin_bswap16(htons(x))
@@ -28,34 +30,207 @@
 
 
 /**
- *  Send command to bootloader and get response.
+ *  State for an operation which is in progress on a port.
+ */
+struct rn_bootloader_op {
+    struct serial_port *port;
+    
+    rn_bootloader_cb callback;
+    void *context;
+    
+    /**
+     *  Function called each time a response is received, returns 1 if the
+     *  operation is complete, 0 if another command was sent and -1 on error.
+     */
+    int (*step)(struct rn_bootloader_op *op);
+    
+    /* Expected length of the response to the current command */
+    size_t response_length;
+    /* Time at which the current command was sent */
+    uint64_t sent_at;
+    /* Current command, its address and length as sent, for tracing */
+    enum rn_bootloader_command command;
+    uint32_t command_address;
+    size_t command_length;
+    union {
+        struct rn_bootloader_rsp_version version;
+        struct rn_bootloader_rsp_status status;
+        struct rn_bootloader_rsp_checksum checksum;
+        uint8_t raw[sizeof(struct rn_bootloader_rsp_version)];
+    } response;
+    
+    /* Operation parameters */
+    struct rn_bootloader_rsp_version *version;
+    uint32_t address;
+    uint16_t length;
+    uint16_t progress;
+    uint8_t *data;
+    
+    /* Operation results */
+    struct rn_bootloader_rsp_version **version_out;
+    uint16_t *checksum_out;
+};
+
+static const char *const rn_bootloader_command_names[] = {
+    [RN_BOOTLOADER_CMD_GET_VERSION] = "GET_VERSION",
+    [RN_BOOTLOADER_CMD_WRITE] = "WRITE",
+    [RN_BOOTLOADER_CMD_ERASE] = "ERASE",
+    [RN_BOOTLOADER_CMD_CHECKSUM] = "CHECKSUM",
+    [RN_BOOTLOADER_CMD_RESET] = "RESET"
+};
+
+
+/**
+ *  Record the end of the current command of an operation in the trace and
+ *  metrics.
  *
- *  @param fd File descriptor for serial connection to radio
+ *  @param op The operation
+ *  @param result What happened to the command
+ */
+static void rn_bootloader_record (struct rn_bootloader_op *op,
+                                  const char *result)
+{
+    uint64_t now = latency_stats_now();
+    
+    if (metrics_enabled) {
+        metrics_command("bootloader",
+                        rn_bootloader_command_names[op->command],
+                        now - op->sent_at, strcmp(result, "ok") == 0);
+    }
+    
+    char args[TRACE_ARGS_LENGTH];
+    snprintf(args, sizeof(args), "\"address\":%" PRIu32 ",\"bytes_out\":%zu,"
+             "\"bytes_in\":%zu,\"result\":\"%s\"", op->command_address,
+             op->command_length, op->response_length, result);
+    trace_complete(serial_port_get_name(op->port), "bootloader",
+                   rn_bootloader_command_names[op->command], op->sent_at,
+                   now, args);
+}
+
+/**
+ *  Complete an operation, free it and call its callback.
+ *
+ *  @param op The operation which has completed
+ *  @param status The status to be passed to the callback
+ */
+static void rn_bootloader_op_finish (struct rn_bootloader_op *op, int status)
+{
+    struct serial_port *port = op->port;
+    rn_bootloader_cb callback = op->callback;
+    void *context = op->context;
+    
+    if ((status != 0) && (op->version_out != NULL)) {
+        // Don't leave the caller with incomplete version information
+        free(*op->version_out);
+        *op->version_out = NULL;
+    }
+    
+    serial_port_set_receiver(port, NULL, NULL);
+    serial_port_set_deadline(port, 0);
+    free(op);
+    
+    callback(port, status, context);
+}
+
+/**
+ *  Handle events from the serial port while an operation is in progress.
+ */
+static size_t rn_bootloader_receive (struct serial_port *port,
+                                     enum serial_port_event event,
+                                     const uint8_t *data, size_t length,
+                                     void *context)
+{
+    struct rn_bootloader_op *op = context;
+    size_t consumed = 0;
+    
+    switch (event) {
+        case SERIAL_PORT_EVENT_DATA:
+            if ((op->response_length == 0) || (length < op->response_length)) {
+                // Wait for the full response
+                return 0;
+            }
+            memcpy(op->response.raw, data, op->response_length);
+            consumed = op->response_length;
+            latency_stats_add(&serial_port_get_stats(port)->rtt,
+                              latency_stats_now() - op->sent_at);
+            if (trace_enabled || metrics_enabled) {
+                rn_bootloader_record(op, "ok");
+            }
+            break;
+        case SERIAL_PORT_EVENT_WRITTEN:
+            if (op->response_length != 0) {
+                // Still need to wait for the response
+                return 0;
+            }
+            if (trace_enabled || metrics_enabled) {
+                rn_bootloader_record(op, "ok");
+            }
+            break;
+        case SERIAL_PORT_EVENT_TIMEOUT:
+            if (!serial_port_is_quiet(port)) {
+                fprintf(stderr, "Timed out waiting for response from "
+                        "bootloader on %s.\n", serial_port_get_name(port));
+            }
+            if (trace_enabled || metrics_enabled) {
+                rn_bootloader_record(op, "timeout");
+            }
+            rn_bootloader_op_finish(op, -1);
+            return 0;
+        case SERIAL_PORT_EVENT_ERROR:
+            if (trace_enabled || metrics_enabled) {
+                rn_bootloader_record(op, "error");
+            }
+            rn_bootloader_op_finish(op, -1);
+            return 0;
+        case SERIAL_PORT_EVENT_CLOSED:
+            free(op);
+            return 0;
+    }
+    
+    serial_port_set_deadline(port, 0);
+    
+    int ret = op->step(op);
+    if (ret != 0) {
+        rn_bootloader_op_finish(op, (ret == 1) ? 0 : -1);
+    }
+    
+    return consumed;
+}
+
+/**
+ *  Send command to bootloader, the operation's step function is called once
+ *  the response has been received.
+ *
+ *  @param op The operation for which the command is being sent
  *  @param command Command to be sent
  *  @param length Length field for command, must not be greater than
- *                RN_BOOTLOADER_MAX_LENGTH
+ *                RN_BOOTLOADER_MAX_LENGTH if data is sent with the command
  *  @param key_one Value for key_one field of command
  *  @param key_two Value for key_two field of command
  *  @param address Value for address field of command
  *  @param data Pointer to data to be send in command, if NULL no data will be
  *              sent, if not NULL `length` bytes of data will be sent
- *  @param response Pointer to where response should be stored
- *  @param reponse_length Length of response
+ *  @param response_length Length of response, if 0 the command is complete
+ *                         once it has been written
+ *  @param timeout Time to wait for the response in milliseconds
  *
  *  @return 0 if successfull
  */
-static int rn_bootloader_do_command (int fd, enum rn_bootloader_command command,
+static int rn_bootloader_do_command (struct rn_bootloader_op *op,
+                                     enum rn_bootloader_command command,
                                      uint16_t length, uint8_t key_one,
                                      uint8_t key_two, uint32_t address,
-                                     char *data, char *response,
-                                     ssize_t response_length)
+                                     char *data, size_t response_length,
+                                     long timeout)
 {
     size_t total_length = (sizeof(struct rn_bootloader_cmd_pkt) +
                            ((data == NULL) ? 0 : length));
     
     struct rn_bootloader_cmd_pkt *cmd = alloca(total_length);
     
-    if (length > RN_BOOTLOADER_MAX_LENGTH) {
+    if ((data != NULL) && (length > RN_BOOTLOADER_MAX_LENGTH)) {
+        // Only the data has to fit in the bootloader's buffer, commands such
+        // as checksum can cover a longer range
         fprintf(stderr, "Invalid length for bootloader command.\n");
         return -1;
     }
@@ -73,49 +248,117 @@ static int rn_bootloader_do_command (int fd, enum rn_bootloader_command command,
     }
     
     /* Send command */
-    ssize_t len = 0;
+    op->response_length = response_length;
+    op->command = command;
+    op->command_address = address;
+    op->command_length = total_length;
+    op->sent_at = latency_stats_now();
     
-    while (len < (ssize_t)total_length) {
-        ssize_t nbytes = write(fd, ((char*)cmd) + len, total_length - len);
-        
-        if (nbytes == -1) {
-            fprintf(stderr, "Could not write command to bootloader: %s.\n",
-                    strerror(errno));
-            return -1;
-        }
-        
-        len += nbytes;
-    }
+    serial_port_discard_input(op->port);
+    serial_port_set_receiver(op->port, rn_bootloader_receive, op);
     
-    /* Get response */
-    len = 0;
+    if (serial_port_write(op->port, cmd, total_length) != 0) {
+        fprintf(stderr, "Could not write command to bootloader.\n");
+        serial_port_set_receiver(op->port, NULL, NULL);
+        return -1;
+    }
     
-    while (len < response_length) {
-        fd_set set;
-        FD_SET(fd, &set);
-        
-        select(fd + 1, &set, NULL, NULL, NULL);
-        
-        if (FD_ISSET(fd, &set)) {
-            // There is data available to be read from the file descriptor
-            ssize_t nbytes = read(fd, response + len, response_length - len);
-            len += nbytes;
-            
-            if (nbytes == -1) {
-                fprintf(stderr, "Could not read from bootloader: %s.\n",
-                        strerror(errno));
-                return -1;
-            }
-        }
+    if (response_length != 0) {
+        return serial_port_set_deadline(op->port, timeout);
     }
     
     return 0;
 }
 
+/**
+ *  Allocate a new operation.
+ *
+ *  @param port The port on which the operation will run
+ *  @param step Function to be called when responses are received
+ *  @param callback Function to be called when the operation completes
+ *  @param context Pointer to be passed to callback
+ *
+ *  @return The new operation, or NULL if it could not be allocated
+ */
+static struct rn_bootloader_op *rn_bootloader_op_new (
+                                        struct serial_port *port,
+                                        int (*step)(struct rn_bootloader_op *),
+                                        rn_bootloader_cb callback,
+                                        void *context)
+{
+    struct rn_bootloader_op *op = calloc(1, sizeof(struct rn_bootloader_op));
+    
+    if (op == NULL) {
+        fprintf(stderr, "Could not allocate memory for bootloader "
+                        "operation.\n");
+        return NULL;
+    }
+    
+    op->port = port;
+    op->step = step;
+    op->callback = callback;
+    op->context = context;
+    
+    return op;
+}
+
+/**
+ *  State used to wait for an operation to complete.
+ */
+struct rn_bootloader_sync {
+    int done;
+    int status;
+};
 
+static void rn_bootloader_sync_done (struct serial_port *port, int status,
+                                     void *context)
+{
+    (void)port;
+    struct rn_bootloader_sync *sync = context;
+    
+    sync->status = status;
+    sync->done = 1;
+}
 
-int rn_bootloader_get_version_info (int fd,
-                                    struct rn_bootloader_rsp_version **version)
+/**
+ *  Run the port's event loop until an operation completes.
+ *
+ *  @param port The port on which the operation is running
+ *  @param sync The state for the operation
+ *
+ *  @return The status of the operation
+ */
+static int rn_bootloader_sync_wait (struct serial_port *port,
+                                    struct rn_bootloader_sync *sync)
+{
+    if (io_loop_run(serial_port_get_loop(port), &sync->done) != 0) {
+        return -1;
+    }
+    
+    return sync->status;
+}
+
+
+
+static int rn_bootloader_version_step (struct rn_bootloader_op *op)
+{
+    struct rn_bootloader_rsp_version *version = *op->version_out;
+    
+    memcpy(version, &op->response.version, sizeof(*version));
+    
+    /* Make sure that endianness of response data is correct */
+    version->version = LE_TO_HOST_16(version->version);
+    version->max_packet_size = LE_TO_HOST_16(version->max_packet_size);
+    version->ack_packet_size = LE_TO_HOST_16(version->ack_packet_size);
+    version->device_id = LE_TO_HOST_16(version->device_id);
+    
+    return 1;
+}
+
+int rn_bootloader_get_version_info_async (struct serial_port *port,
+                                    struct rn_bootloader_rsp_version **version,
+                                    long timeout, rn_bootloader_cb callback,
+                                    void *context)
 {
     *version = malloc(sizeof(struct rn_bootloader_rsp_version));
     
@@ -125,22 +368,49 @@ int rn_bootloader_get_version_info (int fd,
         return -1;
     }
     
-    int ret = rn_bootloader_do_command(fd, RN_BOOTLOADER_CMD_GET_VERSION, 0, 0,
-                                       0, 0, NULL, (char*)*version,
-                                    sizeof(struct rn_bootloader_rsp_version));
+    struct rn_bootloader_op *op = rn_bootloader_op_new(port,
+                                                    rn_bootloader_version_step,
+                                                    callback, context);
     
-    if (ret != 0) {
-        free(*version);
-        return -1;
+    if (op == NULL) {
+        goto free_version;
     }
     
-    /* Make sure that endianness of response data is correct */
-    (*version)->version = LE_TO_HOST_16((*version)->version);
-    (*version)->max_packet_size = LE_TO_HOST_16((*version)->max_packet_size);
-    (*version)->ack_packet_size = LE_TO_HOST_16((*version)->ack_packet_size);
-    (*version)->device_id = LE_TO_HOST_16((*version)->device_id);
+    op->version_out = version;
+    
+    int ret = rn_bootloader_do_command(op, RN_BOOTLOADER_CMD_GET_VERSION, 0, 0,
+                                       0, 0, NULL,
+                                       sizeof(struct rn_bootloader_rsp_version),
+                                       timeout);
+    
+    if (ret != 0) {
+        free(op);
+        goto free_version;
+    }
     
     return 0;
+    
+free_version:
+    free(*version);
+    *version = NULL;
+    return -1;
+}
+
+int rn_bootloader_get_version_info (struct serial_port *port,
+                                    struct rn_bootloader_rsp_version **version)
+{
+    struct rn_bootloader_sync sync = { 0, 0 };
+    
+    int ret = rn_bootloader_get_version_info_async(port, version,
+                                                   RN_BOOTLOADER_TIMEOUT,
+                                                   rn_bootloader_sync_done,
+                                                   &sync);
+    
+    if (ret != 0) {
+        return -1;
+    }
+    
+    return rn_bootloader_sync_wait(port, &sync);
 }
 
 int rn_bootloader_get_version (struct rn_bootloader_rsp_version *version)
@@ -158,97 +428,213 @@ int rn_bootloader_get_write_size (struct rn_bootloader_rsp_version *version)
     return (int)version->write_latch_size;
 }
 
+int rn_bootloader_get_erase_size (struct rn_bootloader_rsp_version *version)
+{
+    return (int)version->erase_row_size;
+}
+
 
-int rn_bootloader_erase (int fd, uint32_t start_address, uint16_t length,
-                         struct rn_bootloader_rsp_version *version)
+/**
+ *  Send the erase command for the next group of rows.
+ */
+static int rn_bootloader_erase_next (struct rn_bootloader_op *op)
 {
-    int total_blocks = length / version->erase_row_size;
-    int remaining_blocks = total_blocks;
+    int remaining_blocks = op->length - op->progress;
+    int blocks = (remaining_blocks > 256) ? 256 : remaining_blocks;
     
-    while (remaining_blocks) {
-        int blocks = (remaining_blocks > 256) ? 256 : remaining_blocks;
-        
-        uint32_t address = start_address + ((total_blocks - remaining_blocks) *
-                                            version->erase_row_size);
-        
-        struct rn_bootloader_rsp_status response;
-        
-        int ret = rn_bootloader_do_command(fd, RN_BOOTLOADER_CMD_ERASE,
-                                           (blocks == 256) ? 0 : blocks,
-                                           RN_BOOTLOADER_KEY_ONE,
-                                           RN_BOOTLOADER_KEY_TWO, address, NULL,
-                                           (char*)&response, sizeof(response));
-        
-        if (ret != 0) {
-            return -1;
-        } else if (response.status != RN_BOOTLOADER_STATUS_SUCCESS) {
-            fprintf(stderr, "Failed to erase blocks.\n");
-            return -1;
-        }
-        
-        remaining_blocks -= blocks;
+    uint32_t address = op->address + (op->progress *
+                                      op->version->erase_row_size);
+    
+    op->progress += blocks;
+    
+    return rn_bootloader_do_command(op, RN_BOOTLOADER_CMD_ERASE,
+                                    (blocks == 256) ? 0 : blocks,
+                                    RN_BOOTLOADER_KEY_ONE,
+                                    RN_BOOTLOADER_KEY_TWO, address, NULL,
+                                    sizeof(struct rn_bootloader_rsp_status),
+                                    RN_BOOTLOADER_TIMEOUT +
+                                    (blocks * RN_BOOTLOADER_ERASE_ROW_TIMEOUT));
+}
+
+static int rn_bootloader_erase_step (struct rn_bootloader_op *op)
+{
+    if (op->response.status.status != RN_BOOTLOADER_STATUS_SUCCESS) {
+        fprintf(stderr, "Failed to erase blocks.\n");
+        return -1;
+    } else if (op->progress == op->length) {
+        return 1;
     }
     
-    return 0;
+    return rn_bootloader_erase_next(op);
 }
 
+int rn_bootloader_erase_async (struct serial_port *port,
+                               uint32_t start_address, uint16_t length,
+                               struct rn_bootloader_rsp_version *version,
+                               rn_bootloader_cb callback, void *context)
+{
+    struct rn_bootloader_op *op = rn_bootloader_op_new(port,
+                                                    rn_bootloader_erase_step,
+                                                    callback, context);
+    
+    if (op == NULL) {
+        return -1;
+    }
+    
+    op->version = version;
+    op->address = start_address;
+    // Length is tracked in blocks for erase operations
+    op->length = length / version->erase_row_size;
+    
+    if ((op->length == 0) || (rn_bootloader_erase_next(op) != 0)) {
+        free(op);
+        return -1;
+    }
+    
+    return 0;
+}
 
-int rn_bootloader_write (int fd, uint32_t address, uint16_t length,
-                         uint8_t *data,
+int rn_bootloader_erase (struct serial_port *port, uint32_t start_address,
+                         uint16_t length,
                          struct rn_bootloader_rsp_version *version)
 {
-    uint16_t bytes_written = 0;
+    struct rn_bootloader_sync sync = { 0, 0 };
     
-    while (bytes_written < length) {
-        uint16_t nbytes = (length > version->write_latch_size) ?
-                                            version->write_latch_size : length;
-        
-        struct rn_bootloader_rsp_status response;
-        
-        int ret = rn_bootloader_do_command(fd, RN_BOOTLOADER_CMD_WRITE,
-                                           nbytes, RN_BOOTLOADER_KEY_ONE,
-                                           RN_BOOTLOADER_KEY_TWO,
-                                           address + bytes_written,
-                                           (char*)data + bytes_written,
-                                           (char*)&response, sizeof(response));
-        
-        if (ret != 0) {
-            return -1;
-        } else if (response.status != RN_BOOTLOADER_STATUS_SUCCESS) {
-            fprintf(stderr, "Failed to write block.\n");
-            return -1;
-        }
-        
-        bytes_written += nbytes;
+    if (rn_bootloader_erase_async(port, start_address, length, version,
+                                  rn_bootloader_sync_done, &sync) != 0) {
+        return -1;
     }
     
-    return 0;
+    return rn_bootloader_sync_wait(port, &sync);
 }
 
 
-int rn_bootloader_checksum (int fd, uint32_t address, uint16_t length,
-                            uint16_t *checksum)
+/**
+ *  Send the write command for the next latch worth of data.
+ */
+static int rn_bootloader_write_next (struct rn_bootloader_op *op)
 {
-    struct rn_bootloader_rsp_checksum response;
+    uint16_t remaining = op->length - op->progress;
+    uint16_t nbytes = (remaining > op->version->write_latch_size) ?
+                                        op->version->write_latch_size : remaining;
     
-    int ret = rn_bootloader_do_command(fd, RN_BOOTLOADER_CMD_CHECKSUM, length,
-                                       0, 0, address, NULL, (char*)&response,
-                                       sizeof(response));
+    uint16_t offset = op->progress;
+    op->progress += nbytes;
     
-    if (ret != 0) {
+    return rn_bootloader_do_command(op, RN_BOOTLOADER_CMD_WRITE, nbytes,
+                                    RN_BOOTLOADER_KEY_ONE,
+                                    RN_BOOTLOADER_KEY_TWO,
+                                    op->address + offset,
+                                    (char*)op->data + offset,
+                                    sizeof(struct rn_bootloader_rsp_status),
+                                    RN_BOOTLOADER_TIMEOUT);
+}
+
+static int rn_bootloader_write_step (struct rn_bootloader_op *op)
+{
+    if (op->response.status.status != RN_BOOTLOADER_STATUS_SUCCESS) {
+        fprintf(stderr, "Failed to write block.\n");
         return -1;
+    } else if (op->progress == op->length) {
+        return 1;
     }
     
+    return rn_bootloader_write_next(op);
+}
+
+int rn_bootloader_write_async (struct serial_port *port, uint32_t address,
+                               uint16_t length, uint8_t *data,
+                               struct rn_bootloader_rsp_version *version,
+                               rn_bootloader_cb callback, void *context)
+{
+    struct rn_bootloader_op *op = rn_bootloader_op_new(port,
+                                                    rn_bootloader_write_step,
+                                                    callback, context);
+    
+    if (op == NULL) {
+        return -1;
+    }
+    
+    op->version = version;
+    op->address = address;
+    op->length = length;
+    op->data = data;
+    
+    if ((length == 0) || (rn_bootloader_write_next(op) != 0)) {
+        free(op);
+        return -1;
+    }
+    
+    return 0;
+}
+
+int rn_bootloader_write (struct serial_port *port, uint32_t address,
+                         uint16_t length, uint8_t *data,
+                         struct rn_bootloader_rsp_version *version)
+{
+    struct rn_bootloader_sync sync = { 0, 0 };
+    
+    if (rn_bootloader_write_async(port, address, length, data, version,
+                                  rn_bootloader_sync_done, &sync) != 0) {
+        return -1;
+    }
+    
+    return rn_bootloader_sync_wait(port, &sync);
+}
+
+
+static int rn_bootloader_checksum_step (struct rn_bootloader_op *op)
+{
     /* Make sure that endianness of response data is correct */
-    *checksum = LE_TO_HOST_16(response.checksum);
+    *op->checksum_out = LE_TO_HOST_16(op->response.checksum.checksum);
+    
+    return 1;
+}
+
+int rn_bootloader_checksum_async (struct serial_port *port, uint32_t address,
+                                  uint16_t length, uint16_t *checksum,
+                                  rn_bootloader_cb callback, void *context)
+{
+    struct rn_bootloader_op *op = rn_bootloader_op_new(port,
+                                                rn_bootloader_checksum_step,
+                                                callback, context);
+    
+    if (op == NULL) {
+        return -1;
+    }
+    
+    op->checksum_out = checksum;
+    
+    int ret = rn_bootloader_do_command(op, RN_BOOTLOADER_CMD_CHECKSUM, length,
+                                       0, 0, address, NULL,
+                                       sizeof(struct rn_bootloader_rsp_checksum),
+                                       RN_BOOTLOADER_TIMEOUT);
+    
+    if (ret != 0) {
+        free(op);
+        return -1;
+    }
     
     return 0;
 }
 
+int rn_bootloader_checksum (struct serial_port *port, uint32_t address,
+                            uint16_t length, uint16_t *checksum)
+{
+    struct rn_bootloader_sync sync = { 0, 0 };
+    
+    if (rn_bootloader_checksum_async(port, address, length, checksum,
+                                     rn_bootloader_sync_done, &sync) != 0) {
+        return -1;
+    }
+    
+    return rn_bootloader_sync_wait(port, &sync);
+}
+
 uint16_t rn_bootloader_calc_checksum(uint8_t *data, uint8_t length)
 {
     uint16_t sum = 0;
-    for (uint8_t i = 0; i < length; i += 2) {
+    for (int i = 0; i < length; i += 2) {
         uint16_t n = 0;
         
         ((uint8_t*)&n)[0] = data[i];
@@ -299,14 +685,41 @@ uint16_t rn_bootloader_calc_config_checksum(uint8_t *data)
 }
 
 
-int rn_bootloader_reset (int fd)
+static int rn_bootloader_reset_step (struct rn_bootloader_op *op)
+{
+    (void)op;
+    return 1;
+}
+
+int rn_bootloader_reset_async (struct serial_port *port,
+                               rn_bootloader_cb callback, void *context)
 {
-    int ret = rn_bootloader_do_command(fd, RN_BOOTLOADER_CMD_RESET, 0,
-                                       0, 0, 0, NULL, NULL, 0);
+    struct rn_bootloader_op *op = rn_bootloader_op_new(port,
+                                                    rn_bootloader_reset_step,
+                                                    callback, context);
+    
+    if (op == NULL) {
+        return -1;
+    }
+    
+    int ret = rn_bootloader_do_command(op, RN_BOOTLOADER_CMD_RESET, 0, 0, 0, 0,
+                                       NULL, 0, 0);
     
     if (ret != 0) {
+        free(op);
         return -1;
     }
     
     return 0;
 }
+
+int rn_bootloader_reset (struct serial_port *port)
+{
+    struct rn_bootloader_sync sync = { 0, 0 };
+    
+    if (rn_bootloader_reset_async(port, rn_bootloader_sync_done, &sync) != 0) {
+        return -1;
+    }
+    
+    return rn_bootloader_sync_wait(port, &sync);
+}
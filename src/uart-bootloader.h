@@ -11,22 +11,57 @@
 
 #include <inttypes.h>
 
+#include "serial-port.h"
+
+/** Default time to wait for a response from the bootloader in milliseconds */
+#define RN_BOOTLOADER_TIMEOUT   1000
+/** Additional time allowed for each row erased by an erase command */
+#define RN_BOOTLOADER_ERASE_ROW_TIMEOUT 10
+
 
 struct rn_bootloader_rsp_version;
 
+/**
+ *  Callback for completion of an asynchronous bootloader operation.
+ *
+ *  @param port The port on which the operation was run
+ *  @param status 0 if the operation was successfull, -1 otherwise
+ *  @param context The context pointer given when the operation was started
+ */
+typedef void (*rn_bootloader_cb)(struct serial_port *port, int status,
+                                 void *context);
+
 /**
  *  Get version information from bootloader. The pointer provided by this
  *  function is malloced and must be freed by the caller.
  *
- *  @param fd File descriptor for serial connection to radio
+ *  @param port Serial connection to radio
  *  @param version Pointer to where pointer to version information should be
  *                 stored
  *
  *  @return 0 if successfull
  */
-extern int rn_bootloader_get_version_info (int fd,
+extern int rn_bootloader_get_version_info (struct serial_port *port,
                                     struct rn_bootloader_rsp_version **version);
 
+/**
+ *  Start getting version information from bootloader. The pointer provided by
+ *  this operation is malloced and must be freed by the caller.
+ *
+ *  @param port Serial connection to radio
+ *  @param version Pointer to where pointer to version information should be
+ *                 stored once the operation completes successfully
+ *  @param timeout Time to wait for a response in milliseconds
+ *  @param callback Function to be called when the operation completes
+ *  @param context Pointer to be passed to callback
+ *
+ *  @return 0 if the operation was started
+ */
+extern int rn_bootloader_get_version_info_async (struct serial_port *port,
+                                    struct rn_bootloader_rsp_version **version,
+                                    long timeout, rn_bootloader_cb callback,
+                                    void *context);
+
 /**
  *  Get the version number of the bootloader.
  *
@@ -57,6 +92,16 @@ extern int rn_bootloader_get_device_id (
 extern int rn_bootloader_get_write_size (
                                     struct rn_bootloader_rsp_version *version);
 
+/**
+ *  Get the erase row size of the bootloader.
+ *
+ *  @param version Pointer to bootloaders version information
+ *
+ *  @return The bootloader's erase row size
+ */
+extern int rn_bootloader_get_erase_size (
+                                    struct rn_bootloader_rsp_version *version);
+
 
 /**
  *  Erase a section of memory on the radio module.
@@ -64,20 +109,39 @@ extern int rn_bootloader_get_write_size (
  *  @note The length should be a multiple of the bootloader's erase row size
  *        (usually 64)
  *
- *  @param fd File descriptor for serial connection to radio
+ *  @param port Serial connection to radio
  *  @param start_address Begining of section to be erased
  *  @param length The length of the section to be erased
  *  @param version Pointer to bootloaders version information
  *
  *  @return 0 if successfull
  */
-extern int rn_bootloader_erase (int fd, uint32_t start_address, uint16_t length,
+extern int rn_bootloader_erase (struct serial_port *port,
+                                uint32_t start_address, uint16_t length,
                                 struct rn_bootloader_rsp_version *version);
 
+/**
+ *  Start erasing a section of memory on the radio module.
+ *
+ *  @param port Serial connection to radio
+ *  @param start_address Begining of section to be erased
+ *  @param length The length of the section to be erased
+ *  @param version Pointer to bootloaders version information
+ *  @param callback Function to be called when the operation completes
+ *  @param context Pointer to be passed to callback
+ *
+ *  @return 0 if the operation was started
+ */
+extern int rn_bootloader_erase_async (struct serial_port *port,
+                                      uint32_t start_address, uint16_t length,
+                                      struct rn_bootloader_rsp_version *version,
+                                      rn_bootloader_cb callback,
+                                      void *context);
+
 /**
  *  Write data to radio module.
  *
- *  @param fd File descriptor for serial connection to radio
+ *  @param port Serial connection to radio
  *  @param address Address where data should be written
  *  @param length The number of bytes to be written
  *  @param data Pointer to the data to be written
@@ -85,22 +149,61 @@ extern int rn_bootloader_erase (int fd, uint32_t start_address, uint16_t length,
  *
  *  @return 0 if successfull
  */
-extern int rn_bootloader_write (int fd, uint32_t address, uint16_t length,
-                                uint8_t *data,
+extern int rn_bootloader_write (struct serial_port *port, uint32_t address,
+                                uint16_t length, uint8_t *data,
                                 struct rn_bootloader_rsp_version *version);
 
+/**
+ *  Start writing data to radio module. The data must remain valid until the
+ *  operation completes.
+ *
+ *  @param port Serial connection to radio
+ *  @param address Address where data should be written
+ *  @param length The number of bytes to be written
+ *  @param data Pointer to the data to be written
+ *  @param version Pointer to bootloaders version information
+ *  @param callback Function to be called when the operation completes
+ *  @param context Pointer to be passed to callback
+ *
+ *  @return 0 if the operation was started
+ */
+extern int rn_bootloader_write_async (struct serial_port *port,
+                                      uint32_t address, uint16_t length,
+                                      uint8_t *data,
+                                      struct rn_bootloader_rsp_version *version,
+                                      rn_bootloader_cb callback,
+                                      void *context);
+
 /**
  *  Get checksum for data in radio module.
  *
- *  @param fd File descriptor for serial connection to radio
+ *  @param port Serial connection to radio
  *  @param address Address of data to be checksummed
  *  @param length The number of bytes to be checksummed
  *  @param checksum Pointer to where checksum will be stored
  *
  *  @return 0 if successfull
  */
-extern int rn_bootloader_checksum (int fd, uint32_t address, uint16_t length,
-                                   uint16_t *checksum);
+extern int rn_bootloader_checksum (struct serial_port *port, uint32_t address,
+                                   uint16_t length, uint16_t *checksum);
+
+/**
+ *  Start getting checksum for data in radio module.
+ *
+ *  @param port Serial connection to radio
+ *  @param address Address of data to be checksummed
+ *  @param length The number of bytes to be checksummed
+ *  @param checksum Pointer to where checksum will be stored
+ *  @param callback Function to be called when the operation completes
+ *  @param context Pointer to be passed to callback
+ *
+ *  @return 0 if the operation was started
+ */
+extern int rn_bootloader_checksum_async (struct serial_port *port,
+                                         uint32_t address, uint16_t length,
+                                         uint16_t *checksum,
+                                         rn_bootloader_cb callback,
+                                         void *context);
 
 /**
  *  Calculate checksum.
@@ -125,10 +228,24 @@ extern uint16_t rn_bootloader_calc_config_checksum(uint8_t *data);
 /**
  *  Reset the module.
  *
- *  @param fd File descriptor for serial connection to radio
+ *  @param port Serial connection to radio
  *
  *  @return 0 if successfull
  */
-extern int rn_bootloader_reset (int fd);
+extern int rn_bootloader_reset (struct serial_port *port);
+
+/**
+ *  Start resetting the module. The operation completes once the command has
+ *  been written to the port.
+ *
+ *  @param port Serial connection to radio
+ *  @param callback Function to be called when the operation completes
+ *  @param context Pointer to be passed to callback
+ *
+ *  @return 0 if the operation was started
+ */
+extern int rn_bootloader_reset_async (struct serial_port *port,
+                                      rn_bootloader_cb callback,
+                                      void *context);
 
 #endif /* uart_bootloader_h */
@@ -0,0 +1,187 @@
+//
+//  verify-plan.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#include "verify-plan.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "uart-bootloader.h"
+
+/** Address of the configuration row, which is checksummed with masks */
+#define VERIFY_CONFIG_ADDRESS   0x300000
+#define VERIFY_CONFIG_LENGTH    14
+
+
+/**
+ *  Check whether a record lies entirely within the application area.
+ */
+static int verify_plan_in_app (uint32_t address, uint8_t length)
+{
+    return (address >= VERIFY_APP_START) &&
+                ((address + length) <= VERIFY_APP_END);
+}
+
+/**
+ *  Calculate the checksum that the bootloader should report for a range of
+ *  the application area.
+ */
+static uint16_t verify_plan_sum (struct verify_plan *plan, uint32_t address,
+                                 uint16_t length)
+{
+    uint16_t sum = 0;
+    for (uint32_t i = 0; i < length; i += 2) {
+        uint8_t high = ((i + 1) < length) ? plan->flash[address + i + 1] : 0xFF;
+        sum += (uint16_t)(plan->flash[address + i] | (high << 8));
+    }
+    return sum;
+}
+
+/**
+ *  Add a range to a plan.
+ *
+ *  @return 0 if successfull
+ */
+static int verify_plan_add (struct verify_plan *plan, int *capacity,
+                            const struct verify_range *range)
+{
+    if (plan->num_ranges == *capacity) {
+        *capacity = (*capacity == 0) ? 16 : (*capacity * 2);
+        struct verify_range *ranges = realloc(plan->ranges,
+                                    (size_t)*capacity * sizeof(*ranges));
+        if (ranges == NULL) {
+            fprintf(stderr, "Could not allocate memory for verification.\n");
+            return -1;
+        }
+        plan->ranges = ranges;
+    }
+    
+    plan->ranges[plan->num_ranges++] = *range;
+    return 0;
+}
+
+
+int verify_plan_init (struct intel_hex_file *hex, struct verify_plan **plan)
+{
+    struct verify_plan *p = calloc(1, sizeof(struct verify_plan));
+    if ((p == NULL) || ((p->flash = malloc(VERIFY_APP_END)) == NULL)) {
+        fprintf(stderr, "Could not allocate memory for verification.\n");
+        free(p);
+        return -1;
+    }
+    memset(p->flash, 0xFF, VERIFY_APP_END);
+    
+    int capacity = 0;
+    uint32_t start = VERIFY_APP_END;
+    uint32_t end = 0;
+    
+    /* Lay out the application area, other records are checked one by one */
+    struct intel_hex_record *record = intel_hex_get_first_record(hex);
+    while (record != NULL) {
+        uint8_t *data;
+        uint32_t address;
+        uint8_t length;
+        record = intel_hex_get_next_record(record, &data, &address, &length);
+        
+        if (verify_plan_in_app(address, length)) {
+            memcpy(p->flash + address, data, length);
+            if (address < start) {
+                start = address;
+            }
+            if ((address + length) > end) {
+                end = address + length;
+            }
+            continue;
+        }
+        
+        struct verify_range range = {
+            .address = address,
+            .length = length,
+            .whole_record = 1
+        };
+        if (address == VERIFY_CONFIG_ADDRESS) {
+            // Configuration row is handled specially because masks need to
+            // be applied
+            if (length != VERIFY_CONFIG_LENGTH) {
+                fprintf(stderr, "Configuration row has unexpected length "
+                        "%d.\n", length);
+                verify_plan_free(p);
+                return -1;
+            }
+            range.checksum = rn_bootloader_calc_config_checksum(data);
+        } else {
+            range.checksum = rn_bootloader_calc_checksum(data, length);
+        }
+        
+        if (verify_plan_add(p, &capacity, &range) != 0) {
+            verify_plan_free(p);
+            return -1;
+        }
+    }
+    
+    /* Cover the application area with as few ranges as possible, starting
+       and ending on row boundaries */
+    start -= start % VERIFY_ROW_LENGTH;
+    end += (VERIFY_ROW_LENGTH - (end % VERIFY_ROW_LENGTH)) % VERIFY_ROW_LENGTH;
+    
+    for (uint32_t address = start; address < end;
+         address += VERIFY_RANGE_LENGTH) {
+        uint32_t length = end - address;
+        if (length > VERIFY_RANGE_LENGTH) {
+            length = VERIFY_RANGE_LENGTH;
+        }
+        
+        struct verify_range range = {
+            .address = address,
+            .length = (uint16_t)length,
+            .checksum = verify_plan_sum(p, address, (uint16_t)length)
+        };
+        if (verify_plan_add(p, &capacity, &range) != 0) {
+            verify_plan_free(p);
+            return -1;
+        }
+    }
+    
+    *plan = p;
+    return 0;
+}
+
+void verify_plan_free (struct verify_plan *plan)
+{
+    free(plan->ranges);
+    free(plan->flash);
+    free(plan);
+}
+
+int verify_plan_split (struct verify_plan *plan,
+                       const struct verify_range *range,
+                       struct verify_range *first, struct verify_range *second)
+{
+    if (range->whole_record || (range->length <= VERIFY_ROW_LENGTH)) {
+        return -1;
+    }
+    
+    uint16_t half = (uint16_t)(range->length / 2);
+    half -= half % VERIFY_ROW_LENGTH;
+    if (half == 0) {
+        half = VERIFY_ROW_LENGTH;
+    }
+    
+    first->address = range->address;
+    first->length = half;
+    first->checksum = verify_plan_sum(plan, first->address, first->length);
+    first->whole_record = 0;
+    
+    second->address = range->address + half;
+    second->length = (uint16_t)(range->length - half);
+    second->checksum = verify_plan_sum(plan, second->address, second->length);
+    second->whole_record = 0;
+    
+    return 0;
+}
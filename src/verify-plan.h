@@ -0,0 +1,88 @@
+//
+//  verify-plan.h
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+
+#ifndef verify_plan_h
+#define verify_plan_h
+
+#include <inttypes.h>
+
+#include "intel-hex.h"
+
+/** First address of the application area of flash */
+#define VERIFY_APP_START    0x300
+/** End of the application area of flash */
+#define VERIFY_APP_END      0x10000
+/** Maximum length of the range covered by a single checksum */
+#define VERIFY_RANGE_LENGTH 0x4000
+/** Smallest range that a mismatch is narrowed down to, one row of flash */
+#define VERIFY_ROW_LENGTH   64
+
+/**
+ *  A range of flash to be checksummed.
+ */
+struct verify_range {
+    uint32_t address;
+    uint16_t length;
+    /** Checksum that the bootloader should report for the range */
+    uint16_t checksum;
+    /** Set if the range is a record outside of the application area, which
+        can not be split up */
+    int whole_record;
+};
+
+/**
+ *  The checksums needed to compare the flash of a module with an image.
+ */
+struct verify_plan {
+    /** Expected contents of the application area, unprogrammed bytes are
+        0xFF because the area is erased before it is written */
+    uint8_t *flash;
+    
+    struct verify_range *ranges;
+    int num_ranges;
+};
+
+/**
+ *  Work out which checksums to ask for to compare flash with an image. The
+ *  application area is covered by a few large ranges, since the bootloader's
+ *  checksum is a sum of words the checksum for a range can be worked out
+ *  from the image even where it spans gaps between records. Records outside
+ *  of the application area each get their own range.
+ *
+ *  @param hex The image
+ *  @param plan Pointer to where pointer to new plan should be stored
+ *
+ *  @return 0 if successfull
+ */
+extern int verify_plan_init (struct intel_hex_file *hex,
+                             struct verify_plan **plan);
+
+/**
+ *  Free a verification plan.
+ *
+ *  @param plan The plan to be freed
+ */
+extern void verify_plan_free (struct verify_plan *plan);
+
+/**
+ *  Split a range of the application area which did not match into two halves
+ *  along a row boundary.
+ *
+ *  @param plan The plan
+ *  @param range The range to be split
+ *  @param first Pointer to where the first half should be stored
+ *  @param second Pointer to where the second half should be stored
+ *
+ *  @return 0 if the range was split, -1 if it can not be split any further
+ */
+extern int verify_plan_split (struct verify_plan *plan,
+                              const struct verify_range *range,
+                              struct verify_range *first,
+                              struct verify_range *second);
+
+#endif /* verify_plan_h */
@@ -0,0 +1,153 @@
+#!/bin/sh
+#
+#  bench-e2e.sh
+#  rn2483-loader
+#
+#  Created by Samuel Dewan on 2026-10-18.
+#  Copyright © 2026 Samuel Dewan.
+#
+#  End to end benchmark of a full update. The loader is run against the
+#  simulator for every combination of baud rate, turnaround latency, image size
+#  and image layout, and one JSON object is printed for each run.
+#
+#  Usage: bench-e2e.sh [objdir]
+#
+#  The matrix can be changed with these environment variables:
+#      BENCH_BAUDS      baud rates (default "57600 230400")
+#      BENCH_LATENCIES  module turnaround times in microseconds
+#                       (default "500 5000")
+#      BENCH_SIZES      bytes of data in each image (default "8192 32768")
+#      BENCH_LAYOUTS    any of dense, sparse and small (default all three)
+#      BENCH_OUT        file the results are also written to
+#                       (default objdir/bench-e2e.jsonl)
+#
+
+OBJDIR=${1:-obj}
+LOADER=$OBJDIR/rn2483_loader
+SIM=$OBJDIR/rn2483-sim
+
+BAUDS=${BENCH_BAUDS:-"57600 230400"}
+LATENCIES=${BENCH_LATENCIES:-"500 5000"}
+SIZES=${BENCH_SIZES:-"8192 32768"}
+LAYOUTS=${BENCH_LAYOUTS:-"dense sparse small"}
+OUT=${BENCH_OUT:-$OBJDIR/bench-e2e.jsonl}
+
+if [ ! -x "$LOADER" ] || [ ! -x "$SIM" ]; then
+    echo "Build the loader and tools first (make build tools)" >&2
+    exit 1
+fi
+
+WORK=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+trap 'exit 1' INT TERM
+
+# Write an image with SIZE bytes of random data starting after the bootloader.
+#   dense   16 byte records, one after another
+#   sparse  16 byte records in 512 byte blocks, each followed by a 1536 byte gap
+#   small   4 byte records, one after another
+# Prints the number of bytes of data in the image.
+make_image () {
+    awk -v layout="$1" -v size="$2" -v path="$3" '
+        function record(address, type, data, count,    sum, line, i) {
+            sum = count + int(address / 256) + (address % 256) + type
+            line = sprintf(":%02X%04X%02X", count, address, type)
+            for (i = 0; i < count; i++) {
+                line = line sprintf("%02X", data[i])
+                sum += data[i]
+            }
+            printf "%s%02X\r\n", line, (256 - (sum % 256)) % 256 > path
+        }
+        BEGIN {
+            srand(size)
+            record_length = (layout == "small") ? 4 : 16
+            block = (layout == "sparse") ? 512 : size
+            gap = (layout == "sparse") ? 1536 : 0
+
+            address = 768
+            written = 0
+            while (written < size) {
+                for (i = 0; (i < block) && (written < size);
+                        i += record_length) {
+                    for (j = 0; j < record_length; j++) {
+                        data[j] = int(rand() * 256)
+                    }
+                    record(address + i, 0, data, record_length)
+                    written += record_length
+                }
+                address += block + gap
+            }
+            record(0, 1, data, 0)
+            print written
+        }'
+}
+
+rm -f "$OUT"
+
+for layout in $LAYOUTS; do
+    for size in $SIZES; do
+        image=$WORK/$layout-$size.hex
+        payload=$(make_image "$layout" "$size" "$image")
+
+        for baud in $BAUDS; do
+            for latency in $LATENCIES; do
+                echo "$layout $size bytes, $baud baud, $latency us" >&2
+
+                rm -f "$WORK/pty" "$WORK/stats.json"
+                "$SIM" --link "$WORK/pty" --stats "$WORK/stats.json" \
+                    --latency "$latency" > /dev/null 2>&1 &
+                sim=$!
+                while [ ! -e "$WORK/pty" ]; do
+                    sleep 0.05
+                done
+
+                start=$(date +%s%N)
+                "$LOADER" -y -b "$baud" "$WORK/pty" "$image" \
+                    > "$WORK/loader.out" 2>&1
+                result=$?
+                end=$(date +%s%N)
+
+                kill "$sim"
+                wait "$sim"
+
+                if [ $result -ne 0 ]; then
+                    tail -n 5 "$WORK/loader.out" >&2
+                fi
+
+                awk -v layout="$layout" -v size="$size" -v baud="$baud" \
+                    -v latency="$latency" -v payload="$payload" \
+                    -v result="$result" -v start="$start" -v end="$end" '
+                    {
+                        # Flat object from the simulator, pull out the numbers
+                        gsub(/[{}"]/, "")
+                        n = split($0, members, ",")
+                        for (i = 1; i <= n; i++) {
+                            split(members[i], kv, ":")
+                            stats[kv[1]] = kv[2]
+                        }
+                    }
+                    END {
+                        seconds = (end - start) / 1e9
+                        commands = stats["app_commands"] + \
+                                   stats["get_version"] + stats["write"] + \
+                                   stats["erase"] + stats["checksum"] + \
+                                   stats["reset"]
+                        wire = stats["bytes_in"] + stats["bytes_out"]
+                        # 8N1 framing, 10 bits per byte
+                        link = baud / 10
+                        printf "{\"layout\":\"%s\",\"size\":%d," \
+                               "\"baud\":%d,\"latency_us\":%d," \
+                               "\"ok\":%s,\"seconds\":%.3f," \
+                               "\"commands\":%d,\"payload_bytes\":%d," \
+                               "\"bytes_tx\":%d,\"bytes_rx\":%d," \
+                               "\"payload_fraction\":%.4f," \
+                               "\"wire_fraction\":%.4f}\n",
+                            layout, size, baud, latency,
+                            (result == 0) ? "true" : "false", seconds,
+                            commands, payload, stats["bytes_in"],
+                            stats["bytes_out"],
+                            payload / seconds / link, wire / seconds / link
+                    }' "$WORK/stats.json" | tee -a "$OUT"
+            done
+        done
+    done
+done
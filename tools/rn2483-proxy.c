@@ -0,0 +1,645 @@
+//
+//  rn2483-proxy.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+//  Proxy which sits between the loader and a serial port, real or simulated.
+//  A pseudo terminal is created for the loader and everything passed through
+//  it can be delayed, throttled, dropped, corrupted or stalled to mimic a bad
+//  adapter. Faults are driven by a seeded random number generator so that a
+//  run can be repeated exactly.
+//
+
+#define _XOPEN_SOURCE 700
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <signal.h>
+#include <getopt.h>
+#include <termios.h>
+#include <inttypes.h>
+
+/** Number of bytes which can be held in each direction */
+#define PROXY_QUEUE_LENGTH  65536
+
+enum proxy_dir {
+    /** From the loader to the module */
+    PROXY_DIR_TX,
+    /** From the module to the loader */
+    PROXY_DIR_RX,
+    PROXY_NUM_DIRS
+};
+
+/**
+ *  Faults injected in one direction.
+ */
+struct proxy_faults {
+    /** Time that each byte is held for in microseconds */
+    long latency_us;
+    /** Random extra time that each chunk is held for, up to this long */
+    long jitter_us;
+    /** Maximum throughput in bytes per second, 0 for no limit */
+    long rate;
+    /** Probability that each byte is lost */
+    double drop;
+    /** Probability that each byte has a bit flipped */
+    double corrupt;
+    /** Probability that each chunk of data stalls the direction */
+    double stall;
+    /** How long a stall lasts in microseconds */
+    long stall_us;
+};
+
+struct proxy_stats {
+    unsigned long bytes;
+    unsigned long dropped;
+    unsigned long corrupted;
+    unsigned long stalls;
+};
+
+struct proxy_byte {
+    /* Time at which the byte should be passed on, in microseconds */
+    uint64_t due;
+    uint8_t value;
+};
+
+/**
+ *  Bytes travelling in one direction.
+ */
+struct proxy_queue {
+    struct proxy_faults faults;
+    struct proxy_stats stats;
+    
+    /** Where bytes are read from and written to */
+    int in;
+    int out;
+    
+    struct proxy_byte bytes[PROXY_QUEUE_LENGTH];
+    size_t head;
+    size_t count;
+    
+    /** Time at which the last byte in the queue is due */
+    uint64_t last_due;
+    /** Time until which the direction is stalled */
+    uint64_t stalled_until;
+};
+
+struct proxy {
+    const char *port;
+    const char *link;
+    const char *stats;
+    uint64_t seed;
+    
+    int master;
+    int slave;
+    int device;
+    /** Speed last copied from the pty to the device */
+    speed_t speed;
+    
+    /** State of the random number generator */
+    uint64_t random;
+    
+    struct proxy_queue queues[PROXY_NUM_DIRS];
+};
+
+static volatile sig_atomic_t proxy_stop = 0;
+
+static const char *const proxy_dir_names[] = {
+    [PROXY_DIR_TX] = "tx",
+    [PROXY_DIR_RX] = "rx"
+};
+
+static struct option longopts[] = {
+    { "link", required_argument, NULL, 'l' },
+    { "seed", required_argument, NULL, 'S' },
+    { "direction", required_argument, NULL, 'd' },
+    { "latency", required_argument, NULL, 't' },
+    { "jitter", required_argument, NULL, 'j' },
+    { "rate", required_argument, NULL, 'r' },
+    { "drop", required_argument, NULL, 'x' },
+    { "corrupt", required_argument, NULL, 'c' },
+    { "stall", required_argument, NULL, 'a' },
+    { "stall-time", required_argument, NULL, 'A' },
+    { "stats", required_argument, NULL, 's' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+};
+
+static void handle_signal (int signal)
+{
+    (void)signal;
+    proxy_stop = 1;
+}
+
+/**
+ *  Get the current time from the monotonic clock in microseconds.
+ */
+static uint64_t now_us (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * UINT64_C(1000000)) +
+                (uint64_t)(ts.tv_nsec / 1000);
+}
+
+/**
+ *  Get the next number from the proxy's random number generator
+ *  (xorshift64*).
+ */
+static uint64_t proxy_random (struct proxy *proxy)
+{
+    proxy->random ^= proxy->random >> 12;
+    proxy->random ^= proxy->random << 25;
+    proxy->random ^= proxy->random >> 27;
+    return proxy->random * UINT64_C(0x2545F4914F6CDD1D);
+}
+
+/**
+ *  Decide whether something with a given probability happens.
+ */
+static int proxy_chance (struct proxy *proxy, double probability)
+{
+    if (probability <= 0) {
+        return 0;
+    }
+    // 53 random bits make a double in [0, 1)
+    double r = (double)(proxy_random(proxy) >> 11) / 9007199254740992.0;
+    return r < probability;
+}
+
+/**
+ *  Add a chunk of data to the queue for a direction, applying its faults.
+ *
+ *  @param proxy The proxy
+ *  @param queue The queue for the direction that the data is travelling in
+ *  @param data The data
+ *  @param length The length of the data
+ */
+static void proxy_enqueue (struct proxy *proxy, struct proxy_queue *queue,
+                           const uint8_t *data, size_t length)
+{
+    struct proxy_faults *faults = &queue->faults;
+    uint64_t now = now_us();
+    
+    if (proxy_chance(proxy, faults->stall)) {
+        queue->stalled_until = now + (uint64_t)faults->stall_us;
+        queue->stats.stalls++;
+    }
+    
+    uint64_t due = now + (uint64_t)faults->latency_us;
+    if (faults->jitter_us > 0) {
+        due += proxy_random(proxy) % (uint64_t)(faults->jitter_us + 1);
+    }
+    
+    for (size_t i = 0; i < length; i++) {
+        queue->stats.bytes++;
+        
+        if (proxy_chance(proxy, faults->drop)) {
+            queue->stats.dropped++;
+            continue;
+        }
+        
+        if (queue->count == PROXY_QUEUE_LENGTH) {
+            // A real adapter would overflow as well
+            queue->stats.dropped++;
+            continue;
+        }
+        
+        uint8_t value = data[i];
+        if (proxy_chance(proxy, faults->corrupt)) {
+            value ^= (uint8_t)(1 << (proxy_random(proxy) % 8));
+            queue->stats.corrupted++;
+        }
+        
+        /* Bytes leave in the order that they arrived */
+        uint64_t byte_due = due;
+        if (byte_due < queue->stalled_until) {
+            byte_due = queue->stalled_until;
+        }
+        if ((faults->rate > 0) && (byte_due < (queue->last_due +
+                                    (uint64_t)(1000000 / faults->rate)))) {
+            byte_due = queue->last_due + (uint64_t)(1000000 / faults->rate);
+        }
+        if (byte_due < queue->last_due) {
+            byte_due = queue->last_due;
+        }
+        
+        size_t tail = (queue->head + queue->count) % PROXY_QUEUE_LENGTH;
+        queue->bytes[tail].due = byte_due;
+        queue->bytes[tail].value = value;
+        queue->count++;
+        queue->last_due = byte_due;
+    }
+}
+
+/**
+ *  Pass on the bytes in a queue which are due.
+ *
+ *  @param queue The queue
+ *  @param now The current time
+ *
+ *  @return Time until the next byte is due in milliseconds, or -1 if the
+ *          queue is empty
+ */
+static long proxy_flush (struct proxy_queue *queue, uint64_t now)
+{
+    uint8_t buffer[512];
+    
+    while (queue->count != 0) {
+        size_t n = 0;
+        while ((n < queue->count) && (n < sizeof(buffer))) {
+            struct proxy_byte *b =
+                        &queue->bytes[(queue->head + n) % PROXY_QUEUE_LENGTH];
+            if (b->due > now) {
+                break;
+            }
+            buffer[n++] = b->value;
+        }
+        
+        if (n == 0) {
+            uint64_t due = queue->bytes[queue->head].due;
+            return (long)((due - now + 999) / 1000);
+        }
+        
+        ssize_t written = write(queue->out, buffer, n);
+        if (written <= 0) {
+            // Try again when the loop next comes around
+            return 1;
+        }
+        
+        queue->head = (queue->head + (size_t)written) % PROXY_QUEUE_LENGTH;
+        queue->count -= (size_t)written;
+    }
+    
+    return -1;
+}
+
+/**
+ *  Copy the baud rate that the loader has set on the pty to the device, so
+ *  that a real module or a simulator sees the same rate.
+ */
+static void proxy_sync_speed (struct proxy *proxy)
+{
+    struct termios term;
+    
+    if (tcgetattr(proxy->slave, &term) != 0) {
+        return;
+    }
+    
+    speed_t speed = cfgetospeed(&term);
+    if (speed == proxy->speed) {
+        return;
+    }
+    proxy->speed = speed;
+    
+    if (tcgetattr(proxy->device, &term) == 0) {
+        cfsetospeed(&term, speed);
+        cfsetispeed(&term, speed);
+        tcsetattr(proxy->device, TCSANOW, &term);
+    }
+}
+
+/**
+ *  Open the port that the proxy forwards to.
+ *
+ *  @return 0 if successfull
+ */
+static int proxy_open_device (struct proxy *proxy)
+{
+    proxy->device = open(proxy->port, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    
+    if (proxy->device == -1) {
+        fprintf(stderr, "Could not open %s: %s.\n", proxy->port,
+                strerror(errno));
+        return -1;
+    }
+    
+    struct termios term;
+    if (tcgetattr(proxy->device, &term) == 0) {
+        cfmakeraw(&term);
+        cfsetospeed(&term, B57600);
+        cfsetispeed(&term, B57600);
+        tcsetattr(proxy->device, TCSANOW, &term);
+    }
+    proxy->speed = B57600;
+    
+    return 0;
+}
+
+/**
+ *  Create the pseudo terminal for the loader.
+ *
+ *  @return 0 if successfull
+ */
+static int proxy_open_pty (struct proxy *proxy)
+{
+    proxy->master = posix_openpt(O_RDWR | O_NOCTTY);
+    
+    if ((proxy->master == -1) || (grantpt(proxy->master) != 0) ||
+            (unlockpt(proxy->master) != 0)) {
+        fprintf(stderr, "Could not create pty: %s.\n", strerror(errno));
+        return -1;
+    }
+    
+    const char *name = ptsname(proxy->master);
+    
+    // Keep the slave open so that the master does not see a hangup when the
+    // loader closes the port, and make it raw until the loader configures it
+    proxy->slave = open(name, O_RDWR | O_NOCTTY);
+    if (proxy->slave == -1) {
+        fprintf(stderr, "Could not open %s: %s.\n", name, strerror(errno));
+        return -1;
+    }
+    
+    struct termios term;
+    tcgetattr(proxy->slave, &term);
+    cfmakeraw(&term);
+    cfsetospeed(&term, B57600);
+    cfsetispeed(&term, B57600);
+    tcsetattr(proxy->slave, TCSANOW, &term);
+    
+    fcntl(proxy->master, F_SETFL, fcntl(proxy->master, F_GETFL) | O_NONBLOCK);
+    
+    if (proxy->link != NULL) {
+        unlink(proxy->link);
+        if (symlink(name, proxy->link) != 0) {
+            fprintf(stderr, "Could not create link %s: %s.\n", proxy->link,
+                    strerror(errno));
+            return -1;
+        }
+    }
+    
+    printf("%s\n", name);
+    fflush(stdout);
+    
+    return 0;
+}
+
+/**
+ *  Write proxy statistics as JSON.
+ */
+static void proxy_write_stats (struct proxy *proxy, const char *path)
+{
+    FILE *f = fopen(path, "w");
+    
+    if (f == NULL) {
+        fprintf(stderr, "Could not open %s: %s.\n", path, strerror(errno));
+        return;
+    }
+    
+    fprintf(f, "{\"seed\":%" PRIu64, proxy->seed);
+    for (int i = 0; i < PROXY_NUM_DIRS; i++) {
+        struct proxy_stats *stats = &proxy->queues[i].stats;
+        fprintf(f, ",\"%s\":{\"bytes\":%lu,\"dropped\":%lu,\"corrupted\":%lu,"
+                   "\"stalls\":%lu}", proxy_dir_names[i], stats->bytes,
+                stats->dropped, stats->corrupted, stats->stalls);
+    }
+    fprintf(f, "}\n");
+    fclose(f);
+}
+
+/**
+ *  Run the proxy until it is signaled to stop or the device goes away.
+ *
+ *  @return 0 if the proxy was stopped by a signal
+ */
+static int proxy_run (struct proxy *proxy)
+{
+    struct pollfd pfds[PROXY_NUM_DIRS];
+    
+    while (!proxy_stop) {
+        uint64_t now = now_us();
+        long timeout = -1;
+        
+        proxy_sync_speed(proxy);
+        
+        /* Pass on anything which is due */
+        for (int i = 0; i < PROXY_NUM_DIRS; i++) {
+            long t = proxy_flush(&proxy->queues[i], now);
+            if ((t >= 0) && ((timeout < 0) || (t < timeout))) {
+                timeout = t;
+            }
+        }
+        
+        // The loader may change the baud rate at any time
+        if ((timeout < 0) || (timeout > 100)) {
+            timeout = 100;
+        }
+        
+        for (int i = 0; i < PROXY_NUM_DIRS; i++) {
+            pfds[i].fd = proxy->queues[i].in;
+            pfds[i].events = POLLIN;
+            pfds[i].revents = 0;
+        }
+        
+        if (poll(pfds, PROXY_NUM_DIRS, (int)timeout) <= 0) {
+            continue;
+        }
+        
+        for (int i = 0; i < PROXY_NUM_DIRS; i++) {
+            if (pfds[i].revents == 0) {
+                continue;
+            }
+            
+            uint8_t buffer[512];
+            ssize_t n = read(pfds[i].fd, buffer, sizeof(buffer));
+            
+            if (n > 0) {
+                proxy_enqueue(proxy, &proxy->queues[i], buffer, (size_t)n);
+            } else if ((pfds[i].fd == proxy->device) &&
+                       ((n == 0) || ((errno != EAGAIN) && (errno != EINTR)))) {
+                fprintf(stderr, "Lost connection to %s.\n", proxy->port);
+                return -1;
+            }
+        }
+    }
+    
+    return 0;
+}
+
+/**
+ *  Parse a numeric option value.
+ */
+static long parse_number (const char *str, const char *name)
+{
+    char *end;
+    long value = strtol(str, &end, 0);
+    
+    if ((*end != '\0') || (value < 0)) {
+        fprintf(stderr, "Invalid value for %s \"%s\"\n", name, str);
+        exit(1);
+    }
+    
+    return value;
+}
+
+/**
+ *  Parse a probability option value.
+ */
+static double parse_probability (const char *str, const char *name)
+{
+    char *end;
+    double value = strtod(str, &end);
+    
+    if ((*end != '\0') || !(value >= 0) || (value > 1)) {
+        fprintf(stderr, "Invalid probability for %s \"%s\"\n", name, str);
+        exit(1);
+    }
+    
+    return value;
+}
+
+int main (int argc, char *argv[])
+{
+    static struct proxy proxy;
+    
+    proxy.seed = (uint64_t)time(NULL);
+    
+    /* Options apply to both directions until --direction is given */
+    int first_dir = 0;
+    int last_dir = PROXY_NUM_DIRS - 1;
+    
+    int c;
+    while ((c = getopt_long(argc, argv, "hl:S:d:t:j:r:s:", longopts,
+                            NULL)) != -1) {
+        if ((c == 'l') || (c == 'S') || (c == 'd') || (c == 's') ||
+                (c == 'h') || (c == '?')) {
+            switch (c) {
+                case 'l':
+                    proxy.link = optarg;
+                    break;
+                case 'S':
+                    proxy.seed = (uint64_t)strtoull(optarg, NULL, 0);
+                    break;
+                case 'd':
+                    if (strcasecmp(optarg, "tx") == 0) {
+                        first_dir = last_dir = PROXY_DIR_TX;
+                    } else if (strcasecmp(optarg, "rx") == 0) {
+                        first_dir = last_dir = PROXY_DIR_RX;
+                    } else if (strcasecmp(optarg, "both") == 0) {
+                        first_dir = 0;
+                        last_dir = PROXY_NUM_DIRS - 1;
+                    } else {
+                        fprintf(stderr, "Unknown direction \"%s\"\n", optarg);
+                        return 1;
+                    }
+                    break;
+                case 's':
+                    proxy.stats = optarg;
+                    break;
+                case 'h':
+                    printf("Fault injection proxy for RN2483 serial "
+                           "sessions.\n"
+                           "Usage: rn2483-proxy [options] port\n"
+                           "  -l, --link PATH             create a symlink to "
+                           "the pty\n"
+                           "  -S, --seed N                seed for random "
+                           "faults\n"
+                           "  -d, --direction tx|rx|both  direction that "
+                           "following options\n"
+                           "                              apply to (tx is "
+                           "towards the module)\n"
+                           "  -t, --latency US            time each byte is "
+                           "held\n"
+                           "  -j, --jitter US             random extra time "
+                           "each chunk is held\n"
+                           "  -r, --rate BYTES            throughput limit "
+                           "per second\n"
+                           "      --drop P                probability of "
+                           "losing a byte\n"
+                           "      --corrupt P             probability of "
+                           "flipping a bit in a byte\n"
+                           "      --stall P               probability of a "
+                           "chunk stalling\n"
+                           "      --stall-time US         length of a "
+                           "stall\n"
+                           "  -s, --stats FILE            write statistics on "
+                           "exit\n");
+                    return 0;
+                default:
+                    return 1;
+            }
+            continue;
+        }
+        
+        for (int i = first_dir; i <= last_dir; i++) {
+            struct proxy_faults *faults = &proxy.queues[i].faults;
+            
+            switch (c) {
+                case 't':
+                    faults->latency_us = parse_number(optarg, "latency");
+                    break;
+                case 'j':
+                    faults->jitter_us = parse_number(optarg, "jitter");
+                    break;
+                case 'r':
+                    faults->rate = parse_number(optarg, "rate");
+                    break;
+                case 'x':
+                    faults->drop = parse_probability(optarg, "drop");
+                    break;
+                case 'c':
+                    faults->corrupt = parse_probability(optarg, "corrupt");
+                    break;
+                case 'a':
+                    faults->stall = parse_probability(optarg, "stall");
+                    break;
+                case 'A':
+                    faults->stall_us = parse_number(optarg, "stall time");
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    
+    if (optind != (argc - 1)) {
+        fprintf(stderr, "Expected a port to forward to\n");
+        return 1;
+    }
+    proxy.port = argv[optind];
+    
+    // xorshift needs a state which is not zero
+    proxy.random = proxy.seed ^ UINT64_C(0x9E3779B97F4A7C15);
+    if (proxy.random == 0) {
+        proxy.random = 1;
+    }
+    fprintf(stderr, "Seed: %" PRIu64 "\n", proxy.seed);
+    
+    if ((proxy_open_device(&proxy) != 0) || (proxy_open_pty(&proxy) != 0)) {
+        return 1;
+    }
+    
+    proxy.queues[PROXY_DIR_TX].in = proxy.master;
+    proxy.queues[PROXY_DIR_TX].out = proxy.device;
+    proxy.queues[PROXY_DIR_RX].in = proxy.device;
+    proxy.queues[PROXY_DIR_RX].out = proxy.master;
+    
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    
+    int ret = proxy_run(&proxy);
+    
+    if (proxy.stats != NULL) {
+        proxy_write_stats(&proxy, proxy.stats);
+    }
+    
+    if (proxy.link != NULL) {
+        unlink(proxy.link);
+    }
+    
+    return (ret == 0) ? 0 : 1;
+}
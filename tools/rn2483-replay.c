@@ -0,0 +1,647 @@
+//
+//  rn2483-replay.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+//  Plays back a capture made with the loader's --capture option. A pseudo
+//  terminal is created which expects the loader to send what was sent in the
+//  capture and answers with what was received, either with the original
+//  timing or as fast as possible.
+//
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <signal.h>
+#include <getopt.h>
+#include <termios.h>
+#include <inttypes.h>
+
+#include "capture.h"
+
+/** Time to wait for the loader to finish after the last record, in
+    microseconds */
+#define REPLAY_LINGER_TIME  500000
+
+struct replay_record {
+    enum capture_record type;
+    /* Time of the record from the start of the capture, in microseconds */
+    uint64_t time;
+    /* Time at which the record was completed during the replay */
+    uint64_t done_at;
+    size_t length;
+    const uint8_t *data;
+};
+
+struct replay_config {
+    const char *link;
+    const char *stats;
+    const char *port;
+    long timeout_ms;
+    int fast;
+    int dump;
+};
+
+struct replay {
+    struct replay_config config;
+    
+    /* Contents of the capture file */
+    uint8_t *capture;
+    size_t capture_length;
+    
+    struct replay_record *records;
+    size_t num_records;
+    
+    /* Next record to be sent to the loader */
+    size_t rx_index;
+    /* Next record expected from the loader and how much of it has arrived */
+    size_t tx_index;
+    size_t tx_offset;
+    
+    int master;
+    int slave;
+    
+    uint64_t start;
+    uint64_t last_progress;
+    
+    unsigned long bytes_in;
+    unsigned long bytes_out;
+    unsigned long mismatched;
+    unsigned long extra;
+    /* Offset in the data sent by the loader of the first mismatched byte */
+    long first_mismatch;
+    int stalled;
+};
+
+static volatile sig_atomic_t replay_stop = 0;
+
+static const struct option longopts[] = {
+    { "link", required_argument, NULL, 'l' },
+    { "port", required_argument, NULL, 'p' },
+    { "fast", no_argument, NULL, 'f' },
+    { "timeout", required_argument, NULL, 't' },
+    { "dump", no_argument, NULL, 'd' },
+    { "stats", required_argument, NULL, 's' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+};
+
+static void handle_signal (int signal)
+{
+    (void)signal;
+    replay_stop = 1;
+}
+
+/**
+ *  Get the current time from the monotonic clock in microseconds.
+ */
+static uint64_t now_us (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * UINT64_C(1000000)) +
+                (uint64_t)(ts.tv_nsec / 1000);
+}
+
+/**
+ *  Read a varint from the capture.
+ *
+ *  @param replay The replay
+ *  @param offset Offset of the varint, advanced past it
+ *  @param value Pointer to where the value should be stored
+ *
+ *  @return 0 if successfull
+ */
+static int replay_read_varint (struct replay *replay, size_t *offset,
+                               uint64_t *value)
+{
+    *value = 0;
+    
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (*offset >= replay->capture_length) {
+            return -1;
+        }
+        uint8_t byte = replay->capture[(*offset)++];
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return 0;
+        }
+    }
+    
+    return -1;
+}
+
+/**
+ *  Load the records for one port from a capture file.
+ *
+ *  @return 0 if successfull
+ */
+static int replay_load (struct replay *replay, const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    
+    if (f == NULL) {
+        fprintf(stderr, "Could not open %s: %s.\n", path, strerror(errno));
+        return -1;
+    }
+    
+    size_t capacity = 0;
+    for (;;) {
+        if (replay->capture_length == capacity) {
+            capacity = (capacity == 0) ? 65536 : (capacity * 2);
+            uint8_t *capture = realloc(replay->capture, capacity);
+            if (capture == NULL) {
+                fprintf(stderr, "Could not allocate memory for capture.\n");
+                fclose(f);
+                return -1;
+            }
+            replay->capture = capture;
+        }
+        size_t n = fread(replay->capture + replay->capture_length, 1,
+                         capacity - replay->capture_length, f);
+        if (n == 0) {
+            break;
+        }
+        replay->capture_length += n;
+    }
+    fclose(f);
+    
+    if ((replay->capture_length < CAPTURE_MAGIC_LENGTH) ||
+            (memcmp(replay->capture, CAPTURE_MAGIC,
+                    CAPTURE_MAGIC_LENGTH) != 0)) {
+        fprintf(stderr, "%s is not a capture.\n", path);
+        return -1;
+    }
+    
+    size_t offset = CAPTURE_MAGIC_LENGTH;
+    uint64_t time = 0;
+    int selected = -1;
+    size_t records_capacity = 0;
+    
+    while (offset < replay->capture_length) {
+        uint64_t delta, length;
+        
+        if ((offset + 2) > replay->capture_length) {
+            break;
+        }
+        uint8_t type = replay->capture[offset++];
+        int port = replay->capture[offset++];
+        
+        if ((replay_read_varint(replay, &offset, &delta) != 0) ||
+                (replay_read_varint(replay, &offset, &length) != 0) ||
+                (length > (replay->capture_length - offset))) {
+            // A capture cut short by a crash is still worth replaying
+            fprintf(stderr, "Capture is truncated.\n");
+            break;
+        }
+        
+        const uint8_t *data = replay->capture + offset;
+        offset += (size_t)length;
+        time += delta;
+        
+        if (type == CAPTURE_RECORD_PORT) {
+            if ((selected == -1) && ((replay->config.port == NULL) ||
+                    ((strlen(replay->config.port) == length) &&
+                     (memcmp(replay->config.port, data, length) == 0)))) {
+                selected = port;
+                printf("Replaying %.*s\n", (int)length, (const char *)data);
+            }
+            continue;
+        } else if ((port != selected) || (length == 0)) {
+            continue;
+        }
+        
+        if (replay->num_records == records_capacity) {
+            records_capacity = (records_capacity == 0) ? 1024 :
+                                    (records_capacity * 2);
+            struct replay_record *records = realloc(replay->records,
+                                records_capacity * sizeof(*records));
+            if (records == NULL) {
+                fprintf(stderr, "Could not allocate memory for capture.\n");
+                return -1;
+            }
+            replay->records = records;
+        }
+        
+        struct replay_record *record = &replay->records[replay->num_records++];
+        record->type = (enum capture_record)type;
+        record->time = time;
+        record->done_at = 0;
+        record->length = (size_t)length;
+        record->data = data;
+    }
+    
+    if (selected == -1) {
+        if (replay->config.port != NULL) {
+            fprintf(stderr, "No data for %s in capture.\n",
+                    replay->config.port);
+        } else {
+            fprintf(stderr, "Capture is empty.\n");
+        }
+        return -1;
+    }
+    
+    return 0;
+}
+
+/**
+ *  Print the records being replayed.
+ */
+static void replay_dump (struct replay *replay)
+{
+    for (size_t i = 0; i < replay->num_records; i++) {
+        struct replay_record *record = &replay->records[i];
+        
+        printf("%10.3f %s %4zu ", (double)record->time / 1000.0,
+               (record->type == CAPTURE_RECORD_TX) ? ">" : "<",
+               record->length);
+        for (size_t j = 0; (j < record->length) && (j < 24); j++) {
+            printf("%02x", record->data[j]);
+        }
+        printf((record->length > 24) ? "...\n" : "\n");
+    }
+}
+
+/**
+ *  Write replay statistics as JSON.
+ */
+static void replay_write_stats (struct replay *replay, const char *path)
+{
+    FILE *f = fopen(path, "w");
+    
+    if (f == NULL) {
+        fprintf(stderr, "Could not open %s: %s.\n", path, strerror(errno));
+        return;
+    }
+    
+    uint64_t capture_time = 0;
+    uint64_t replay_time = 0;
+    if (replay->num_records != 0) {
+        capture_time = replay->records[replay->num_records - 1].time -
+                            replay->records[0].time;
+    }
+    if (replay->start != 0) {
+        replay_time = replay->last_progress - replay->start;
+    }
+    
+    int complete = (replay->tx_index == replay->num_records) &&
+                        (replay->rx_index == replay->num_records);
+    
+    fprintf(f, "{\"records\":%zu,\"complete\":%s,\"stalled\":%s,"
+               "\"bytes_in\":%lu,\"bytes_out\":%lu,\"mismatched\":%lu,"
+               "\"first_mismatch\":%ld,\"extra\":%lu,"
+               "\"capture_time_us\":%" PRIu64 ",\"replay_time_us\":%" PRIu64
+               "}\n",
+            replay->num_records, complete ? "true" : "false",
+            replay->stalled ? "true" : "false", replay->bytes_in,
+            replay->bytes_out, replay->mismatched, replay->first_mismatch,
+            replay->extra, capture_time, replay_time);
+    fclose(f);
+}
+
+/**
+ *  Create the pseudo terminal for the replay.
+ *
+ *  @return 0 if successfull
+ */
+static int replay_open_pty (struct replay *replay)
+{
+    replay->master = posix_openpt(O_RDWR | O_NOCTTY);
+    
+    if ((replay->master == -1) || (grantpt(replay->master) != 0) ||
+            (unlockpt(replay->master) != 0)) {
+        fprintf(stderr, "Could not create pty: %s.\n", strerror(errno));
+        return -1;
+    }
+    
+    const char *name = ptsname(replay->master);
+    
+    // Keep the slave open so that the master does not see a hangup when the
+    // loader closes the port
+    replay->slave = open(name, O_RDWR | O_NOCTTY);
+    if (replay->slave == -1) {
+        fprintf(stderr, "Could not open %s: %s.\n", name, strerror(errno));
+        return -1;
+    }
+    
+    struct termios term;
+    tcgetattr(replay->slave, &term);
+    cfmakeraw(&term);
+    cfsetospeed(&term, B57600);
+    cfsetispeed(&term, B57600);
+    tcsetattr(replay->slave, TCSANOW, &term);
+    
+    if (replay->config.link != NULL) {
+        unlink(replay->config.link);
+        if (symlink(name, replay->config.link) != 0) {
+            fprintf(stderr, "Could not create link %s: %s.\n",
+                    replay->config.link, strerror(errno));
+            return -1;
+        }
+    }
+    
+    printf("%s\n", name);
+    fflush(stdout);
+    
+    return 0;
+}
+
+/**
+ *  Move the cursors past records which are not of the type they look for.
+ */
+static void replay_skip (struct replay *replay)
+{
+    while ((replay->tx_index < replay->num_records) &&
+            (replay->records[replay->tx_index].type != CAPTURE_RECORD_TX)) {
+        replay->tx_index++;
+    }
+    while ((replay->rx_index < replay->num_records) &&
+            (replay->records[replay->rx_index].type != CAPTURE_RECORD_RX)) {
+        replay->rx_index++;
+    }
+}
+
+/**
+ *  Get the time at which the next record for the loader should be sent.
+ *
+ *  @return The time in microseconds, or 0 if it can not be sent yet
+ */
+static uint64_t replay_rx_due (struct replay *replay)
+{
+    size_t i = replay->rx_index;
+    
+    // Everything that the loader sent before the record must have arrived
+    if ((replay->start == 0) || (replay->tx_index < i)) {
+        return 0;
+    }
+    if (i == 0) {
+        return replay->start;
+    }
+    
+    struct replay_record *prev = &replay->records[i - 1];
+    if (replay->config.fast) {
+        return prev->done_at;
+    }
+    return prev->done_at + (replay->records[i].time - prev->time);
+}
+
+/**
+ *  Handle data sent by the loader.
+ */
+static void replay_input (struct replay *replay, const uint8_t *data,
+                          size_t length, uint64_t now)
+{
+    if (replay->start == 0) {
+        replay->start = now;
+    }
+    
+    for (size_t i = 0; i < length; i++) {
+        if (replay->tx_index == replay->num_records) {
+            replay->extra++;
+            continue;
+        }
+        
+        struct replay_record *record = &replay->records[replay->tx_index];
+        
+        if (record->data[replay->tx_offset] != data[i]) {
+            if (replay->mismatched == 0) {
+                replay->first_mismatch = (long)(replay->bytes_in + i);
+            }
+            replay->mismatched++;
+        }
+        
+        if (++replay->tx_offset == record->length) {
+            record->done_at = now;
+            replay->tx_index++;
+            replay->tx_offset = 0;
+            replay->last_progress = now;
+            replay_skip(replay);
+        }
+    }
+    
+    replay->bytes_in += (unsigned long)length;
+}
+
+/**
+ *  Wait for data from the loader.
+ *
+ *  @param replay The replay
+ *  @param timeout How long to wait in microseconds
+ *
+ *  @return 1 if data is available, 0 on timeout
+ */
+static int replay_wait (struct replay *replay, uint64_t timeout)
+{
+    // Timing is kept to the microsecond, poll's millisecond timeout would add
+    // up to a millisecond to every response
+    struct timespec ts = {
+        .tv_sec = (time_t)(timeout / 1000000),
+        .tv_nsec = (long)(timeout % 1000000) * 1000
+    };
+    struct pollfd pfd = { .fd = replay->master, .events = POLLIN };
+    
+    return ppoll(&pfd, 1, &ts, NULL) > 0;
+}
+
+/**
+ *  Run the replay until every record has been played or the loader stops
+ *  sending what is expected.
+ */
+static void replay_run (struct replay *replay)
+{
+    replay->first_mismatch = -1;
+    replay_skip(replay);
+    
+    while (!replay_stop && ((replay->tx_index < replay->num_records) ||
+                            (replay->rx_index < replay->num_records))) {
+        uint64_t now = now_us();
+        uint64_t timeout = (uint64_t)replay->config.timeout_ms * 1000;
+        
+        /* Send the next record if it is due */
+        uint64_t due = 0;
+        if (replay->rx_index < replay->num_records) {
+            due = replay_rx_due(replay);
+        }
+        if ((due != 0) && (due <= now)) {
+            struct replay_record *record = &replay->records[replay->rx_index];
+            size_t written = 0;
+            
+            while (written < record->length) {
+                ssize_t n = write(replay->master, record->data + written,
+                                  record->length - written);
+                if (n > 0) {
+                    written += (size_t)n;
+                } else if ((n == -1) && (errno != EINTR)) {
+                    break;
+                }
+            }
+            
+            replay->bytes_out += (unsigned long)written;
+            record->done_at = now;
+            replay->last_progress = now;
+            replay->rx_index++;
+            replay_skip(replay);
+            continue;
+        } else if (due != 0) {
+            timeout = due - now;
+        }
+        
+        if (!replay_wait(replay, timeout)) {
+            if ((due == 0) && (replay->start != 0)) {
+                replay->stalled = 1;
+                fprintf(stderr, "Loader stopped sending after %lu bytes, "
+                        "%zu of %zu records replayed.\n", replay->bytes_in,
+                        (replay->tx_index < replay->rx_index) ?
+                            replay->tx_index : replay->rx_index,
+                        replay->num_records);
+                return;
+            }
+            continue;
+        }
+        
+        uint8_t buffer[512];
+        ssize_t n = read(replay->master, buffer, sizeof(buffer));
+        
+        if (n > 0) {
+            replay_input(replay, buffer, (size_t)n, now_us());
+        }
+    }
+    
+    /* Give the loader time to read the last response before the pty goes
+       away, anything it sends meanwhile is more than was captured */
+    while (!replay_stop && replay_wait(replay, REPLAY_LINGER_TIME)) {
+        uint8_t buffer[512];
+        ssize_t n = read(replay->master, buffer, sizeof(buffer));
+        
+        if (n > 0) {
+            replay_input(replay, buffer, (size_t)n, replay->last_progress);
+        }
+    }
+}
+
+/**
+ *  Parse a numeric option value.
+ */
+static long parse_number (const char *str, const char *name)
+{
+    char *end;
+    long value = strtol(str, &end, 0);
+    
+    if ((*end != '\0') || (value < 0)) {
+        fprintf(stderr, "Invalid value for %s \"%s\"\n", name, str);
+        exit(1);
+    }
+    
+    return value;
+}
+
+int main (int argc, char *argv[])
+{
+    static struct replay replay;
+    
+    replay.config.timeout_ms = 10000;
+    
+    int c;
+    while ((c = getopt_long(argc, argv, "hl:p:ft:ds:", longopts,
+                            NULL)) != -1) {
+        switch (c) {
+            case 'l':
+                replay.config.link = optarg;
+                break;
+            case 'p':
+                replay.config.port = optarg;
+                break;
+            case 'f':
+                replay.config.fast = 1;
+                break;
+            case 't':
+                replay.config.timeout_ms = parse_number(optarg, "timeout");
+                break;
+            case 'd':
+                replay.config.dump = 1;
+                break;
+            case 's':
+                replay.config.stats = optarg;
+                break;
+            case 'h':
+                printf("Plays back a capture made with rn2483-loader "
+                       "--capture.\n"
+                       "Usage: rn2483-replay [options] capture\n"
+                       "  -l, --link PATH     create a symlink to the pty\n"
+                       "  -p, --port NAME     port to replay, the first in "
+                       "the capture by default\n"
+                       "  -f, --fast          answer as soon as the loader "
+                       "is done sending\n"
+                       "  -t, --timeout MS    give up when the loader sends "
+                       "nothing for this long\n"
+                       "  -d, --dump          print the records and exit\n"
+                       "  -s, --stats FILE    write statistics on exit\n");
+                return 0;
+            default:
+                return 1;
+        }
+    }
+    
+    if (optind != (argc - 1)) {
+        fprintf(stderr, "Usage: rn2483-replay [options] capture\n");
+        return 1;
+    }
+    
+    if (replay_load(&replay, argv[optind]) != 0) {
+        return 1;
+    }
+    
+    if (replay.config.dump) {
+        replay_dump(&replay);
+        return 0;
+    }
+    
+    if (replay_open_pty(&replay) != 0) {
+        return 1;
+    }
+    
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    
+    replay_run(&replay);
+    
+    if (replay.config.stats != NULL) {
+        replay_write_stats(&replay, replay.config.stats);
+    }
+    
+    if (replay.config.link != NULL) {
+        unlink(replay.config.link);
+    }
+    
+    int complete = (replay.tx_index == replay.num_records) &&
+                        (replay.rx_index == replay.num_records);
+    
+    if (replay.start != 0) {
+        printf("Replayed %zu of %zu records in %.1f ms, the capture took "
+               "%.1f ms.\n", (replay.tx_index < replay.rx_index) ?
+                    replay.tx_index : replay.rx_index, replay.num_records,
+               (double)(replay.last_progress - replay.start) / 1000.0,
+               (double)(replay.records[replay.num_records - 1].time -
+                        replay.records[0].time) / 1000.0);
+    }
+    if (replay.mismatched != 0) {
+        printf("%lu bytes from the loader did not match the capture, the "
+               "first at offset %ld.\n", replay.mismatched,
+               replay.first_mismatch);
+    }
+    
+    return (complete && (replay.mismatched == 0) && (replay.extra == 0)) ?
+                0 : 1;
+}
@@ -0,0 +1,912 @@
+//
+//  rn2483-sim.c
+//  rn2483-loader
+//
+//  Created by Samuel Dewan on 2026-10-18.
+//  Copyright © 2026 Samuel Dewan.
+//
+//  Simulator for an RN2483 radio module. A pseudo terminal is created which
+//  behaves like a module running either the application firmware or the UART
+//  bootloader, backed by an in-memory model of the flash.
+//
+
+#define _XOPEN_SOURCE 700
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <signal.h>
+#include <getopt.h>
+#include <termios.h>
+#include <inttypes.h>
+
+#include "bootloader-commands.h"
+
+/** Size of program memory */
+#define SIM_FLASH_SIZE          0x10000
+/** First address of application code, everything below is the bootloader */
+#define SIM_APP_START           0x300
+/** Address of the configuration row */
+#define SIM_CONFIG_ADDRESS      0x300000
+/** Length of the configuration row */
+#define SIM_CONFIG_LENGTH       14
+/** Maximum length of a line in application mode */
+#define SIM_LINE_LENGTH         256
+/** Maximum number of pending output chunks */
+#define SIM_MAX_OUTPUT          64
+/** Maximum length of an output chunk */
+#define SIM_OUTPUT_LENGTH       512
+
+enum sim_mode {
+    SIM_MODE_APP,
+    SIM_MODE_BOOTLOADER,
+    SIM_MODE_BOOTING
+};
+
+struct sim_output {
+    /* Time at which the chunk should be written, in microseconds */
+    uint64_t due;
+    size_t length;
+    uint8_t data[SIM_OUTPUT_LENGTH];
+};
+
+struct sim_config {
+    const char *link;
+    const char *stats;
+    const char *load;
+    const char *version;
+    const char *hweui;
+    long latency_us;
+    long erase_row_us;
+    long write_us;
+    long boot_ms;
+    int pacing;
+    int banner;
+    uint16_t bootloader_version;
+    uint16_t device_id;
+    uint16_t max_packet_size;
+    uint8_t erase_row_size;
+    uint8_t write_latch_size;
+};
+
+struct sim_stats {
+    unsigned long commands[256];
+    unsigned long app_commands;
+    unsigned long bytes_in;
+    unsigned long bytes_out;
+    unsigned long bytes_written;
+    unsigned long resets;
+    unsigned long errors;
+};
+
+struct sim {
+    struct sim_config config;
+    struct sim_stats stats;
+    
+    int master;
+    int slave;
+    
+    enum sim_mode mode;
+    /* Mode to enter once booting is complete */
+    enum sim_mode next_mode;
+    uint64_t boot_done;
+    
+    uint8_t flash[SIM_FLASH_SIZE];
+    uint8_t config_row[SIM_CONFIG_LENGTH];
+    
+    /* Application mode input line */
+    char line[SIM_LINE_LENGTH];
+    size_t line_length;
+    
+    /* Bootloader mode input frame */
+    uint8_t frame[sizeof(struct rn_bootloader_cmd_base) +
+                  RN_BOOTLOADER_MAX_LENGTH + 1];
+    size_t frame_length;
+    
+    /* Output queue */
+    struct sim_output output[SIM_MAX_OUTPUT];
+    size_t output_head;
+    size_t output_count;
+    /* Time at which the simulated transmit line becomes idle */
+    uint64_t tx_free;
+};
+
+static volatile sig_atomic_t sim_stop = 0;
+
+static struct option longopts[] = {
+    { "link", required_argument, NULL, 'l' },
+    { "mode", required_argument, NULL, 'm' },
+    { "firmware-version", required_argument, NULL, 'v' },
+    { "load", required_argument, NULL, 'f' },
+    { "hweui", required_argument, NULL, 'e' },
+    { "latency", required_argument, NULL, 't' },
+    { "erase-time", required_argument, NULL, 'E' },
+    { "write-time", required_argument, NULL, 'W' },
+    { "boot-time", required_argument, NULL, 'B' },
+    { "no-pacing", no_argument, NULL, 'P' },
+    { "no-banner", no_argument, NULL, 'N' },
+    { "bootloader-version", required_argument, NULL, 'V' },
+    { "device-id", required_argument, NULL, 'D' },
+    { "erase-row-size", required_argument, NULL, 'r' },
+    { "write-latch-size", required_argument, NULL, 'w' },
+    { "max-packet-size", required_argument, NULL, 'p' },
+    { "stats", required_argument, NULL, 's' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+};
+
+static void handle_signal (int signal)
+{
+    (void)signal;
+    sim_stop = 1;
+}
+
+/**
+ *  Get the current time from the monotonic clock in microseconds.
+ */
+static uint64_t now_us (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * UINT64_C(1000000)) +
+                (uint64_t)(ts.tv_nsec / 1000);
+}
+
+/**
+ *  Get the time it takes to transfer a number of bytes at the baudrate that
+ *  the host has configured for the port.
+ *
+ *  @param sim The simulator
+ *  @param nbytes The number of bytes being transfered
+ *
+ *  @return The transfer time in microseconds
+ */
+static uint64_t wire_time (struct sim *sim, size_t nbytes)
+{
+    if (!sim->config.pacing) {
+        return 0;
+    }
+    
+    struct termios term;
+    long baud = 57600;
+    
+    if (tcgetattr(sim->slave, &term) == 0) {
+        switch (cfgetospeed(&term)) {
+            case B9600:     baud = 9600;    break;
+            case B19200:    baud = 19200;   break;
+            case B38400:    baud = 38400;   break;
+            case B57600:    baud = 57600;   break;
+            case B115200:   baud = 115200;  break;
+            case B230400:   baud = 230400;  break;
+            default:                        break;
+        }
+    }
+    
+    // 8N1 framing, 10 bits per byte
+    return ((uint64_t)nbytes * UINT64_C(10000000)) / (uint64_t)baud;
+}
+
+/**
+ *  Queue data to be sent to the host.
+ *
+ *  @param sim The simulator
+ *  @param delay Processing time before the data is sent in microseconds
+ *  @param data The data to be sent
+ *  @param length The number of bytes to be sent
+ */
+static void sim_send (struct sim *sim, uint64_t delay, const void *data,
+                      size_t length)
+{
+    if ((sim->output_count == SIM_MAX_OUTPUT) || (length > SIM_OUTPUT_LENGTH)) {
+        fprintf(stderr, "Output queue overflow.\n");
+        return;
+    }
+    
+    uint64_t start = now_us() + delay;
+    if (start < sim->tx_free) {
+        start = sim->tx_free;
+    }
+    sim->tx_free = start + wire_time(sim, length);
+    
+    struct sim_output *out = &sim->output[(sim->output_head +
+                                           sim->output_count) % SIM_MAX_OUTPUT];
+    out->due = sim->tx_free;
+    out->length = length;
+    memcpy(out->data, data, length);
+    sim->output_count++;
+}
+
+static void sim_send_line (struct sim *sim, uint64_t delay, const char *line)
+{
+    char buffer[SIM_OUTPUT_LENGTH];
+    int n = snprintf(buffer, sizeof(buffer), "%s\r\n", line);
+    sim_send(sim, delay, buffer, (size_t)n);
+}
+
+/**
+ *  Get the firmware version string stored in flash. Real firmware images
+ *  contain their version string, so when one is found it is used so that the
+ *  reported version changes when new firmware is loaded.
+ *
+ *  @param sim The simulator
+ *  @param buffer Buffer where the version should be stored
+ *  @param length Length of buffer
+ */
+static void sim_get_version (struct sim *sim, char *buffer, size_t length)
+{
+    static const char prefix[] = "RN2483 ";
+    
+    for (size_t i = SIM_APP_START; i + sizeof(prefix) < SIM_FLASH_SIZE; i++) {
+        if (memcmp(sim->flash + i, prefix, sizeof(prefix) - 1) != 0) {
+            continue;
+        }
+        size_t n = 0;
+        while (((i + n) < SIM_FLASH_SIZE) && (n < (length - 1)) &&
+               (sim->flash[i + n] >= 0x20) && (sim->flash[i + n] < 0x7f)) {
+            buffer[n] = (char)sim->flash[i + n];
+            n++;
+        }
+        buffer[n] = '\0';
+        return;
+    }
+    
+    snprintf(buffer, length, "%s", sim->config.version);
+}
+
+/**
+ *  Check whether there is an application in flash.
+ */
+static int sim_app_valid (struct sim *sim)
+{
+    for (size_t i = SIM_APP_START; i < SIM_FLASH_SIZE; i++) {
+        if (sim->flash[i] != 0xFF) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ *  Start a reset of the module.
+ *
+ *  @param sim The simulator
+ */
+static void sim_reset (struct sim *sim)
+{
+    sim->stats.resets++;
+    sim->next_mode = sim_app_valid(sim) ? SIM_MODE_APP : SIM_MODE_BOOTLOADER;
+    sim->mode = SIM_MODE_BOOTING;
+    sim->boot_done = now_us() +
+                ((uint64_t)sim->config.boot_ms * UINT64_C(1000));
+    sim->line_length = 0;
+    sim->frame_length = 0;
+}
+
+static void sim_boot_complete (struct sim *sim)
+{
+    sim->mode = sim->next_mode;
+    
+    if ((sim->mode == SIM_MODE_APP) && sim->config.banner) {
+        char version[128];
+        sim_get_version(sim, version, sizeof(version));
+        sim_send_line(sim, 0, version);
+    }
+}
+
+/**
+ *  Handle a command in application mode.
+ *
+ *  @param sim The simulator
+ *  @param line The command line without line ending
+ */
+static void sim_app_command (struct sim *sim, const char *line)
+{
+    uint64_t delay = (uint64_t)sim->config.latency_us;
+    sim->stats.app_commands++;
+    
+    if (strcmp(line, "sys get ver") == 0) {
+        char version[128];
+        sim_get_version(sim, version, sizeof(version));
+        sim_send_line(sim, delay, version);
+    } else if (strcmp(line, "sys eraseFW") == 0) {
+        // The application is erased and the module resets into the bootloader
+        memset(sim->flash + SIM_APP_START, 0xFF,
+               SIM_FLASH_SIZE - SIM_APP_START);
+        sim_reset(sim);
+    } else if (strcmp(line, "sys reset") == 0) {
+        sim_reset(sim);
+    } else if (strcmp(line, "sys get hweui") == 0) {
+        sim_send_line(sim, delay, sim->config.hweui);
+    } else if (strcmp(line, "mac save") == 0) {
+        // Saving to EEPROM takes a while
+        sim_send_line(sim, delay + 100000, "ok");
+    } else if ((strncmp(line, "mac set ", 8) == 0) ||
+               (strncmp(line, "radio set ", 10) == 0) ||
+               (strncmp(line, "sys set ", 8) == 0)) {
+        sim_send_line(sim, delay, "ok");
+    } else if (strncmp(line, "mac get ", 8) == 0) {
+        sim_send_line(sim, delay, "0");
+    } else if (strncmp(line, "mac join ", 9) == 0) {
+        // The join request is answered after the receive windows
+        sim_send_line(sim, delay, "ok");
+        sim_send_line(sim, delay + 200000, "accepted");
+    } else if (strncmp(line, "mac tx ", 7) == 0) {
+        sim_send_line(sim, delay, "ok");
+        sim_send_line(sim, delay + 100000, "mac_tx_ok");
+    } else {
+        sim_send_line(sim, delay, "invalid_param");
+    }
+}
+
+/**
+ *  Handle input bytes in application mode.
+ */
+static void sim_app_input (struct sim *sim, uint8_t c)
+{
+    if (c == '\n') {
+        if ((sim->line_length > 0) &&
+                (sim->line[sim->line_length - 1] == '\r')) {
+            sim->line_length--;
+        }
+        sim->line[sim->line_length] = '\0';
+        sim->line_length = 0;
+        sim_app_command(sim, sim->line);
+    } else if (sim->line_length < (SIM_LINE_LENGTH - 1)) {
+        sim->line[sim->line_length++] = (char)c;
+    } else {
+        // Line too long, real firmware discards the input
+        sim->line_length = 0;
+        sim->stats.errors++;
+    }
+}
+
+/**
+ *  Calculate the checksum of a region of flash the same way the bootloader
+ *  does.
+ */
+static uint16_t sim_checksum (struct sim *sim, uint32_t address,
+                              uint16_t length)
+{
+    uint16_t sum = 0;
+    
+    if (address == SIM_CONFIG_ADDRESS) {
+        static const uint16_t masks[] = { 0xFF00, 0x3F1F, 0xBF00, 0x00C5,
+                                          0xC00F, 0xE00F, 0x400F };
+        for (size_t i = 0; i < (SIM_CONFIG_LENGTH / 2); i++) {
+            uint16_t n = (uint16_t)(sim->config_row[2 * i] |
+                                    (sim->config_row[(2 * i) + 1] << 8));
+            sum += n & masks[i];
+        }
+        return sum;
+    }
+    
+    for (uint32_t i = 0; i < length; i += 2) {
+        uint32_t a = address + i;
+        uint8_t lo = (a < SIM_FLASH_SIZE) ? sim->flash[a] : 0xFF;
+        uint8_t hi = (((i + 1) < length) && ((a + 1) < SIM_FLASH_SIZE)) ?
+                                                    sim->flash[a + 1] : 0xFF;
+        sum += (uint16_t)(lo | (hi << 8));
+    }
+    
+    return sum;
+}
+
+/**
+ *  Handle a complete bootloader command frame.
+ */
+static void sim_bootloader_command (struct sim *sim)
+{
+    struct rn_bootloader_cmd_pkt *cmd = (struct rn_bootloader_cmd_pkt *)
+                                                                sim->frame;
+    uint16_t length = (uint16_t)(sim->frame[2] | (sim->frame[3] << 8));
+    uint32_t address = ((uint32_t)sim->frame[6] |
+                        ((uint32_t)sim->frame[7] << 8) |
+                        ((uint32_t)sim->frame[8] << 16) |
+                        ((uint32_t)sim->frame[9] << 24));
+    int keys_valid = ((cmd->key_one == RN_BOOTLOADER_KEY_ONE) &&
+                      (cmd->key_two == RN_BOOTLOADER_KEY_TWO));
+    uint64_t delay = (uint64_t)sim->config.latency_us;
+    
+    uint8_t rsp[sizeof(struct rn_bootloader_rsp_version)];
+    size_t base = sizeof(struct rn_bootloader_cmd_base);
+    memcpy(rsp, sim->frame, base);
+    
+    sim->stats.commands[sim->frame[1]]++;
+    
+    switch (sim->frame[1]) {
+        case RN_BOOTLOADER_CMD_GET_VERSION:
+            rsp[base + 0] = (uint8_t)(sim->config.bootloader_version & 0xFF);
+            rsp[base + 1] = (uint8_t)(sim->config.bootloader_version >> 8);
+            rsp[base + 2] = (uint8_t)(sim->config.max_packet_size & 0xFF);
+            rsp[base + 3] = (uint8_t)(sim->config.max_packet_size >> 8);
+            rsp[base + 4] = 0;
+            rsp[base + 5] = 0;
+            rsp[base + 6] = (uint8_t)(sim->config.device_id & 0xFF);
+            rsp[base + 7] = (uint8_t)(sim->config.device_id >> 8);
+            rsp[base + 8] = 0;
+            rsp[base + 9] = 0;
+            rsp[base + 10] = sim->config.erase_row_size;
+            rsp[base + 11] = sim->config.write_latch_size;
+            rsp[base + 12] = 0;
+            rsp[base + 13] = 0;
+            rsp[base + 14] = 0;
+            rsp[base + 15] = 0;
+            sim_send(sim, delay, rsp, base + 16);
+            break;
+        case RN_BOOTLOADER_CMD_WRITE:
+            if (keys_valid && (address == SIM_CONFIG_ADDRESS) &&
+                    (length <= SIM_CONFIG_LENGTH)) {
+                memcpy(sim->config_row, cmd->data, length);
+                rsp[base] = RN_BOOTLOADER_STATUS_SUCCESS;
+            } else if (!keys_valid || (address < SIM_APP_START) ||
+                    ((address + length) > SIM_FLASH_SIZE)) {
+                rsp[base] = RN_BOOTLOADER_STATUS_FAILED;
+                sim->stats.errors++;
+            } else {
+                for (uint16_t i = 0; i < length; i++) {
+                    // Flash can only be programmed from 1 to 0
+                    sim->flash[address + i] &= (uint8_t)cmd->data[i];
+                }
+                sim->stats.bytes_written += length;
+                rsp[base] = RN_BOOTLOADER_STATUS_SUCCESS;
+                delay += (uint64_t)sim->config.write_us;
+            }
+            sim_send(sim, delay, rsp, base + 1);
+            break;
+        case RN_BOOTLOADER_CMD_ERASE:
+            ;
+            uint32_t rows = (length == 0) ? 256 : length;
+            uint32_t end = address + (rows * sim->config.erase_row_size);
+            if (!keys_valid || (address < SIM_APP_START) ||
+                    (end > SIM_FLASH_SIZE) ||
+                    (address % sim->config.erase_row_size)) {
+                rsp[base] = RN_BOOTLOADER_STATUS_FAILED;
+                sim->stats.errors++;
+            } else {
+                memset(sim->flash + address, 0xFF, end - address);
+                rsp[base] = RN_BOOTLOADER_STATUS_SUCCESS;
+                delay += (uint64_t)sim->config.erase_row_us * rows;
+            }
+            sim_send(sim, delay, rsp, base + 1);
+            break;
+        case RN_BOOTLOADER_CMD_CHECKSUM:
+            ;
+            uint16_t sum = sim_checksum(sim, address, length);
+            rsp[base] = (uint8_t)(sum & 0xFF);
+            rsp[base + 1] = (uint8_t)(sum >> 8);
+            // Reading flash takes time proportional to the length
+            delay += length / 4;
+            sim_send(sim, delay, rsp, base + 2);
+            break;
+        case RN_BOOTLOADER_CMD_RESET:
+            sim_reset(sim);
+            break;
+        default:
+            sim->stats.errors++;
+            break;
+    }
+}
+
+/**
+ *  Handle input bytes in bootloader mode.
+ */
+static void sim_bootloader_input (struct sim *sim, uint8_t c)
+{
+    // The first byte of every command is taken as the autobaud character,
+    // whatever it is
+    sim->frame[sim->frame_length++] = c;
+    
+    size_t base = sizeof(struct rn_bootloader_cmd_base);
+    if (sim->frame_length < base) {
+        return;
+    }
+    
+    size_t length = (size_t)(sim->frame[2] | (sim->frame[3] << 8));
+    size_t total = base;
+    if (sim->frame[1] == RN_BOOTLOADER_CMD_WRITE) {
+        if (length > sim->config.max_packet_size) {
+            // Packet too large, drop it
+            sim->stats.errors++;
+            sim->frame_length = 0;
+            return;
+        }
+        total += length;
+    }
+    
+    if (sim->frame_length == total) {
+        if (sim->frame[0] != RN_BOOTLOADER_MAGIC) {
+            // The baudrate was measured from the wrong character, so the
+            // command is garbled
+            sim->stats.errors++;
+        } else {
+            sim_bootloader_command(sim);
+        }
+        sim->frame_length = 0;
+    }
+}
+
+/**
+ *  Load an intel hex file into the simulated flash.
+ *
+ *  @param sim The simulator
+ *  @param path Path to the hex file
+ *
+ *  @return 0 if successfull
+ */
+static int sim_load_hex (struct sim *sim, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    
+    if (f == NULL) {
+        fprintf(stderr, "Could not open %s: %s.\n", path, strerror(errno));
+        return -1;
+    }
+    
+    memset(sim->flash + SIM_APP_START, 0xFF, SIM_FLASH_SIZE - SIM_APP_START);
+    
+    char line[600];
+    uint32_t upper = 0;
+    while (fgets(line, sizeof(line), f)) {
+        unsigned int length, address, type;
+        if ((line[0] != ':') ||
+                (sscanf(line + 1, "%2x%4x%2x", &length, &address,
+                        &type) != 3)) {
+            continue;
+        }
+        uint8_t data[256];
+        for (unsigned int i = 0; i < length; i++) {
+            unsigned int b;
+            sscanf(line + 9 + (2 * i), "%2x", &b);
+            data[i] = (uint8_t)b;
+        }
+        if (type == 0x04) {
+            upper = (uint32_t)((data[0] << 8) | data[1]) << 16;
+        } else if (type == 0x00) {
+            uint32_t a = upper | address;
+            for (unsigned int i = 0; i < length; i++) {
+                if ((a + i) < SIM_FLASH_SIZE) {
+                    sim->flash[a + i] = data[i];
+                } else if (((a + i) >= SIM_CONFIG_ADDRESS) &&
+                           ((a + i) < (SIM_CONFIG_ADDRESS +
+                                       SIM_CONFIG_LENGTH))) {
+                    sim->config_row[a + i - SIM_CONFIG_ADDRESS] = data[i];
+                }
+            }
+        }
+    }
+    
+    fclose(f);
+    return 0;
+}
+
+/**
+ *  Write simulator statistics as JSON.
+ */
+static void sim_write_stats (struct sim *sim, const char *path)
+{
+    FILE *f = fopen(path, "w");
+    
+    if (f == NULL) {
+        fprintf(stderr, "Could not open %s: %s.\n", path, strerror(errno));
+        return;
+    }
+    
+    fprintf(f, "{\"bytes_in\":%lu,\"bytes_out\":%lu,\"bytes_written\":%lu,"
+               "\"resets\":%lu,\"errors\":%lu,\"app_commands\":%lu,"
+               "\"get_version\":%lu,\"write\":%lu,\"erase\":%lu,"
+               "\"checksum\":%lu,\"reset\":%lu}\n",
+            sim->stats.bytes_in, sim->stats.bytes_out,
+            sim->stats.bytes_written, sim->stats.resets, sim->stats.errors,
+            sim->stats.app_commands,
+            sim->stats.commands[RN_BOOTLOADER_CMD_GET_VERSION],
+            sim->stats.commands[RN_BOOTLOADER_CMD_WRITE],
+            sim->stats.commands[RN_BOOTLOADER_CMD_ERASE],
+            sim->stats.commands[RN_BOOTLOADER_CMD_CHECKSUM],
+            sim->stats.commands[RN_BOOTLOADER_CMD_RESET]);
+    fclose(f);
+}
+
+/**
+ *  Create the pseudo terminal for the simulator.
+ *
+ *  @return 0 if successfull
+ */
+static int sim_open_pty (struct sim *sim)
+{
+    sim->master = posix_openpt(O_RDWR | O_NOCTTY);
+    
+    if ((sim->master == -1) || (grantpt(sim->master) != 0) ||
+            (unlockpt(sim->master) != 0)) {
+        fprintf(stderr, "Could not create pty: %s.\n", strerror(errno));
+        return -1;
+    }
+    
+    const char *name = ptsname(sim->master);
+    
+    // Keep the slave open so that the master does not see a hangup when the
+    // host closes the port, and make it raw until the host configures it
+    sim->slave = open(name, O_RDWR | O_NOCTTY);
+    if (sim->slave == -1) {
+        fprintf(stderr, "Could not open %s: %s.\n", name, strerror(errno));
+        return -1;
+    }
+    
+    struct termios term;
+    tcgetattr(sim->slave, &term);
+    cfmakeraw(&term);
+    cfsetospeed(&term, B57600);
+    cfsetispeed(&term, B57600);
+    tcsetattr(sim->slave, TCSANOW, &term);
+    
+    fcntl(sim->master, F_SETFL, fcntl(sim->master, F_GETFL) | O_NONBLOCK);
+    
+    if (sim->config.link != NULL) {
+        unlink(sim->config.link);
+        if (symlink(name, sim->config.link) != 0) {
+            fprintf(stderr, "Could not create link %s: %s.\n",
+                    sim->config.link, strerror(errno));
+            return -1;
+        }
+    }
+    
+    printf("%s\n", name);
+    fflush(stdout);
+    
+    return 0;
+}
+
+/**
+ *  Run the simulator until it is signaled to stop.
+ */
+static void sim_run (struct sim *sim)
+{
+    while (!sim_stop) {
+        uint64_t now = now_us();
+        long timeout = -1;
+        
+        if (sim->mode == SIM_MODE_BOOTING) {
+            if (now >= sim->boot_done) {
+                sim_boot_complete(sim);
+            } else {
+                timeout = (long)((sim->boot_done - now + 999) / 1000);
+            }
+        }
+        
+        /* Send any output which is due */
+        while (sim->output_count != 0) {
+            struct sim_output *out = &sim->output[sim->output_head];
+            if (out->due > now) {
+                long t = (long)((out->due - now + 999) / 1000);
+                if ((timeout < 0) || (t < timeout)) {
+                    timeout = t;
+                }
+                break;
+            }
+            ssize_t n = write(sim->master, out->data, out->length);
+            if (n > 0) {
+                sim->stats.bytes_out += (unsigned long)n;
+            }
+            sim->output_head = (sim->output_head + 1) % SIM_MAX_OUTPUT;
+            sim->output_count--;
+        }
+        
+        struct pollfd pfd = { .fd = sim->master, .events = POLLIN };
+        int ret = poll(&pfd, 1, (int)timeout);
+        
+        if (ret <= 0) {
+            continue;
+        }
+        
+        uint8_t buffer[512];
+        ssize_t n = read(sim->master, buffer, sizeof(buffer));
+        
+        if (n <= 0) {
+            continue;
+        }
+        
+        sim->stats.bytes_in += (unsigned long)n;
+        
+        for (ssize_t i = 0; i < n; i++) {
+            switch (sim->mode) {
+                case SIM_MODE_APP:
+                    sim_app_input(sim, buffer[i]);
+                    break;
+                case SIM_MODE_BOOTLOADER:
+                    sim_bootloader_input(sim, buffer[i]);
+                    break;
+                case SIM_MODE_BOOTING:
+                    // Input is lost while the module is resetting
+                    break;
+            }
+        }
+    }
+}
+
+/**
+ *  Parse a numeric option value.
+ */
+static long parse_number (const char *str, const char *name)
+{
+    char *end;
+    long value = strtol(str, &end, 0);
+    
+    if ((*end != '\0') || (value < 0)) {
+        fprintf(stderr, "Invalid value for %s \"%s\"\n", name, str);
+        exit(1);
+    }
+    
+    return value;
+}
+
+int main (int argc, char *argv[])
+{
+    static struct sim sim;
+    
+    sim.config.version = "RN2483 1.0.5 Oct 31 2018 15:06:52";
+    sim.config.hweui = "0004A30B001A2B3C";
+    sim.config.latency_us = 1000;
+    sim.config.erase_row_us = 2800;
+    sim.config.write_us = 1000;
+    sim.config.boot_ms = 100;
+    sim.config.pacing = 1;
+    sim.config.banner = 1;
+    sim.config.bootloader_version = 0x0102;
+    sim.config.device_id = 0x5440;
+    sim.config.max_packet_size = 0x00FF;
+    sim.config.erase_row_size = 64;
+    sim.config.write_latch_size = 64;
+    
+    enum sim_mode mode = SIM_MODE_APP;
+    
+    int c;
+    while ((c = getopt_long(argc, argv, "hl:m:v:f:e:t:s:", longopts,
+                            NULL)) != -1) {
+        switch (c) {
+            case 'l':
+                sim.config.link = optarg;
+                break;
+            case 'm':
+                if (strcasecmp(optarg, "app") == 0) {
+                    mode = SIM_MODE_APP;
+                } else if (strcasecmp(optarg, "bootloader") == 0) {
+                    mode = SIM_MODE_BOOTLOADER;
+                } else {
+                    fprintf(stderr, "Unknown mode \"%s\"\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'v':
+                sim.config.version = optarg;
+                break;
+            case 'f':
+                sim.config.load = optarg;
+                break;
+            case 'e':
+                sim.config.hweui = optarg;
+                break;
+            case 't':
+                sim.config.latency_us = parse_number(optarg, "latency");
+                break;
+            case 'E':
+                sim.config.erase_row_us = parse_number(optarg, "erase time");
+                break;
+            case 'W':
+                sim.config.write_us = parse_number(optarg, "write time");
+                break;
+            case 'B':
+                sim.config.boot_ms = parse_number(optarg, "boot time");
+                break;
+            case 'P':
+                sim.config.pacing = 0;
+                break;
+            case 'N':
+                sim.config.banner = 0;
+                break;
+            case 'V':
+                sim.config.bootloader_version = (uint16_t)parse_number(optarg,
+                                                        "bootloader version");
+                break;
+            case 'D':
+                sim.config.device_id = (uint16_t)parse_number(optarg,
+                                                              "device id");
+                break;
+            case 'r':
+                sim.config.erase_row_size = (uint8_t)parse_number(optarg,
+                                                            "erase row size");
+                break;
+            case 'w':
+                sim.config.write_latch_size = (uint8_t)parse_number(optarg,
+                                                          "write latch size");
+                break;
+            case 'p':
+                sim.config.max_packet_size = (uint16_t)parse_number(optarg,
+                                                           "max packet size");
+                break;
+            case 's':
+                sim.config.stats = optarg;
+                break;
+            case 'h':
+                printf("Simulator for Microchip RN2483 radio modules.\n"
+                       "Usage: rn2483-sim [options]\n"
+                       "  -l, --link PATH             create a symlink to "
+                       "the pty\n"
+                       "  -m, --mode app|bootloader   initial mode\n"
+                       "  -v, --firmware-version STR  version when none is "
+                       "found in flash\n"
+                       "  -f, --load HEX              preload flash from a "
+                       "hex file\n"
+                       "  -e, --hweui EUI             hardware EUI\n"
+                       "  -t, --latency US            command turnaround "
+                       "time\n"
+                       "      --erase-time US         time to erase a row\n"
+                       "      --write-time US         time to write a latch\n"
+                       "      --boot-time MS          time to reset\n"
+                       "      --no-pacing             do not simulate baud "
+                       "rate\n"
+                       "      --no-banner             do not print version "
+                       "after reset\n"
+                       "      --bootloader-version N\n"
+                       "      --device-id N\n"
+                       "      --erase-row-size N\n"
+                       "      --write-latch-size N\n"
+                       "      --max-packet-size N\n"
+                       "  -s, --stats FILE            write statistics on "
+                       "exit\n");
+                return 0;
+            default:
+                return 1;
+        }
+    }
+    
+    if ((sim.config.erase_row_size == 0) ||
+            (sim.config.write_latch_size == 0)) {
+        fprintf(stderr, "Row and latch sizes must not be zero\n");
+        return 1;
+    }
+    
+    /* Initialize flash */
+    memset(sim.flash, 0xFF, sizeof(sim.flash));
+    // Something that looks like a bootloader
+    memset(sim.flash, 0x00, SIM_APP_START);
+    memset(sim.config_row, 0xFF, sizeof(sim.config_row));
+    
+    if (sim.config.load != NULL) {
+        if (sim_load_hex(&sim, sim.config.load) != 0) {
+            return 1;
+        }
+    } else if (mode == SIM_MODE_APP) {
+        // Something that looks like an application
+        memset(sim.flash + SIM_APP_START, 0x00, 0x100);
+    }
+    
+    sim.mode = mode;
+    
+    if (sim_open_pty(&sim) != 0) {
+        return 1;
+    }
+    
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    
+    sim_run(&sim);
+    
+    if (sim.config.stats != NULL) {
+        sim_write_stats(&sim, sim.config.stats);
+    }
+    
+    if (sim.config.link != NULL) {
+        unlink(sim.config.link);
+    }
+    
+    return 0;
+}